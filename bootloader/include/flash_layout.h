@@ -17,5 +17,16 @@
 #define FW_MAX_SIZE                 (800 * 1024)
 #define FW_SECTOR                   (PERSIST_CONFIG_SECTOR + 2 * FLASH_SECTOR_SIZE)
 #define FW_ADDR                     _SECTOR_TO_ADDR(FW_SECTOR)
+/* the running one and the update being received */
+#define FW_SLOTS                    2
+
+/* readings the uplink couldn't send yet, a ring of sectors at the top of
+ * flash, clear of both firmware slots */
+#define PERSIST_LOG_SIZE            (64 * FLASH_SECTOR_SIZE) /* 256kB */
+#define PERSIST_LOG_SECTOR          (PICO_FLASH_SIZE_BYTES - PERSIST_LOG_SIZE)
+#define PERSIST_LOG_SECTOR_ADDR     _SECTOR_TO_ADDR(PERSIST_LOG_SECTOR)
+#define PERSIST_LOG_RAW_DATA        ((const uint8_t*)PERSIST_LOG_SECTOR_ADDR)
 
 _Static_assert(FW_ADDR + FW_MAX_SIZE < XIP_BASE + PICO_FLASH_SIZE_BYTES, "Firmware address overrun.");
+_Static_assert(FW_SECTOR + FW_SLOTS * FW_MAX_SIZE <= PERSIST_LOG_SECTOR, "Firmware slots overlap the log.");
+_Static_assert(0 == PERSIST_LOG_SECTOR % FLASH_SECTOR_SIZE, "Log must start on a sector.");
@@ -5,6 +5,7 @@ pico_sdk_init()
 find_program(TERSER terser)
 find_program(CLEANCSS cleancss)
 find_program(WEBPACK webpack-cli)
+find_program(GZIP gzip)
 
 add_compile_options(-Wall
     -Werror
@@ -30,16 +31,34 @@ add_executable(application
     ${CMAKE_CURRENT_LIST_DIR}/src/main.c
     ${CMAKE_CURRENT_LIST_DIR}/src/dhcp_server.c
     ${CMAKE_CURRENT_LIST_DIR}/src/http_server.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/http_request.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/rate_limit.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/ws_server.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/json_writer.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/json_reader.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/metrics.c
     ${CMAKE_CURRENT_LIST_DIR}/src/config.c
     ${CMAKE_CURRENT_LIST_DIR}/src/htu31d.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/sampler.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/aggregate.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/rules.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/filter.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/series.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/line_protocol.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/meas_log.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/uplink.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/mqtt.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/telemetry.c
     ${CMAKE_CURRENT_LIST_DIR}/src/ap_station.c
     ${CMAKE_CURRENT_LIST_DIR}/src/common.c
-    ${CMAKE_CURRENT_LIST_DIR}/libs/tiny-json/tiny-json.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/webroot.S
 )
 
 target_link_libraries(application
     pico_stdlib
     pico_lwip_http
+    pico_lwip_mqtt
+    pico_unique_id
     pico_httpd_webroot
     pico_cyw43_arch_lwip_poll
     hardware_i2c
@@ -71,6 +90,19 @@ add_custom_command(
     COMMENT "Combining with HTML"
 )
 
+add_custom_command(
+    OUTPUT ${CMAKE_BINARY_DIR}/webroot/index.html.gz
+    COMMAND ${GZIP} -9 -n -k -f ${CMAKE_BINARY_DIR}/webroot/index.html
+    DEPENDS ${CMAKE_BINARY_DIR}/webroot/index.html
+    COMMENT "Compressing HTML"
+)
+
+set_source_files_properties(${CMAKE_CURRENT_LIST_DIR}/src/webroot.S
+    PROPERTIES
+        COMPILE_DEFINITIONS WHM_WEBROOT_INDEX_GZ="${CMAKE_BINARY_DIR}/webroot/index.html.gz"
+        OBJECT_DEPENDS ${CMAKE_BINARY_DIR}/webroot/index.html.gz
+)
+
 set_target_properties(application
     PROPERTIES PICO_TARGET_LINKER_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/application.ld
 )
@@ -86,7 +118,6 @@ target_include_directories(application PUBLIC
     ${CMAKE_CURRENT_LIST_DIR}/src/internal
     ${CMAKE_CURRENT_LIST_DIR}/include
     ${CMAKE_CURRENT_LIST_DIR}/bootloader/include
-    ${CMAKE_CURRENT_LIST_DIR}/libs/tiny-json
     ${CONFIG_DIR}
 )
 
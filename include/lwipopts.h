@@ -34,9 +34,11 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+// pool and heap counters are served on /api/metrics
+#define LWIP_STATS                  1
+#define MEM_STATS                   1
 #define SYS_STATS                   0
-#define MEMP_STATS                  0
+#define MEMP_STATS                  1
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
@@ -58,18 +60,24 @@
 #define LWIP_HTTPD_CUSTOM_FILES     1
 #define LWIP_HTTPD_DYNAMIC_HEADERS  1
 #define LWIP_HTTPD_SUPPORT_EXTSTATUS 1
+#define LWIP_HTTPD_DYNAMIC_FILE_READ 1
+#define LWIP_HTTPD_FS_ASYNC_READ    1
+#define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1
 #define HTTPD_FSDATA_FILE           "pico_fsdata.inc"
 
 #define LWIP_MDNS_RESPONDER         1
 #define LWIP_IGMP                   1
 #define LWIP_NUM_NETIF_CLIENT_DATA  1
 #define MDNS_RESP_USENETIF_EXTCALLBACK  1
-#define MEMP_NUM_SYS_TIMEOUT        (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 3)
+#define MEMP_NUM_SYS_TIMEOUT        (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 4)
 #define MEMP_NUM_TCP_PCB            12
 
+/* room for the publishes in flight and the status */
+#define MQTT_REQ_MAX_IN_FLIGHT      8
+#define MQTT_OUTPUT_RINGBUF_SIZE    1024
+
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
-#define LWIP_STATS                  1
 #define LWIP_STATS_DISPLAY          1
 #endif
 
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "aggregate.h"
+#include "util.h"
+
+
+/* sums are kept whole, a day of a reading a second in e3 is well within
+ * 64 bits */
+typedef struct _whm_aggregate_sum
+{
+    int32_t min_e3;
+    int32_t max_e3;
+    int64_t sum_e3;
+} _whm_aggregate_sum_t;
+
+
+typedef struct _whm_aggregate_slot
+{
+    /* which slot_ms long stretch of uptime this holds */
+    uint32_t epoch;
+    uint32_t count;
+    _whm_aggregate_sum_t rh;
+    _whm_aggregate_sum_t t;
+} _whm_aggregate_slot_t;
+
+
+static void _whm_aggregate_sum_add(_whm_aggregate_sum_t* sum, bool first, int32_t value_e3);
+static void _whm_aggregate_sum_merge(_whm_aggregate_sum_t* sum, bool first, const _whm_aggregate_sum_t* other);
+static void _whm_aggregate_stat(whm_aggregate_stat_t* stat, const _whm_aggregate_sum_t* sum, uint32_t count);
+
+
+static const uint32_t _whm_aggregate_window_s[WHM_AGGREGATE_WINDOWS] =
+{
+    60U,
+    15U * 60U,
+    60U * 60U,
+    24U * 60U * 60U,
+};
+
+
+static _whm_aggregate_slot_t _whm_aggregate_slots[WHM_AGGREGATE_WINDOWS][WHM_AGGREGATE_SLOTS];
+
+
+void whm_aggregate_init(void)
+{
+    memset(_whm_aggregate_slots, 0, sizeof(_whm_aggregate_slots));
+}
+
+
+void whm_aggregate_add(uint64_t time_us, uint32_t rh_e3, int32_t t_e3)
+{
+    uint64_t time_ms = time_us / 1000U;
+    for (unsigned w = 0; w < WHM_AGGREGATE_WINDOWS; w++)
+    {
+        uint32_t slot_ms = _whm_aggregate_window_s[w] * 1000U / WHM_AGGREGATE_SLOTS;
+        uint32_t epoch = time_ms / slot_ms;
+        _whm_aggregate_slot_t* slot = &_whm_aggregate_slots[w][epoch % WHM_AGGREGATE_SLOTS];
+        if (slot->epoch != epoch)
+        {
+            /* last held a slot a whole window ago */
+            slot->epoch = epoch;
+            slot->count = 0;
+        }
+        _whm_aggregate_sum_add(&slot->rh, !slot->count, rh_e3);
+        _whm_aggregate_sum_add(&slot->t, !slot->count, t_e3);
+        slot->count++;
+    }
+}
+
+
+void whm_aggregate_get(uint64_t time_us, whm_aggregate_window_t windows[WHM_AGGREGATE_WINDOWS])
+{
+    uint64_t time_ms = time_us / 1000U;
+    for (unsigned w = 0; w < WHM_AGGREGATE_WINDOWS; w++)
+    {
+        uint32_t slot_ms = _whm_aggregate_window_s[w] * 1000U / WHM_AGGREGATE_SLOTS;
+        uint32_t epoch = time_ms / slot_ms;
+        _whm_aggregate_sum_t rh = {0};
+        _whm_aggregate_sum_t t = {0};
+        uint32_t count = 0;
+        for (unsigned i = 0; i < WHM_AGGREGATE_SLOTS; i++)
+        {
+            const _whm_aggregate_slot_t* slot = &_whm_aggregate_slots[w][i];
+            if (!slot->count || epoch - slot->epoch >= WHM_AGGREGATE_SLOTS)
+            {
+                continue;
+            }
+            _whm_aggregate_sum_merge(&rh, !count, &slot->rh);
+            _whm_aggregate_sum_merge(&t, !count, &slot->t);
+            count += slot->count;
+        }
+        windows[w].window_s = _whm_aggregate_window_s[w];
+        windows[w].count = count;
+        _whm_aggregate_stat(&windows[w].rh, &rh, count);
+        _whm_aggregate_stat(&windows[w].t, &t, count);
+    }
+}
+
+
+static void _whm_aggregate_sum_add(_whm_aggregate_sum_t* sum, bool first, int32_t value_e3)
+{
+    if (first)
+    {
+        sum->min_e3 = value_e3;
+        sum->max_e3 = value_e3;
+        sum->sum_e3 = 0;
+    }
+    else if (value_e3 < sum->min_e3)
+    {
+        sum->min_e3 = value_e3;
+    }
+    else if (value_e3 > sum->max_e3)
+    {
+        sum->max_e3 = value_e3;
+    }
+    sum->sum_e3 += value_e3;
+}
+
+
+static void _whm_aggregate_sum_merge(_whm_aggregate_sum_t* sum, bool first, const _whm_aggregate_sum_t* other)
+{
+    if (first)
+    {
+        *sum = *other;
+        return;
+    }
+    sum->min_e3 = WHM_MIN(sum->min_e3, other->min_e3);
+    sum->max_e3 = WHM_MAX(sum->max_e3, other->max_e3);
+    sum->sum_e3 += other->sum_e3;
+}
+
+
+static void _whm_aggregate_stat(whm_aggregate_stat_t* stat, const _whm_aggregate_sum_t* sum, uint32_t count)
+{
+    if (!count)
+    {
+        stat->min_e3 = 0;
+        stat->max_e3 = 0;
+        stat->mean_e3 = 0;
+        return;
+    }
+    stat->min_e3 = sum->min_e3;
+    stat->max_e3 = sum->max_e3;
+    /* rounded half away from zero */
+    int64_t half = sum->sum_e3 < 0 ? -(int64_t)(count / 2U) : (int64_t)(count / 2U);
+    stat->mean_e3 = (sum->sum_e3 + half) / (int64_t)count;
+}
@@ -7,6 +7,10 @@
 #include "config.h"
 #include "dhcp_server.h"
 #include "http_server.h"
+#include "ws_server.h"
+#include "uplink.h"
+#include "mqtt.h"
+#include "telemetry.h"
 
 #define _WHM_AP_STATION_BUF_SIZE            128
 #define _WHM_AP_STATION_SCAN_TIMEOUT_US     (10 * 1000 * 1000) /* 10 seconds */
@@ -31,6 +35,7 @@ static int _whm_ap_station_scan_result(void* userdata, const cyw43_ev_scan_resul
 static int _whm_ap_station_connect(void);
 static int _whm_ap_station_set_mode(bool station);
 static whm_ap_station_scan_result_t* _whm_ap_station_found_ssid(const char* ssid);
+static whm_ap_station_scan_result_t* _whm_ap_station_scan_take(void);
 
 
 static struct
@@ -38,13 +43,17 @@ static struct
     _whm_ap_station_state_t state;
     bool is_station;
     uint64_t last_scan_us;
+    /* who started the scan, NULL for anyone */
+    const void* scan_owner;
     whm_dhcp_server_t dhcp_server;
     whm_http_server_t http_server;
+    whm_ws_server_t ws_server;
 } _whm_ap_station_ctx =
 {
     .state = _WHM_AP_STATION_STATE_OFF,
     .is_station = false,
     .last_scan_us = 0,
+    .scan_owner = NULL,
 };
 whm_ap_station_scan_result_t* whm_ap_station_scan_results = NULL;
 
@@ -61,13 +70,27 @@ int whm_ap_station_init(void)
     if (ret)
     {
         printf("Failed to initialise tcp server\n");
+        return ret;
     }
-    return ret;
+    ret = whm_ws_server_init(&_whm_ap_station_ctx.ws_server);
+    if (ret)
+    {
+        printf("Failed to initialise websocket server\n");
+        return ret;
+    }
+    whm_uplink_init();
+    whm_mqtt_init();
+    whm_telemetry_init();
+    return 0;
 }
 
 
 void whm_ap_station_deinit(void)
 {
+    whm_telemetry_deinit();
+    whm_mqtt_deinit();
+    whm_uplink_deinit();
+    whm_ws_server_deinit(&_whm_ap_station_ctx.ws_server);
     whm_http_server_deinit(&_whm_ap_station_ctx.http_server);
     whm_dhcp_server_deinit(&_whm_ap_station_ctx.dhcp_server);
 }
@@ -77,6 +100,11 @@ void whm_ap_station_iterate(void)
 {
     uint64_t now = time_us_64();
     cyw43_arch_poll();
+    whm_http_server_iterate(&_whm_ap_station_ctx.http_server);
+    whm_ws_server_iterate(&_whm_ap_station_ctx.ws_server);
+    whm_uplink_iterate();
+    whm_mqtt_iterate();
+    whm_telemetry_iterate();
     switch (_whm_ap_station_ctx.state)
     {
         case _WHM_AP_STATION_STATE_SCAN:
@@ -177,10 +205,25 @@ const char* whm_ap_station_get_state(void)
 
 
 bool whm_ap_station_start_scan(void)
+{
+    return whm_ap_station_start_scan_for(NULL);
+}
+
+
+bool whm_ap_station_start_scan_for(const void* owner)
 {
     bool ret = false;
+    if (whm_ap_station_scanning())
+    {
+        return NULL != owner && owner == _whm_ap_station_ctx.scan_owner;
+    }
     if (NULL != whm_ap_station_scan_results)
     {
+        if (NULL != _whm_ap_station_ctx.scan_owner && owner != _whm_ap_station_ctx.scan_owner)
+        {
+            /* someone else's results they haven't taken yet */
+            return false;
+        }
         /* free if not already */
         whm_ap_station_scan_results_free();
     }
@@ -189,6 +232,7 @@ bool whm_ap_station_start_scan(void)
     {
         ret = true;
         _whm_ap_station_ctx.state = _WHM_AP_STATION_STATE_SCAN;
+        _whm_ap_station_ctx.scan_owner = owner;
     }
     return ret;
 }
@@ -200,16 +244,37 @@ whm_ap_station_scan_result_t* whm_ap_station_get_scan(void)
 }
 
 
-void whm_ap_station_scan_results_free(void)
+whm_ap_station_scan_result_t* whm_ap_station_take_scan(void)
+{
+    return whm_ap_station_take_scan_for(NULL);
+}
+
+
+whm_ap_station_scan_result_t* whm_ap_station_take_scan_for(const void* owner)
 {
-    whm_ap_station_scan_result_t* current = whm_ap_station_scan_results;
+    if (owner != _whm_ap_station_ctx.scan_owner)
+    {
+        return NULL;
+    }
+    return _whm_ap_station_scan_take();
+}
+
+
+void whm_ap_station_scan_free(whm_ap_station_scan_result_t* results)
+{
+    whm_ap_station_scan_result_t* current = results;
     while (current != NULL)
     {
         whm_ap_station_scan_result_t* next = current->next;
         free(current);
         current = next;
     }
-    whm_ap_station_scan_results = NULL;
+}
+
+
+void whm_ap_station_scan_results_free(void)
+{
+    whm_ap_station_scan_free(_whm_ap_station_scan_take());
 }
 
 
@@ -367,3 +432,11 @@ static whm_ap_station_scan_result_t* _whm_ap_station_found_ssid(const char* ssid
     return NULL;
 }
 
+
+static whm_ap_station_scan_result_t* _whm_ap_station_scan_take(void)
+{
+    whm_ap_station_scan_result_t* results = whm_ap_station_scan_results;
+    whm_ap_station_scan_results = NULL;
+    _whm_ap_station_ctx.scan_owner = NULL;
+    return results;
+}
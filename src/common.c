@@ -4,6 +4,7 @@
 
 #include "ap_station.h"
 #include "htu31d.h"
+#include "sampler.h"
 
 
 int whm_main_loop_iterate(void* userdata, int (* cb)(void* userdata), uint64_t timeout_us)
@@ -14,6 +15,7 @@ int whm_main_loop_iterate(void* userdata, int (* cb)(void* userdata), uint64_t t
         tight_loop_contents();
         whm_ap_station_iterate();
         whm_htu31d_iterate();
+        whm_sampler_iterate();
         int ret = cb(userdata);
         if (ret)
         {
@@ -6,20 +6,35 @@
 #include "pico/sync.h"
 #include "pico/cyw43_arch.h"
 #include "hardware/flash.h"
-#include "hardware/divider.h"
-
-#include "tiny-json.h"
 
 #include "config.h"
 #include "flash_layout.h"
+#include "htu31d.h"
+#include "json_reader.h"
+#include "json_writer.h"
 
 
-#define _WHM_CONFIG_JSON_BUFFER_LEN                 1024
-#define _WHM_CONFIG_JSON_MAX_FIELDS                 32
 #define _WHM_CONFIG_DEFAULT                                             \
 {                                                                       \
     .name = "Web-Host MCU",                                             \
     .blinking_ms = 250,                                                 \
+    .history_ms = 60 * 1000,                                            \
+    .sensor_profile = WHM_HTU31D_PROFILE_FAST,                          \
+    .filters =                                                          \
+    {                                                                   \
+        [WHM_CONFIG_CHANNEL_RELATIVE_HUMIDITY] =                        \
+        {                                                               \
+            .type = WHM_CONFIG_FILTER_NONE,                             \
+            .length = WHM_CONFIG_FILTER_LENGTH_DEFAULT,                 \
+            .shift = WHM_CONFIG_FILTER_SHIFT_DEFAULT,                   \
+        },                                                              \
+        [WHM_CONFIG_CHANNEL_TEMPERATURE] =                              \
+        {                                                               \
+            .type = WHM_CONFIG_FILTER_NONE,                             \
+            .length = WHM_CONFIG_FILTER_LENGTH_DEFAULT,                 \
+            .shift = WHM_CONFIG_FILTER_SHIFT_DEFAULT,                   \
+        },                                                              \
+    },                                                                  \
     .ap =                                                               \
     {                                                                   \
         .ssid = "Web-Host MCU",                                         \
@@ -31,29 +46,106 @@
         .password = "",                                                 \
         .auth = 0,                                                      \
     },                                                                  \
+    .uplink =                                                           \
+    {                                                                   \
+        .url = "",                                                      \
+        .batch = 8,                                                     \
+        .interval_s = 30,                                               \
+    },                                                                  \
+    .mqtt =                                                             \
+    {                                                                   \
+        .host = "",                                                     \
+        .port = 1883,                                                   \
+        .meas_topic = "whm/meas",                                       \
+        .status_topic = "whm/status",                                   \
+    },                                                                  \
+    .telemetry =                                                        \
+    {                                                                   \
+        .host = "",                                                     \
+        .port = 8089,                                                   \
+        .batch = 1,                                                     \
+    },                                                                  \
 }
 
 
-static int _whm_config_commit2(uint8_t* dst, uint8_t* src, uint32_t size);
+/* objects the config fields are in */
+typedef enum _whm_config_section
+{
+    _WHM_CONFIG_SECTION_ROOT,
+    _WHM_CONFIG_SECTION_AP,
+    _WHM_CONFIG_SECTION_STATION,
+    _WHM_CONFIG_SECTION_UPLINK,
+    _WHM_CONFIG_SECTION_MQTT,
+    _WHM_CONFIG_SECTION_TELEMETRY,
+    /* the rules array, and one of its objects being read */
+    _WHM_CONFIG_SECTION_RULES,
+    _WHM_CONFIG_SECTION_RULE,
+    /* the filters object, and one channel's filter being read */
+    _WHM_CONFIG_SECTION_FILTERS,
+    _WHM_CONFIG_SECTION_FILTER,
+    /* anything else, skipped */
+    _WHM_CONFIG_SECTION_OTHER,
+} _whm_config_section_t;
+
+
+static void _whm_config_parser_token(whm_config_parser_t* parser, whm_json_reader_token_t token);
+static void _whm_config_parser_value(whm_config_parser_t* parser, whm_json_reader_token_t token);
+static void _whm_config_copy(char* dst, unsigned size, const whm_json_reader_t* reader);
 static bool _whm_config_get_auth(const char* auth_str, uint32_t* auth);
+static const char* _whm_config_get_auth_name(uint32_t auth);
+static void _whm_config_parser_rule(whm_config_parser_t* parser, whm_json_reader_token_t token);
+static bool _whm_config_get_e3(const char* str, int32_t* value);
+static void _whm_config_write_rule(whm_json_writer_t* writer, const whm_config_rule_t* rule);
+static void _whm_config_parser_filter(whm_config_parser_t* parser, whm_json_reader_token_t token);
+static bool _whm_config_get_filter(const char* name, uint8_t* type);
+static void _whm_config_render_page(const whm_config_t* config, unsigned offset);
 static int _whm_config_save(void);
-static int _whm_config_load(whm_config_t* config);
 
 
 whm_config_t whm_conf = _WHM_CONFIG_DEFAULT;
-static char _whm_config_json[_WHM_CONFIG_JSON_BUFFER_LEN];
-static json_t _whm_config_json_pool[_WHM_CONFIG_JSON_MAX_FIELDS];
+/* what the next whm_config_save() commits */
+static whm_config_t _whm_config_staged = _WHM_CONFIG_DEFAULT;
+/* for whole documents, too big for the stack */
+static whm_config_parser_t _whm_config_parser;
+static uint8_t _whm_config_page[FLASH_PAGE_SIZE];
 static bool _whm_config_loaded = false;
+static const struct
+{
+    const char* name;
+    uint32_t auth;
+} _whm_config_auths[] =
+{
+    {"OPEN", CYW43_AUTH_OPEN},
+    {"WPA_TKIP", CYW43_AUTH_WPA_TKIP_PSK},
+    {"WPA2_AES", CYW43_AUTH_WPA2_AES_PSK},
+    {"WPA2_MIXED", CYW43_AUTH_WPA2_MIXED_PSK},
+    {"WPA3_SAE_AES", CYW43_AUTH_WPA3_SAE_AES_PSK},
+    {"WPA3_WPA2_AES", CYW43_AUTH_WPA3_WPA2_AES_PSK},
+};
+static const char* const _whm_config_filters[WHM_CONFIG_FILTER_TYPES] =
+{
+    [WHM_CONFIG_FILTER_NONE] = "none",
+    [WHM_CONFIG_FILTER_MEAN] = "mean",
+    [WHM_CONFIG_FILTER_MEDIAN] = "median",
+    [WHM_CONFIG_FILTER_IIR] = "iir",
+};
 
 
 int whm_config_init(void)
 {
     /* always will be loaded after this point, if invalid, then will be loaded as default */
     _whm_config_loaded = true;
-    const char* config_raw = (const char*)PERSIST_RAW_DATA;
-    memcpy(_whm_config_json, config_raw, _WHM_CONFIG_JSON_BUFFER_LEN);
-
-    return _whm_config_load(&whm_conf);
+    whm_config_parser_init(&_whm_config_parser);
+    /* the stored document is followed by erased flash, which is ignored */
+    whm_config_parser_feed(&_whm_config_parser, (const char*)PERSIST_RAW_DATA, PERSIST_CONFIG_SIZE);
+    if (0 != whm_config_parser_finish(&_whm_config_parser))
+    {
+        /* no config available */
+        return -1;
+    }
+    memcpy(&whm_conf, &_whm_config_parser.config, sizeof(whm_config_t));
+    memcpy(&_whm_config_staged, &whm_conf, sizeof(whm_config_t));
+    return 0;
 }
 
 
@@ -63,22 +155,138 @@ bool whm_config_loaded(void)
 }
 
 
-int whm_config_set_string(char* config_str, unsigned len)
+void whm_config_parser_init(whm_config_parser_t* parser)
 {
-    int ret = -1;
-    if (len < _WHM_CONFIG_JSON_BUFFER_LEN)
+    static const whm_config_t _default_config = _WHM_CONFIG_DEFAULT;
+    whm_json_reader_init(&parser->reader);
+    memcpy(&parser->config, &_default_config, sizeof(whm_config_t));
+    parser->section = _WHM_CONFIG_SECTION_ROOT;
+    parser->key[0] = '\0';
+}
+
+
+int whm_config_parser_feed(whm_config_parser_t* parser, const char* data, unsigned len)
+{
+    while (len && !whm_json_reader_done(&parser->reader))
     {
-        memcpy(_whm_config_json, config_str, len);
-        memset(&_whm_config_json[len], 0, _WHM_CONFIG_JSON_BUFFER_LEN - len);
-        ret = 0;
+        whm_json_reader_token_t token;
+        unsigned used = whm_json_reader_next(&parser->reader, data, len, &token);
+        data += used;
+        len -= used;
+        if (WHM_JSON_READER_TOKEN_ERROR == token)
+        {
+            return -1;
+        }
+        _whm_config_parser_token(parser, token);
     }
-    return ret;
+    return 0;
+}
+
+
+int whm_config_parser_finish(whm_config_parser_t* parser)
+{
+    return whm_json_reader_done(&parser->reader) ? 0 : -1;
+}
+
+
+int whm_config_set(const whm_config_t* config)
+{
+    memcpy(&_whm_config_staged, config, sizeof(whm_config_t));
+    return 0;
+}
+
+
+int whm_config_set_string(const char* config_str, unsigned len)
+{
+    whm_config_parser_init(&_whm_config_parser);
+    if (0 != whm_config_parser_feed(&_whm_config_parser, config_str, len)
+        || 0 != whm_config_parser_finish(&_whm_config_parser))
+    {
+        return -1;
+    }
+    return whm_config_set(&_whm_config_parser.config);
 }
 
 
-char* whm_config_get_string(void)
+void whm_config_write(whm_json_writer_t* writer, const whm_config_t* config)
 {
-    return _whm_config_json;
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "name");
+    whm_json_writer_string(writer, config->name);
+    whm_json_writer_key(writer, "blinking_ms");
+    whm_json_writer_uint(writer, config->blinking_ms);
+    whm_json_writer_key(writer, "history_ms");
+    whm_json_writer_uint(writer, config->history_ms);
+    whm_json_writer_key(writer, "sensor_profile");
+    whm_json_writer_string(writer, whm_htu31d_profile_name(config->sensor_profile));
+    whm_json_writer_key(writer, "filters");
+    whm_json_writer_object_begin(writer);
+    for (uint8_t i = 0; i < WHM_CONFIG_CHANNELS; i++)
+    {
+        whm_json_writer_key(writer, whm_config_channel_name(i));
+        whm_json_writer_object_begin(writer);
+        whm_json_writer_key(writer, "type");
+        whm_json_writer_string(writer, whm_config_filter_name(config->filters[i].type));
+        whm_json_writer_key(writer, "length");
+        whm_json_writer_uint(writer, config->filters[i].length);
+        whm_json_writer_key(writer, "shift");
+        whm_json_writer_uint(writer, config->filters[i].shift);
+        whm_json_writer_object_end(writer);
+    }
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "rules");
+    whm_json_writer_array_begin(writer);
+    for (uint8_t i = 0; i < config->rules_count; i++)
+    {
+        _whm_config_write_rule(writer, &config->rules[i]);
+    }
+    whm_json_writer_array_end(writer);
+    whm_json_writer_key(writer, "ap");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "ssid");
+    whm_json_writer_string(writer, config->ap.ssid);
+    whm_json_writer_key(writer, "password");
+    whm_json_writer_string(writer, config->ap.password);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "station");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "ssid");
+    whm_json_writer_string(writer, config->station.ssid);
+    whm_json_writer_key(writer, "password");
+    whm_json_writer_string(writer, config->station.password);
+    whm_json_writer_key(writer, "auth");
+    whm_json_writer_string(writer, _whm_config_get_auth_name(config->station.auth));
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "uplink");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "url");
+    whm_json_writer_string(writer, config->uplink.url);
+    whm_json_writer_key(writer, "batch");
+    whm_json_writer_uint(writer, config->uplink.batch);
+    whm_json_writer_key(writer, "interval_s");
+    whm_json_writer_uint(writer, config->uplink.interval_s);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "mqtt");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "host");
+    whm_json_writer_string(writer, config->mqtt.host);
+    whm_json_writer_key(writer, "port");
+    whm_json_writer_uint(writer, config->mqtt.port);
+    whm_json_writer_key(writer, "meas_topic");
+    whm_json_writer_string(writer, config->mqtt.meas_topic);
+    whm_json_writer_key(writer, "status_topic");
+    whm_json_writer_string(writer, config->mqtt.status_topic);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "telemetry");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "host");
+    whm_json_writer_string(writer, config->telemetry.host);
+    whm_json_writer_key(writer, "port");
+    whm_json_writer_uint(writer, config->telemetry.port);
+    whm_json_writer_key(writer, "batch");
+    whm_json_writer_uint(writer, config->telemetry.batch);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_object_end(writer);
 }
 
 
@@ -90,16 +298,21 @@ void whm_config_wipe(void)
 }
 
 
+const char* whm_config_channel_name(uint8_t channel)
+{
+    return WHM_CONFIG_CHANNEL_TEMPERATURE == channel ? "temperature" : "relative_humidity";
+}
+
+
+const char* whm_config_filter_name(uint8_t type)
+{
+    return _whm_config_filters[type < WHM_CONFIG_FILTER_TYPES ? type : WHM_CONFIG_FILTER_NONE];
+}
+
+
 int whm_config_save(void)
 {
-    int ret = 0;
-    whm_config_t test_conf = _WHM_CONFIG_DEFAULT;
-    ret = _whm_config_load(&test_conf);
-    if (0 != ret)
-    {
-        return ret;
-    }
-    memcpy(&whm_conf, &test_conf, sizeof(whm_config_t));
+    memcpy(&whm_conf, &_whm_config_staged, sizeof(whm_config_t));
     return _whm_config_save();
 }
 
@@ -111,23 +324,322 @@ int whm_config_restore(void)
 }
 
 
-static int _whm_config_commit2(uint8_t* dst, uint8_t* src, uint32_t size)
+static void _whm_config_parser_token(whm_config_parser_t* parser, whm_json_reader_token_t token)
 {
-    static uint8_t  _persist_page[FLASH_PAGE_SIZE];
+    unsigned depth = parser->reader.depth;
+    switch (token)
+    {
+        case WHM_JSON_READER_TOKEN_KEY:
+            if (parser->reader.value_len > WHM_CONFIG_KEY_LEN)
+            {
+                /* can't be one of ours */
+                parser->key[0] = '\0';
+            }
+            else
+            {
+                memcpy(parser->key, parser->reader.value, parser->reader.value_len + 1);
+            }
+            break;
+        case WHM_JSON_READER_TOKEN_OBJECT_BEGIN:
+        case WHM_JSON_READER_TOKEN_ARRAY_BEGIN:
+            /* depth is after the object or array was opened */
+            if (2 == depth)
+            {
+                if (WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token && 0 == strcmp(parser->key, "ap"))
+                {
+                    parser->section = _WHM_CONFIG_SECTION_AP;
+                }
+                else if (WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token && 0 == strcmp(parser->key, "station"))
+                {
+                    parser->section = _WHM_CONFIG_SECTION_STATION;
+                }
+                else if (WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token && 0 == strcmp(parser->key, "uplink"))
+                {
+                    parser->section = _WHM_CONFIG_SECTION_UPLINK;
+                }
+                else if (WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token && 0 == strcmp(parser->key, "mqtt"))
+                {
+                    parser->section = _WHM_CONFIG_SECTION_MQTT;
+                }
+                else if (WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token && 0 == strcmp(parser->key, "telemetry"))
+                {
+                    parser->section = _WHM_CONFIG_SECTION_TELEMETRY;
+                }
+                else if (WHM_JSON_READER_TOKEN_ARRAY_BEGIN == token && 0 == strcmp(parser->key, "rules"))
+                {
+                    /* replaces the defaults rather than adding to them */
+                    parser->section = _WHM_CONFIG_SECTION_RULES;
+                    parser->config.rules_count = 0;
+                }
+                else if (WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token && 0 == strcmp(parser->key, "filters"))
+                {
+                    parser->section = _WHM_CONFIG_SECTION_FILTERS;
+                }
+                else
+                {
+                    parser->section = _WHM_CONFIG_SECTION_OTHER;
+                }
+            }
+            else if (3 == depth && _WHM_CONFIG_SECTION_RULES == parser->section
+                && WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token)
+            {
+                if (parser->config.rules_count < WHM_CONFIG_RULES_MAX)
+                {
+                    whm_config_rule_t* rule = &parser->config.rules[parser->config.rules_count++];
+                    memset(rule, 0, sizeof(whm_config_rule_t));
+                    parser->section = _WHM_CONFIG_SECTION_RULE;
+                }
+                else
+                {
+                    printf("too many rules\n");
+                }
+            }
+            else if (3 == depth && _WHM_CONFIG_SECTION_FILTERS == parser->section
+                && WHM_JSON_READER_TOKEN_OBJECT_BEGIN == token)
+            {
+                for (uint8_t i = 0; i < WHM_CONFIG_CHANNELS; i++)
+                {
+                    if (0 == strcmp(parser->key, whm_config_channel_name(i)))
+                    {
+                        /* fields not given take their defaults */
+                        parser->config.filters[i].type = WHM_CONFIG_FILTER_NONE;
+                        parser->config.filters[i].length = WHM_CONFIG_FILTER_LENGTH_DEFAULT;
+                        parser->config.filters[i].shift = WHM_CONFIG_FILTER_SHIFT_DEFAULT;
+                        parser->channel = i;
+                        parser->section = _WHM_CONFIG_SECTION_FILTER;
+                    }
+                }
+            }
+            break;
+        case WHM_JSON_READER_TOKEN_OBJECT_END:
+        case WHM_JSON_READER_TOKEN_ARRAY_END:
+            if (1 == depth)
+            {
+                parser->section = _WHM_CONFIG_SECTION_ROOT;
+            }
+            else if (2 == depth && _WHM_CONFIG_SECTION_RULE == parser->section)
+            {
+                parser->section = _WHM_CONFIG_SECTION_RULES;
+            }
+            else if (2 == depth && _WHM_CONFIG_SECTION_FILTER == parser->section)
+            {
+                parser->section = _WHM_CONFIG_SECTION_FILTERS;
+            }
+            break;
+        case WHM_JSON_READER_TOKEN_NONE:
+        case WHM_JSON_READER_TOKEN_ERROR:
+            break;
+        default:
+            /* only fields directly in the root or one of the sections */
+            if ((1 == depth && _WHM_CONFIG_SECTION_ROOT == parser->section)
+                || (2 == depth && (_WHM_CONFIG_SECTION_AP == parser->section
+                                   || _WHM_CONFIG_SECTION_STATION == parser->section
+                                   || _WHM_CONFIG_SECTION_UPLINK == parser->section
+                                   || _WHM_CONFIG_SECTION_MQTT == parser->section
+                                   || _WHM_CONFIG_SECTION_TELEMETRY == parser->section)))
+            {
+                _whm_config_parser_value(parser, token);
+            }
+            else if (3 == depth && _WHM_CONFIG_SECTION_RULE == parser->section)
+            {
+                _whm_config_parser_rule(parser, token);
+            }
+            else if (3 == depth && _WHM_CONFIG_SECTION_FILTER == parser->section)
+            {
+                _whm_config_parser_filter(parser, token);
+            }
+            break;
+    }
+}
+
 
-    divmod_result_t uresult = hw_divider_divmod_u32(size, FLASH_PAGE_SIZE);
-    uint32_t num_full_pages = to_quotient_u32(uresult);
-    uint32_t last_page_len = to_remainder_u32(uresult);
-    uint32_t offset = 0;
-    for (uint32_t page = 0; page < num_full_pages; page++)
+static void _whm_config_parser_value(whm_config_parser_t* parser, whm_json_reader_token_t token)
+{
+    whm_config_t* config = &parser->config;
+    const whm_json_reader_t* reader = &parser->reader;
+    bool is_string = WHM_JSON_READER_TOKEN_STRING == token;
+    switch (parser->section)
     {
-        flash_range_program((uintptr_t)dst - XIP_BASE + offset, src + offset, FLASH_PAGE_SIZE);
-        offset += FLASH_PAGE_SIZE;
+        case _WHM_CONFIG_SECTION_ROOT:
+            if (is_string && 0 == strcmp(parser->key, "name"))
+            {
+                _whm_config_copy(config->name, sizeof(config->name), reader);
+            }
+            else if (0 == strcmp(parser->key, "blinking_ms"))
+            {
+                char* p = NULL;
+                uint32_t blinking_ms = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0' || blinking_ms > UINT16_MAX)
+                {
+                    printf("invalid blinking_ms\n");
+                }
+                else
+                {
+                    config->blinking_ms = blinking_ms;
+                }
+            }
+            else if (0 == strcmp(parser->key, "history_ms"))
+            {
+                char* p = NULL;
+                uint32_t history_ms = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0'
+                    || history_ms < WHM_CONFIG_HISTORY_MS_MIN || history_ms > WHM_CONFIG_HISTORY_MS_MAX)
+                {
+                    printf("invalid history_ms\n");
+                }
+                else
+                {
+                    config->history_ms = history_ms;
+                }
+            }
+            else if (0 == strcmp(parser->key, "sensor_profile"))
+            {
+                uint8_t profile = 0;
+                if (is_string && whm_htu31d_profile_from_name(reader->value, &profile))
+                {
+                    config->sensor_profile = profile;
+                }
+                else
+                {
+                    printf("invalid sensor_profile\n");
+                }
+            }
+            break;
+        case _WHM_CONFIG_SECTION_AP:
+            if (is_string && 0 == strcmp(parser->key, "ssid"))
+            {
+                _whm_config_copy(config->ap.ssid, sizeof(config->ap.ssid), reader);
+            }
+            else if (is_string && 0 == strcmp(parser->key, "password"))
+            {
+                _whm_config_copy(config->ap.password, sizeof(config->ap.password), reader);
+            }
+            break;
+        case _WHM_CONFIG_SECTION_STATION:
+            if (is_string && 0 == strcmp(parser->key, "ssid"))
+            {
+                _whm_config_copy(config->station.ssid, sizeof(config->station.ssid), reader);
+            }
+            else if (is_string && 0 == strcmp(parser->key, "password"))
+            {
+                _whm_config_copy(config->station.password, sizeof(config->station.password), reader);
+            }
+            else if (0 == strcmp(parser->key, "auth"))
+            {
+                uint32_t auth = 0;
+                if (is_string && _whm_config_get_auth(reader->value, &auth))
+                {
+                    config->station.auth = auth;
+                }
+                else
+                {
+                    printf("invalid auth\n");
+                }
+            }
+            break;
+        case _WHM_CONFIG_SECTION_UPLINK:
+            if (is_string && 0 == strcmp(parser->key, "url"))
+            {
+                _whm_config_copy(config->uplink.url, sizeof(config->uplink.url), reader);
+            }
+            else if (0 == strcmp(parser->key, "batch"))
+            {
+                char* p = NULL;
+                unsigned long batch = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0' || !batch || batch > WHM_CONFIG_UPLINK_BATCH_MAX)
+                {
+                    printf("invalid uplink batch\n");
+                }
+                else
+                {
+                    config->uplink.batch = batch;
+                }
+            }
+            else if (0 == strcmp(parser->key, "interval_s"))
+            {
+                char* p = NULL;
+                unsigned long interval_s = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0'
+                    || !interval_s || interval_s > WHM_CONFIG_UPLINK_INTERVAL_S_MAX)
+                {
+                    printf("invalid uplink interval_s\n");
+                }
+                else
+                {
+                    config->uplink.interval_s = interval_s;
+                }
+            }
+            break;
+        case _WHM_CONFIG_SECTION_MQTT:
+            if (is_string && 0 == strcmp(parser->key, "host"))
+            {
+                _whm_config_copy(config->mqtt.host, sizeof(config->mqtt.host), reader);
+            }
+            else if (0 == strcmp(parser->key, "port"))
+            {
+                char* p = NULL;
+                unsigned long port = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0' || !port || port > UINT16_MAX)
+                {
+                    printf("invalid mqtt port\n");
+                }
+                else
+                {
+                    config->mqtt.port = port;
+                }
+            }
+            else if (is_string && 0 == strcmp(parser->key, "meas_topic"))
+            {
+                _whm_config_copy(config->mqtt.meas_topic, sizeof(config->mqtt.meas_topic), reader);
+            }
+            else if (is_string && 0 == strcmp(parser->key, "status_topic"))
+            {
+                _whm_config_copy(config->mqtt.status_topic, sizeof(config->mqtt.status_topic), reader);
+            }
+            break;
+        case _WHM_CONFIG_SECTION_TELEMETRY:
+            if (is_string && 0 == strcmp(parser->key, "host"))
+            {
+                _whm_config_copy(config->telemetry.host, sizeof(config->telemetry.host), reader);
+            }
+            else if (0 == strcmp(parser->key, "port"))
+            {
+                char* p = NULL;
+                unsigned long port = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0' || !port || port > UINT16_MAX)
+                {
+                    printf("invalid telemetry port\n");
+                }
+                else
+                {
+                    config->telemetry.port = port;
+                }
+            }
+            else if (0 == strcmp(parser->key, "batch"))
+            {
+                char* p = NULL;
+                unsigned long batch = strtoul(reader->value, &p, 10);
+                if (WHM_JSON_READER_TOKEN_NUMBER != token || *p != '\0' || !batch || batch > WHM_CONFIG_TELEMETRY_BATCH_MAX)
+                {
+                    printf("invalid telemetry batch\n");
+                }
+                else
+                {
+                    config->telemetry.batch = batch;
+                }
+            }
+            break;
+        default:
+            break;
     }
-    memcpy(_persist_page, src + offset, last_page_len);
-    memset(_persist_page + last_page_len, 0xFF, FLASH_PAGE_SIZE - last_page_len);
-    flash_range_program((uintptr_t)dst - XIP_BASE + offset, _persist_page, FLASH_PAGE_SIZE);
-    return memcmp(dst, src, size);
+}
+
+
+static void _whm_config_copy(char* dst, unsigned size, const whm_json_reader_t* reader)
+{
+    unsigned len = reader->value_len < size - 1 ? reader->value_len : size - 1;
+    memcpy(dst, reader->value, len);
+    dst[len] = '\0';
 }
 
 
@@ -137,124 +649,254 @@ static bool _whm_config_get_auth(const char* auth_str, uint32_t* auth)
     {
         return false;
     }
-    if (0 == strcmp(auth_str, "OPEN"))
+    for (size_t i = 0; i < sizeof(_whm_config_auths) / sizeof(_whm_config_auths[0]); i++)
+    {
+        if (0 == strcmp(auth_str, _whm_config_auths[i].name))
+        {
+            *auth = _whm_config_auths[i].auth;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static const char* _whm_config_get_auth_name(uint32_t auth)
+{
+    for (size_t i = 0; i < sizeof(_whm_config_auths) / sizeof(_whm_config_auths[0]); i++)
+    {
+        if (auth == _whm_config_auths[i].auth)
+        {
+            return _whm_config_auths[i].name;
+        }
+    }
+    return _whm_config_auths[0].name;
+}
+
+
+static void _whm_config_parser_rule(whm_config_parser_t* parser, whm_json_reader_token_t token)
+{
+    whm_config_rule_t* rule = &parser->config.rules[parser->config.rules_count - 1];
+    const whm_json_reader_t* reader = &parser->reader;
+    if (0 == strcmp(parser->key, "channel"))
+    {
+        if (WHM_JSON_READER_TOKEN_STRING == token && 0 == strcmp(reader->value, "relative_humidity"))
+        {
+            rule->channel = WHM_CONFIG_CHANNEL_RELATIVE_HUMIDITY;
+        }
+        else if (WHM_JSON_READER_TOKEN_STRING == token && 0 == strcmp(reader->value, "temperature"))
+        {
+            rule->channel = WHM_CONFIG_CHANNEL_TEMPERATURE;
+        }
+        else
+        {
+            printf("invalid rule channel\n");
+        }
+        return;
+    }
+    int32_t value = 0;
+    if (WHM_JSON_READER_TOKEN_NUMBER != token || !_whm_config_get_e3(reader->value, &value))
     {
-        *auth = CYW43_AUTH_OPEN;
+        printf("invalid rule %s\n", parser->key);
+        return;
     }
-    else if (0 == strcmp(auth_str, "WPA_TKIP"))
+    if (0 == strcmp(parser->key, "high"))
     {
-        *auth = CYW43_AUTH_WPA_TKIP_PSK;
+        rule->high_e3 = value;
+        rule->high_set = true;
     }
-    else if (0 == strcmp(auth_str, "WPA2_AES"))
+    else if (0 == strcmp(parser->key, "low"))
     {
-        *auth = CYW43_AUTH_WPA2_AES_PSK;
+        rule->low_e3 = value;
+        rule->low_set = true;
     }
-    else if (0 == strcmp(auth_str, "WPA2_MIXED"))
+    else if (value < 0)
     {
-        *auth = CYW43_AUTH_WPA2_MIXED_PSK;
+        printf("invalid rule %s\n", parser->key);
     }
-    else if (0 == strcmp(auth_str, "WPA3_SAE_AES"))
+    else if (0 == strcmp(parser->key, "deadband"))
     {
-        *auth = CYW43_AUTH_WPA3_SAE_AES_PSK;
+        rule->deadband_e3 = value;
     }
-    else if (0 == strcmp(auth_str, "WPA3_WPA2_AES"))
+    else if (0 == strcmp(parser->key, "hysteresis"))
     {
-        *auth = CYW43_AUTH_WPA3_WPA2_AES_PSK;
+        rule->hysteresis_e3 = value;
     }
-    else
+    else if (0 == strcmp(parser->key, "rate"))
     {
-        return false;
+        rule->rate_e3 = value;
     }
-    return true;
-}
-
-
-static int _whm_config_save(void)
-{
-    critical_section_t crit_sec;
-    critical_section_init(&crit_sec);
-    critical_section_enter_blocking(&crit_sec);
-    flash_range_erase(PERSIST_CONFIG_SECTOR, FLASH_SECTOR_SIZE);
-    int ret = _whm_config_commit2(PERSIST_RAW_DATA, (uint8_t*)_whm_config_json, _WHM_CONFIG_JSON_BUFFER_LEN);
-    critical_section_exit(&crit_sec);
-    critical_section_deinit(&crit_sec);
-    return ret;
 }
 
 
-static int _whm_config_load(whm_config_t* config)
+static void _whm_config_parser_filter(whm_config_parser_t* parser, whm_json_reader_token_t token)
 {
-    if (!config)
+    whm_config_filter_t* filter = &parser->config.filters[parser->channel];
+    const whm_json_reader_t* reader = &parser->reader;
+    if (0 == strcmp(parser->key, "type"))
     {
-        return -1;
-    }
-    /* json parsing is destructive, so need a copy */
-    static char _whm_config_json_cpy[_WHM_CONFIG_JSON_BUFFER_LEN];
-    memcpy(_whm_config_json_cpy, _whm_config_json, _WHM_CONFIG_JSON_BUFFER_LEN);
-    json_t const* parent = json_create(_whm_config_json_cpy, _whm_config_json_pool, _WHM_CONFIG_JSON_MAX_FIELDS);
-    if (!parent)
-    {
-        /* no config available */
-        return -1;
-    }
-    const char* namefield = json_getPropertyValue(parent, "name");
-    if (namefield)
-    {
-        unsigned len = strlen(namefield);
-        memcpy(config->name, namefield, len);
-        config->name[len] = '\0';
+        uint8_t type = 0;
+        if (WHM_JSON_READER_TOKEN_STRING == token && _whm_config_get_filter(reader->value, &type))
+        {
+            filter->type = type;
+        }
+        else
+        {
+            printf("invalid filter type\n");
+        }
+        return;
     }
-    const char* blinking_ms_str = json_getPropertyValue(parent, "blinking_ms");
-    if (blinking_ms_str)
+    char* p = NULL;
+    unsigned long value = strtoul(reader->value, &p, 10);
+    bool valid = WHM_JSON_READER_TOKEN_NUMBER == token && *p == '\0' && value;
+    if (0 == strcmp(parser->key, "length"))
     {
-        char* p = NULL;
-        uint32_t blinking_ms = strtoul(blinking_ms_str, &p, 10);
-        if (*p != '\0')
+        if (valid && value <= WHM_CONFIG_FILTER_LENGTH_MAX)
         {
-            printf("invalid blinking_ms\n");
+            filter->length = value;
         }
         else
         {
-            config->blinking_ms = blinking_ms;
+            printf("invalid filter length\n");
         }
     }
-    json_t const* ap_obj = json_getProperty(parent, "ap");
-    if (ap_obj)
+    else if (0 == strcmp(parser->key, "shift"))
     {
-        const char* ap_ssid = json_getPropertyValue(ap_obj, "ssid");
-        if (ap_ssid)
+        if (valid && value <= WHM_CONFIG_FILTER_SHIFT_MAX)
         {
-            strncpy(config->ap.ssid, ap_ssid, WHM_CONFIG_WIRELESS_LEN-1);
+            filter->shift = value;
         }
-        const char* ap_password = json_getPropertyValue(ap_obj, "password");
-        if (ap_password)
+        else
+        {
+            printf("invalid filter shift\n");
+        }
+    }
+}
+
+
+static bool _whm_config_get_filter(const char* name, uint8_t* type)
+{
+    for (uint8_t i = 0; i < WHM_CONFIG_FILTER_TYPES; i++)
+    {
+        if (0 == strcmp(name, _whm_config_filters[i]))
         {
-            strncpy(config->ap.password, ap_password, WHM_CONFIG_WIRELESS_LEN-1);
+            *type = i;
+            return true;
         }
     }
-    json_t const* station_obj = json_getProperty(parent, "station");
-    if (station_obj)
+    return false;
+}
+
+
+/* a plain decimal, extra decimals are cut off */
+static bool _whm_config_get_e3(const char* str, int32_t* value)
+{
+    bool negative = '-' == *str;
+    str += negative;
+    /* wider than needed, so the checks can't overflow */
+    int64_t e3 = 0;
+    unsigned decimals = 0;
+    bool point = false;
+    bool digits = false;
+    for (; *str; str++)
     {
-        const char* station_ssid = json_getPropertyValue(station_obj, "ssid");
-        if (station_ssid)
+        if ('.' == *str && !point)
         {
-            strncpy(config->station.ssid, station_ssid, WHM_CONFIG_WIRELESS_LEN-1);
+            point = true;
+            continue;
         }
-        const char* station_password = json_getPropertyValue(station_obj, "password");
-        if (station_password)
+        if (*str < '0' || *str > '9')
         {
-            strncpy(config->station.password, station_password, WHM_CONFIG_WIRELESS_LEN-1);
+            return false;
         }
-        const char* station_auth = json_getPropertyValue(station_obj, "auth");
-        uint32_t auth = 0;
-        if (_whm_config_get_auth(station_auth, &auth))
+        digits = true;
+        if (point && decimals >= 3)
         {
-            config->station.auth = auth;
+            continue;
         }
-        else
+        if (e3 > WHM_CONFIG_RULE_E3_MAX)
         {
-            printf("invalid auth\n");
+            /* already too big, and any further would overflow */
+            return false;
         }
+        decimals += point;
+        e3 = e3 * 10 + (*str - '0');
     }
-    return 0;
+    for (; decimals < 3; decimals++)
+    {
+        e3 *= 10;
+    }
+    if (!digits || e3 > WHM_CONFIG_RULE_E3_MAX)
+    {
+        return false;
+    }
+    *value = (int32_t)(negative ? -e3 : e3);
+    return true;
+}
+
+
+static void _whm_config_write_rule(whm_json_writer_t* writer, const whm_config_rule_t* rule)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "channel");
+    whm_json_writer_string(writer, whm_config_channel_name(rule->channel));
+    whm_json_writer_key(writer, "deadband");
+    whm_json_writer_fixed(writer, rule->deadband_e3, 3);
+    if (rule->high_set)
+    {
+        whm_json_writer_key(writer, "high");
+        whm_json_writer_fixed(writer, rule->high_e3, 3);
+    }
+    if (rule->low_set)
+    {
+        whm_json_writer_key(writer, "low");
+        whm_json_writer_fixed(writer, rule->low_e3, 3);
+    }
+    whm_json_writer_key(writer, "hysteresis");
+    whm_json_writer_fixed(writer, rule->hysteresis_e3, 3);
+    whm_json_writer_key(writer, "rate");
+    whm_json_writer_fixed(writer, rule->rate_e3, 3);
+    whm_json_writer_object_end(writer);
+}
+
+
+static void _whm_config_render_page(const whm_config_t* config, unsigned offset)
+{
+    /* past the end of the document reads as erased */
+    memset(_whm_config_page, 0xFF, FLASH_PAGE_SIZE);
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, (char*)_whm_config_page, FLASH_PAGE_SIZE, offset);
+    whm_config_write(&writer, config);
+}
+
+
+static int _whm_config_save(void)
+{
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, NULL, 0, 0);
+    whm_config_write(&writer, &whm_conf);
+    unsigned len = whm_json_writer_len(&writer);
+    if (len > PERSIST_CONFIG_SIZE)
+    {
+        return -1;
+    }
+    critical_section_t crit_sec;
+    critical_section_init(&crit_sec);
+    critical_section_enter_blocking(&crit_sec);
+    flash_range_erase(PERSIST_CONFIG_SECTOR, FLASH_SECTOR_SIZE);
+    /* rendered a page at a time, the document is never held whole */
+    for (unsigned offset = 0; offset < len; offset += FLASH_PAGE_SIZE)
+    {
+        _whm_config_render_page(&whm_conf, offset);
+        flash_range_program(PERSIST_CONFIG_SECTOR + offset, _whm_config_page, FLASH_PAGE_SIZE);
+    }
+    critical_section_exit(&crit_sec);
+    critical_section_deinit(&crit_sec);
+    int ret = 0;
+    for (unsigned offset = 0; offset < len && 0 == ret; offset += FLASH_PAGE_SIZE)
+    {
+        _whm_config_render_page(&whm_conf, offset);
+        ret = memcmp(PERSIST_RAW_DATA + offset, _whm_config_page, FLASH_PAGE_SIZE);
+    }
+    return ret;
 }
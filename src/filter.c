@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "filter.h"
+#include "config.h"
+
+
+static int32_t _whm_filter_mean(whm_filter_t* filter, int32_t value_e3);
+static int32_t _whm_filter_median(whm_filter_t* filter, int32_t value_e3);
+static int32_t _whm_filter_iir(whm_filter_t* filter, int32_t value_e3);
+static int32_t _whm_filter_div_round(int64_t num, int64_t den);
+
+
+void whm_filter_init(whm_filter_t* filter, const whm_config_filter_t* config)
+{
+    memset(filter, 0, sizeof(whm_filter_t));
+    filter->config = *config;
+    /* the config is checked when parsed, but a bad length would run off
+     * the window */
+    filter->length = config->length;
+    if (!filter->length || filter->length > WHM_CONFIG_FILTER_LENGTH_MAX)
+    {
+        filter->length = WHM_CONFIG_FILTER_LENGTH_MAX;
+    }
+}
+
+
+int32_t whm_filter_apply(whm_filter_t* filter, const whm_config_filter_t* config, int32_t value_e3)
+{
+    if (0 != memcmp(&filter->config, config, sizeof(whm_config_filter_t)))
+    {
+        whm_filter_init(filter, config);
+    }
+    switch (filter->config.type)
+    {
+        case WHM_CONFIG_FILTER_MEAN:
+            return _whm_filter_mean(filter, value_e3);
+        case WHM_CONFIG_FILTER_MEDIAN:
+            return _whm_filter_median(filter, value_e3);
+        case WHM_CONFIG_FILTER_IIR:
+            return _whm_filter_iir(filter, value_e3);
+        default:
+            return value_e3;
+    }
+}
+
+
+/* a running sum, what drops out of the window is taken off */
+static int32_t _whm_filter_mean(whm_filter_t* filter, int32_t value_e3)
+{
+    if (filter->count == filter->length)
+    {
+        filter->sum -= filter->window[filter->pos];
+    }
+    else
+    {
+        filter->count++;
+    }
+    filter->window[filter->pos] = value_e3;
+    filter->sum += value_e3;
+    filter->pos = (filter->pos + 1) % filter->length;
+    return _whm_filter_div_round(filter->sum, filter->count);
+}
+
+
+static int32_t _whm_filter_median(whm_filter_t* filter, int32_t value_e3)
+{
+    if (filter->count < filter->length)
+    {
+        filter->count++;
+    }
+    filter->window[filter->pos] = value_e3;
+    filter->pos = (filter->pos + 1) % filter->length;
+    /* at most WHM_CONFIG_FILTER_LENGTH_MAX, an insertion sort will do */
+    int32_t sorted[WHM_CONFIG_FILTER_LENGTH_MAX];
+    for (uint8_t i = 0; i < filter->count; i++)
+    {
+        int32_t v = filter->window[i];
+        uint8_t j = i;
+        for (; j && sorted[j - 1] > v; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+    uint8_t mid = filter->count / 2U;
+    if (filter->count % 2U)
+    {
+        return sorted[mid];
+    }
+    /* even, halfway between the middle two */
+    return _whm_filter_div_round((int64_t)sorted[mid - 1] + sorted[mid], 2);
+}
+
+
+/* y += (x - y) / 2^shift, y kept with WHM_FILTER_IIR_FRACTION extra bits
+ * so small steps aren't lost to rounding */
+static int32_t _whm_filter_iir(whm_filter_t* filter, int32_t value_e3)
+{
+    int32_t x = value_e3 * (1 << WHM_FILTER_IIR_FRACTION);
+    if (!filter->count)
+    {
+        /* start from the first reading rather than rising from 0 */
+        filter->iir = x;
+        filter->count = 1;
+    }
+    else
+    {
+        filter->iir += _whm_filter_div_round((int64_t)x - filter->iir, 1 << filter->config.shift);
+    }
+    return _whm_filter_div_round(filter->iir, 1 << WHM_FILTER_IIR_FRACTION);
+}
+
+
+/* rounded half away from zero, as C division truncates */
+static int32_t _whm_filter_div_round(int64_t num, int64_t den)
+{
+    int64_t half = den / 2;
+    return (int32_t)((num < 0 ? num - half : num + half) / den);
+}
@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http_request.h"
+
+
+static bool _whm_http_request_starts(const char* data, unsigned len);
+static void _whm_http_request_header(whm_http_request_t* request, const char* line, unsigned len, const char* etag);
+
+
+void whm_http_request_init(whm_http_request_t* request)
+{
+    memset(request, 0, sizeof(whm_http_request_t));
+}
+
+
+bool whm_http_request_feed(whm_http_request_t* request, const char* data, unsigned len, const char* etag)
+{
+    bool starts = _whm_http_request_starts(data, len);
+    if (starts)
+    {
+        whm_http_request_init(request);
+        request->in_headers = true;
+        /* the request line */
+        const char* eol = memchr(data, '\n', len);
+        len = NULL == eol ? 0 : len - (eol + 1 - data);
+        data = NULL == eol ? data : eol + 1;
+    }
+    const char* end = data + len;
+    while (request->in_headers && data < end)
+    {
+        const char* eol = memchr(data, '\n', end - data);
+        if (NULL == eol)
+        {
+            eol = end;
+        }
+        unsigned line_len = eol - data;
+        if (line_len && '\r' == data[line_len - 1])
+        {
+            line_len--;
+        }
+        if (!line_len && eol < end)
+        {
+            request->in_headers = false;
+        }
+        else
+        {
+            _whm_http_request_header(request, data, line_len, etag);
+        }
+        data = eol + 1;
+    }
+    return starts;
+}
+
+
+whm_http_request_index_t whm_http_request_index(const whm_http_request_t* request)
+{
+    if (!request->accepts_gzip)
+    {
+        return WHM_HTTP_REQUEST_INDEX_PLAIN;
+    }
+    return request->etag_matched ? WHM_HTTP_REQUEST_INDEX_NOT_MODIFIED : WHM_HTTP_REQUEST_INDEX_GZIP;
+}
+
+
+const char* whm_http_request_header_find(const char* http_request, unsigned http_request_len, const char* name, unsigned* value_len)
+{
+    unsigned name_len = strlen(name);
+    const char* end = http_request + http_request_len;
+    const char* line = http_request;
+    while (line < end)
+    {
+        const char* eol = memchr(line, '\n', end - line);
+        if (NULL == eol)
+        {
+            eol = end;
+        }
+        if ((unsigned)(eol - line) > name_len && ':' == line[name_len]
+            && 0 == strncasecmp(line, name, name_len))
+        {
+            const char* value = line + name_len + 1;
+            while (value < eol && ' ' == *value)
+            {
+                value++;
+            }
+            const char* value_end = eol;
+            if (value < value_end && '\r' == value_end[-1])
+            {
+                value_end--;
+            }
+            *value_len = value_end - value;
+            return value;
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+
+bool whm_http_request_header_contains(const char* value, unsigned value_len, const char* token)
+{
+    unsigned token_len = strlen(token);
+    for (unsigned i = 0; i + token_len <= value_len; i++)
+    {
+        if (0 == strncasecmp(&value[i], token, token_len))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* the methods httpd takes */
+static bool _whm_http_request_starts(const char* data, unsigned len)
+{
+    return (len >= 4 && 0 == memcmp(data, "GET ", 4))
+        || (len >= 5 && 0 == memcmp(data, "POST ", 5));
+}
+
+
+static void _whm_http_request_header(whm_http_request_t* request, const char* line, unsigned len, const char* etag)
+{
+    unsigned value_len = 0;
+    const char* value = whm_http_request_header_find(line, len, "Accept-Encoding", &value_len);
+    if (NULL != value)
+    {
+        request->accepts_gzip = whm_http_request_header_contains(value, value_len, "gzip");
+        return;
+    }
+    value = whm_http_request_header_find(line, len, "Accept", &value_len);
+    if (NULL != value)
+    {
+        request->accepts_cbor = whm_http_request_header_contains(value, value_len, "application/cbor");
+        return;
+    }
+    value = whm_http_request_header_find(line, len, "If-None-Match", &value_len);
+    if (NULL != value)
+    {
+        request->etag_matched = whm_http_request_header_contains(value, value_len, etag);
+    }
+}
@@ -1,4 +1,8 @@
 
+#include <stdlib.h>
+#include <strings.h>
+#include <inttypes.h>
+
 #include "pico/cyw43_arch.h"
 #include "pico/stdlib.h"
 
@@ -7,17 +11,54 @@
 #include "lwip/apps/httpd.h"
 #include "lwip/apps/fs.h"
 #include "lwip/tcpbase.h"
+#include "lwip/priv/tcp_priv.h"
 
 #include "http_server.h"
 #include "config.h"
 #include "util.h"
+#include "sampler.h"
 #include "htu31d.h"
 #include "ap_station.h"
-#include "common.h"
+#include "webroot.h"
+#include "http_request.h"
+#include "rate_limit.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "aggregate.h"
+#include "rules.h"
 
 
-#define _WHM_HTTP_SERVER_CONFIG_BUFFER_SIZE                 1024
 #define _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE               1024
+#define _WHM_HTTP_SERVER_CTX_MAX                            MEMP_NUM_TCP_PCB
+#define _WHM_HTTP_SERVER_CTX_STALE_US                       (30 * 1000 * 1000) /* 30 seconds */
+#define _WHM_HTTP_SERVER_ASYNC_TIMEOUT_US                   (5 * 1000 * 1000) /* 5 seconds */
+#define _WHM_HTTP_SERVER_INDEX_PATH                         "/index.html"
+#define _WHM_HTTP_SERVER_DASHBOARD_PATH                     "/api/dashboard"
+#define _WHM_HTTP_SERVER_STREAM_PATH                        "/api/stream"
+/* leave the rest of the contexts for ordinary requests */
+#define _WHM_HTTP_SERVER_STREAM_MAX                         4
+/* httpd drops a connection that has sent nothing for about 8 seconds */
+#define _WHM_HTTP_SERVER_STREAM_HEARTBEAT_US                (2 * 1000 * 1000) /* 2 seconds */
+#define _WHM_HTTP_SERVER_STREAM_RETRY                       "retry: 2000\n\n"
+/* Retry-After of the 503 a stream gets while the others are all taken */
+#define _WHM_HTTP_SERVER_STREAM_BUSY_S                      5
+#define _WHM_HTTP_SERVER_STREAM_BUSY_BODY                   "{\"status\":\"error\",\"error\":\"too many streams\"}"
+/* room a rule event needs, the rest wait for the next refill */
+#define _WHM_HTTP_SERVER_STREAM_EVENT_ROOM                  (_WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - 160)
+#define _WHM_HTTP_SERVER_STATS_PATH                         "/api/http-stats"
+#define _WHM_HTTP_SERVER_METRICS_PATH                       "/api/metrics"
+#define _WHM_HTTP_SERVER_MEAS_PATH                          "/api/meas"
+#define _WHM_HTTP_SERVER_HISTORY_PATH                       "/api/meas/history"
+#define _WHM_HTTP_SERVER_AGGREGATES_PATH                    "/api/meas/aggregates"
+#define _WHM_HTTP_SERVER_METRICS_LABELS_LEN                 64
+#define _WHM_HTTP_SERVER_CONN_MAX                           MEMP_NUM_TCP_PCB
+/* start reclaiming idle keep-alive connections when fewer PCBs than
+ * this are free, so a new client still gets one */
+#define _WHM_HTTP_SERVER_PCB_RESERVE                        2
+/* don't reclaim a connection that may be about to send its next request */
+#define _WHM_HTTP_SERVER_CONN_IDLE_MIN_US                   (1000 * 1000) /* 1 second */
+#define _WHM_HTTP_SERVER_REJECTED_BODY                      "{\"status\":\"error\",\"error\":\"rate limited\"}"
+#define _WHM_HTTP_SERVER_REJECTED_HEAD_LEN                  192
 
 
 typedef enum _whm_http_server_rest
@@ -27,73 +68,281 @@ typedef enum _whm_http_server_rest
 } _whm_http_server_rest_t;
 
 
+/* parts of the dashboard, each selected by a bare query parameter of
+ * its name, e.g. /api/dashboard?config&meas, all of them if none are */
+typedef enum _whm_http_server_section
+{
+    _WHM_HTTP_SERVER_SECTION_CONFIG     = (1 << 0),
+    _WHM_HTTP_SERVER_SECTION_STATUS     = (1 << 1),
+    _WHM_HTTP_SERVER_SECTION_MEAS       = (1 << 2),
+    _WHM_HTTP_SERVER_SECTION_ALL        = _WHM_HTTP_SERVER_SECTION_CONFIG
+                                        | _WHM_HTTP_SERVER_SECTION_STATUS
+                                        | _WHM_HTTP_SERVER_SECTION_MEAS,
+} _whm_http_server_section_t;
+
+
+typedef struct _whm_http_server_ctx _whm_http_server_ctx_t;
+
+
+/* An httpd connection that has made a request. The connection pointer
+ * is httpd's own state which is pooled, so the PCB and remote port are
+ * kept too to tell a new connection from one kept alive. */
+typedef struct _whm_http_server_conn
+{
+    void* connection;
+    struct tcp_pcb* pcb;
+    uint16_t remote_port;
+    uint64_t last_us;
+} _whm_http_server_conn_t;
+
+
+/* counted when a request arrives, timed until its body is ready */
+typedef struct _whm_http_server_route
+{
+    uint32_t requests;
+    uint32_t rejected;
+    whm_metrics_histogram_t latency;
+} _whm_http_server_route_t;
+
+
 typedef struct _whm_http_server_rest_get_handler
 {
     const char *path;
-    err_t (* handler)(struct fs_file *file, const char* name);
+    err_t (* handler)(_whm_http_server_ctx_t* ctx, const char* name);
+    whm_rate_limit_budget_t budget;
 } _whm_http_server_rest_get_handler_t;
 
 
 typedef struct _whm_http_server_rest_post_handler
 {
     const char *path;
-    err_t (* begin_handler)(const char* http_request, uint16_t http_request_len, int content_len, char* response_uri, uint16_t response_uri_len, uint8_t* post_auto_wnd);
-    err_t (* recv_handler)(struct pbuf *p);
-    err_t (* finish_handler)(char* response_uri, uint16_t response_uri_len);
+    err_t (* begin_handler)(_whm_http_server_ctx_t* ctx, const char* http_request, uint16_t http_request_len, int content_len, char* response_uri, uint16_t response_uri_len, uint8_t* post_auto_wnd);
+    err_t (* recv_handler)(_whm_http_server_ctx_t* ctx, struct pbuf *p);
+    err_t (* finish_handler)(_whm_http_server_ctx_t* ctx, char* response_uri, uint16_t response_uri_len);
+    /* completes the response when the finish handler returns ERR_INPROGRESS */
+    err_t (* async_poll)(_whm_http_server_ctx_t* ctx);
+    whm_rate_limit_budget_t budget;
 } _whm_http_server_rest_post_handler_t;
 
 
+/* One per request in flight, a POST claims one in httpd_post_begin
+ * keyed by its connection, a GET in fs_open_custom keyed by its file.
+ * Either way it is released when httpd closes the file. */
+struct _whm_http_server_ctx
+{
+    bool used;
+    void* connection;
+    struct fs_file* file;
+    uint64_t start_us;
+    /* until the response is timed */
+    _whm_http_server_route_t* route;
+    /* turned away by the rate limit, answered 429 with this Retry-After */
+    uint32_t retry_after_s;
+    _whm_http_server_rest_post_handler_t* post;
+    err_t response_code;
+    /* returns ERR_INPROGRESS until the body has been written */
+    err_t (* poll)(_whm_http_server_ctx_t* ctx);
+    bool pending;
+    uint64_t deadline_us;
+    fs_wait_cb wait_cb;
+    void* wait_arg;
+    /* renders the body, run once for its length then again for each
+     * read, so nothing it reads may change in between */
+    void (* gen)(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+    const char* body;
+    whm_sampler_reading_t reading;
+    bool have_reading;
+    uint32_t age_ms;
+    /* the query's max_age_ms, older than that the sensor is read for it */
+    uint32_t max_age_ms;
+    /* a reading asked of the sensor, the callback finds the context by it */
+    bool sensor_wait;
+    bool sensor_failed;
+    uint8_t sections;
+    /* the query's since and limit until the handler resolves them to
+     * the records covered, which are pinned until the context is freed */
+    uint32_t history_from;
+    uint32_t history_count;
+    uint32_t history_last;
+    bool history;
+    bool json;
+    /* asked for with Accept: application/cbor, gen's output is encoded
+     * as CBOR rather than JSON */
+    bool cbor;
+    /* holds the shared metrics snapshot */
+    bool metrics;
+    bool connected;
+    const char* state;
+    whm_ap_station_scan_result_t* scan;
+    whm_http_server_stats_t stats;
+    int len;
+    /* an event stream never finishes, its events are read from
+     * stream_pos up to len and the buffer refilled when drained */
+    bool stream;
+    int stream_pos;
+    uint32_t stream_seq;
+    uint32_t stream_event;
+    const char* stream_state;
+    uint64_t stream_heartbeat_us;
+    union
+    {
+        /* a GET's copy, a POST could replace it between renders */
+        whm_config_t config;
+        /* a POST's body, applied as it arrives */
+        whm_config_parser_t config_parser;
+        whm_aggregate_window_t aggregates[WHM_AGGREGATE_WINDOWS];
+    };
+    char response_buffer[_WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE];
+};
+
+
 static const char* _whm_http_server_cgi_handler_index(int index, int num_params, char *pc_param[], char *pc_value[]);
-static err_t _whm_http_server_rest_get_handler_config(struct fs_file *file, const char* name);
-static err_t _whm_http_server_rest_get_handler_meas(struct fs_file *file, const char* name);
-static err_t _whm_http_server_rest_get_handler_status(struct fs_file *file, const char* name);
-static err_t _whm_http_server_rest_get_handler_wifi_scan_start(struct fs_file *file, const char* name);
-static err_t _whm_http_server_rest_get_handler_wifi_scan_get(struct fs_file *file, const char* name);
-static void _whm_http_server_meas_finish(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3);
-static err_t _whm_http_server_rest_post_handler_config_begin(const char* http_request, uint16_t http_request_len, int content_len, char* response_uri, uint16_t response_uri_len, uint8_t* post_auto_wnd);
-static err_t _whm_http_server_rest_post_handler_config_recv(struct pbuf* p);
-static err_t _whm_http_server_rest_post_handler_config_finish(char* response_uri, uint16_t response_uri_len);
+static const char* _whm_http_server_cgi_handler_dashboard(int index, int num_params, char *pc_param[], char *pc_value[]);
+static const char* _whm_http_server_cgi_handler_metrics(int index, int num_params, char *pc_param[], char *pc_value[]);
+static const char* _whm_http_server_cgi_handler_meas(int index, int num_params, char *pc_param[], char *pc_value[]);
+static const char* _whm_http_server_cgi_handler_history(int index, int num_params, char *pc_param[], char *pc_value[]);
+static void _whm_http_server_hook(void);
+static err_t _whm_http_server_accept(void* arg, struct tcp_pcb* pcb, err_t err);
+static err_t _whm_http_server_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err);
+static void _whm_http_server_request_feed(void* connection, struct tcp_pcb* pcb, const struct pbuf* p);
+static int _whm_http_server_webroot_open(struct fs_file* file, whm_http_request_index_t index);
+static bool _whm_http_server_accepts_cbor(const char* http_request, unsigned http_request_len);
+static err_t _whm_http_server_rest_get_handler_config(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_meas(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_history(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_aggregates(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_status(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_wifi_scan_start(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_wifi_scan_get(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_stream(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_dashboard(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_stats(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_get_handler_metrics(_whm_http_server_ctx_t* ctx, const char* name);
+static err_t _whm_http_server_rest_post_handler_config_begin(_whm_http_server_ctx_t* ctx, const char* http_request, uint16_t http_request_len, int content_len, char* response_uri, uint16_t response_uri_len, uint8_t* post_auto_wnd);
+static err_t _whm_http_server_rest_post_handler_config_recv(_whm_http_server_ctx_t* ctx, struct pbuf* p);
+static err_t _whm_http_server_rest_post_handler_config_finish(_whm_http_server_ctx_t* ctx, char* response_uri, uint16_t response_uri_len);
+static err_t _whm_http_server_rest_post_handler_config_commit(_whm_http_server_ctx_t* ctx);
+static _whm_http_server_ctx_t* _whm_http_server_ctx_alloc(void);
+static _whm_http_server_ctx_t* _whm_http_server_ctx_find_connection(void* connection);
+static _whm_http_server_ctx_t* _whm_http_server_ctx_find_file(struct fs_file* file);
+static void _whm_http_server_ctx_free(_whm_http_server_ctx_t* ctx);
+static void _whm_http_server_ctx_measure(_whm_http_server_ctx_t* ctx);
+static uint32_t _whm_http_server_admit(const struct tcp_pcb* pcb, unsigned route);
+static const whm_rate_limit_budget_t* _whm_http_server_budget(unsigned route);
+static void _whm_http_server_ctx_reject(_whm_http_server_ctx_t* ctx);
+static void _whm_http_server_gen_rejected(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_stream_busy(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_write_refusal(whm_json_writer_t* writer, const char* status, uint32_t retry_after_s, const char* body);
+static const _whm_http_server_route_t* _whm_http_server_metrics_route(unsigned index, const char** method, const char** path);
+static void _whm_http_server_metrics_labels(char* labels, unsigned index);
+static void _whm_http_server_ctx_respond(_whm_http_server_ctx_t* ctx, void (* gen)(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer));
+static unsigned _whm_http_server_render(_whm_http_server_ctx_t* ctx, char* buf, unsigned buflen, unsigned offset);
+static err_t _whm_http_server_async_begin(_whm_http_server_ctx_t* ctx, err_t (* poll)(_whm_http_server_ctx_t* ctx));
+static void _whm_http_server_async_finish(_whm_http_server_ctx_t* ctx);
+static err_t _whm_http_server_async_poll_meas(_whm_http_server_ctx_t* ctx);
+static err_t _whm_http_server_async_poll_meas_sensor(_whm_http_server_ctx_t* ctx);
+static void _whm_http_server_htu31d_finish(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3);
+static err_t _whm_http_server_async_poll_wifi_scan(_whm_http_server_ctx_t* ctx);
+static err_t _whm_http_server_async_poll_stream(_whm_http_server_ctx_t* ctx);
+static void _whm_http_server_gen_body(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_config(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_metrics_prometheus(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_metrics_json(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_meas(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_history(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_aggregates(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_write_aggregate(whm_json_writer_t* writer, const whm_aggregate_stat_t* stat);
+static void _whm_http_server_gen_status(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_wifi_scan(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_dashboard(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_gen_stats(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer);
+static void _whm_http_server_write_meas(whm_json_writer_t* writer, const whm_sampler_reading_t* reading, uint32_t age_ms);
+static void _whm_http_server_write_rule_event(whm_json_writer_t* writer, const whm_rules_event_t* event, uint32_t age_ms);
+static void _whm_http_server_write_status(whm_json_writer_t* writer, bool connected, const char* state);
+static void _whm_http_server_write_wifi_scan(whm_json_writer_t* writer, const whm_ap_station_scan_result_t* results);
+static void _whm_http_server_write_mac(whm_json_writer_t* writer, const uint8_t* bssid, unsigned bssid_len);
+static int _whm_http_server_terminate(char* buf, const whm_json_writer_t* writer);
+static bool _whm_http_server_scan_take(_whm_http_server_ctx_t* ctx);
 static _whm_http_server_rest_get_handler_t* _whm_http_server_rest_get_handler_find(const char* uri);
 static _whm_http_server_rest_post_handler_t* _whm_http_server_rest_post_handler_find(const char* uri);
-static int _whm_http_server_gen_mac(char* buf, unsigned buflen, const uint8_t* bssid, unsigned bssid_len);
 static const char* _whm_http_server_gen_auth(uint8_t auth);
-
-
-static char _whm_http_server_config_buffer[_WHM_HTTP_SERVER_CONFIG_BUFFER_SIZE];
-static char* _whm_http_server_config_pos = _whm_http_server_config_buffer;
-static char _whm_http_server_response_buffer[_WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE];
-static int _whm_http_server_response_code = ERR_OK;
-static int _whm_http_server_current_rest_req = 0;
-static void* _whm_http_server_current_connection = NULL;
-static _whm_http_server_rest_post_handler_t* _whm_http_server_current_post = NULL;
-static struct {
-    bool done;
-    bool success;
-    uint32_t rel_hum;
-    int32_t temperature;
-} _whm_http_server_meas =
-{
-    .done = false,
-    .success = false,
-    .rel_hum = 0,
-    .temperature = 0,
+static void _whm_http_server_conn_touch(void* connection, struct tcp_pcb* pcb);
+static struct tcp_pcb* _whm_http_server_connection_pcb(void* connection);
+static struct tcp_pcb* _whm_http_server_conn_pcb(const _whm_http_server_conn_t* conn);
+static bool _whm_http_server_conn_idle(const _whm_http_server_conn_t* conn, uint64_t now);
+static void _whm_http_server_conn_reclaim(uint64_t now);
+static unsigned _whm_http_server_pcb_count(const struct tcp_pcb* pcb);
+
+
+static _whm_http_server_ctx_t _whm_http_server_ctxs[_WHM_HTTP_SERVER_CTX_MAX] = {0};
+/* POST whose response is about to be opened, httpd_post_finished is
+ * immediately followed by fs_open_custom for the response URI */
+static _whm_http_server_ctx_t* _whm_http_server_ctx_opening = NULL;
+/* httpd's own callbacks, each of its connections' is wrapped */
+static tcp_accept_fn _whm_http_server_httpd_accept = NULL;
+static tcp_recv_fn _whm_http_server_httpd_recv = NULL;
+/* from the headers of the request whose file is about to be opened, fed
+ * by the receive callback just before httpd opens it */
+static struct
+{
+    void* connection;
+    /* the client's, to rate limit by */
+    struct tcp_pcb* pcb;
+    whm_http_request_t headers;
+    uint8_t sections;
+    uint32_t since;
+    uint32_t limit;
+    /* whatever the sampler has unless asked for */
+    uint32_t max_age_ms;
+    bool json;
+} _whm_http_server_request =
+{
+    .connection = NULL,
+    .pcb = NULL,
+    .headers = {0},
+    .sections = _WHM_HTTP_SERVER_SECTION_ALL,
+    .since = 0,
+    .limit = WHM_SAMPLER_HISTORY_LEN,
+    .max_age_ms = UINT32_MAX,
+    .json = false,
 };
+static _whm_http_server_conn_t _whm_http_server_conns[_WHM_HTTP_SERVER_CONN_MAX] = {0};
+static whm_http_server_stats_t _whm_http_server_stats = {0};
+/* 1.1 so the connection can be kept alive after it */
+static const char _whm_http_server_index_not_modified[] =
+    "HTTP/1.1 304 Not Modified\r\n"
+    "ETag: " WHM_WEBROOT_INDEX_GZ_ETAG "\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
 
 
 static tCGI _whm_http_server_cgi_handlers[] =
 {
     {"/", _whm_http_server_cgi_handler_index},
     {"/index.html", _whm_http_server_cgi_handler_index},
+    {_WHM_HTTP_SERVER_DASHBOARD_PATH, _whm_http_server_cgi_handler_dashboard},
+    {_WHM_HTTP_SERVER_METRICS_PATH, _whm_http_server_cgi_handler_metrics},
+    {_WHM_HTTP_SERVER_MEAS_PATH, _whm_http_server_cgi_handler_meas},
+    {_WHM_HTTP_SERVER_HISTORY_PATH, _whm_http_server_cgi_handler_history},
 };
 
 
 static _whm_http_server_rest_get_handler_t _whm_http_server_rest_get_handlers[] =
 {
-    {"/api/config" , _whm_http_server_rest_get_handler_config},
-    {"/api/meas" , _whm_http_server_rest_get_handler_meas},
-    {"/api/status" , _whm_http_server_rest_get_handler_status},
-    {"/api/wifi-scan-start" , _whm_http_server_rest_get_handler_wifi_scan_start},
-    {"/api/wifi-scan-get" , _whm_http_server_rest_get_handler_wifi_scan_get},
+    {"/api/config" , _whm_http_server_rest_get_handler_config, {5, 1000}},
+    {_WHM_HTTP_SERVER_MEAS_PATH , _whm_http_server_rest_get_handler_meas, {10, 200}},
+    {_WHM_HTTP_SERVER_HISTORY_PATH , _whm_http_server_rest_get_handler_history, {5, 1000}},
+    {_WHM_HTTP_SERVER_AGGREGATES_PATH , _whm_http_server_rest_get_handler_aggregates, {10, 500}},
+    {"/api/status" , _whm_http_server_rest_get_handler_status, {10, 200}},
+    /* a scan takes the radio off the network for a few seconds */
+    {"/api/wifi-scan-start" , _whm_http_server_rest_get_handler_wifi_scan_start, {2, 10000}},
+    {"/api/wifi-scan-get" , _whm_http_server_rest_get_handler_wifi_scan_get, {10, 500}},
+    {_WHM_HTTP_SERVER_STREAM_PATH , _whm_http_server_rest_get_handler_stream, {4, 1000}},
+    {_WHM_HTTP_SERVER_DASHBOARD_PATH , _whm_http_server_rest_get_handler_dashboard, {5, 1000}},
+    {_WHM_HTTP_SERVER_STATS_PATH , _whm_http_server_rest_get_handler_stats, {10, 500}},
+    {_WHM_HTTP_SERVER_METRICS_PATH , _whm_http_server_rest_get_handler_metrics, {10, 500}},
 };
 
 
@@ -104,15 +353,43 @@ static _whm_http_server_rest_post_handler_t _whm_http_server_rest_post_handlers[
         .begin_handler = _whm_http_server_rest_post_handler_config_begin,
         .recv_handler = _whm_http_server_rest_post_handler_config_recv,
         .finish_handler = _whm_http_server_rest_post_handler_config_finish,
+        .async_poll = _whm_http_server_rest_post_handler_config_commit,
+        /* each one is a flash write */
+        .budget = {3, 5000},
     },
 };
 
 
+#define _WHM_HTTP_SERVER_ROUTES                                                 \
+    (LWIP_ARRAYSIZE(_whm_http_server_rest_get_handlers)                         \
+     + LWIP_ARRAYSIZE(_whm_http_server_rest_post_handlers))
+
+
+/* GET handlers first, then POST, in table order */
+static _whm_http_server_route_t _whm_http_server_routes[_WHM_HTTP_SERVER_ROUTES] = {0};
+static whm_rate_limit_t _whm_http_server_rate_limit;
+static uint32_t _whm_http_server_tokens[WHM_RATE_LIMIT_CLIENT_MAX * _WHM_HTTP_SERVER_ROUTES] = {0};
+
+
+/* Taken by the first /api/metrics request in flight and shared with any
+ * that overlap it, too big for each context to have a copy. */
+static struct
+{
+    unsigned users;
+    whm_metrics_snapshot_t device;
+    whm_http_server_stats_t http;
+    _whm_http_server_route_t routes[_WHM_HTTP_SERVER_ROUTES];
+} _whm_http_server_metrics = {0};
+
+
 int whm_http_server_init(whm_http_server_t* server)
 {
+    whm_rate_limit_init(&_whm_http_server_rate_limit, _WHM_HTTP_SERVER_ROUTES, _whm_http_server_budget,
+                        _whm_http_server_tokens);
     cyw43_arch_lwip_begin();
     httpd_init();
     http_set_cgi_handlers(_whm_http_server_cgi_handlers, LWIP_ARRAYSIZE(_whm_http_server_cgi_handlers));
+    _whm_http_server_hook();
     cyw43_arch_lwip_end();
     return 0;
 }
@@ -122,21 +399,91 @@ void whm_http_server_deinit(whm_http_server_t* server)
 }
 
 
+void whm_http_server_iterate(whm_http_server_t* server)
+{
+    uint64_t now = time_us_64();
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CTX_MAX; i++)
+    {
+        _whm_http_server_ctx_t* ctx = &_whm_http_server_ctxs[i];
+        if (!ctx->used || !ctx->pending)
+        {
+            continue;
+        }
+        err_t ret = ctx->poll(ctx);
+        if (ERR_INPROGRESS == ret)
+        {
+            if (now < ctx->deadline_us)
+            {
+                continue;
+            }
+            ctx->body = "{\"status\":\"error\",\"error\":\"timed out\"}";
+            ctx->gen = _whm_http_server_gen_body;
+        }
+        _whm_http_server_async_finish(ctx);
+    }
+    cyw43_arch_lwip_begin();
+    _whm_http_server_conn_reclaim(now);
+    cyw43_arch_lwip_end();
+}
+
+
+void whm_http_server_get_stats(whm_http_server_stats_t* stats)
+{
+    uint64_t now = time_us_64();
+    *stats = _whm_http_server_stats;
+    stats->idle = 0;
+    cyw43_arch_lwip_begin();
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CONN_MAX; i++)
+    {
+        if (_whm_http_server_conn_idle(&_whm_http_server_conns[i], now))
+        {
+            stats->idle++;
+        }
+    }
+    cyw43_arch_lwip_end();
+}
+
+
 err_t httpd_post_begin(void* connection, const char* uri, const char* http_request,
         uint16_t http_request_len, int content_len, char* response_uri,
         uint16_t response_uri_len, uint8_t* post_auto_wnd)
 {
-    _whm_http_server_current_rest_req++;
-    err_t ret = ERR_VAL;
-    if (_whm_http_server_current_connection != connection)
+    _whm_http_server_rest_post_handler_t* h = _whm_http_server_rest_post_handler_find(uri);
+    if (NULL == h)
     {
-        _whm_http_server_current_connection = connection;
-        _whm_http_server_rest_post_handler_t* h = _whm_http_server_rest_post_handler_find(uri);
-        _whm_http_server_current_post = h;
-        if (NULL != h)
-        {
-            ret = h->begin_handler(http_request, http_request_len, content_len, response_uri, response_uri_len, post_auto_wnd);
-        }
+        return ERR_VAL;
+    }
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_connection(connection);
+    if (NULL != ctx)
+    {
+        /* left over from an earlier connection that never finished */
+        _whm_http_server_ctx_free(ctx);
+    }
+    ctx = _whm_http_server_ctx_alloc();
+    if (NULL == ctx)
+    {
+        /* every context busy */
+        return ERR_MEM;
+    }
+    ctx->connection = connection;
+    ctx->post = h;
+    /* the headers are gone by the time the response is opened */
+    ctx->cbor = _whm_http_server_accepts_cbor(http_request, http_request_len);
+    unsigned route = LWIP_ARRAYSIZE(_whm_http_server_rest_get_handlers) + (h - _whm_http_server_rest_post_handlers);
+    ctx->route = &_whm_http_server_routes[route];
+    ctx->route->requests++;
+    ctx->retry_after_s = _whm_http_server_admit(_whm_http_server_connection_pcb(connection), route);
+    if (ctx->retry_after_s)
+    {
+        /* the body is read and dropped so the 429 can take the place
+         * of the response */
+        *post_auto_wnd = 1;
+        return ERR_OK;
+    }
+    err_t ret = h->begin_handler(ctx, http_request, http_request_len, content_len, response_uri, response_uri_len, post_auto_wnd);
+    if (ERR_OK != ret)
+    {
+        _whm_http_server_ctx_free(ctx);
     }
     return ret;
 }
@@ -145,13 +492,12 @@ err_t httpd_post_begin(void* connection, const char* uri, const char* http_reque
 err_t httpd_post_receive_data(void *connection, struct pbuf *p)
 {
     err_t ret = ERR_VAL;
-    if (_whm_http_server_current_connection == connection
-        && p && p->len)
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_connection(connection);
+    if (NULL != ctx && p && p->len)
     {
-        _whm_http_server_rest_post_handler_t* h = _whm_http_server_current_post;
-        if (NULL != h)
+        if (!ctx->retry_after_s)
         {
-            h->recv_handler(p);
+            ctx->post->recv_handler(ctx, p);
         }
         ret = ERR_OK;
     }
@@ -162,26 +508,59 @@ err_t httpd_post_receive_data(void *connection, struct pbuf *p)
 
 void httpd_post_finished(void* connection, char* response_uri, uint16_t response_uri_len)
 {
-    if (_whm_http_server_current_connection == connection)
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_connection(connection);
+    if (NULL == ctx)
     {
-        _whm_http_server_rest_post_handler_t* h = _whm_http_server_current_post;
-        if (NULL != h)
-        {
-            h->finish_handler(response_uri, response_uri_len);
-        }
+        return;
+    }
+    if (ctx->retry_after_s)
+    {
+        strncpy(response_uri, ctx->post->path, response_uri_len);
+    }
+    else
+    {
+        ctx->response_code = ctx->post->finish_handler(ctx, response_uri, response_uri_len);
     }
-    _whm_http_server_current_connection = NULL;
-    _whm_http_server_current_post = NULL;
+    _whm_http_server_ctx_opening = ctx;
 }
 
 
 const char* httpd_headers(struct fs_file* file, const char* uri)
 {
+    if (NULL != file && (file->flags & FS_FILE_FLAGS_HEADER_INCLUDED))
+    {
+        return NULL;
+    }
+    _whm_http_server_ctx_t* ctx = NULL == file ? NULL : _whm_http_server_ctx_find_file(file);
+    if (NULL != ctx && _whm_http_server_gen_metrics_prometheus == ctx->gen)
+    {
+        return "Content-Type: text/plain; version=0.0.4\r\n"
+               "Cache-Control: no-cache\r\n";
+    }
+    if (0 == strcmp(uri, _WHM_HTTP_SERVER_STREAM_PATH))
+    {
+        return "Content-Type: text/event-stream\r\n"
+               "Cache-Control: no-cache\r\n";
+    }
+    if (NULL != file && (const char*)whm_webroot_index_gz == file->data)
+    {
+        return "Content-Encoding: gzip\r\n"
+               "ETag: " WHM_WEBROOT_INDEX_GZ_ETAG "\r\n"
+               "Cache-Control: no-cache\r\n"
+               "Vary: Accept-Encoding\r\n";
+    }
     _whm_http_server_rest_get_handler_t* handler = _whm_http_server_rest_get_handler_find(uri);
+    if (NULL != handler && NULL != ctx && ctx->cbor)
+    {
+        return "Content-Type: application/cbor\r\n"
+               "Cache-Control: no-cache\r\n"
+               "Vary: Accept\r\n";
+    }
     if (NULL != handler)
     {
         return "Content-Type: application/json\r\n"
-               "Cache-Control: no-cache\r\n";
+               "Cache-Control: no-cache\r\n"
+               "Vary: Accept\r\n";
     }
     return NULL;
 }
@@ -190,27 +569,95 @@ const char* httpd_headers(struct fs_file* file, const char* uri)
 int fs_open_custom(struct fs_file* file, const char* name)
 {
     int ret = 0;
-    if (0 < _whm_http_server_current_rest_req)
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_opening;
+    _whm_http_server_ctx_opening = NULL;
+    whm_http_request_index_t index = whm_http_request_index(&_whm_http_server_request.headers);
+    uint8_t sections = _whm_http_server_request.sections;
+    uint32_t since = _whm_http_server_request.since;
+    uint32_t limit = _whm_http_server_request.limit;
+    uint32_t max_age_ms = _whm_http_server_request.max_age_ms;
+    void* connection = _whm_http_server_request.connection;
+    struct tcp_pcb* pcb = _whm_http_server_request.pcb;
+    bool json = _whm_http_server_request.json;
+    bool cbor = _whm_http_server_request.headers.accepts_cbor;
+    _whm_http_server_request.connection = NULL;
+    _whm_http_server_request.pcb = NULL;
+    _whm_http_server_request.json = false;
+    whm_http_request_init(&_whm_http_server_request.headers);
+    _whm_http_server_request.sections = _WHM_HTTP_SERVER_SECTION_ALL;
+    _whm_http_server_request.since = 0;
+    _whm_http_server_request.limit = WHM_SAMPLER_HISTORY_LEN;
+    _whm_http_server_request.max_age_ms = UINT32_MAX;
+    if (NULL != ctx && ctx->post == _whm_http_server_rest_post_handler_find(name))
     {
-        _whm_http_server_current_rest_req--;
         printf("POST: %s\n", name);
-        _whm_http_server_rest_post_handler_t* h = _whm_http_server_rest_post_handler_find(name);
-        if (NULL != h)
+        ctx->file = file;
+        if (ctx->retry_after_s)
+        {
+            _whm_http_server_ctx_reject(ctx);
+        }
+        else if (ERR_INPROGRESS == ctx->response_code && NULL != ctx->post->async_poll)
+        {
+            ctx->response_code = _whm_http_server_async_begin(ctx, ctx->post->async_poll);
+        }
+        else
         {
-            file->data = _whm_http_server_response_buffer;
-            file->len = strnlen(_whm_http_server_response_buffer, _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1);
-            file->index = file->len;
-            file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
-            ret = ERR_OK == _whm_http_server_response_code;
-            _whm_http_server_response_code = ERR_OK;
+            _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_body);
         }
+        ret = ERR_OK == ctx->response_code;
     }
     else
     {
-        _whm_http_server_current_rest_req = 0;
+        if (NULL != ctx)
+        {
+            /* POST response went somewhere else */
+            _whm_http_server_ctx_free(ctx);
+        }
         printf("GET: %s\n", name);
+        if (0 == strcmp(name, _WHM_HTTP_SERVER_INDEX_PATH))
+        {
+            /* clients without gzip get the uncompressed built-in copy */
+            return _whm_http_server_webroot_open(file, index);
+        }
         _whm_http_server_rest_get_handler_t* h = _whm_http_server_rest_get_handler_find(name);
-        ret = (NULL != h && ERR_OK == h->handler(file, name));
+        if (NULL == h)
+        {
+            return 0;
+        }
+        ctx = _whm_http_server_ctx_alloc();
+        if (NULL == ctx)
+        {
+            /* every context busy */
+            return 0;
+        }
+        ctx->file = file;
+        /* httpd's state, as for a POST, keeps the connection from being
+         * reclaimed as idle while the response is sent */
+        ctx->connection = connection;
+        ctx->sections = sections;
+        ctx->history_from = since;
+        ctx->history_count = limit;
+        ctx->max_age_ms = max_age_ms;
+        ctx->json = json;
+        ctx->cbor = cbor;
+        unsigned route = h - _whm_http_server_rest_get_handlers;
+        ctx->route = &_whm_http_server_routes[route];
+        ctx->route->requests++;
+        ctx->retry_after_s = _whm_http_server_admit(pcb, route);
+        if (ctx->retry_after_s)
+        {
+            _whm_http_server_ctx_reject(ctx);
+            ret = 1;
+        }
+        else
+        {
+            ret = ERR_OK == h->handler(ctx, name);
+        }
+    }
+    if (!ret)
+    {
+        /* httpd won't close a file it failed to open */
+        _whm_http_server_ctx_free(ctx);
     }
     return ret;
 }
@@ -218,297 +665,1300 @@ int fs_open_custom(struct fs_file* file, const char* name)
 
 void fs_close_custom(struct fs_file *file)
 {
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_file(file);
+    if (NULL != ctx)
+    {
+        /* connection may have gone before an async response completed */
+        _whm_http_server_ctx_free(ctx);
+    }
+}
+
+
+u8_t fs_canread_custom(struct fs_file *file)
+{
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_file(file);
+    return NULL == ctx || !ctx->pending;
 }
 
 
-static _whm_http_server_rest_get_handler_t* _whm_http_server_rest_get_handler_find(const char* uri)
+u8_t fs_wait_read_custom(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg)
 {
-    for (size_t i = 0; i < LWIP_ARRAYSIZE(_whm_http_server_rest_get_handlers); i++)
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_file(file);
+    if (NULL == ctx)
     {
-        if (strcmp(uri, _whm_http_server_rest_get_handlers[i].path) == 0)
+        return 0;
+    }
+    ctx->wait_cb = callback_fn;
+    ctx->wait_arg = callback_arg;
+    return 1;
+}
+
+
+int fs_read_async_custom(struct fs_file *file, char *buffer, int count, fs_wait_cb callback_fn, void *callback_arg)
+{
+    _whm_http_server_ctx_t* ctx = _whm_http_server_ctx_find_file(file);
+    if (NULL == ctx)
+    {
+        return FS_READ_EOF;
+    }
+    if (ctx->stream && ctx->stream_pos >= ctx->len)
+    {
+        /* drained, wait for the next event */
+        ctx->pending = true;
+    }
+    if (ctx->pending)
+    {
+        ctx->wait_cb = callback_fn;
+        ctx->wait_arg = callback_arg;
+        return FS_READ_DELAYED;
+    }
+    if (ctx->stream)
+    {
+        int len = WHM_MIN(count, ctx->len - ctx->stream_pos);
+        memcpy(buffer, &ctx->response_buffer[ctx->stream_pos], len);
+        ctx->stream_pos += len;
+        file->index += len;
+        return len;
+    }
+    int len = _whm_http_server_render(ctx, buffer, WHM_MIN(count, file->len - file->index), file->index);
+    file->index += len;
+    return len;
+}
+
+
+static _whm_http_server_ctx_t* _whm_http_server_ctx_alloc(void)
+{
+    uint64_t now = time_us_64();
+    _whm_http_server_ctx_t* ctx = NULL;
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CTX_MAX; i++)
+    {
+        _whm_http_server_ctx_t* c = &_whm_http_server_ctxs[i];
+        if (!c->used)
         {
-            return &_whm_http_server_rest_get_handlers[i];
+            ctx = c;
+            break;
+        }
+        /* httpd doesn't tell us about a POST whose connection dropped
+         * before it finished, those never get a file, reuse the oldest */
+        if (NULL == c->file && c != _whm_http_server_ctx_opening
+            && c->start_us + _WHM_HTTP_SERVER_CTX_STALE_US <= now
+            && (NULL == ctx || c->start_us < ctx->start_us))
+        {
+            ctx = c;
+        }
+    }
+    if (NULL == ctx)
+    {
+        return NULL;
+    }
+    ctx->used = true;
+    ctx->connection = NULL;
+    ctx->file = NULL;
+    ctx->start_us = now;
+    ctx->route = NULL;
+    ctx->retry_after_s = 0;
+    ctx->post = NULL;
+    ctx->response_code = ERR_OK;
+    ctx->poll = NULL;
+    ctx->pending = false;
+    ctx->wait_cb = NULL;
+    ctx->wait_arg = NULL;
+    ctx->gen = NULL;
+    ctx->body = NULL;
+    ctx->scan = NULL;
+    ctx->len = 0;
+    ctx->stream = false;
+    ctx->stream_pos = 0;
+    ctx->cbor = false;
+    ctx->sensor_wait = false;
+    return ctx;
+}
+
+
+static _whm_http_server_ctx_t* _whm_http_server_ctx_find_connection(void* connection)
+{
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CTX_MAX; i++)
+    {
+        _whm_http_server_ctx_t* ctx = &_whm_http_server_ctxs[i];
+        if (ctx->used && NULL == ctx->file && ctx->connection == connection)
+        {
+            return ctx;
         }
     }
     return NULL;
 }
 
 
-static _whm_http_server_rest_post_handler_t* _whm_http_server_rest_post_handler_find(const char* uri)
+static _whm_http_server_ctx_t* _whm_http_server_ctx_find_file(struct fs_file* file)
 {
-    for (size_t i = 0; i < LWIP_ARRAYSIZE(_whm_http_server_rest_post_handlers); i++)
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CTX_MAX; i++)
     {
-        if (strcmp(uri, _whm_http_server_rest_post_handlers[i].path) == 0)
+        _whm_http_server_ctx_t* ctx = &_whm_http_server_ctxs[i];
+        if (ctx->used && ctx->file == file)
         {
-            return &_whm_http_server_rest_post_handlers[i];
+            return ctx;
         }
     }
     return NULL;
 }
 
 
-#define __WHM_HTTP_SERVER_CGI_HANDLER_DEFAULT(_name, _path)                                                                 \
-static const char* _whm_http_server_cgi_handler_ ## _name (int index, int num_params, char *pc_param[], char *pc_value[])\
-{                                                                                                                           \
-    return _path;                                                                                                           \
+static void _whm_http_server_ctx_free(_whm_http_server_ctx_t* ctx)
+{
+    ctx->used = false;
+    ctx->connection = NULL;
+    ctx->file = NULL;
+    ctx->pending = false;
+    ctx->wait_cb = NULL;
+    ctx->wait_arg = NULL;
+    /* a reading still coming is dropped by the callback */
+    ctx->sensor_wait = false;
+    if (NULL != ctx->scan)
+    {
+        whm_ap_station_scan_free(ctx->scan);
+        ctx->scan = NULL;
+    }
+    if (ctx->metrics)
+    {
+        _whm_http_server_metrics.users--;
+        ctx->metrics = false;
+    }
+    if (ctx->history)
+    {
+        whm_sampler_history_unpin();
+        ctx->history = false;
+    }
 }
-__WHM_HTTP_SERVER_CGI_HANDLER_DEFAULT(index, "/index.html")
 
 
-static err_t _whm_http_server_rest_get_handler_config(struct fs_file *file, const char* name)
+static void _whm_http_server_ctx_measure(_whm_http_server_ctx_t* ctx)
 {
-    const char* config = whm_config_get_string();
-    file->data = config;
-    file->len = strlen(config);
-    file->index = file->len;
-    file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
-    return ERR_OK;
+    if (NULL != ctx->route)
+    {
+        whm_metrics_observe(&ctx->route->latency, time_us_64() - ctx->start_us);
+        ctx->route = NULL;
+    }
+}
+
+
+/* takes a token from the client's bucket for the route, returns 0 if
+ * there was one or else how many seconds until there will be */
+static uint32_t _whm_http_server_admit(const struct tcp_pcb* pcb, unsigned route)
+{
+    if (NULL == pcb)
+    {
+        /* can't tell who is asking */
+        return 0;
+    }
+    return whm_rate_limit_admit(&_whm_http_server_rate_limit, ip4_addr_get_u32(ip_2_ip4(&pcb->remote_ip)), route,
+                                time_us_64());
+}
+
+
+static const whm_rate_limit_budget_t* _whm_http_server_budget(unsigned route)
+{
+    size_t gets = LWIP_ARRAYSIZE(_whm_http_server_rest_get_handlers);
+    return route < gets
+        ? &_whm_http_server_rest_get_handlers[route].budget
+        : &_whm_http_server_rest_post_handlers[route - gets].budget;
+}
+
+
+static void _whm_http_server_ctx_reject(_whm_http_server_ctx_t* ctx)
+{
+    _whm_http_server_stats.rejected++;
+    ctx->route->rejected++;
+    /* left out of the handler times */
+    ctx->route = NULL;
+    ctx->cbor = false;
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_rejected);
+    ctx->file->flags |= FS_FILE_FLAGS_HEADER_INCLUDED;
+}
+
+
+static void _whm_http_server_gen_rejected(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    _whm_http_server_write_refusal(writer, "429 Too Many Requests", ctx->retry_after_s, _WHM_HTTP_SERVER_REJECTED_BODY);
+}
+
+
+static void _whm_http_server_gen_stream_busy(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    _whm_http_server_write_refusal(writer, "503 Service Unavailable", _WHM_HTTP_SERVER_STREAM_BUSY_S,
+                                   _WHM_HTTP_SERVER_STREAM_BUSY_BODY);
 }
 
 
-static int _whm_http_server_meas_get_htu31d(void* userdata)
+/* httpd has neither a 429 nor a 503 of its own, the headers are part
+ * of the file */
+static void _whm_http_server_write_refusal(whm_json_writer_t* writer, const char* status, uint32_t retry_after_s, const char* body)
 {
-    return _whm_http_server_meas.done ? 1 : 0;
+    char head[_WHM_HTTP_SERVER_REJECTED_HEAD_LEN];
+    snprintf(head, sizeof(head),
+        "HTTP/1.1 %s\r\n"
+        "Retry-After: %" PRIu32 "\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %u\r\n"
+        "Cache-Control: no-cache\r\n"
+        "\r\n",
+        status, retry_after_s, (unsigned)strlen(body));
+    whm_json_writer_raw(writer, head);
+    whm_json_writer_raw(writer, body);
 }
 
 
-static int _whm_http_server_measurement_err(void)
+static void _whm_http_server_ctx_respond(_whm_http_server_ctx_t* ctx, void (* gen)(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer))
 {
-    strncpy(
-        _whm_http_server_response_buffer,
-        "{\"error\":\"failed to get measurements\"}",
-        _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1
-    );
-    _whm_http_server_response_buffer[_WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1] = '\0';
-    return strnlen(_whm_http_server_response_buffer, _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1);
+    ctx->gen = gen;
+    /* body is rendered a read at a time through fs_read_async_custom */
+    ctx->file->data = NULL;
+    ctx->file->len = _whm_http_server_render(ctx, NULL, 0, 0);
+    ctx->file->index = 0;
+    ctx->file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
+    _whm_http_server_ctx_measure(ctx);
 }
 
 
-static err_t _whm_http_server_rest_get_handler_meas(struct fs_file *file, const char* name)
+static unsigned _whm_http_server_render(_whm_http_server_ctx_t* ctx, char* buf, unsigned buflen, unsigned offset)
 {
-    int ret = ERR_OK;
-    int len = 0;
-    if (!whm_htu31d_get(NULL, _whm_http_server_meas_finish))
+    whm_json_writer_t writer;
+    if (ctx->cbor)
     {
-        ret = ERR_INPROGRESS;
-        len = _whm_http_server_measurement_err();
+        whm_json_writer_init_cbor(&writer, buf, buflen, offset);
     }
     else
     {
-        whm_main_loop_iterate(NULL, _whm_http_server_meas_get_htu31d, WHM_HTU31D_MAX_CONV_TIME_US);
-        _whm_http_server_meas.done = false;
-        if (_whm_http_server_meas.success)
-        {
-            len = snprintf(
-                _whm_http_server_response_buffer,
-                _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1,
-                "["
-                    "{"
-                        "\"name\":\"relative_humidity\","
-                        "\"value\":%"PRIu32".%03"PRIu32","
-                        "\"unit\":\"%%\""
-                    "},{"
-                        "\"name\":\"temperature\","
-                        "\"value\":%"PRId32".%03"PRIu32","
-                        "\"unit\":\"ºC\""
-                    "}"
-                "]",
-                _whm_http_server_meas.rel_hum / 1000U, _whm_http_server_meas.rel_hum % 1000U,
-                _whm_http_server_meas.temperature / 1000, WHM_ABS32(_whm_http_server_meas.temperature) % 1000U
-            );
-            _whm_http_server_response_buffer[_WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1] = '\0';
-        }
-        else
-        {
-            len = _whm_http_server_measurement_err();
-            ret = ERR_TIMEOUT;
-        }
+        whm_json_writer_init(&writer, buf, buflen, offset);
     }
-    file->data = _whm_http_server_response_buffer;
-    file->len = len;
-    file->index = file->len;
-    file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
-    return ret;
+    ctx->gen(ctx, &writer);
+    return NULL == buf ? whm_json_writer_len(&writer) : whm_json_writer_written(&writer);
 }
 
 
-static err_t _whm_http_server_rest_get_handler_status(struct fs_file *file, const char* name)
+static err_t _whm_http_server_async_begin(_whm_http_server_ctx_t* ctx, err_t (* poll)(_whm_http_server_ctx_t* ctx))
 {
-    bool is_connected = whm_ap_station_get_connected();
-    unsigned len = snprintf(
-        _whm_http_server_response_buffer,
-        _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE,
-        "{\"network\":{\"connected\":%s,\"state\":\"%s\"}}",
-        is_connected ? "true" : "false",
-        whm_ap_station_get_state()
-    );
-    file->data = _whm_http_server_response_buffer;
-    file->len = len;
-    file->index = file->len;
-    file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
+    ctx->poll = poll;
+    ctx->pending = true;
+    ctx->deadline_us = time_us_64() + _WHM_HTTP_SERVER_ASYNC_TIMEOUT_US;
+    ctx->wait_cb = NULL;
+    ctx->wait_arg = NULL;
+    ctx->len = 0;
+    /* body is read later through fs_read_async_custom, its length
+     * isn't known until then so it can't be sent as persistent */
+    ctx->file->data = NULL;
+    ctx->file->len = INT32_MAX;
+    ctx->file->index = 0;
+    ctx->file->flags = 0;
     return ERR_OK;
 }
 
 
-static err_t _whm_http_server_rest_get_handler_wifi_scan_start(struct fs_file *file, const char* name)
+static void _whm_http_server_async_finish(_whm_http_server_ctx_t* ctx)
 {
-    bool started = whm_ap_station_start_scan();
-    unsigned len = snprintf(
-        _whm_http_server_response_buffer,
-        _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE,
-        "{\"status\":\"ok\",\"scan\":\"%s\"}",
-        started ? "started" : "failed"
-    );
-    file->data = _whm_http_server_response_buffer;
-    file->len = len;
-    file->index = file->len;
-    file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
-    return ERR_OK;
+    ctx->pending = false;
+    if (!ctx->stream)
+    {
+        ctx->file->len = _whm_http_server_render(ctx, NULL, 0, 0);
+        _whm_http_server_ctx_measure(ctx);
+    }
+    if (NULL != ctx->wait_cb)
+    {
+        fs_wait_cb cb = ctx->wait_cb;
+        ctx->wait_cb = NULL;
+        cyw43_arch_lwip_begin();
+        cb(ctx->wait_arg);
+        cyw43_arch_lwip_end();
+    }
 }
 
 
-static err_t _whm_http_server_rest_get_handler_wifi_scan_get(struct fs_file *file, const char* name)
+static _whm_http_server_rest_get_handler_t* _whm_http_server_rest_get_handler_find(const char* uri)
 {
-    whm_ap_station_scan_result_t* results = whm_ap_station_get_scan();
-    unsigned len = 0;
-    int ret = ERR_OK;
-    if (NULL == results)
-    {
-        strncpy(
-            _whm_http_server_response_buffer,
-            "{\"status\":\"error\"}",
-            _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE
-        );
-        len = strnlen(_whm_http_server_response_buffer, _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - 1);
-        ret = ERR_INPROGRESS;
-    }
-    else
+    for (size_t i = 0; i < LWIP_ARRAYSIZE(_whm_http_server_rest_get_handlers); i++)
     {
-        strncpy(_whm_http_server_response_buffer, "{\"status\":\"ok\",\"stations\":[", _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE);
-        len = strnlen(_whm_http_server_response_buffer, _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - 1);
-        char* p = &_whm_http_server_response_buffer[len];
-        size_t buf_remain = _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - len;
-        whm_ap_station_scan_result_t* c = results;
-        bool first = true;
-        while (c)
-        {
-            const cyw43_ev_scan_result_t* r = &c->result;
-            char mac_address[18];
-            _whm_http_server_gen_mac(mac_address, sizeof(mac_address), r->bssid, sizeof(r->bssid));
-            const char* auth = _whm_http_server_gen_auth(r->auth_mode);
-            const char* prefix = first ? "" : ",";
-            int written = snprintf(
-                p, buf_remain,
-                "%s{\"ssid\":\"%.*s\",\"mac\":\"%s\",\"channel\":%"PRIu16",\"auth\":\"%s\",\"rssi\":%"PRId16"}",
-                prefix,
-                r->ssid_len, r->ssid, mac_address, r->channel, auth, r->rssi
-            );
-            if (written < 0 || (size_t)written >= buf_remain)
-            {
-                break;
-            }
-            p += written;
-            len += written;
-            buf_remain -= written;
-            first = false;
-            c = c->next;
-        }
-        if (buf_remain >= 3)
+        if (strcmp(uri, _whm_http_server_rest_get_handlers[i].path) == 0)
         {
-            int written = snprintf(p, buf_remain, "]}");
-            if (written > 0)
-            {
-                len += written;
-            }
+            return &_whm_http_server_rest_get_handlers[i];
         }
-        whm_ap_station_scan_results_free();
     }
-
-    file->data = _whm_http_server_response_buffer;
-    file->len = len;
-    file->index = file->len;
-    file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
-    return ret;
+    return NULL;
 }
 
 
-static void _whm_http_server_meas_finish(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3)
+static _whm_http_server_rest_post_handler_t* _whm_http_server_rest_post_handler_find(const char* uri)
 {
-    _whm_http_server_meas.done = true;
-    _whm_http_server_meas.success = success;
-    _whm_http_server_meas.rel_hum = rh_e3;
-    _whm_http_server_meas.temperature = t_e3;
+    for (size_t i = 0; i < LWIP_ARRAYSIZE(_whm_http_server_rest_post_handlers); i++)
+    {
+        if (strcmp(uri, _whm_http_server_rest_post_handlers[i].path) == 0)
+        {
+            return &_whm_http_server_rest_post_handlers[i];
+        }
+    }
+    return NULL;
 }
 
 
-static err_t _whm_http_server_rest_post_handler_config_begin(const char* http_request, uint16_t http_request_len, int content_len, char* response_uri, uint16_t response_uri_len, uint8_t* post_auto_wnd)
-{
-    _whm_http_server_config_buffer[0] = '\0';
-    *post_auto_wnd = 1;
-    return ERR_OK;
+#define __WHM_HTTP_SERVER_CGI_HANDLER_DEFAULT(_name, _path)                                                                 \
+static const char* _whm_http_server_cgi_handler_ ## _name (int index, int num_params, char *pc_param[], char *pc_value[])\
+{                                                                                                                           \
+    return _path;                                                                                                           \
 }
+__WHM_HTTP_SERVER_CGI_HANDLER_DEFAULT(index, _WHM_HTTP_SERVER_INDEX_PATH)
 
 
-static err_t _whm_http_server_rest_post_handler_config_recv(struct pbuf* p)
+static const char* _whm_http_server_cgi_handler_dashboard(int index, int num_params, char *pc_param[], char *pc_value[])
 {
-    int ret = ERR_VAL;
-    int rem_size = _whm_http_server_config_pos - _whm_http_server_config_buffer + _WHM_HTTP_SERVER_CONFIG_BUFFER_SIZE;
-    if (p && p->len < rem_size)
+    static const struct
     {
-        memcpy(_whm_http_server_config_pos, p->payload, p->len);
-        _whm_http_server_config_pos[p->len] = '\0';
-        _whm_http_server_config_pos += p->len;
-        ret = ERR_OK;
+        const char* name;
+        uint8_t section;
+    } sections[] =
+    {
+        {"config", _WHM_HTTP_SERVER_SECTION_CONFIG},
+        {"status", _WHM_HTTP_SERVER_SECTION_STATUS},
+        {"meas", _WHM_HTTP_SERVER_SECTION_MEAS},
+    };
+    uint8_t selected = 0;
+    for (int i = 0; i < num_params; i++)
+    {
+        for (size_t j = 0; j < LWIP_ARRAYSIZE(sections); j++)
+        {
+            if (0 == strcmp(pc_param[i], sections[j].name))
+            {
+                selected |= sections[j].section;
+            }
+        }
     }
-    return ret;
+    /* picked up by fs_open_custom for the path returned */
+    _whm_http_server_request.sections = selected ? selected : _WHM_HTTP_SERVER_SECTION_ALL;
+    return _WHM_HTTP_SERVER_DASHBOARD_PATH;
 }
 
 
-static err_t _whm_http_server_rest_post_handler_config_finish(char* response_uri, uint16_t response_uri_len)
+static const char* _whm_http_server_cgi_handler_metrics(int index, int num_params, char *pc_param[], char *pc_value[])
 {
-    int len = _whm_http_server_config_pos - _whm_http_server_config_buffer;
-    _whm_http_server_config_pos = _whm_http_server_config_buffer;
-    _whm_http_server_response_code = ERR_OK;
-    if (0 == whm_config_set_string(_whm_http_server_config_buffer, len) &&
-        0 == whm_config_save())
-    {
-        strncpy(_whm_http_server_response_buffer, "{\"status\":\"ok\"}", _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1);
-    }
-    else
+    for (int i = 0; i < num_params; i++)
     {
-        strncpy(_whm_http_server_response_buffer, "{\"status\":\"error\",\"error\":\"config invalid\"}", _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1);
-        _whm_http_server_response_code = ERR_ARG;
+        if (0 == strcmp(pc_param[i], "format") && NULL != pc_value[i])
+        {
+            /* Prometheus text unless asked otherwise */
+            _whm_http_server_request.json = 0 == strcmp(pc_value[i], "json");
+        }
     }
-    _whm_http_server_response_buffer[_WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE-1] = '\0';
-    strncpy(response_uri, "/api/config", response_uri_len);
-    return _whm_http_server_response_code;
+    return _WHM_HTTP_SERVER_METRICS_PATH;
 }
 
 
-static int _whm_http_server_gen_mac(char* buf, unsigned buflen, const uint8_t* bssid, unsigned bssid_len)
+static const char* _whm_http_server_cgi_handler_meas(int index, int num_params, char *pc_param[], char *pc_value[])
 {
-    int len = 0;
-    char* p = buf;
-    for (unsigned i = 0; i < bssid_len; i++)
+    for (int i = 0; i < num_params; i++)
     {
-        if (buf + buflen <= p)
+        if (0 == strcmp(pc_param[i], "max_age_ms") && NULL != pc_value[i])
         {
-            break;
+            _whm_http_server_request.max_age_ms = strtoul(pc_value[i], NULL, 10);
         }
-        len += snprintf(p, buf+buflen - p, "%02"PRIx8":", bssid[i]);
-        p = buf + len;
     }
-    buf[--len] = '\0';
-    return len;
+    return _WHM_HTTP_SERVER_MEAS_PATH;
 }
 
 
-static const char* _whm_http_server_gen_auth(uint8_t auth)
+static const char* _whm_http_server_cgi_handler_history(int index, int num_params, char *pc_param[], char *pc_value[])
 {
-    /* Unfortunately these auths aren't CYW43_AUTH_, but made up of some
-     * different values
-        OPEN  = 0x0
-        WEP  |= 0x1
+    for (int i = 0; i < num_params; i++)
+    {
+        if (NULL == pc_value[i])
+        {
+            continue;
+        }
+        if (0 == strcmp(pc_param[i], "since"))
+        {
+            _whm_http_server_request.since = strtoul(pc_value[i], NULL, 10);
+        }
+        else if (0 == strcmp(pc_param[i], "limit"))
+        {
+            uint32_t limit = strtoul(pc_value[i], NULL, 10);
+            _whm_http_server_request.limit = WHM_MIN(limit, WHM_SAMPLER_HISTORY_LEN);
+        }
+    }
+    return _WHM_HTTP_SERVER_HISTORY_PATH;
+}
+
+
+/* httpd hands a GET's headers to nothing, and fs_open_custom not even
+ * the connection, so the receive callback of each connection httpd
+ * accepts is wrapped to see the request first. httpd opens the file from
+ * within its receive callback, straight after. */
+static void _whm_http_server_hook(void)
+{
+    for (struct tcp_pcb_listen* lpcb = tcp_listen_pcbs.listen_pcbs; NULL != lpcb; lpcb = lpcb->next)
+    {
+        if (HTTPD_SERVER_PORT == lpcb->local_port)
+        {
+            _whm_http_server_httpd_accept = lpcb->accept;
+            tcp_accept((struct tcp_pcb*)lpcb, _whm_http_server_accept);
+            return;
+        }
+    }
+    printf("Unable to find the httpd listener.\n");
+}
+
+
+static err_t _whm_http_server_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    err_t ret = _whm_http_server_httpd_accept(arg, pcb, err);
+    if (ERR_OK == ret && NULL != pcb)
+    {
+        /* the same for every connection */
+        _whm_http_server_httpd_recv = pcb->recv;
+        tcp_recv(pcb, _whm_http_server_recv);
+    }
+    return ret;
+}
+
+
+static err_t _whm_http_server_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    if (NULL != p && ERR_OK == err)
+    {
+        _whm_http_server_request_feed(arg, pcb, p);
+    }
+    return _whm_http_server_httpd_recv(arg, pcb, p, err);
+}
+
+
+/* arg is httpd's state, the connection its other callbacks are given */
+static void _whm_http_server_request_feed(void* connection, struct tcp_pcb* pcb, const struct pbuf* p)
+{
+    if (connection != _whm_http_server_request.connection)
+    {
+        /* anything left is another connection's unfinished request */
+        whm_http_request_init(&_whm_http_server_request.headers);
+        _whm_http_server_request.connection = connection;
+    }
+    _whm_http_server_request.pcb = pcb;
+    for (const struct pbuf* q = p; NULL != q; q = q->next)
+    {
+        if (whm_http_request_feed(&_whm_http_server_request.headers, q->payload, q->len, WHM_WEBROOT_INDEX_GZ_ETAG))
+        {
+            _whm_http_server_conn_touch(connection, pcb);
+        }
+    }
+}
+
+
+static int _whm_http_server_webroot_open(struct fs_file* file, whm_http_request_index_t index)
+{
+    if (WHM_HTTP_REQUEST_INDEX_PLAIN == index)
+    {
+        return 0;
+    }
+    if (WHM_HTTP_REQUEST_INDEX_NOT_MODIFIED == index)
+    {
+        file->data = _whm_http_server_index_not_modified;
+        file->len = sizeof(_whm_http_server_index_not_modified) - 1;
+        file->flags = FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT;
+    }
+    else
+    {
+        file->data = (const char*)whm_webroot_index_gz;
+        file->len = WHM_WEBROOT_INDEX_GZ_LEN;
+        file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
+    }
+    file->index = file->len;
+    return 1;
+}
+
+
+static bool _whm_http_server_accepts_cbor(const char* http_request, unsigned http_request_len)
+{
+    unsigned len = 0;
+    const char* value = whm_http_request_header_find(http_request, http_request_len, "Accept", &len);
+    return NULL != value && whm_http_request_header_contains(value, len, "application/cbor");
+}
+
+
+static err_t _whm_http_server_rest_get_handler_config(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    memcpy(&ctx->config, &whm_conf, sizeof(whm_config_t));
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_config);
+    return ERR_OK;
+}
+
+
+static void _whm_http_server_gen_config(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    whm_config_write(writer, &ctx->config);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_meas(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    bool have = whm_sampler_get(&ctx->reading);
+    if (have)
+    {
+        ctx->age_ms = whm_sampler_get_age_ms(&ctx->reading);
+        if (ctx->age_ms <= ctx->max_age_ms)
+        {
+            _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_meas);
+            return ERR_OK;
+        }
+    }
+    /* Older than asked for, so the sensor is asked directly. It joins a
+     * reading under way or gives its last if that is recent enough. */
+    if (UINT32_MAX != ctx->max_age_ms
+        && whm_htu31d_get_max_age(ctx->max_age_ms, ctx, _whm_http_server_htu31d_finish))
+    {
+        ctx->sensor_wait = true;
+        ctx->sensor_failed = false;
+        return _whm_http_server_async_begin(ctx, _whm_http_server_async_poll_meas_sensor);
+    }
+    if (have)
+    {
+        /* sensor busy, the sampler's is the freshest there is */
+        _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_meas);
+        return ERR_OK;
+    }
+    /* nothing sampled yet, respond once the first reading is in */
+    return _whm_http_server_async_begin(ctx, _whm_http_server_async_poll_meas);
+}
+
+
+static err_t _whm_http_server_async_poll_meas(_whm_http_server_ctx_t* ctx)
+{
+    if (!whm_sampler_get(&ctx->reading))
+    {
+        return ERR_INPROGRESS;
+    }
+    ctx->age_ms = whm_sampler_get_age_ms(&ctx->reading);
+    ctx->gen = _whm_http_server_gen_meas;
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_async_poll_meas_sensor(_whm_http_server_ctx_t* ctx)
+{
+    if (ctx->sensor_wait)
+    {
+        return ERR_INPROGRESS;
+    }
+    if (ctx->sensor_failed)
+    {
+        /* the sampler's reading then, or wait for one as without max_age_ms */
+        return _whm_http_server_async_poll_meas(ctx);
+    }
+    ctx->gen = _whm_http_server_gen_meas;
+    return ERR_OK;
+}
+
+
+/* unfiltered, straight from the sensor, so with no seq of the sampler's */
+static void _whm_http_server_htu31d_finish(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3)
+{
+    _whm_http_server_ctx_t* ctx = userdata;
+    if (!ctx->used || !ctx->sensor_wait)
+    {
+        /* the request went meanwhile */
+        return;
+    }
+    ctx->sensor_wait = false;
+    if (!success)
+    {
+        ctx->sensor_failed = true;
+        return;
+    }
+    ctx->reading.rh_e3 = rh_e3;
+    ctx->reading.t_e3 = t_e3;
+    ctx->age_ms = whm_htu31d_get_age_ms();
+}
+
+
+int whm_http_server_gen_meas(char* buf, unsigned buflen, const whm_sampler_reading_t* reading)
+{
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, buf, buflen - 1, 0);
+    _whm_http_server_write_meas(&writer, reading, whm_sampler_get_age_ms(reading));
+    return _whm_http_server_terminate(buf, &writer);
+}
+
+
+static void _whm_http_server_gen_meas(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    _whm_http_server_write_meas(writer, &ctx->reading, ctx->age_ms);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_history(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    /* since is the newest the client already has, anything older than
+     * what is still held is simply skipped */
+    uint32_t since = ctx->history_from;
+    uint32_t limit = ctx->history_count;
+    uint32_t first = whm_sampler_history_first();
+    ctx->history_last = whm_sampler_history_last();
+    ctx->history_from = since < first ? first : since + 1;
+    ctx->history_count = 0;
+    if (0 != first && since < ctx->history_last && limit)
+    {
+        ctx->history_count = WHM_MIN(ctx->history_last - ctx->history_from + 1, limit);
+        whm_sampler_history_pin(ctx->history_from);
+        ctx->history = true;
+    }
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_history);
+    return ERR_OK;
+}
+
+
+static void _whm_http_server_gen_history(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    uint32_t end = ctx->history_from + ctx->history_count;
+    whm_json_writer_object_begin(writer);
+    /* a client holding a since above this is talking to a device that
+     * has restarted and should start again from 0 */
+    whm_json_writer_key(writer, "last");
+    whm_json_writer_uint(writer, ctx->history_last);
+    whm_json_writer_key(writer, "more");
+    whm_json_writer_bool(writer, ctx->history_count && end <= ctx->history_last);
+    whm_json_writer_key(writer, "samples");
+    whm_json_writer_array_begin(writer);
+    for (uint32_t seq = ctx->history_from; seq < end; seq++)
+    {
+        whm_sampler_reading_t reading;
+        if (!whm_sampler_history_get(seq, &reading))
+        {
+            /* pinned, so only if the sampler lost track */
+            continue;
+        }
+        whm_json_writer_object_begin(writer);
+        whm_json_writer_key(writer, "seq");
+        whm_json_writer_uint(writer, seq);
+        /* against when the request came in, so every render agrees */
+        whm_json_writer_key(writer, "age_ms");
+        whm_json_writer_uint(writer, (ctx->start_us - reading.time_us) / 1000U);
+        whm_json_writer_key(writer, "relative_humidity");
+        whm_json_writer_fixed(writer, reading.rh_e3, 3);
+        whm_json_writer_key(writer, "temperature");
+        whm_json_writer_fixed(writer, reading.t_e3, 3);
+        whm_json_writer_object_end(writer);
+    }
+    whm_json_writer_array_end(writer);
+    whm_json_writer_object_end(writer);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_aggregates(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    whm_aggregate_get(ctx->start_us, ctx->aggregates);
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_aggregates);
+    return ERR_OK;
+}
+
+
+static void _whm_http_server_gen_aggregates(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    whm_json_writer_array_begin(writer);
+    for (unsigned i = 0; i < WHM_AGGREGATE_WINDOWS; i++)
+    {
+        const whm_aggregate_window_t* window = &ctx->aggregates[i];
+        whm_json_writer_object_begin(writer);
+        whm_json_writer_key(writer, "window_s");
+        whm_json_writer_uint(writer, window->window_s);
+        whm_json_writer_key(writer, "count");
+        whm_json_writer_uint(writer, window->count);
+        if (window->count)
+        {
+            whm_json_writer_key(writer, "relative_humidity");
+            _whm_http_server_write_aggregate(writer, &window->rh);
+            whm_json_writer_key(writer, "temperature");
+            _whm_http_server_write_aggregate(writer, &window->t);
+        }
+        whm_json_writer_object_end(writer);
+    }
+    whm_json_writer_array_end(writer);
+}
+
+
+static void _whm_http_server_write_aggregate(whm_json_writer_t* writer, const whm_aggregate_stat_t* stat)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "min");
+    whm_json_writer_fixed(writer, stat->min_e3, 3);
+    whm_json_writer_key(writer, "max");
+    whm_json_writer_fixed(writer, stat->max_e3, 3);
+    whm_json_writer_key(writer, "mean");
+    whm_json_writer_fixed(writer, stat->mean_e3, 3);
+    whm_json_writer_object_end(writer);
+}
+
+
+static void _whm_http_server_write_rule_event(whm_json_writer_t* writer, const whm_rules_event_t* event, uint32_t age_ms)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "seq");
+    whm_json_writer_uint(writer, event->seq);
+    whm_json_writer_key(writer, "rule");
+    whm_json_writer_uint(writer, event->rule);
+    whm_json_writer_key(writer, "channel");
+    whm_json_writer_string(writer, whm_config_channel_name(event->channel));
+    whm_json_writer_key(writer, "kind");
+    whm_json_writer_string(writer, whm_rules_kind_name(event->kind));
+    whm_json_writer_key(writer, "value");
+    whm_json_writer_fixed(writer, event->value_e3, 3);
+    whm_json_writer_key(writer, "age_ms");
+    whm_json_writer_uint(writer, age_ms);
+    whm_json_writer_object_end(writer);
+}
+
+
+static void _whm_http_server_write_meas(whm_json_writer_t* writer, const whm_sampler_reading_t* reading, uint32_t age_ms)
+{
+    whm_json_writer_array_begin(writer);
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "name");
+    whm_json_writer_string(writer, "relative_humidity");
+    whm_json_writer_key(writer, "value");
+    whm_json_writer_fixed(writer, reading->rh_e3, 3);
+    whm_json_writer_key(writer, "unit");
+    whm_json_writer_string(writer, "%");
+    whm_json_writer_key(writer, "age_ms");
+    whm_json_writer_uint(writer, age_ms);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "name");
+    whm_json_writer_string(writer, "temperature");
+    whm_json_writer_key(writer, "value");
+    whm_json_writer_fixed(writer, reading->t_e3, 3);
+    whm_json_writer_key(writer, "unit");
+    whm_json_writer_string(writer, "ºC");
+    whm_json_writer_key(writer, "age_ms");
+    whm_json_writer_uint(writer, age_ms);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_array_end(writer);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_status(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    ctx->connected = whm_ap_station_get_connected();
+    ctx->state = whm_ap_station_get_state();
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_status);
+    return ERR_OK;
+}
+
+
+int whm_http_server_gen_status(char* buf, unsigned buflen)
+{
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, buf, buflen - 1, 0);
+    _whm_http_server_write_status(&writer, whm_ap_station_get_connected(), whm_ap_station_get_state());
+    return _whm_http_server_terminate(buf, &writer);
+}
+
+
+static void _whm_http_server_gen_status(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    _whm_http_server_write_status(writer, ctx->connected, ctx->state);
+}
+
+
+static void _whm_http_server_write_status(whm_json_writer_t* writer, bool connected, const char* state)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "network");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "connected");
+    whm_json_writer_bool(writer, connected);
+    whm_json_writer_key(writer, "state");
+    whm_json_writer_string(writer, state);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_object_end(writer);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_wifi_scan_start(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    ctx->body = whm_ap_station_start_scan()
+        ? "{\"status\":\"ok\",\"scan\":\"started\"}"
+        : "{\"status\":\"ok\",\"scan\":\"failed\"}";
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_body);
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_rest_get_handler_wifi_scan_get(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    if (whm_ap_station_scanning())
+    {
+        /* respond once the scan has finished rather than have the
+         * client guess how long it takes */
+        return _whm_http_server_async_begin(ctx, _whm_http_server_async_poll_wifi_scan);
+    }
+    if (!_whm_http_server_scan_take(ctx))
+    {
+        _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_body);
+        return ERR_INPROGRESS;
+    }
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_wifi_scan);
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_async_poll_wifi_scan(_whm_http_server_ctx_t* ctx)
+{
+    if (whm_ap_station_scanning())
+    {
+        return ERR_INPROGRESS;
+    }
+    /* already committed to the response, errors go in the body */
+    ctx->gen = _whm_http_server_scan_take(ctx)
+        ? _whm_http_server_gen_wifi_scan
+        : _whm_http_server_gen_body;
+    return ERR_OK;
+}
+
+
+/* the results are owned by the context until it is freed, so every
+ * render of the body sees the same list */
+static bool _whm_http_server_scan_take(_whm_http_server_ctx_t* ctx)
+{
+    ctx->scan = whm_ap_station_take_scan();
+    if (NULL == ctx->scan)
+    {
+        ctx->body = "{\"status\":\"error\"}";
+        return false;
+    }
+    return true;
+}
+
+
+err_t whm_http_server_gen_wifi_scan(char* buf, unsigned buflen, const whm_ap_station_scan_result_t* results, unsigned* len)
+{
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, buf, buflen - 1, 0);
+    err_t ret = ERR_OK;
+    if (NULL == results)
+    {
+        whm_json_writer_raw(&writer, "{\"status\":\"error\"}");
+        ret = ERR_INPROGRESS;
+    }
+    else
+    {
+        _whm_http_server_write_wifi_scan(&writer, results);
+    }
+    *len = _whm_http_server_terminate(buf, &writer);
+    return ret;
+}
+
+
+static void _whm_http_server_gen_wifi_scan(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    _whm_http_server_write_wifi_scan(writer, ctx->scan);
+}
+
+
+static void _whm_http_server_write_wifi_scan(whm_json_writer_t* writer, const whm_ap_station_scan_result_t* results)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "status");
+    whm_json_writer_string(writer, "ok");
+    whm_json_writer_key(writer, "stations");
+    whm_json_writer_array_begin(writer);
+    for (const whm_ap_station_scan_result_t* c = results; c && !whm_json_writer_full(writer); c = c->next)
+    {
+        const cyw43_ev_scan_result_t* r = &c->result;
+        whm_json_writer_object_begin(writer);
+        whm_json_writer_key(writer, "ssid");
+        whm_json_writer_string_n(writer, (const char*)r->ssid, r->ssid_len);
+        whm_json_writer_key(writer, "mac");
+        _whm_http_server_write_mac(writer, r->bssid, sizeof(r->bssid));
+        whm_json_writer_key(writer, "channel");
+        whm_json_writer_uint(writer, r->channel);
+        whm_json_writer_key(writer, "auth");
+        whm_json_writer_string(writer, _whm_http_server_gen_auth(r->auth_mode));
+        whm_json_writer_key(writer, "rssi");
+        whm_json_writer_int(writer, r->rssi);
+        whm_json_writer_object_end(writer);
+    }
+    whm_json_writer_array_end(writer);
+    whm_json_writer_object_end(writer);
+}
+
+
+static void _whm_http_server_write_mac(whm_json_writer_t* writer, const uint8_t* bssid, unsigned bssid_len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char mac[3 * 6];
+    unsigned len = 0;
+    for (unsigned i = 0; i < bssid_len && len + 3 <= sizeof(mac); i++)
+    {
+        mac[len++] = hex[bssid[i] >> 4];
+        mac[len++] = hex[bssid[i] & 0xF];
+        mac[len++] = ':';
+    }
+    whm_json_writer_string_n(writer, mac, len ? len - 1 : 0);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_stream(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    unsigned streams = 0;
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CTX_MAX; i++)
+    {
+        streams += _whm_http_server_ctxs[i].used && _whm_http_server_ctxs[i].stream;
+    }
+    if (streams >= _WHM_HTTP_SERVER_STREAM_MAX)
+    {
+        /* rather than the 404 failing the open would give */
+        ctx->cbor = false;
+        _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_stream_busy);
+        ctx->file->flags |= FS_FILE_FLAGS_HEADER_INCLUDED;
+        return ERR_OK;
+    }
+    _whm_http_server_async_begin(ctx, _whm_http_server_async_poll_stream);
+    ctx->stream = true;
+    /* events are text whatever was asked for */
+    ctx->cbor = false;
+    ctx->stream_seq = 0;
+    /* only events from now on */
+    ctx->stream_event = whm_rules_event_last();
+    ctx->stream_state = NULL;
+    ctx->stream_heartbeat_us = 0;
+    /* only ends when the client goes, so no length */
+    ctx->deadline_us = UINT64_MAX;
+    ctx->file->len = INT32_MAX;
+    memcpy(ctx->response_buffer, _WHM_HTTP_SERVER_STREAM_RETRY, sizeof(_WHM_HTTP_SERVER_STREAM_RETRY) - 1);
+    ctx->len = sizeof(_WHM_HTTP_SERVER_STREAM_RETRY) - 1;
+    ctx->stream_pos = 0;
+    ctx->pending = false;
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_async_poll_stream(_whm_http_server_ctx_t* ctx)
+{
+    uint64_t now = time_us_64();
+    whm_json_writer_t writer;
+    unsigned len = 0;
+    const char* state = whm_ap_station_get_state();
+    if (state != ctx->stream_state)
+    {
+        whm_json_writer_init(&writer, &ctx->response_buffer[len], _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - len, 0);
+        whm_json_writer_raw(&writer, "event: status\ndata: ");
+        _whm_http_server_write_status(&writer, whm_ap_station_get_connected(), state);
+        whm_json_writer_raw(&writer, "\n\n");
+        len += whm_json_writer_written(&writer);
+        ctx->stream_state = state;
+    }
+    whm_sampler_reading_t reading;
+    if (whm_sampler_get_reported(&reading) && reading.seq != ctx->stream_seq)
+    {
+        whm_json_writer_init(&writer, &ctx->response_buffer[len], _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - len, 0);
+        whm_json_writer_raw(&writer, "event: meas\ndata: ");
+        _whm_http_server_write_meas(&writer, &reading, whm_sampler_get_age_ms(&reading));
+        whm_json_writer_raw(&writer, "\n\n");
+        len += whm_json_writer_written(&writer);
+        ctx->stream_seq = reading.seq;
+    }
+    whm_rules_event_t event;
+    while (ctx->stream_event < whm_rules_event_last() && len < _WHM_HTTP_SERVER_STREAM_EVENT_ROOM)
+    {
+        /* those overwritten before being sent are skipped */
+        if (whm_rules_event_get(++ctx->stream_event, &event))
+        {
+            whm_json_writer_init(&writer, &ctx->response_buffer[len], _WHM_HTTP_SERVER_RESPONSE_BUFFER_SIZE - len, 0);
+            whm_json_writer_raw(&writer, "event: rule\ndata: ");
+            _whm_http_server_write_rule_event(&writer, &event, (now - event.time_us) / 1000U);
+            whm_json_writer_raw(&writer, "\n\n");
+            len += whm_json_writer_written(&writer);
+        }
+    }
+    if (0 == len)
+    {
+        if (now < ctx->stream_heartbeat_us)
+        {
+            return ERR_INPROGRESS;
+        }
+        /* comment line, ignored by EventSource but keeps httpd from
+         * timing out the connection */
+        memcpy(ctx->response_buffer, ":\n\n", 3);
+        len = 3;
+    }
+    ctx->stream_heartbeat_us = now + _WHM_HTTP_SERVER_STREAM_HEARTBEAT_US;
+    ctx->len = len;
+    ctx->stream_pos = 0;
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_rest_get_handler_dashboard(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    if (ctx->sections & _WHM_HTTP_SERVER_SECTION_CONFIG)
+    {
+        memcpy(&ctx->config, &whm_conf, sizeof(whm_config_t));
+    }
+    ctx->connected = whm_ap_station_get_connected();
+    ctx->state = whm_ap_station_get_state();
+    ctx->have_reading = whm_sampler_get(&ctx->reading);
+    if (ctx->have_reading)
+    {
+        ctx->age_ms = whm_sampler_get_age_ms(&ctx->reading);
+    }
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_dashboard);
+    return ERR_OK;
+}
+
+
+static void _whm_http_server_gen_dashboard(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    whm_json_writer_object_begin(writer);
+    if (ctx->sections & _WHM_HTTP_SERVER_SECTION_CONFIG)
+    {
+        whm_json_writer_key(writer, "config");
+        whm_config_write(writer, &ctx->config);
+    }
+    if (ctx->sections & _WHM_HTTP_SERVER_SECTION_STATUS)
+    {
+        whm_json_writer_key(writer, "status");
+        _whm_http_server_write_status(writer, ctx->connected, ctx->state);
+    }
+    if (ctx->sections & _WHM_HTTP_SERVER_SECTION_MEAS)
+    {
+        whm_json_writer_key(writer, "meas");
+        if (ctx->have_reading)
+        {
+            _whm_http_server_write_meas(writer, &ctx->reading, ctx->age_ms);
+        }
+        else
+        {
+            whm_json_writer_null(writer);
+        }
+    }
+    whm_json_writer_object_end(writer);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_stats(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    whm_http_server_get_stats(&ctx->stats);
+    _whm_http_server_ctx_respond(ctx, _whm_http_server_gen_stats);
+    return ERR_OK;
+}
+
+
+static void _whm_http_server_gen_stats(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "requests");
+    whm_json_writer_uint(writer, ctx->stats.requests);
+    whm_json_writer_key(writer, "reused");
+    whm_json_writer_uint(writer, ctx->stats.reused);
+    whm_json_writer_key(writer, "reclaimed");
+    whm_json_writer_uint(writer, ctx->stats.reclaimed);
+    whm_json_writer_key(writer, "idle");
+    whm_json_writer_uint(writer, ctx->stats.idle);
+    whm_json_writer_key(writer, "rejected");
+    whm_json_writer_uint(writer, ctx->stats.rejected);
+    whm_json_writer_object_end(writer);
+}
+
+
+static err_t _whm_http_server_rest_get_handler_metrics(_whm_http_server_ctx_t* ctx, const char* name)
+{
+    if (0 == _whm_http_server_metrics.users)
+    {
+        whm_metrics_snapshot(&_whm_http_server_metrics.device);
+        whm_http_server_get_stats(&_whm_http_server_metrics.http);
+        memcpy(_whm_http_server_metrics.routes, _whm_http_server_routes, sizeof(_whm_http_server_routes));
+    }
+    _whm_http_server_metrics.users++;
+    ctx->metrics = true;
+    /* Prometheus only reads text, CBOR is of the JSON layout */
+    bool json = ctx->json || ctx->cbor;
+    _whm_http_server_ctx_respond(ctx, json ? _whm_http_server_gen_metrics_json : _whm_http_server_gen_metrics_prometheus);
+    return ERR_OK;
+}
+
+
+static void _whm_http_server_gen_metrics_prometheus(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    char labels[_WHM_HTTP_SERVER_METRICS_LABELS_LEN];
+    whm_metrics_write_prometheus_type(writer, "whm_http_requests_total", "counter");
+    for (unsigned i = 0; i < _WHM_HTTP_SERVER_ROUTES; i++)
+    {
+        _whm_http_server_metrics_labels(labels, i);
+        whm_metrics_write_prometheus_value(writer, "whm_http_requests_total", labels, _whm_http_server_metrics.routes[i].requests);
+    }
+    whm_metrics_write_prometheus_type(writer, "whm_http_handler_seconds", "histogram");
+    for (unsigned i = 0; i < _WHM_HTTP_SERVER_ROUTES; i++)
+    {
+        _whm_http_server_metrics_labels(labels, i);
+        whm_metrics_write_prometheus_histogram(writer, "whm_http_handler_seconds", labels, &_whm_http_server_metrics.routes[i].latency);
+    }
+    const whm_http_server_stats_t* http = &_whm_http_server_metrics.http;
+    whm_metrics_write_prometheus_type(writer, "whm_http_connections_reused_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_http_connections_reused_total", NULL, http->reused);
+    whm_metrics_write_prometheus_type(writer, "whm_http_connections_reclaimed_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_http_connections_reclaimed_total", NULL, http->reclaimed);
+    whm_metrics_write_prometheus_type(writer, "whm_http_connections_idle", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_http_connections_idle", NULL, http->idle);
+    whm_metrics_write_prometheus_type(writer, "whm_http_rejected_total", "counter");
+    for (unsigned i = 0; i < _WHM_HTTP_SERVER_ROUTES; i++)
+    {
+        _whm_http_server_metrics_labels(labels, i);
+        whm_metrics_write_prometheus_value(writer, "whm_http_rejected_total", labels, _whm_http_server_metrics.routes[i].rejected);
+    }
+    whm_metrics_write_prometheus(writer, &_whm_http_server_metrics.device);
+}
+
+
+static void _whm_http_server_gen_metrics_json(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "routes");
+    whm_json_writer_array_begin(writer);
+    for (unsigned i = 0; i < _WHM_HTTP_SERVER_ROUTES; i++)
+    {
+        const char* method = NULL;
+        const char* path = NULL;
+        const _whm_http_server_route_t* route = _whm_http_server_metrics_route(i, &method, &path);
+        whm_json_writer_object_begin(writer);
+        whm_json_writer_key(writer, "method");
+        whm_json_writer_string(writer, method);
+        whm_json_writer_key(writer, "route");
+        whm_json_writer_string(writer, path);
+        whm_json_writer_key(writer, "requests");
+        whm_json_writer_uint(writer, route->requests);
+        whm_json_writer_key(writer, "rejected");
+        whm_json_writer_uint(writer, route->rejected);
+        whm_json_writer_key(writer, "latency");
+        whm_metrics_write_json_histogram(writer, &route->latency);
+        whm_json_writer_object_end(writer);
+    }
+    whm_json_writer_array_end(writer);
+    const whm_http_server_stats_t* http = &_whm_http_server_metrics.http;
+    whm_json_writer_key(writer, "http");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "requests");
+    whm_json_writer_uint(writer, http->requests);
+    whm_json_writer_key(writer, "reused");
+    whm_json_writer_uint(writer, http->reused);
+    whm_json_writer_key(writer, "reclaimed");
+    whm_json_writer_uint(writer, http->reclaimed);
+    whm_json_writer_key(writer, "idle");
+    whm_json_writer_uint(writer, http->idle);
+    whm_json_writer_key(writer, "rejected");
+    whm_json_writer_uint(writer, http->rejected);
+    whm_json_writer_object_end(writer);
+    whm_metrics_write_json(writer, &_whm_http_server_metrics.device);
+    whm_json_writer_object_end(writer);
+}
+
+
+static const _whm_http_server_route_t* _whm_http_server_metrics_route(unsigned index, const char** method, const char** path)
+{
+    /* GET routes first, then POST */
+    size_t gets = LWIP_ARRAYSIZE(_whm_http_server_rest_get_handlers);
+    if (index < gets)
+    {
+        *method = "GET";
+        *path = _whm_http_server_rest_get_handlers[index].path;
+    }
+    else
+    {
+        *method = "POST";
+        *path = _whm_http_server_rest_post_handlers[index - gets].path;
+    }
+    return &_whm_http_server_metrics.routes[index];
+}
+
+
+static void _whm_http_server_metrics_labels(char* labels, unsigned index)
+{
+    const char* method = NULL;
+    const char* path = NULL;
+    _whm_http_server_metrics_route(index, &method, &path);
+    snprintf(labels, _WHM_HTTP_SERVER_METRICS_LABELS_LEN, "method=\"%s\",route=\"%s\"", method, path);
+}
+
+
+static void _whm_http_server_gen_body(_whm_http_server_ctx_t* ctx, whm_json_writer_t* writer)
+{
+    if (NULL != ctx->body)
+    {
+        whm_json_writer_value(writer, ctx->body);
+    }
+}
+
+
+static int _whm_http_server_terminate(char* buf, const whm_json_writer_t* writer)
+{
+    unsigned len = whm_json_writer_written(writer);
+    buf[len] = '\0';
+    return len;
+}
+
+
+static err_t _whm_http_server_rest_post_handler_config_begin(_whm_http_server_ctx_t* ctx, const char* http_request, uint16_t http_request_len, int content_len, char* response_uri, uint16_t response_uri_len, uint8_t* post_auto_wnd)
+{
+    whm_config_parser_init(&ctx->config_parser);
+    *post_auto_wnd = 1;
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_rest_post_handler_config_recv(_whm_http_server_ctx_t* ctx, struct pbuf* p)
+{
+    /* nothing is kept, a parse error sticks until finish */
+    for (struct pbuf* q = p; NULL != q; q = q->next)
+    {
+        if (0 != whm_config_parser_feed(&ctx->config_parser, q->payload, q->len))
+        {
+            return ERR_VAL;
+        }
+    }
+    return ERR_OK;
+}
+
+
+static err_t _whm_http_server_rest_post_handler_config_finish(_whm_http_server_ctx_t* ctx, char* response_uri, uint16_t response_uri_len)
+{
+    err_t ret = ERR_OK;
+    if (0 == whm_config_parser_finish(&ctx->config_parser)
+        && 0 == whm_config_set(&ctx->config_parser.config))
+    {
+        /* flash commit is done from the loop, not the receive callback */
+        ret = ERR_INPROGRESS;
+    }
+    else
+    {
+        ctx->body = "{\"status\":\"error\",\"error\":\"config invalid\"}";
+        ret = ERR_ARG;
+    }
+    strncpy(response_uri, "/api/config", response_uri_len);
+    return ret;
+}
+
+
+static err_t _whm_http_server_rest_post_handler_config_commit(_whm_http_server_ctx_t* ctx)
+{
+    if (0 == whm_config_save())
+    {
+        ctx->body = "{\"status\":\"ok\"}";
+    }
+    else
+    {
+        ctx->body = "{\"status\":\"error\",\"error\":\"config invalid\"}";
+    }
+    ctx->gen = _whm_http_server_gen_body;
+    return ERR_OK;
+}
+
+
+static const char* _whm_http_server_gen_auth(uint8_t auth)
+{
+    /* Unfortunately these auths aren't CYW43_AUTH_, but made up of some
+     * different values
+        OPEN  = 0x0
+        WEP  |= 0x1
         WPA  |= 0x2
         WPA2 |= 0x4
     */
@@ -529,3 +1979,148 @@ static const char* _whm_http_server_gen_auth(uint8_t auth)
     }
     return "UNKNOWN";
 }
+
+
+static void _whm_http_server_conn_touch(void* connection, struct tcp_pcb* pcb)
+{
+    uint64_t now = time_us_64();
+    _whm_http_server_stats.requests++;
+    _whm_http_server_conn_t* conn = NULL;
+    _whm_http_server_conn_t* oldest = NULL;
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CONN_MAX; i++)
+    {
+        _whm_http_server_conn_t* c = &_whm_http_server_conns[i];
+        if (c->connection == connection)
+        {
+            if (c->pcb == pcb && c->remote_port == pcb->remote_port)
+            {
+                _whm_http_server_stats.reused++;
+                c->last_us = now;
+                return;
+            }
+            /* httpd's state has been handed to a new connection */
+            conn = c;
+            break;
+        }
+        if (NULL == c->connection || NULL == _whm_http_server_conn_pcb(c))
+        {
+            conn = c;
+        }
+        else if (NULL == oldest || c->last_us < oldest->last_us)
+        {
+            oldest = c;
+        }
+    }
+    if (NULL == conn)
+    {
+        /* only when more connections than PCBs, which can't happen */
+        conn = oldest;
+    }
+    conn->connection = connection;
+    conn->pcb = pcb;
+    conn->remote_port = pcb->remote_port;
+    conn->last_us = now;
+}
+
+
+static struct tcp_pcb* _whm_http_server_connection_pcb(void* connection)
+{
+    for (struct tcp_pcb* pcb = tcp_active_pcbs; NULL != pcb; pcb = pcb->next)
+    {
+        if (pcb->callback_arg == connection)
+        {
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+
+static struct tcp_pcb* _whm_http_server_conn_pcb(const _whm_http_server_conn_t* conn)
+{
+    if (NULL == conn->connection)
+    {
+        return NULL;
+    }
+    for (struct tcp_pcb* pcb = tcp_active_pcbs; NULL != pcb; pcb = pcb->next)
+    {
+        if (pcb == conn->pcb)
+        {
+            if (pcb->callback_arg == conn->connection && pcb->remote_port == conn->remote_port)
+            {
+                return pcb;
+            }
+            break;
+        }
+    }
+    return NULL;
+}
+
+
+static bool _whm_http_server_conn_idle(const _whm_http_server_conn_t* conn, uint64_t now)
+{
+    struct tcp_pcb* pcb = _whm_http_server_conn_pcb(conn);
+    if (NULL == pcb || ESTABLISHED != pcb->state
+        || conn->last_us + _WHM_HTTP_SERVER_CONN_IDLE_MIN_US > now)
+    {
+        return false;
+    }
+    /* still sending the last response, or another request arrived */
+    if (NULL != pcb->unsent || NULL != pcb->unacked || NULL != pcb->refused_data)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CTX_MAX; i++)
+    {
+        const _whm_http_server_ctx_t* ctx = &_whm_http_server_ctxs[i];
+        if (ctx->used && ctx->connection == conn->connection)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void _whm_http_server_conn_reclaim(uint64_t now)
+{
+    /* listening PCBs come from their own pool */
+    unsigned used = _whm_http_server_pcb_count(tcp_active_pcbs)
+                  + _whm_http_server_pcb_count(tcp_tw_pcbs)
+                  + _whm_http_server_pcb_count(tcp_bound_pcbs);
+    if (used + _WHM_HTTP_SERVER_PCB_RESERVE <= MEMP_NUM_TCP_PCB)
+    {
+        return;
+    }
+    _whm_http_server_conn_t* lru = NULL;
+    for (size_t i = 0; i < _WHM_HTTP_SERVER_CONN_MAX; i++)
+    {
+        _whm_http_server_conn_t* c = &_whm_http_server_conns[i];
+        if (_whm_http_server_conn_idle(c, now) && (NULL == lru || c->last_us < lru->last_us))
+        {
+            lru = c;
+        }
+    }
+    if (NULL == lru)
+    {
+        return;
+    }
+    /* abort rather than close so the PCB is free now rather than after
+     * TIME_WAIT, httpd frees its state from the error callback. Clients
+     * retry a request on a kept alive connection that was reset. */
+    tcp_abort(lru->pcb);
+    lru->connection = NULL;
+    lru->pcb = NULL;
+    _whm_http_server_stats.reclaimed++;
+}
+
+
+static unsigned _whm_http_server_pcb_count(const struct tcp_pcb* pcb)
+{
+    unsigned count = 0;
+    for (; NULL != pcb; pcb = pcb->next)
+    {
+        count++;
+    }
+    return count;
+}
@@ -2,17 +2,22 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
 
 #include "htu31d.h"
+#include "metrics.h"
+#include "config.h"
 #include "pinmap.h"
 #include "util.h"
 
 
 #define _WHM_HTU31D_I2C_SCL_FREQ_HZ                 (400U * 1000U)
+#define _WHM_HTU31D_I2C_IRQ                         (I2C0_IRQ + WHM_HTU31D_I2C_UNIT)
 
 #define _WHM_HTU31D_I2C_ADDR_GND                    0U
 #define _WHM_HTU31D_I2C_ADDR_VDD                    1U
@@ -21,6 +26,7 @@
 
 #define _WHM_HTU31D_I2C_WRITE_TIMEOUT_US(_bytes)   (2000U * (_bytes))
 #define _WHM_HTU31D_I2C_READ_TIMEOUT_US(_bytes)    (2000U * (_bytes))
+#define _WHM_HTU31D_READ_T_RH_LEN                   6U
 
 #define _WHM_HTU31D_RH_OSR_0_020_PERC               0x0U
 #define _WHM_HTU31D_RH_OSR_0_014_PERC               0x1U
@@ -42,10 +48,15 @@
 #define _WHM_HTU31D_T_OSR_0_016_C_CONV_TIME_US      6100U
 #define _WHM_HTU31D_T_OSR_0_012_C_CONV_TIME_US      12100U
 
-#define _WHM_HTU31D_CONV_TIME_STATIC                10000U
-
-#define _WHM_HTU31D_RH_OSR                          _WHM_HTU31D_RH_OSR_0_020_PERC
-#define _WHM_HTU31D_T_OSR                           _WHM_HTU31D_T_OSR_0_040_C
+/* Added to the datasheet conversion time. Grown when the sensor NACKs a
+ * read for not having finished, shrunk a little after each reading that
+ * didn't need it, so it settles just above what this part needs. */
+#define _WHM_HTU31D_MARGIN_INITIAL_US               1000U
+#define _WHM_HTU31D_MARGIN_MIN_US                   100U
+#define _WHM_HTU31D_MARGIN_MAX_US                   10000U
+#define _WHM_HTU31D_MARGIN_SHRINK_SHIFT             4U
+/* reads NACKed before a get gives up */
+#define _WHM_HTU31D_READ_RETRIES                    3U
 
 #define _WHM_HTU31D_CMD_CONVERSION(_rh, _t)         (0x40U | ((0x3U & _rh) << 3U) | ((0x3U & _t) << 1U))
 #define _WHM_HTU31D_CMD_READ_T_RH                   0x00U
@@ -57,10 +68,17 @@
 #define _WHM_HTU31D_CMD_READ_DIAGNOSTIC             0x08U
 
 
-static void _whm_htu31d_do_read(void);
-static bool _whm_htu31d_command(const uint8_t command, bool nostop);
-static bool _whm_htu31d_read_rh_t(uint16_t* rh, uint16_t* t, bool nostop);
-static uint8_t _whm_htu31d_crc8(uint8_t* data, uint8_t length);
+static void _whm_htu31d_bus_init(void);
+static bool _whm_htu31d_transfer(uint8_t command, uint8_t read_len);
+static bool _whm_htu31d_transfer_done(uint64_t now);
+static void _whm_htu31d_i2c_irq(void);
+static void _whm_htu31d_finish(bool success, uint16_t rh_raw, uint16_t t_raw);
+static bool _whm_htu31d_subscribe(void* userdata, whm_htu31d_callback_t callback);
+static bool _whm_htu31d_start(void);
+static void _whm_htu31d_read_retry(uint64_t now);
+static uint32_t _whm_htu31d_conv_time(uint8_t profile);
+static bool _whm_htu31d_parse_rh_t(const uint8_t* buf, uint16_t* rh, uint16_t* t);
+static uint8_t _whm_htu31d_crc8(const uint8_t* data, uint8_t length);
 static uint32_t _whm_htu31d_conv_rel_hum(uint16_t raw);
 static int32_t _whm_htu31d_conv_temperature(uint16_t raw);
 
@@ -79,18 +97,85 @@ static const uint16_t _whm_htu31d_temperature_conv_time[] =
     _WHM_HTU31D_T_OSR_0_016_C_CONV_TIME_US,
     _WHM_HTU31D_T_OSR_0_012_C_CONV_TIME_US,
 };
-#define _WHM_HTU31D_GET_CONV_TIME(_rh, _t)          WHM_MAX(_whm_htu31d_rel_hum_conv_time[_rh], _whm_htu31d_temperature_conv_time[_t])
+static const struct
+{
+    const char* name;
+    uint8_t rh_osr;
+    uint8_t t_osr;
+} _whm_htu31d_profiles[WHM_HTU31D_PROFILES] =
+{
+    [WHM_HTU31D_PROFILE_FAST] = {"fast", _WHM_HTU31D_RH_OSR_0_020_PERC, _WHM_HTU31D_T_OSR_0_040_C},
+    [WHM_HTU31D_PROFILE_BALANCED] = {"balanced", _WHM_HTU31D_RH_OSR_0_010_PERC, _WHM_HTU31D_T_OSR_0_025_C},
+    [WHM_HTU31D_PROFILE_PRECISE] = {"precise", _WHM_HTU31D_RH_OSR_0_007_PERC, _WHM_HTU31D_T_OSR_0_012_C},
+};
+
+
+/* A get goes through each in turn, the I2C transfers are queued whole
+ * in the FIFOs and the interrupt only says when the bus has stopped, so
+ * nothing ever waits on the bus. */
+typedef enum _whm_htu31d_state
+{
+    _WHM_HTU31D_STATE_IDLE,
+    _WHM_HTU31D_STATE_CONVERT,
+    _WHM_HTU31D_STATE_CONVERTING,
+    _WHM_HTU31D_STATE_READ,
+} _whm_htu31d_state_t;
 
-static void* _whm_htu31d_callback = NULL;
-static void* _whm_htu31d_userdata = NULL;
-static bool _whm_htu31d_collecting = 0;
-static uint64_t _whm_htu31d_conversion_time = 0;
-#define _WHM_HTU31D_CONVERSION_READY(_t)            (_whm_htu31d_conversion_time <= _t)
+
+typedef struct _whm_htu31d_subscriber
+{
+    whm_htu31d_callback_t callback;
+    void* userdata;
+} _whm_htu31d_subscriber_t;
+
+
+static struct
+{
+    _whm_htu31d_state_t state;
+    /* all complete with the one reading */
+    _whm_htu31d_subscriber_t subscribers[WHM_HTU31D_SUBSCRIBERS];
+    uint8_t subscribed;
+    /* last good reading, given to those that will take it this old */
+    bool valid;
+    uint64_t valid_us;
+    uint16_t rh_raw;
+    uint16_t t_raw;
+    uint8_t profile;
+    uint64_t requested_us;
+    uint64_t conversion_time;
+    uint64_t deadline;
+    uint8_t retries;
+    bool timed_out;
+    /* set from the interrupt */
+    volatile bool stopped;
+    volatile bool aborted;
+    whm_htu31d_stats_t stats;
+    whm_metrics_histogram_t latency;
+} _whm_htu31d_ctx =
+{
+    .state = _WHM_HTU31D_STATE_IDLE,
+    .subscribed = 0,
+    .valid = false,
+    .valid_us = 0,
+    .rh_raw = 0,
+    .t_raw = 0,
+    .profile = WHM_HTU31D_PROFILE_FAST,
+    .requested_us = 0,
+    .conversion_time = 0,
+    .deadline = 0,
+    .retries = 0,
+    .timed_out = false,
+    .stopped = false,
+    .aborted = false,
+    .stats =
+    {
+        .margin_us = _WHM_HTU31D_MARGIN_INITIAL_US,
+    },
+};
 
 
 void whm_htu31d_init(void)
 {
-    i2c_init(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT), _WHM_HTU31D_I2C_SCL_FREQ_HZ);
     gpio_init(WHM_HTU31D_SDA_PIN);
     gpio_init(WHM_HTU31D_SCL_PIN);
     gpio_set_drive_strength(WHM_HTU31D_SDA_PIN, GPIO_DRIVE_STRENGTH_12MA);
@@ -102,104 +187,346 @@ void whm_htu31d_init(void)
     gpio_init(WHM_HTU31D_RESET_PIN);
     gpio_set_dir(WHM_HTU31D_RESET_PIN, true);
     gpio_put(WHM_HTU31D_RESET_PIN, 1);
+    _whm_htu31d_bus_init();
+    irq_set_exclusive_handler(_WHM_HTU31D_I2C_IRQ, _whm_htu31d_i2c_irq);
+    irq_set_enabled(_WHM_HTU31D_I2C_IRQ, true);
 }
 
 
 void whm_htu31d_deinit(void)
 {
+    irq_set_enabled(_WHM_HTU31D_I2C_IRQ, false);
+    irq_remove_handler(_WHM_HTU31D_I2C_IRQ, _whm_htu31d_i2c_irq);
     i2c_deinit(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT));
-    _whm_htu31d_collecting = false;
-    _whm_htu31d_callback = NULL;
-    _whm_htu31d_userdata = NULL;
+    _whm_htu31d_ctx.state = _WHM_HTU31D_STATE_IDLE;
+    _whm_htu31d_ctx.subscribed = 0;
+    _whm_htu31d_ctx.valid = false;
 }
 
 
 void whm_htu31d_iterate(void)
 {
     uint64_t now = time_us_64();
-    if (_whm_htu31d_collecting && _WHM_HTU31D_CONVERSION_READY(now))
+    switch (_whm_htu31d_ctx.state)
     {
-        _whm_htu31d_do_read();
-        _whm_htu31d_collecting = false;
-        _whm_htu31d_callback = NULL;
-        _whm_htu31d_userdata = NULL;
+        case _WHM_HTU31D_STATE_IDLE:
+            if (_whm_htu31d_ctx.subscribed)
+            {
+                /* only taken when the last reading was recent enough */
+                _whm_htu31d_finish(true, _whm_htu31d_ctx.rh_raw, _whm_htu31d_ctx.t_raw);
+            }
+            break;
+        case _WHM_HTU31D_STATE_CONVERT:
+            if (!_whm_htu31d_transfer_done(now))
+            {
+                break;
+            }
+            if (_whm_htu31d_ctx.aborted)
+            {
+                /* failed to execute conversion command */
+                _whm_htu31d_finish(false, 0, 0);
+                break;
+            }
+            _whm_htu31d_ctx.conversion_time = now
+                + _whm_htu31d_conv_time(_whm_htu31d_ctx.profile) + _whm_htu31d_ctx.stats.margin_us;
+            _whm_htu31d_ctx.state = _WHM_HTU31D_STATE_CONVERTING;
+            break;
+        case _WHM_HTU31D_STATE_CONVERTING:
+            if (now < _whm_htu31d_ctx.conversion_time)
+            {
+                break;
+            }
+            if (!_whm_htu31d_transfer(_WHM_HTU31D_CMD_READ_T_RH, _WHM_HTU31D_READ_T_RH_LEN))
+            {
+                _whm_htu31d_finish(false, 0, 0);
+                break;
+            }
+            _whm_htu31d_ctx.state = _WHM_HTU31D_STATE_READ;
+            break;
+        case _WHM_HTU31D_STATE_READ:
+        {
+            if (!_whm_htu31d_transfer_done(now))
+            {
+                break;
+            }
+            if (_whm_htu31d_ctx.aborted && !_whm_htu31d_ctx.timed_out
+                && _whm_htu31d_ctx.retries < _WHM_HTU31D_READ_RETRIES)
+            {
+                _whm_htu31d_read_retry(now);
+                break;
+            }
+            i2c_hw_t* hw = i2c_get_hw(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT));
+            uint8_t buf[_WHM_HTU31D_READ_T_RH_LEN];
+            uint16_t rh_raw = 0;
+            uint16_t t_raw = 0;
+            bool success = !_whm_htu31d_ctx.aborted && hw->rxflr >= sizeof(buf);
+            for (size_t i = 0; success && i < sizeof(buf); i++)
+            {
+                buf[i] = (uint8_t)hw->data_cmd;
+            }
+            success = success && _whm_htu31d_parse_rh_t(buf, &rh_raw, &t_raw);
+            if (success && !_whm_htu31d_ctx.retries)
+            {
+                uint32_t margin = _whm_htu31d_ctx.stats.margin_us;
+                margin -= margin >> _WHM_HTU31D_MARGIN_SHRINK_SHIFT;
+                _whm_htu31d_ctx.stats.margin_us = WHM_MAX(margin, _WHM_HTU31D_MARGIN_MIN_US);
+            }
+            _whm_htu31d_finish(success, rh_raw, t_raw);
+            break;
+        }
     }
 }
 
 
 bool whm_htu31d_get(void* userdata, whm_htu31d_callback_t callback)
 {
-    if (_whm_htu31d_collecting)
+    return whm_htu31d_get_max_age(0, userdata, callback);
+}
+
+
+bool whm_htu31d_get_max_age(uint32_t max_age_ms, void* userdata, whm_htu31d_callback_t callback)
+{
+    if (_WHM_HTU31D_STATE_IDLE != _whm_htu31d_ctx.state)
+    {
+        /* join the reading under way */
+        if (!_whm_htu31d_subscribe(userdata, callback))
+        {
+            return false;
+        }
+        _whm_htu31d_ctx.stats.coalesced++;
+        return true;
+    }
+    uint64_t now = time_us_64();
+    if (_whm_htu31d_ctx.valid && now - _whm_htu31d_ctx.valid_us <= (uint64_t)max_age_ms * 1000U)
+    {
+        /* made from whm_htu31d_iterate, same as a reading */
+        if (!_whm_htu31d_subscribe(userdata, callback))
+        {
+            return false;
+        }
+        _whm_htu31d_ctx.stats.cached++;
+        return true;
+    }
+    if (_whm_htu31d_ctx.subscribed >= WHM_HTU31D_SUBSCRIBERS || !_whm_htu31d_start())
     {
-        /* already collecting */
         return false;
     }
-    uint8_t conv_command = _WHM_HTU31D_CMD_CONVERSION(_WHM_HTU31D_RH_OSR, _WHM_HTU31D_T_OSR);
-    if (!_whm_htu31d_command(conv_command, false))
+    /* any already waiting on the last reading now get this one */
+    _whm_htu31d_subscribe(userdata, callback);
+    return true;
+}
+
+
+uint32_t whm_htu31d_get_age_ms(void)
+{
+    if (!_whm_htu31d_ctx.valid)
+    {
+        return UINT32_MAX;
+    }
+    return (time_us_64() - _whm_htu31d_ctx.valid_us) / 1000U;
+}
+
+
+void whm_htu31d_get_stats(whm_htu31d_stats_t* stats)
+{
+    *stats = _whm_htu31d_ctx.stats;
+    stats->profile = _whm_htu31d_ctx.profile;
+    stats->conversion_us = _whm_htu31d_conv_time(_whm_htu31d_ctx.profile);
+}
+
+
+void whm_htu31d_get_latency(whm_metrics_histogram_t* latency)
+{
+    *latency = _whm_htu31d_ctx.latency;
+}
+
+
+const char* whm_htu31d_profile_name(uint8_t profile)
+{
+    return _whm_htu31d_profiles[profile < WHM_HTU31D_PROFILES ? profile : WHM_HTU31D_PROFILE_FAST].name;
+}
+
+
+bool whm_htu31d_profile_from_name(const char* name, uint8_t* profile)
+{
+    for (uint8_t i = 0; i < WHM_HTU31D_PROFILES; i++)
+    {
+        if (0 == strcmp(name, _whm_htu31d_profiles[i].name))
+        {
+            *profile = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void _whm_htu31d_bus_init(void)
+{
+    i2c_init(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT), _WHM_HTU31D_I2C_SCL_FREQ_HZ);
+    i2c_hw_t* hw = i2c_get_hw(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT));
+    /* a transfer has ended, one way or the other, once the bus stops */
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+}
+
+
+/* writes the command then, if read_len, reads that many bytes after a
+ * restart, all queued at once as it fits in the FIFOs */
+static bool _whm_htu31d_transfer(uint8_t command, uint8_t read_len)
+{
+    i2c_hw_t* hw = i2c_get_hw(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT));
+    if (hw->status & I2C_IC_STATUS_ACTIVITY_BITS)
     {
-        /* failed to execute conversion command */
         return false;
     }
-    _whm_htu31d_collecting = true;
-    _whm_htu31d_conversion_time = time_us_64()
-        + _WHM_HTU31D_GET_CONV_TIME(_WHM_HTU31D_RH_OSR, _WHM_HTU31D_T_OSR) + _WHM_HTU31D_CONV_TIME_STATIC;
-    _whm_htu31d_userdata = userdata;
-    _whm_htu31d_callback = (void*)callback;
+    hw->enable = 0;
+    hw->tar = _WHM_HTU31D_I2C_ADDR;
+    hw->enable = 1;
+    (void)hw->clr_intr;
+    /* anything left from a read cut short */
+    while (hw->rxflr)
+    {
+        (void)hw->data_cmd;
+    }
+    _whm_htu31d_ctx.stopped = false;
+    _whm_htu31d_ctx.aborted = false;
+    _whm_htu31d_ctx.timed_out = false;
+    _whm_htu31d_ctx.deadline = time_us_64()
+        + _WHM_HTU31D_I2C_WRITE_TIMEOUT_US(1U) + _WHM_HTU31D_I2C_READ_TIMEOUT_US(read_len);
+    hw->data_cmd = command | (read_len ? 0 : I2C_IC_DATA_CMD_STOP_BITS);
+    for (uint8_t i = 0; i < read_len; i++)
+    {
+        hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS
+            | (0 == i ? I2C_IC_DATA_CMD_RESTART_BITS : 0)
+            | (read_len - 1 == i ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
     return true;
 }
 
 
-static void _whm_htu31d_do_read(void)
+static bool _whm_htu31d_transfer_done(uint64_t now)
 {
-    uint16_t rh_raw = 0;
-    uint16_t t_raw = 0;
-    bool success = _whm_htu31d_command(_WHM_HTU31D_CMD_READ_T_RH, true)
-        && _whm_htu31d_read_rh_t(&rh_raw, &t_raw, false);
-    if (_whm_htu31d_callback)
+    if (_whm_htu31d_ctx.stopped)
     {
-        uint32_t rh_e3 = _whm_htu31d_conv_rel_hum(rh_raw);
-        int32_t t_e3 = _whm_htu31d_conv_temperature(t_raw);
-        ((whm_htu31d_callback_t)_whm_htu31d_callback)(_whm_htu31d_userdata, success, rh_e3, t_e3);
+        return true;
     }
+    if (now < _whm_htu31d_ctx.deadline)
+    {
+        return false;
+    }
+    /* sensor holding the bus or not answering, start the block afresh
+     * rather than wait on an abort that may never finish */
+    _whm_htu31d_bus_init();
+    _whm_htu31d_ctx.aborted = true;
+    _whm_htu31d_ctx.timed_out = true;
+    return true;
 }
 
 
-static bool _whm_htu31d_command(const uint8_t command, bool nostop)
+static void _whm_htu31d_i2c_irq(void)
 {
-    int ret = i2c_write_timeout_us(
-        I2C_INSTANCE(WHM_HTU31D_I2C_UNIT),
-        _WHM_HTU31D_I2C_ADDR,
-        &command,
-        1U,
-        nostop,
-        _WHM_HTU31D_I2C_WRITE_TIMEOUT_US(1U)
-    );
-    return ret == 1;
+    i2c_hw_t* hw = i2c_get_hw(I2C_INSTANCE(WHM_HTU31D_I2C_UNIT));
+    uint32_t status = hw->intr_stat;
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS)
+    {
+        /* no ack or lost arbitration, a stop follows */
+        (void)hw->clr_tx_abrt;
+        _whm_htu31d_ctx.aborted = true;
+    }
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS)
+    {
+        (void)hw->clr_stop_det;
+        _whm_htu31d_ctx.stopped = true;
+    }
 }
 
 
-static bool _whm_htu31d_read_rh_t(uint16_t* rh, uint16_t* t, bool nostop)
+static void _whm_htu31d_finish(bool success, uint16_t rh_raw, uint16_t t_raw)
 {
-    if (!rh || !t)
+    bool converted = _WHM_HTU31D_STATE_IDLE != _whm_htu31d_ctx.state;
+    _whm_htu31d_ctx.state = _WHM_HTU31D_STATE_IDLE;
+    if (success && converted)
+    {
+        uint64_t now = time_us_64();
+        uint32_t latency_us = now - _whm_htu31d_ctx.requested_us;
+        _whm_htu31d_ctx.stats.latency_us = latency_us;
+        whm_metrics_observe(&_whm_htu31d_ctx.latency, latency_us);
+        _whm_htu31d_ctx.valid = true;
+        _whm_htu31d_ctx.valid_us = now;
+        _whm_htu31d_ctx.rh_raw = rh_raw;
+        _whm_htu31d_ctx.t_raw = t_raw;
+    }
+    /* taken first, a callback may get again */
+    uint8_t subscribed = _whm_htu31d_ctx.subscribed;
+    _whm_htu31d_subscriber_t subscribers[WHM_HTU31D_SUBSCRIBERS];
+    memcpy(subscribers, _whm_htu31d_ctx.subscribers, sizeof(subscribers));
+    _whm_htu31d_ctx.subscribed = 0;
+    uint32_t rh_e3 = _whm_htu31d_conv_rel_hum(rh_raw);
+    int32_t t_e3 = _whm_htu31d_conv_temperature(t_raw);
+    for (uint8_t i = 0; i < subscribed; i++)
     {
-        /* null pointer */
+        if (subscribers[i].callback)
+        {
+            subscribers[i].callback(subscribers[i].userdata, success, rh_e3, t_e3);
+        }
+    }
+}
+
+
+/* sends the conversion command, false if the bus is busy */
+static bool _whm_htu31d_start(void)
+{
+    /* picked up per reading so a config change applies to the next */
+    uint8_t profile = whm_conf.sensor_profile < WHM_HTU31D_PROFILES ? whm_conf.sensor_profile : WHM_HTU31D_PROFILE_FAST;
+    uint8_t conv_command = _WHM_HTU31D_CMD_CONVERSION(_whm_htu31d_profiles[profile].rh_osr, _whm_htu31d_profiles[profile].t_osr);
+    if (!_whm_htu31d_transfer(conv_command, 0))
+    {
+        /* bus still busy */
         return false;
     }
-    uint8_t buf[6];
-
-    int ret = i2c_read_timeout_us(
-        I2C_INSTANCE(WHM_HTU31D_I2C_UNIT),
-        _WHM_HTU31D_I2C_ADDR,
-        buf,
-        6U,
-        nostop,
-        _WHM_HTU31D_I2C_READ_TIMEOUT_US(6U)
-    );
-    if (ret != 6)
+    _whm_htu31d_ctx.state = _WHM_HTU31D_STATE_CONVERT;
+    _whm_htu31d_ctx.profile = profile;
+    _whm_htu31d_ctx.requested_us = time_us_64();
+    _whm_htu31d_ctx.retries = 0;
+    return true;
+}
+
+
+static bool _whm_htu31d_subscribe(void* userdata, whm_htu31d_callback_t callback)
+{
+    if (_whm_htu31d_ctx.subscribed >= WHM_HTU31D_SUBSCRIBERS)
     {
-        /* failed reading i2c */
         return false;
     }
+    _whm_htu31d_ctx.subscribers[_whm_htu31d_ctx.subscribed].callback = callback;
+    _whm_htu31d_ctx.subscribers[_whm_htu31d_ctx.subscribed].userdata = userdata;
+    _whm_htu31d_ctx.subscribed++;
+    return true;
+}
+
+
+/* not finished converting, wait the margin again, longer next time */
+static void _whm_htu31d_read_retry(uint64_t now)
+{
+    _whm_htu31d_ctx.retries++;
+    _whm_htu31d_ctx.stats.not_ready++;
+    uint32_t margin = _whm_htu31d_ctx.stats.margin_us;
+    _whm_htu31d_ctx.conversion_time = now + margin;
+    _whm_htu31d_ctx.stats.margin_us = WHM_MIN(2 * margin, _WHM_HTU31D_MARGIN_MAX_US);
+    _whm_htu31d_ctx.state = _WHM_HTU31D_STATE_CONVERTING;
+}
+
+
+static uint32_t _whm_htu31d_conv_time(uint8_t profile)
+{
+    /* both are measured, one after the other */
+    return _whm_htu31d_rel_hum_conv_time[_whm_htu31d_profiles[profile].rh_osr]
+        + _whm_htu31d_temperature_conv_time[_whm_htu31d_profiles[profile].t_osr];
+}
+
+
+static bool _whm_htu31d_parse_rh_t(const uint8_t* buf, uint16_t* rh, uint16_t* t)
+{
     uint8_t t_crc8 = _whm_htu31d_crc8(buf, 2);
     if (t_crc8 != buf[2])
     {
@@ -218,7 +545,7 @@ static bool _whm_htu31d_read_rh_t(uint16_t* rh, uint16_t* t, bool nostop)
 }
 
 
-static uint8_t _whm_htu31d_crc8(uint8_t *data, uint8_t length)
+static uint8_t _whm_htu31d_crc8(const uint8_t *data, uint8_t length)
 {
     uint32_t polynom = 0x98800000UL;
     uint32_t msb     = 0x80000000UL;
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 1 minute, 15 minutes, 1 hour and 24 hours */
+#define WHM_AGGREGATE_WINDOWS                   4U
+/* each window is kept as this many slots, it moves a slot at a time */
+#define WHM_AGGREGATE_SLOTS                     12U
+
+
+typedef struct whm_aggregate_stat
+{
+    int32_t min_e3;
+    int32_t max_e3;
+    int32_t mean_e3;
+} whm_aggregate_stat_t;
+
+
+typedef struct whm_aggregate_window
+{
+    uint32_t window_s;
+    /* readings in the window, min, max and mean are 0 when there are none */
+    uint32_t count;
+    whm_aggregate_stat_t rh;
+    whm_aggregate_stat_t t;
+} whm_aggregate_window_t;
+
+
+void whm_aggregate_init(void);
+void whm_aggregate_add(uint64_t time_us, uint32_t rh_e3, int32_t t_e3);
+/* Each window covers its current slot and the WHM_AGGREGATE_SLOTS - 1
+ * before it, so it reaches back up to a slot further than its length. */
+void whm_aggregate_get(uint64_t time_us, whm_aggregate_window_t windows[WHM_AGGREGATE_WINDOWS]);
@@ -29,6 +29,15 @@ bool whm_ap_station_get_connection(char** ssid, char** password);
 bool whm_ap_station_get_connected(void);
 const char* whm_ap_station_get_state(void);
 bool whm_ap_station_start_scan(void);
+/* Results of a scan started for an owner are only taken by it, nobody
+ * else can start a scan until it has. Starting again while its scan
+ * runs joins it. */
+bool whm_ap_station_start_scan_for(const void* owner);
 whm_ap_station_scan_result_t* whm_ap_station_get_scan(void);
+/* caller owns the results, free with whm_ap_station_scan_free */
+whm_ap_station_scan_result_t* whm_ap_station_take_scan(void);
+/* NULL unless the results are owner's */
+whm_ap_station_scan_result_t* whm_ap_station_take_scan_for(const void* owner);
+void whm_ap_station_scan_free(whm_ap_station_scan_result_t* results);
 void whm_ap_station_scan_results_free(void);
 bool whm_ap_station_scanning(void);
@@ -1,16 +1,109 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "json_reader.h"
+#include "json_writer.h"
 
 
 #define WHM_CONFIG_NAME_LEN                 63
 #define WHM_CONFIG_WIRELESS_LEN             128
+#define WHM_CONFIG_KEY_LEN                  15
+#define WHM_CONFIG_HISTORY_MS_MIN           1000U
+#define WHM_CONFIG_HISTORY_MS_MAX           (24U * 60U * 60U * 1000U) /* a day */
+#define WHM_CONFIG_RULES_MAX                4
+/* rule values are e3, up to a thousand either way */
+#define WHM_CONFIG_RULE_E3_MAX              (1000 * 1000)
+#define WHM_CONFIG_FILTER_LENGTH_MAX        8
+#define WHM_CONFIG_URL_LEN                  128
+#define WHM_CONFIG_UPLINK_BATCH_MAX         16
+#define WHM_CONFIG_UPLINK_INTERVAL_S_MAX    3600
+#define WHM_CONFIG_HOST_LEN                 64
+#define WHM_CONFIG_TOPIC_LEN                64
+#define WHM_CONFIG_TELEMETRY_BATCH_MAX      8
+#define WHM_CONFIG_FILTER_SHIFT_MAX         6
+#define WHM_CONFIG_FILTER_LENGTH_DEFAULT    4
+#define WHM_CONFIG_FILTER_SHIFT_DEFAULT     2
+
+
+typedef enum whm_config_channel
+{
+    WHM_CONFIG_CHANNEL_RELATIVE_HUMIDITY,
+    WHM_CONFIG_CHANNEL_TEMPERATURE,
+    WHM_CONFIG_CHANNELS,
+} whm_config_channel_t;
+
+
+typedef enum whm_config_filter_type
+{
+    WHM_CONFIG_FILTER_NONE,
+    WHM_CONFIG_FILTER_MEAN,
+    WHM_CONFIG_FILTER_MEDIAN,
+    WHM_CONFIG_FILTER_IIR,
+    WHM_CONFIG_FILTER_TYPES,
+} whm_config_filter_type_t;
+
+
+/* Smooths a channel before anything else sees it. mean and median are
+ * over the last length readings, iir moves 1/2^shift of the way to each. */
+typedef struct whm_config_filter
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t shift;
+} whm_config_filter_t;
+
+
+/* When a reading is worth reporting, values are e3 of the channel's unit
+ * and a 0 deadband or rate is off. high and low fire on crossing and
+ * clear once back past them by hysteresis. rate is change per minute. */
+typedef struct whm_config_rule
+{
+    uint8_t channel;
+    bool high_set;
+    bool low_set;
+    int32_t deadband_e3;
+    int32_t high_e3;
+    int32_t low_e3;
+    int32_t hysteresis_e3;
+    int32_t rate_e3;
+} whm_config_rule_t;
+
+
+/* broker readings and status are published to, off while host is "" */
+typedef struct whm_config_mqtt
+{
+    char host[WHM_CONFIG_HOST_LEN];
+    uint16_t port;
+    char meas_topic[WHM_CONFIG_TOPIC_LEN];
+    /* retained, "offline" left as the will */
+    char status_topic[WHM_CONFIG_TOPIC_LEN];
+} whm_config_mqtt_t;
+
+
+/* where readings are sent as UDP line protocol, off while host is "" */
+typedef struct whm_config_telemetry
+{
+    char host[WHM_CONFIG_HOST_LEN];
+    uint16_t port;
+    /* readings in one datagram */
+    uint8_t batch;
+} whm_config_telemetry_t;
 
 
 typedef struct whm_config
 {
     char name[WHM_CONFIG_NAME_LEN + 1];
     uint16_t blinking_ms;
+    /* how often a reading is kept in the measurement history */
+    uint32_t history_ms;
+    /* whm_htu31d_profile_t the sensor is read with */
+    uint8_t sensor_profile;
+    whm_config_filter_t filters[WHM_CONFIG_CHANNELS];
+    /* with none, every reading is reported */
+    whm_config_rule_t rules[WHM_CONFIG_RULES_MAX];
+    uint8_t rules_count;
     struct
     {
         char ssid[WHM_CONFIG_WIRELESS_LEN];
@@ -22,16 +115,47 @@ typedef struct whm_config
         char password[WHM_CONFIG_WIRELESS_LEN];
         uint32_t auth;
     } station;
+    /* where readings are posted once on a network, off while url is "" */
+    struct
+    {
+        char url[WHM_CONFIG_URL_LEN];
+        /* readings sent together, sooner if the oldest is interval_s old */
+        uint16_t batch;
+        uint32_t interval_s;
+    } uplink;
+    whm_config_mqtt_t mqtt;
+    whm_config_telemetry_t telemetry;
 } whm_config_t;
 
 
+/* Applies a JSON config to a copy of the defaults as it arrives, fields
+ * not given keep their default and unknown ones are skipped. */
+typedef struct whm_config_parser
+{
+    whm_json_reader_t reader;
+    whm_config_t config;
+    uint8_t section;
+    /* the channel whose filter is being read */
+    uint8_t channel;
+    char key[WHM_CONFIG_KEY_LEN + 1];
+} whm_config_parser_t;
+
+
 extern whm_config_t whm_conf;
 
 
 int whm_config_init(void);
 bool whm_config_loaded(void);
-int whm_config_set_string(char* config_str, unsigned len);
-char* whm_config_get_string(void);
+void whm_config_parser_init(whm_config_parser_t* parser);
+int whm_config_parser_feed(whm_config_parser_t* parser, const char* data, unsigned len);
+/* 0 once a whole document has been read */
+int whm_config_parser_finish(whm_config_parser_t* parser);
+/* staged until whm_config_save() */
+int whm_config_set(const whm_config_t* config);
+int whm_config_set_string(const char* config_str, unsigned len);
+void whm_config_write(whm_json_writer_t* writer, const whm_config_t* config);
 void whm_config_wipe(void);
 int whm_config_save(void);
 int whm_config_restore(void);
+const char* whm_config_channel_name(uint8_t channel);
+const char* whm_config_filter_name(uint8_t type);
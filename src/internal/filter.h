@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "config.h"
+
+/* fractional bits the IIR keeps between readings */
+#define WHM_FILTER_IIR_FRACTION                 8U
+
+
+/* One channel's state, kept by whoever owns the channel. Starts again
+ * whenever the config it is run with changes. */
+typedef struct whm_filter
+{
+    whm_config_filter_t config;
+    /* the config's, kept inside the window */
+    uint8_t length;
+    uint8_t count;
+    uint8_t pos;
+    int32_t window[WHM_CONFIG_FILTER_LENGTH_MAX];
+    int64_t sum;
+    int32_t iir;
+} whm_filter_t;
+
+
+void whm_filter_init(whm_filter_t* filter, const whm_config_filter_t* config);
+/* takes a reading in e3 and gives back the filtered one */
+int32_t whm_filter_apply(whm_filter_t* filter, const whm_config_filter_t* config, int32_t value_e3);
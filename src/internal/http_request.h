@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* What the server needs from a request's headers. httpd keeps them to
+ * itself for a GET, so they are read from the segments as they arrive,
+ * a header split between two segments being missed. */
+typedef struct whm_http_request
+{
+    /* until the blank line, a POST's body is never taken for headers */
+    bool in_headers;
+    bool accepts_gzip;
+    /* Accept: application/cbor */
+    bool accepts_cbor;
+    /* If-None-Match has the etag the request was fed with */
+    bool etag_matched;
+} whm_http_request_t;
+
+
+typedef enum whm_http_request_index
+{
+    /* the uncompressed built-in copy */
+    WHM_HTTP_REQUEST_INDEX_PLAIN,
+    WHM_HTTP_REQUEST_INDEX_GZIP,
+    WHM_HTTP_REQUEST_INDEX_NOT_MODIFIED,
+} whm_http_request_index_t;
+
+
+void whm_http_request_init(whm_http_request_t* request);
+/* Takes a segment, true if it starts a request which clears what the
+ * one before left. */
+bool whm_http_request_feed(whm_http_request_t* request, const char* data, unsigned len, const char* etag);
+/* how the gzipped index.html is answered */
+whm_http_request_index_t whm_http_request_index(const whm_http_request_t* request);
+
+/* the value of the first header called name in the lines of
+ * http_request, NULL if there is none */
+const char* whm_http_request_header_find(const char* http_request, unsigned http_request_len, const char* name, unsigned* value_len);
+bool whm_http_request_header_contains(const char* value, unsigned value_len, const char* token);
@@ -1,9 +1,37 @@
 #pragma once
 
+#include "lwip/err.h"
+
+#include "sampler.h"
+#include "ap_station.h"
+
 
 typedef struct whm_http_server
 {
 } whm_http_server_t;
 
+
+typedef struct whm_http_server_stats
+{
+    uint32_t requests;
+    /* requests made on a connection kept alive from an earlier one */
+    uint32_t reused;
+    /* idle keep-alive connections closed to free a PCB */
+    uint32_t reclaimed;
+    /* connections currently kept alive between requests */
+    uint32_t idle;
+    /* requests turned away with 429 by the per-client rate limit */
+    uint32_t rejected;
+} whm_http_server_stats_t;
+
+
 int whm_http_server_init(whm_http_server_t* server);
 void whm_http_server_deinit(whm_http_server_t* server);
+void whm_http_server_iterate(whm_http_server_t* server);
+void whm_http_server_get_stats(whm_http_server_stats_t* stats);
+
+/* bodies shared with the other servers, buffer is always terminated */
+int whm_http_server_gen_meas(char* buf, unsigned buflen, const whm_sampler_reading_t* reading);
+int whm_http_server_gen_status(char* buf, unsigned buflen);
+/* ERR_INPROGRESS with an error body if there are no results */
+err_t whm_http_server_gen_wifi_scan(char* buf, unsigned buflen, const whm_ap_station_scan_result_t* results, unsigned* len);
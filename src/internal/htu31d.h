@@ -3,7 +3,39 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define WHM_HTU31D_MAX_CONV_TIME_US             13000U
+/* gets that can wait on one reading */
+#define WHM_HTU31D_SUBSCRIBERS                  4U
+
+
+/* oversampling of both readings, finer is slower */
+typedef enum whm_htu31d_profile
+{
+    WHM_HTU31D_PROFILE_FAST,
+    WHM_HTU31D_PROFILE_BALANCED,
+    WHM_HTU31D_PROFILE_PRECISE,
+    WHM_HTU31D_PROFILES,
+} whm_htu31d_profile_t;
+
+
+typedef struct whm_htu31d_stats
+{
+    uint8_t profile;
+    /* datasheet time for the profile */
+    uint32_t conversion_us;
+    /* waited on top of it */
+    uint32_t margin_us;
+    /* reads NACKed for being too soon */
+    uint32_t not_ready;
+    /* gets that joined a reading under way or took the last one */
+    uint32_t coalesced;
+    uint32_t cached;
+    /* from asking for a reading to having it, the last one */
+    uint32_t latency_us;
+} whm_htu31d_stats_t;
+
+
+/* kept by metrics.h, which includes this */
+struct whm_metrics_histogram;
 
 
 typedef void (* whm_htu31d_callback_t)(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3);
@@ -12,5 +44,18 @@ void whm_htu31d_init(void);
 void whm_htu31d_deinit(void);
 void whm_htu31d_iterate(void);
 /* e3 represents x1000, so temperature in milli-celcius, relative humidity
- * in per-millicent */
+ * in per-millicent. The callback is made from whm_htu31d_iterate once the
+ * reading is in or has failed. A get made while a reading is under way
+ * is completed by that reading. false if WHM_HTU31D_SUBSCRIBERS are
+ * already waiting or the bus is busy. */
 bool whm_htu31d_get(void* userdata, whm_htu31d_callback_t callback);
+/* as whm_htu31d_get, but the last good reading is given without using
+ * the bus if it is no older than max_age_ms */
+bool whm_htu31d_get_max_age(uint32_t max_age_ms, void* userdata, whm_htu31d_callback_t callback);
+/* how old the last good reading is, the one a callback was just given */
+uint32_t whm_htu31d_get_age_ms(void);
+void whm_htu31d_get_stats(whm_htu31d_stats_t* stats);
+/* every latency_us so far */
+void whm_htu31d_get_latency(struct whm_metrics_histogram* latency);
+const char* whm_htu31d_profile_name(uint8_t profile);
+bool whm_htu31d_profile_from_name(const char* name, uint8_t* profile);
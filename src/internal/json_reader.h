@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define WHM_JSON_READER_VALUE_MAX               127
+#define WHM_JSON_READER_DEPTH_MAX               32
+
+
+typedef enum whm_json_reader_token
+{
+    WHM_JSON_READER_TOKEN_NONE,
+    WHM_JSON_READER_TOKEN_OBJECT_BEGIN,
+    WHM_JSON_READER_TOKEN_OBJECT_END,
+    WHM_JSON_READER_TOKEN_ARRAY_BEGIN,
+    WHM_JSON_READER_TOKEN_ARRAY_END,
+    WHM_JSON_READER_TOKEN_KEY,
+    WHM_JSON_READER_TOKEN_STRING,
+    WHM_JSON_READER_TOKEN_NUMBER,
+    WHM_JSON_READER_TOKEN_TRUE,
+    WHM_JSON_READER_TOKEN_FALSE,
+    WHM_JSON_READER_TOKEN_NULL,
+    WHM_JSON_READER_TOKEN_ERROR,
+} whm_json_reader_token_t;
+
+
+/* Pulls tokens out of JSON as it arrives, so a document can be read a
+ * piece at a time without ever being held whole. Keys, strings and
+ * numbers are collected in value, anything longer than
+ * WHM_JSON_READER_VALUE_MAX is cut short and flagged truncated. The
+ * document must be an object or an array, anything after it is ignored. */
+typedef struct whm_json_reader
+{
+    uint8_t state;
+    uint8_t depth;
+    /* bit per level, set where that level is an object */
+    uint32_t objects;
+    bool key;
+    const char* literal;
+    uint8_t literal_pos;
+    uint8_t unicode_digits;
+    uint16_t unicode;
+    uint16_t surrogate;
+    bool truncated;
+    unsigned value_len;
+    char value[WHM_JSON_READER_VALUE_MAX + 1];
+} whm_json_reader_t;
+
+
+void whm_json_reader_init(whm_json_reader_t* reader);
+/* reads up to the end of the next token, returns how much of data was
+ * used and the token in *token, NONE if data ran out before one ended */
+unsigned whm_json_reader_next(whm_json_reader_t* reader, const char* data, unsigned len, whm_json_reader_token_t* token);
+/* the outermost object or array has been closed */
+bool whm_json_reader_done(const whm_json_reader_t* reader);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Writes JSON into a window of the output rather than a whole buffer.
+ * Everything before skip and after skip + buflen is only counted, so a
+ * body of any size can be sent in pieces by rendering it again for each
+ * piece, and its length found first with a NULL buffer. The generator
+ * must produce the same output every time it is run.
+ *
+ * Initialised with whm_json_writer_init_cbor the same calls write CBOR
+ * (RFC 8949) instead, objects and arrays as indefinite length so nothing
+ * has to be counted ahead. */
+typedef struct whm_json_writer
+{
+    char* buf;
+    unsigned buflen;
+    unsigned skip;
+    unsigned pos;
+    bool comma;
+    bool cbor;
+} whm_json_writer_t;
+
+
+void whm_json_writer_init(whm_json_writer_t* writer, char* buf, unsigned buflen, unsigned skip);
+void whm_json_writer_init_cbor(whm_json_writer_t* writer, char* buf, unsigned buflen, unsigned skip);
+/* total length of the output so far, including anything not in the window */
+unsigned whm_json_writer_len(const whm_json_writer_t* writer);
+/* bytes that landed in the window */
+unsigned whm_json_writer_written(const whm_json_writer_t* writer);
+bool whm_json_writer_full(const whm_json_writer_t* writer);
+
+void whm_json_writer_object_begin(whm_json_writer_t* writer);
+void whm_json_writer_object_end(whm_json_writer_t* writer);
+void whm_json_writer_array_begin(whm_json_writer_t* writer);
+void whm_json_writer_array_end(whm_json_writer_t* writer);
+void whm_json_writer_key(whm_json_writer_t* writer, const char* key);
+void whm_json_writer_string(whm_json_writer_t* writer, const char* str);
+void whm_json_writer_string_n(whm_json_writer_t* writer, const char* str, unsigned len);
+void whm_json_writer_uint(whm_json_writer_t* writer, uint32_t value);
+void whm_json_writer_int(whm_json_writer_t* writer, int32_t value);
+/* value scaled by 10^decimals, e.g. (-1500, 3) is -1.500, a double in
+ * CBOR unless decimals is 0 */
+void whm_json_writer_fixed(whm_json_writer_t* writer, int32_t value, unsigned decimals);
+void whm_json_writer_bool(whm_json_writer_t* writer, bool value);
+void whm_json_writer_null(whm_json_writer_t* writer);
+/* a value that is already encoded JSON, re-encoded when writing CBOR */
+void whm_json_writer_value(whm_json_writer_t* writer, const char* json);
+/* copied as is in either format, for framing around the JSON */
+void whm_json_writer_raw(whm_json_writer_t* writer, const char* str);
+void whm_json_writer_raw_n(whm_json_writer_t* writer, const char* str, unsigned len);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+
+/* the measurement and the name tag, "whm,name=" and the name escaped */
+#define WHM_LINE_PROTOCOL_PREFIX_MAX(_name_len) (sizeof("whm,name=") + 2U * (_name_len))
+
+
+/* Lines of InfluxDB line protocol for the readings, without a timestamp
+ * as the receiver stamps them on arrival, age_ms saying how long before
+ * that the reading was taken. */
+
+/* the measurement, with the name as a tag unless empty as a tag can't be */
+void whm_line_protocol_prefix(char* dst, unsigned size, const char* name);
+/* the line's length, 0 if it doesn't fit */
+unsigned whm_line_protocol_line(char* buf, unsigned size, const char* prefix, uint32_t seq, unsigned boot,
+                                uint64_t age_ms, uint32_t rh_e3, int32_t t_e3);
+/* commas, equals signs and spaces end a tag value unless escaped */
+void whm_line_protocol_escape(char* dst, unsigned size, const char* src);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sampler.h"
+
+
+typedef struct whm_meas_log_entry
+{
+    /* the log's own, kept across boots */
+    uint32_t seq;
+    /* which boot the reading was taken in, its time_us is from then */
+    uint16_t boot;
+    whm_sampler_reading_t reading;
+} whm_meas_log_entry_t;
+
+
+typedef struct whm_meas_log_stats
+{
+    /* readings not yet consumed, in flash and waiting for a page */
+    uint32_t pending;
+    uint32_t appended;
+    /* unconsumed readings overwritten once the log went round */
+    uint32_t dropped;
+    uint32_t erases;
+    /* records that failed their CRC, e.g. cut short by a power loss */
+    uint32_t corrupt;
+    uint16_t boot;
+} whm_meas_log_stats_t;
+
+
+/* A ring of records in the flash region after the firmware, appended a
+ * page at a time and read back oldest first. Records are CRC checked, so
+ * whatever a power loss cut short is skipped, and consumed ones are
+ * marked in place so they aren't read again after a reboot. The sector
+ * a record lands in follows from its seq, so erases go round them all. */
+void whm_meas_log_init(void);
+uint16_t whm_meas_log_boot(void);
+void whm_meas_log_append(const whm_sampler_reading_t* reading);
+/* oldest pending first, returns how many were copied */
+unsigned whm_meas_log_peek(whm_meas_log_entry_t* entries, unsigned max);
+/* everything up to and including seq has been delivered */
+void whm_meas_log_consume(uint32_t seq);
+void whm_meas_log_get_stats(whm_meas_log_stats_t* stats);
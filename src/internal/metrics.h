@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "json_writer.h"
+#include "htu31d.h"
+#include "uplink.h"
+#include "mqtt.h"
+#include "telemetry.h"
+#include "meas_log.h"
+
+
+/* finite buckets, there is always one more for +Inf */
+#define WHM_METRICS_BUCKETS                     10
+#define WHM_METRICS_POOLS                       7
+
+
+typedef struct whm_metrics_histogram
+{
+    /* not cumulative, each counts only what fell in it */
+    uint32_t buckets[WHM_METRICS_BUCKETS + 1];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+} whm_metrics_histogram_t;
+
+
+/* lwIP's view of a pool, max is the high-water mark */
+typedef struct whm_metrics_pool
+{
+    uint32_t avail;
+    uint32_t used;
+    uint32_t max;
+    uint32_t err;
+} whm_metrics_pool_t;
+
+
+typedef struct whm_metrics_snapshot
+{
+    uint64_t uptime_us;
+    whm_metrics_pool_t mem;
+    whm_metrics_pool_t pools[WHM_METRICS_POOLS];
+    uint32_t heap_used;
+    uint32_t heap_size;
+    whm_metrics_histogram_t loop;
+    whm_htu31d_stats_t sensor;
+    whm_metrics_histogram_t sensor_latency;
+    whm_uplink_stats_t uplink;
+    whm_mqtt_stats_t mqtt;
+    whm_telemetry_stats_t telemetry;
+    whm_meas_log_stats_t meas_log;
+} whm_metrics_snapshot_t;
+
+
+/* times the main loop, call once per pass */
+void whm_metrics_iterate(void);
+void whm_metrics_observe(whm_metrics_histogram_t* histogram, uint32_t us);
+void whm_metrics_snapshot(whm_metrics_snapshot_t* snapshot);
+
+/* Prometheus text format, labels are written as given, e.g.
+ * route="/api/meas", and may be NULL */
+void whm_metrics_write_prometheus(whm_json_writer_t* writer, const whm_metrics_snapshot_t* snapshot);
+void whm_metrics_write_prometheus_type(whm_json_writer_t* writer, const char* name, const char* type);
+void whm_metrics_write_prometheus_value(whm_json_writer_t* writer, const char* name, const char* labels, uint64_t value);
+void whm_metrics_write_prometheus_histogram(whm_json_writer_t* writer, const char* name, const char* labels, const whm_metrics_histogram_t* histogram);
+
+/* members of an object the caller has opened */
+void whm_metrics_write_json(whm_json_writer_t* writer, const whm_metrics_snapshot_t* snapshot);
+void whm_metrics_write_json_histogram(whm_json_writer_t* writer, const whm_metrics_histogram_t* histogram);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+/* readings held while the broker can't be reached, oldest dropped */
+#define WHM_MQTT_QUEUE_LEN                      64U
+/* QoS 1 publishes waiting on their PUBACK at once */
+#define WHM_MQTT_INFLIGHT                       4U
+
+
+typedef struct whm_mqtt_stats
+{
+    uint32_t connects;
+    /* connections refused, lost or timed out, each followed by a backoff */
+    uint32_t failures;
+    uint32_t published;
+    uint32_t acked;
+    /* publishes that timed out or were lost with the connection, sent again */
+    uint32_t retries;
+    /* readings lost to a full queue */
+    uint32_t dropped;
+    uint32_t queued;
+    uint32_t inflight;
+} whm_mqtt_stats_t;
+
+
+/* Publishes the readings the sampler reports to the broker of the config
+ * at QoS 1, over one connection kept while connected as a station. A
+ * retained status is published on connecting, the will clearing it.
+ * Readings are only queued while the config has a broker host. */
+void whm_mqtt_init(void);
+void whm_mqtt_deinit(void);
+void whm_mqtt_iterate(void);
+void whm_mqtt_get_stats(whm_mqtt_stats_t* stats);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* clients limited at once, the least recently seen makes way */
+#define WHM_RATE_LIMIT_CLIENT_MAX               8U
+/* buckets are kept in thousandths of a request */
+#define WHM_RATE_LIMIT_TOKEN                    1000U
+
+
+/* What each client may spend on a route, a token bucket holding up to
+ * burst requests and gaining one every interval_ms. */
+typedef struct whm_rate_limit_budget
+{
+    uint32_t burst;
+    uint32_t interval_ms;
+} whm_rate_limit_budget_t;
+
+
+/* A client by IPv4 address, its buckets are the same row of tokens, one
+ * per route. */
+typedef struct whm_rate_limit_client
+{
+    bool used;
+    uint32_t addr;
+    uint64_t last_us;
+} whm_rate_limit_client_t;
+
+
+typedef struct whm_rate_limit
+{
+    unsigned routes;
+    const whm_rate_limit_budget_t* (* budget)(unsigned route);
+    whm_rate_limit_client_t clients[WHM_RATE_LIMIT_CLIENT_MAX];
+    /* WHM_RATE_LIMIT_CLIENT_MAX rows of routes */
+    uint32_t* tokens;
+} whm_rate_limit_t;
+
+
+void whm_rate_limit_init(whm_rate_limit_t* limit, unsigned routes,
+                         const whm_rate_limit_budget_t* (* budget)(unsigned route), uint32_t* tokens);
+/* 0 and a token taken if addr may make a request of route now, else the
+ * seconds until it may */
+uint32_t whm_rate_limit_admit(whm_rate_limit_t* limit, uint32_t addr, unsigned route, uint64_t now_us);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+
+/* recent events kept for the stream to catch up on */
+#define WHM_RULES_EVENTS                        8U
+
+
+typedef enum whm_rules_kind
+{
+    WHM_RULES_KIND_DEADBAND,
+    WHM_RULES_KIND_HIGH,
+    WHM_RULES_KIND_HIGH_CLEAR,
+    WHM_RULES_KIND_LOW,
+    WHM_RULES_KIND_LOW_CLEAR,
+    WHM_RULES_KIND_RATE,
+} whm_rules_kind_t;
+
+
+typedef struct whm_rules_event
+{
+    uint32_t seq;
+    uint64_t time_us;
+    uint8_t rule;
+    uint8_t channel;
+    uint8_t kind;
+    int32_t value_e3;
+} whm_rules_event_t;
+
+
+void whm_rules_init(void);
+/* Runs a reading through the rules of the config, true if any fired.
+ * A rule's state starts again whenever the rule itself changes. */
+bool whm_rules_evaluate(uint64_t time_us, uint32_t rh_e3, int32_t t_e3);
+/* Events are numbered from 1 in their own seq, last is 0 while there
+ * are none. Only the last WHM_RULES_EVENTS can be got. */
+uint32_t whm_rules_event_last(void);
+bool whm_rules_event_get(uint32_t seq, whm_rules_event_t* event);
+const char* whm_rules_kind_name(uint8_t kind);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WHM_SAMPLER_INTERVAL_MS                 1000U
+/* most readings one history request is given */
+#define WHM_SAMPLER_HISTORY_LEN                 512U
+/* compressed blocks of history kept in RAM, one reading every history_ms
+ * of the config, around 70 a block so a week at a minute apiece */
+#define WHM_SAMPLER_HISTORY_BLOCKS              128U
+
+
+typedef struct whm_sampler_reading
+{
+    uint32_t seq;
+    uint64_t time_us;
+    uint32_t rh_e3;
+    int32_t t_e3;
+} whm_sampler_reading_t;
+
+
+void whm_sampler_init(void);
+void whm_sampler_deinit(void);
+void whm_sampler_iterate(void);
+/* latest validated reading, false if there has not been one yet */
+bool whm_sampler_get(whm_sampler_reading_t* reading);
+/* Latest reading worth pushing to clients, every one unless the config
+ * has rules, then the first and those a rule fired on. */
+bool whm_sampler_get_reported(whm_sampler_reading_t* reading);
+uint32_t whm_sampler_get_age_ms(const whm_sampler_reading_t* reading);
+
+/* History records are numbered from 1 in their own seq, first and last
+ * are 0 while there are none. Overwritten oldest first once full. */
+uint32_t whm_sampler_history_first(void);
+uint32_t whm_sampler_history_last(void);
+bool whm_sampler_history_get(uint32_t seq, whm_sampler_reading_t* reading);
+/* Keeps records from seq onwards from being overwritten, for a reader
+ * that needs them to stay put over several calls. A record that would
+ * overwrite one is held back until the last pin is released, only the
+ * newest being kept if more arrive meanwhile. */
+void whm_sampler_history_pin(uint32_t seq);
+void whm_sampler_history_unpin(void);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* a flash page, so a block can be programmed as is */
+#define WHM_SERIES_BLOCK_SIZE                   256U
+#define WHM_SERIES_DATA_SIZE                    (WHM_SERIES_BLOCK_SIZE - 24U)
+
+
+typedef struct whm_series_sample
+{
+    uint64_t time_ms;
+    uint32_t rh_e3;
+    int32_t t_e3;
+} whm_series_sample_t;
+
+
+/* Samples of consecutive seq, the first kept whole in the header so a
+ * block decodes without any other, its full 64 bit time the base the
+ * others' times are counted from. Each after it is the change in its
+ * time delta and the change in either value from the one before, as
+ * zig-zag varints, so a steady interval and slowly moving values take a
+ * byte apiece. */
+typedef struct whm_series_block
+{
+    uint64_t base_ms;
+    uint32_t first_seq;
+    uint16_t count;
+    /* bytes of data used */
+    uint16_t len;
+    uint32_t first_rh_e3;
+    int32_t first_t_e3;
+    uint8_t data[WHM_SERIES_DATA_SIZE];
+} whm_series_block_t;
+
+
+typedef struct whm_series_encoder
+{
+    whm_series_block_t* block;
+    whm_series_sample_t last;
+    int64_t delta_ms;
+} whm_series_encoder_t;
+
+
+typedef struct whm_series_decoder
+{
+    const whm_series_block_t* block;
+    uint16_t index;
+    uint16_t pos;
+    whm_series_sample_t last;
+    int64_t delta_ms;
+} whm_series_decoder_t;
+
+
+/* empties the block, its first sample will be first_seq */
+void whm_series_encoder_init(whm_series_encoder_t* encoder, whm_series_block_t* block, uint32_t first_seq);
+/* false, leaving the block as it was, if the sample doesn't fit */
+bool whm_series_encoder_add(whm_series_encoder_t* encoder, const whm_series_sample_t* sample);
+
+/* Samples come out in order, reading the block's count as it goes so one
+ * still being added to can be followed. */
+void whm_series_decoder_init(whm_series_decoder_t* decoder, const whm_series_block_t* block);
+bool whm_series_decoder_next(whm_series_decoder_t* decoder, whm_series_sample_t* sample);
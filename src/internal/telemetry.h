@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+
+typedef struct whm_telemetry_stats
+{
+    uint32_t datagrams;
+    uint32_t lines;
+    /* readings not sent, as nowhere to send them yet or no pbuf */
+    uint32_t skipped;
+    uint32_t send_errors;
+    uint32_t resolve_errors;
+} whm_telemetry_stats_t;
+
+
+/* Sends the readings the sampler reports as InfluxDB line protocol in
+ * UDP datagrams, batch lines apiece, to the host of the config while
+ * connected as a station. Nothing is kept or sent again, each line has
+ * a seq counted from one every boot so the receiver can tell what it
+ * lost. */
+void whm_telemetry_init(void);
+void whm_telemetry_deinit(void);
+void whm_telemetry_iterate(void);
+void whm_telemetry_get_stats(whm_telemetry_stats_t* stats);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* readings held until the next batch, the oldest going to the flash log
+ * if the collector is slow to take them */
+#define WHM_UPLINK_QUEUE_LEN                    256U
+
+
+typedef struct whm_uplink_stats
+{
+    /* batches the collector took, and readings in them */
+    uint32_t posts;
+    uint32_t sent;
+    /* posts that failed, each followed by a backoff */
+    uint32_t failures;
+    uint32_t connects;
+    /* readings moved to the flash log, while the collector couldn't be
+     * reached or for want of room in the queue */
+    uint32_t logged;
+    uint32_t queued;
+    uint32_t backoff_ms;
+} whm_uplink_stats_t;
+
+
+/* Posts the readings the sampler reports to the collector of the config
+ * in batches, over a kept-alive connection while connected as a station.
+ * Failures back off exponentially with jitter. */
+void whm_uplink_init(void);
+void whm_uplink_deinit(void);
+void whm_uplink_iterate(void);
+void whm_uplink_get_stats(whm_uplink_stats_t* stats);
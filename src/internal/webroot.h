@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+
+#define WHM_WEBROOT_INDEX_GZ_ETAG           "\"" FIRMWARE_SHA1 "-gz\""
+
+
+extern const uint8_t whm_webroot_index_gz[];
+extern const uint8_t whm_webroot_index_gz_end[];
+
+#define WHM_WEBROOT_INDEX_GZ_LEN            ((unsigned)(whm_webroot_index_gz_end - whm_webroot_index_gz))
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lwip/tcp.h"
+
+
+#define WHM_WS_SERVER_PORT                      8080
+#define WHM_WS_SERVER_CLIENT_MAX                2
+#define WHM_WS_SERVER_RECV_BUFFER_SIZE          1280
+#define WHM_WS_SERVER_SEND_BUFFER_SIZE          1024
+
+
+struct whm_ws_server;
+
+
+typedef struct whm_ws_server_client
+{
+    struct whm_ws_server* server;
+    struct tcp_pcb* pcb;
+    bool upgraded;
+    uint8_t topics;
+    uint32_t meas_seq;
+    const char* state;
+    /* when the client last sent anything, or was pinged */
+    uint64_t last_us;
+    bool ping_sent;
+    bool scan_pending;
+    bool config_pending;
+    unsigned recv_len;
+    uint8_t recv_buffer[WHM_WS_SERVER_RECV_BUFFER_SIZE];
+} whm_ws_server_client_t;
+
+
+typedef struct whm_ws_server
+{
+    struct tcp_pcb* pcb;
+    whm_ws_server_client_t clients[WHM_WS_SERVER_CLIENT_MAX];
+    char send_buffer[WHM_WS_SERVER_SEND_BUFFER_SIZE];
+} whm_ws_server_t;
+
+
+int whm_ws_server_init(whm_ws_server_t* server);
+void whm_ws_server_deinit(whm_ws_server_t* server);
+void whm_ws_server_iterate(whm_ws_server_t* server);
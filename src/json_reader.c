@@ -0,0 +1,434 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "json_reader.h"
+
+
+typedef enum _whm_json_reader_state
+{
+    /* a value, at the top only an object or array */
+    _WHM_JSON_READER_STATE_VALUE,
+    /* first value of an array */
+    _WHM_JSON_READER_STATE_VALUE_OR_END,
+    _WHM_JSON_READER_STATE_KEY,
+    /* first key of an object */
+    _WHM_JSON_READER_STATE_KEY_OR_END,
+    _WHM_JSON_READER_STATE_COLON,
+    _WHM_JSON_READER_STATE_COMMA_OR_END,
+    _WHM_JSON_READER_STATE_STRING,
+    _WHM_JSON_READER_STATE_ESCAPE,
+    _WHM_JSON_READER_STATE_UNICODE,
+    _WHM_JSON_READER_STATE_NUMBER,
+    _WHM_JSON_READER_STATE_LITERAL,
+    _WHM_JSON_READER_STATE_DONE,
+    _WHM_JSON_READER_STATE_ERROR,
+} _whm_json_reader_state_t;
+
+
+static whm_json_reader_token_t _whm_json_reader_char(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_value(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_open(whm_json_reader_t* reader, bool object);
+static whm_json_reader_token_t _whm_json_reader_close(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_string(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_escape(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_unicode(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_literal(whm_json_reader_t* reader, char c);
+static whm_json_reader_token_t _whm_json_reader_scalar_end(whm_json_reader_t* reader, whm_json_reader_token_t token);
+static whm_json_reader_token_t _whm_json_reader_error(whm_json_reader_t* reader);
+static void _whm_json_reader_begin(whm_json_reader_t* reader, _whm_json_reader_state_t state);
+static bool _whm_json_reader_codepoint(whm_json_reader_t* reader, uint16_t unit);
+static void _whm_json_reader_append(whm_json_reader_t* reader, char c);
+static bool _whm_json_reader_is_number(char c);
+static int _whm_json_reader_hex(char c);
+
+
+void whm_json_reader_init(whm_json_reader_t* reader)
+{
+    memset(reader, 0, sizeof(whm_json_reader_t));
+    reader->state = _WHM_JSON_READER_STATE_VALUE;
+}
+
+
+unsigned whm_json_reader_next(whm_json_reader_t* reader, const char* data, unsigned len, whm_json_reader_token_t* token)
+{
+    *token = WHM_JSON_READER_TOKEN_NONE;
+    unsigned i = 0;
+    while (i < len && WHM_JSON_READER_TOKEN_NONE == *token)
+    {
+        if (_WHM_JSON_READER_STATE_NUMBER == reader->state && !_whm_json_reader_is_number(data[i]))
+        {
+            /* only ends on what follows it, which belongs to the next token */
+            *token = _whm_json_reader_scalar_end(reader, WHM_JSON_READER_TOKEN_NUMBER);
+            break;
+        }
+        *token = _whm_json_reader_char(reader, data[i]);
+        i++;
+    }
+    if (_WHM_JSON_READER_STATE_ERROR == reader->state)
+    {
+        *token = WHM_JSON_READER_TOKEN_ERROR;
+        return len;
+    }
+    return i;
+}
+
+
+bool whm_json_reader_done(const whm_json_reader_t* reader)
+{
+    return _WHM_JSON_READER_STATE_DONE == reader->state;
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_char(whm_json_reader_t* reader, char c)
+{
+    switch (reader->state)
+    {
+        case _WHM_JSON_READER_STATE_STRING:
+            return _whm_json_reader_string(reader, c);
+        case _WHM_JSON_READER_STATE_ESCAPE:
+            return _whm_json_reader_escape(reader, c);
+        case _WHM_JSON_READER_STATE_UNICODE:
+            return _whm_json_reader_unicode(reader, c);
+        case _WHM_JSON_READER_STATE_NUMBER:
+            _whm_json_reader_append(reader, c);
+            return WHM_JSON_READER_TOKEN_NONE;
+        case _WHM_JSON_READER_STATE_LITERAL:
+            return _whm_json_reader_literal(reader, c);
+        case _WHM_JSON_READER_STATE_DONE:
+            return WHM_JSON_READER_TOKEN_NONE;
+        case _WHM_JSON_READER_STATE_ERROR:
+            return WHM_JSON_READER_TOKEN_ERROR;
+        default:
+            break;
+    }
+    if (' ' == c || '\t' == c || '\r' == c || '\n' == c)
+    {
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    switch (reader->state)
+    {
+        case _WHM_JSON_READER_STATE_COLON:
+            if (':' != c)
+            {
+                return _whm_json_reader_error(reader);
+            }
+            reader->state = _WHM_JSON_READER_STATE_VALUE;
+            return WHM_JSON_READER_TOKEN_NONE;
+        case _WHM_JSON_READER_STATE_COMMA_OR_END:
+            if (',' != c)
+            {
+                return _whm_json_reader_close(reader, c);
+            }
+            reader->state = (reader->objects & (1UL << (reader->depth - 1)))
+                ? _WHM_JSON_READER_STATE_KEY
+                : _WHM_JSON_READER_STATE_VALUE;
+            return WHM_JSON_READER_TOKEN_NONE;
+        case _WHM_JSON_READER_STATE_KEY_OR_END:
+        case _WHM_JSON_READER_STATE_KEY:
+            if ('}' == c && _WHM_JSON_READER_STATE_KEY_OR_END == reader->state)
+            {
+                return _whm_json_reader_close(reader, c);
+            }
+            if ('"' != c)
+            {
+                return _whm_json_reader_error(reader);
+            }
+            reader->key = true;
+            _whm_json_reader_begin(reader, _WHM_JSON_READER_STATE_STRING);
+            return WHM_JSON_READER_TOKEN_NONE;
+        case _WHM_JSON_READER_STATE_VALUE_OR_END:
+            if (']' == c)
+            {
+                return _whm_json_reader_close(reader, c);
+            }
+            return _whm_json_reader_value(reader, c);
+        default:
+            return _whm_json_reader_value(reader, c);
+    }
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_value(whm_json_reader_t* reader, char c)
+{
+    if ('{' == c || '[' == c)
+    {
+        return _whm_json_reader_open(reader, '{' == c);
+    }
+    if (0 == reader->depth)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    if ('"' == c)
+    {
+        reader->key = false;
+        _whm_json_reader_begin(reader, _WHM_JSON_READER_STATE_STRING);
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    if ('-' == c || (c >= '0' && c <= '9'))
+    {
+        _whm_json_reader_begin(reader, _WHM_JSON_READER_STATE_NUMBER);
+        _whm_json_reader_append(reader, c);
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    static const char* const literals[] = {"true", "false", "null"};
+    for (unsigned i = 0; i < sizeof(literals) / sizeof(literals[0]); i++)
+    {
+        if (literals[i][0] == c)
+        {
+            _whm_json_reader_begin(reader, _WHM_JSON_READER_STATE_LITERAL);
+            reader->literal = literals[i];
+            reader->literal_pos = 1;
+            return WHM_JSON_READER_TOKEN_NONE;
+        }
+    }
+    return _whm_json_reader_error(reader);
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_open(whm_json_reader_t* reader, bool object)
+{
+    if (reader->depth >= WHM_JSON_READER_DEPTH_MAX)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    if (object)
+    {
+        reader->objects |= 1UL << reader->depth;
+        reader->state = _WHM_JSON_READER_STATE_KEY_OR_END;
+    }
+    else
+    {
+        reader->objects &= ~(1UL << reader->depth);
+        reader->state = _WHM_JSON_READER_STATE_VALUE_OR_END;
+    }
+    reader->depth++;
+    return object ? WHM_JSON_READER_TOKEN_OBJECT_BEGIN : WHM_JSON_READER_TOKEN_ARRAY_BEGIN;
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_close(whm_json_reader_t* reader, char c)
+{
+    if (0 == reader->depth)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    bool object = reader->objects & (1UL << (reader->depth - 1));
+    if ((object && '}' != c) || (!object && ']' != c))
+    {
+        return _whm_json_reader_error(reader);
+    }
+    reader->depth--;
+    reader->state = reader->depth ? _WHM_JSON_READER_STATE_COMMA_OR_END : _WHM_JSON_READER_STATE_DONE;
+    return object ? WHM_JSON_READER_TOKEN_OBJECT_END : WHM_JSON_READER_TOKEN_ARRAY_END;
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_string(whm_json_reader_t* reader, char c)
+{
+    if (reader->surrogate && '\\' != c)
+    {
+        /* a high surrogate not followed by the low one it needs */
+        return _whm_json_reader_error(reader);
+    }
+    if ('"' == c)
+    {
+        if (reader->key)
+        {
+            reader->value[reader->value_len] = '\0';
+            reader->state = _WHM_JSON_READER_STATE_COLON;
+            return WHM_JSON_READER_TOKEN_KEY;
+        }
+        return _whm_json_reader_scalar_end(reader, WHM_JSON_READER_TOKEN_STRING);
+    }
+    if ('\\' == c)
+    {
+        reader->state = _WHM_JSON_READER_STATE_ESCAPE;
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    if ((unsigned char)c < 0x20)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    _whm_json_reader_append(reader, c);
+    return WHM_JSON_READER_TOKEN_NONE;
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_escape(whm_json_reader_t* reader, char c)
+{
+    static const char escapes[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+    if (reader->surrogate && 'u' != c)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    if ('u' == c)
+    {
+        reader->unicode = 0;
+        reader->unicode_digits = 0;
+        reader->state = _WHM_JSON_READER_STATE_UNICODE;
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    for (unsigned i = 0; i + 1 < sizeof(escapes); i += 2)
+    {
+        if (escapes[i] == c)
+        {
+            _whm_json_reader_append(reader, escapes[i + 1]);
+            reader->state = _WHM_JSON_READER_STATE_STRING;
+            return WHM_JSON_READER_TOKEN_NONE;
+        }
+    }
+    return _whm_json_reader_error(reader);
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_unicode(whm_json_reader_t* reader, char c)
+{
+    int digit = _whm_json_reader_hex(c);
+    if (digit < 0)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    reader->unicode = (reader->unicode << 4) | digit;
+    if (++reader->unicode_digits < 4)
+    {
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    if (!_whm_json_reader_codepoint(reader, reader->unicode))
+    {
+        return _whm_json_reader_error(reader);
+    }
+    reader->state = _WHM_JSON_READER_STATE_STRING;
+    return WHM_JSON_READER_TOKEN_NONE;
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_literal(whm_json_reader_t* reader, char c)
+{
+    if (reader->literal[reader->literal_pos] != c)
+    {
+        return _whm_json_reader_error(reader);
+    }
+    if ('\0' != reader->literal[++reader->literal_pos])
+    {
+        return WHM_JSON_READER_TOKEN_NONE;
+    }
+    switch (reader->literal[0])
+    {
+        case 't':
+            return _whm_json_reader_scalar_end(reader, WHM_JSON_READER_TOKEN_TRUE);
+        case 'f':
+            return _whm_json_reader_scalar_end(reader, WHM_JSON_READER_TOKEN_FALSE);
+        default:
+            return _whm_json_reader_scalar_end(reader, WHM_JSON_READER_TOKEN_NULL);
+    }
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_scalar_end(whm_json_reader_t* reader, whm_json_reader_token_t token)
+{
+    /* scalars only appear inside an object or array */
+    reader->value[reader->value_len] = '\0';
+    reader->state = _WHM_JSON_READER_STATE_COMMA_OR_END;
+    return token;
+}
+
+
+static whm_json_reader_token_t _whm_json_reader_error(whm_json_reader_t* reader)
+{
+    reader->state = _WHM_JSON_READER_STATE_ERROR;
+    return WHM_JSON_READER_TOKEN_ERROR;
+}
+
+
+static void _whm_json_reader_begin(whm_json_reader_t* reader, _whm_json_reader_state_t state)
+{
+    reader->state = state;
+    reader->value_len = 0;
+    reader->truncated = false;
+    reader->surrogate = 0;
+}
+
+
+/* false for what a C string can't hold or isn't a whole character, a
+ * NUL or a surrogate without its other half */
+static bool _whm_json_reader_codepoint(whm_json_reader_t* reader, uint16_t unit)
+{
+    bool low = unit >= 0xDC00 && unit < 0xE000;
+    if (!unit || (reader->surrogate && !low) || (!reader->surrogate && low))
+    {
+        return false;
+    }
+    if (unit >= 0xD800 && unit < 0xDC00)
+    {
+        /* first half of a pair, the second follows as its own escape */
+        reader->surrogate = unit;
+        return true;
+    }
+    uint32_t codepoint = unit;
+    if (low)
+    {
+        codepoint = 0x10000 + ((uint32_t)(reader->surrogate - 0xD800) << 10) + (unit - 0xDC00);
+    }
+    reader->surrogate = 0;
+    if (codepoint < 0x80)
+    {
+        _whm_json_reader_append(reader, codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        _whm_json_reader_append(reader, 0xC0 | (codepoint >> 6));
+        _whm_json_reader_append(reader, 0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        _whm_json_reader_append(reader, 0xE0 | (codepoint >> 12));
+        _whm_json_reader_append(reader, 0x80 | ((codepoint >> 6) & 0x3F));
+        _whm_json_reader_append(reader, 0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        _whm_json_reader_append(reader, 0xF0 | (codepoint >> 18));
+        _whm_json_reader_append(reader, 0x80 | ((codepoint >> 12) & 0x3F));
+        _whm_json_reader_append(reader, 0x80 | ((codepoint >> 6) & 0x3F));
+        _whm_json_reader_append(reader, 0x80 | (codepoint & 0x3F));
+    }
+    return true;
+}
+
+
+static void _whm_json_reader_append(whm_json_reader_t* reader, char c)
+{
+    if (reader->value_len < WHM_JSON_READER_VALUE_MAX)
+    {
+        reader->value[reader->value_len++] = c;
+    }
+    else
+    {
+        reader->truncated = true;
+    }
+}
+
+
+static bool _whm_json_reader_is_number(char c)
+{
+    return (c >= '0' && c <= '9') || '-' == c || '+' == c || '.' == c || 'e' == c || 'E' == c;
+}
+
+
+static int _whm_json_reader_hex(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
@@ -0,0 +1,459 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_writer.h"
+#include "json_reader.h"
+
+
+#define _WHM_JSON_WRITER_UINT32_DIGITS          10
+
+/* major types, in the top three bits of the initial byte */
+#define _WHM_JSON_WRITER_CBOR_UINT              0x00
+#define _WHM_JSON_WRITER_CBOR_NINT              0x20
+#define _WHM_JSON_WRITER_CBOR_TEXT              0x60
+#define _WHM_JSON_WRITER_CBOR_ARRAY             0x80
+#define _WHM_JSON_WRITER_CBOR_MAP               0xA0
+#define _WHM_JSON_WRITER_CBOR_INDEFINITE        0x1F
+#define _WHM_JSON_WRITER_CBOR_FALSE             0xF4
+#define _WHM_JSON_WRITER_CBOR_TRUE              0xF5
+#define _WHM_JSON_WRITER_CBOR_NULL              0xF6
+#define _WHM_JSON_WRITER_CBOR_DOUBLE            0xFB
+#define _WHM_JSON_WRITER_CBOR_BREAK             0xFF
+
+
+static void _whm_json_writer_put(whm_json_writer_t* writer, const char* str, unsigned len);
+static void _whm_json_writer_separate(whm_json_writer_t* writer);
+static void _whm_json_writer_digits(whm_json_writer_t* writer, uint32_t value, unsigned min_digits);
+static void _whm_json_writer_cbor_byte(whm_json_writer_t* writer, uint8_t byte);
+static void _whm_json_writer_cbor_head(whm_json_writer_t* writer, uint8_t major, uint32_t value);
+static void _whm_json_writer_cbor_double(whm_json_writer_t* writer, double value);
+static void _whm_json_writer_cbor_number(whm_json_writer_t* writer, const char* number);
+
+
+void whm_json_writer_init(whm_json_writer_t* writer, char* buf, unsigned buflen, unsigned skip)
+{
+    writer->buf = buf;
+    writer->buflen = buf ? buflen : 0;
+    writer->skip = skip;
+    writer->pos = 0;
+    writer->comma = false;
+    writer->cbor = false;
+}
+
+
+void whm_json_writer_init_cbor(whm_json_writer_t* writer, char* buf, unsigned buflen, unsigned skip)
+{
+    whm_json_writer_init(writer, buf, buflen, skip);
+    writer->cbor = true;
+}
+
+
+unsigned whm_json_writer_len(const whm_json_writer_t* writer)
+{
+    return writer->pos;
+}
+
+
+unsigned whm_json_writer_written(const whm_json_writer_t* writer)
+{
+    if (writer->pos <= writer->skip)
+    {
+        return 0;
+    }
+    unsigned written = writer->pos - writer->skip;
+    return written < writer->buflen ? written : writer->buflen;
+}
+
+
+bool whm_json_writer_full(const whm_json_writer_t* writer)
+{
+    return writer->buf && writer->pos >= writer->skip + writer->buflen;
+}
+
+
+void whm_json_writer_object_begin(whm_json_writer_t* writer)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_byte(writer, _WHM_JSON_WRITER_CBOR_MAP | _WHM_JSON_WRITER_CBOR_INDEFINITE);
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    _whm_json_writer_put(writer, "{", 1);
+    writer->comma = false;
+}
+
+
+void whm_json_writer_object_end(whm_json_writer_t* writer)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_byte(writer, _WHM_JSON_WRITER_CBOR_BREAK);
+        return;
+    }
+    _whm_json_writer_put(writer, "}", 1);
+    writer->comma = true;
+}
+
+
+void whm_json_writer_array_begin(whm_json_writer_t* writer)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_byte(writer, _WHM_JSON_WRITER_CBOR_ARRAY | _WHM_JSON_WRITER_CBOR_INDEFINITE);
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    _whm_json_writer_put(writer, "[", 1);
+    writer->comma = false;
+}
+
+
+void whm_json_writer_array_end(whm_json_writer_t* writer)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_byte(writer, _WHM_JSON_WRITER_CBOR_BREAK);
+        return;
+    }
+    _whm_json_writer_put(writer, "]", 1);
+    writer->comma = true;
+}
+
+
+void whm_json_writer_key(whm_json_writer_t* writer, const char* key)
+{
+    whm_json_writer_string(writer, key);
+    if (writer->cbor)
+    {
+        /* a map's keys and values simply alternate */
+        return;
+    }
+    _whm_json_writer_put(writer, ":", 1);
+    writer->comma = false;
+}
+
+
+void whm_json_writer_string(whm_json_writer_t* writer, const char* str)
+{
+    whm_json_writer_string_n(writer, str, strlen(str));
+}
+
+
+void whm_json_writer_string_n(whm_json_writer_t* writer, const char* str, unsigned len)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_head(writer, _WHM_JSON_WRITER_CBOR_TEXT, len);
+        _whm_json_writer_put(writer, str, len);
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    _whm_json_writer_put(writer, "\"", 1);
+    unsigned run = 0;
+    for (unsigned i = 0; i < len; i++)
+    {
+        unsigned char c = str[i];
+        if (c >= 0x20 && '"' != c && '\\' != c)
+        {
+            continue;
+        }
+        /* flush the plain run before the character that needs escaping */
+        _whm_json_writer_put(writer, &str[run], i - run);
+        run = i + 1;
+        char escaped[6] = {'\\', c, 0, 0, 0, 0};
+        unsigned escaped_len = 2;
+        switch (c)
+        {
+            case '"':
+            case '\\':
+                break;
+            case '\n':
+                escaped[1] = 'n';
+                break;
+            case '\r':
+                escaped[1] = 'r';
+                break;
+            case '\t':
+                escaped[1] = 't';
+                break;
+            default:
+                escaped[1] = 'u';
+                escaped[2] = '0';
+                escaped[3] = '0';
+                escaped[4] = hex[c >> 4];
+                escaped[5] = hex[c & 0xF];
+                escaped_len = 6;
+                break;
+        }
+        _whm_json_writer_put(writer, escaped, escaped_len);
+    }
+    _whm_json_writer_put(writer, &str[run], len - run);
+    _whm_json_writer_put(writer, "\"", 1);
+    writer->comma = true;
+}
+
+
+void whm_json_writer_uint(whm_json_writer_t* writer, uint32_t value)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_head(writer, _WHM_JSON_WRITER_CBOR_UINT, value);
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    _whm_json_writer_digits(writer, value, 1);
+    writer->comma = true;
+}
+
+
+void whm_json_writer_int(whm_json_writer_t* writer, int32_t value)
+{
+    whm_json_writer_fixed(writer, value, 0);
+}
+
+
+void whm_json_writer_fixed(whm_json_writer_t* writer, int32_t value, unsigned decimals)
+{
+    /* sign written separately so -0.5 isn't lost in the integer part */
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+    uint32_t scale = 1;
+    for (unsigned i = 0; i < decimals; i++)
+    {
+        scale *= 10;
+    }
+    if (writer->cbor)
+    {
+        if (decimals)
+        {
+            _whm_json_writer_cbor_double(writer, (double)value / scale);
+        }
+        else if (value < 0)
+        {
+            _whm_json_writer_cbor_head(writer, _WHM_JSON_WRITER_CBOR_NINT, magnitude - 1);
+        }
+        else
+        {
+            _whm_json_writer_cbor_head(writer, _WHM_JSON_WRITER_CBOR_UINT, magnitude);
+        }
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    if (value < 0)
+    {
+        _whm_json_writer_put(writer, "-", 1);
+    }
+    _whm_json_writer_digits(writer, magnitude / scale, 1);
+    if (decimals)
+    {
+        _whm_json_writer_put(writer, ".", 1);
+        _whm_json_writer_digits(writer, magnitude % scale, decimals);
+    }
+    writer->comma = true;
+}
+
+
+void whm_json_writer_bool(whm_json_writer_t* writer, bool value)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_byte(writer, value ? _WHM_JSON_WRITER_CBOR_TRUE : _WHM_JSON_WRITER_CBOR_FALSE);
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    if (value)
+    {
+        _whm_json_writer_put(writer, "true", 4);
+    }
+    else
+    {
+        _whm_json_writer_put(writer, "false", 5);
+    }
+    writer->comma = true;
+}
+
+
+void whm_json_writer_null(whm_json_writer_t* writer)
+{
+    if (writer->cbor)
+    {
+        _whm_json_writer_cbor_byte(writer, _WHM_JSON_WRITER_CBOR_NULL);
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    _whm_json_writer_put(writer, "null", 4);
+    writer->comma = true;
+}
+
+
+void whm_json_writer_value(whm_json_writer_t* writer, const char* json)
+{
+    if (writer->cbor)
+    {
+        /* only ever small documents built into the firmware, so whatever
+         * fails to parse is cut short rather than reported */
+        whm_json_reader_t reader;
+        whm_json_reader_init(&reader);
+        unsigned len = strlen(json);
+        unsigned pos = 0;
+        while (pos < len && !whm_json_reader_done(&reader))
+        {
+            whm_json_reader_token_t token = WHM_JSON_READER_TOKEN_NONE;
+            pos += whm_json_reader_next(&reader, &json[pos], len - pos, &token);
+            switch (token)
+            {
+                case WHM_JSON_READER_TOKEN_OBJECT_BEGIN:
+                    whm_json_writer_object_begin(writer);
+                    break;
+                case WHM_JSON_READER_TOKEN_ARRAY_BEGIN:
+                    whm_json_writer_array_begin(writer);
+                    break;
+                case WHM_JSON_READER_TOKEN_OBJECT_END:
+                case WHM_JSON_READER_TOKEN_ARRAY_END:
+                    _whm_json_writer_cbor_byte(writer, _WHM_JSON_WRITER_CBOR_BREAK);
+                    break;
+                case WHM_JSON_READER_TOKEN_KEY:
+                case WHM_JSON_READER_TOKEN_STRING:
+                    whm_json_writer_string_n(writer, reader.value, reader.value_len);
+                    break;
+                case WHM_JSON_READER_TOKEN_NUMBER:
+                    _whm_json_writer_cbor_number(writer, reader.value);
+                    break;
+                case WHM_JSON_READER_TOKEN_TRUE:
+                case WHM_JSON_READER_TOKEN_FALSE:
+                    whm_json_writer_bool(writer, WHM_JSON_READER_TOKEN_TRUE == token);
+                    break;
+                case WHM_JSON_READER_TOKEN_NULL:
+                    whm_json_writer_null(writer);
+                    break;
+                case WHM_JSON_READER_TOKEN_ERROR:
+                    return;
+                default:
+                    break;
+            }
+        }
+        return;
+    }
+    _whm_json_writer_separate(writer);
+    _whm_json_writer_put(writer, json, strlen(json));
+    writer->comma = true;
+}
+
+
+void whm_json_writer_raw(whm_json_writer_t* writer, const char* str)
+{
+    whm_json_writer_raw_n(writer, str, strlen(str));
+}
+
+
+void whm_json_writer_raw_n(whm_json_writer_t* writer, const char* str, unsigned len)
+{
+    _whm_json_writer_put(writer, str, len);
+}
+
+
+static void _whm_json_writer_put(whm_json_writer_t* writer, const char* str, unsigned len)
+{
+    unsigned start = writer->pos;
+    writer->pos += len;
+    if (!writer->buf)
+    {
+        return;
+    }
+    unsigned window_end = writer->skip + writer->buflen;
+    unsigned from = start > writer->skip ? start : writer->skip;
+    unsigned to = writer->pos < window_end ? writer->pos : window_end;
+    if (from < to)
+    {
+        memcpy(&writer->buf[from - writer->skip], &str[from - start], to - from);
+    }
+}
+
+
+static void _whm_json_writer_separate(whm_json_writer_t* writer)
+{
+    if (writer->comma)
+    {
+        _whm_json_writer_put(writer, ",", 1);
+    }
+}
+
+
+static void _whm_json_writer_digits(whm_json_writer_t* writer, uint32_t value, unsigned min_digits)
+{
+    char digits[_WHM_JSON_WRITER_UINT32_DIGITS];
+    unsigned n = 0;
+    do
+    {
+        digits[sizeof(digits) - 1 - n++] = '0' + (value % 10);
+        value /= 10;
+    } while ((value || n < min_digits) && n < sizeof(digits));
+    _whm_json_writer_put(writer, &digits[sizeof(digits) - n], n);
+}
+
+
+static void _whm_json_writer_cbor_byte(whm_json_writer_t* writer, uint8_t byte)
+{
+    _whm_json_writer_put(writer, (const char*)&byte, 1);
+}
+
+
+static void _whm_json_writer_cbor_head(whm_json_writer_t* writer, uint8_t major, uint32_t value)
+{
+    /* shortest form, the argument follows big-endian in 1, 2 or 4 bytes */
+    char head[5] = {major, 0, 0, 0, 0};
+    unsigned len = 0;
+    if (value < 24)
+    {
+        head[0] |= value;
+    }
+    else if (value <= UINT8_MAX)
+    {
+        head[0] |= 24;
+        len = 1;
+    }
+    else if (value <= UINT16_MAX)
+    {
+        head[0] |= 25;
+        len = 2;
+    }
+    else
+    {
+        head[0] |= 26;
+        len = 4;
+    }
+    for (unsigned i = 0; i < len; i++)
+    {
+        head[len - i] = value >> (8 * i);
+    }
+    _whm_json_writer_put(writer, head, len + 1);
+}
+
+
+static void _whm_json_writer_cbor_double(whm_json_writer_t* writer, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    char encoded[9] = {_WHM_JSON_WRITER_CBOR_DOUBLE};
+    for (unsigned i = 0; i < 8; i++)
+    {
+        encoded[8 - i] = bits >> (8 * i);
+    }
+    _whm_json_writer_put(writer, encoded, sizeof(encoded));
+}
+
+
+static void _whm_json_writer_cbor_number(whm_json_writer_t* writer, const char* number)
+{
+    if (NULL == strpbrk(number, ".eE"))
+    {
+        whm_json_writer_int(writer, strtol(number, NULL, 10));
+    }
+    else
+    {
+        _whm_json_writer_cbor_double(writer, strtod(number, NULL));
+    }
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "line_protocol.h"
+#include "util.h"
+
+
+void whm_line_protocol_prefix(char* dst, unsigned size, const char* name)
+{
+    snprintf(dst, size, "%s", name[0] ? "whm,name=" : "whm");
+    unsigned len = strlen(dst);
+    if (name[0])
+    {
+        whm_line_protocol_escape(&dst[len], size - len, name);
+    }
+}
+
+
+unsigned whm_line_protocol_line(char* buf, unsigned size, const char* prefix, uint32_t seq, unsigned boot,
+                                uint64_t age_ms, uint32_t rh_e3, int32_t t_e3)
+{
+    int len = snprintf(buf, size,
+                       "%s seq=%" PRIu32 "i,boot=%ui,age_ms=%" PRIu64 "i,"
+                       "relative_humidity=%" PRIu32 ".%03" PRIu32 ",temperature=%s%" PRIu32 ".%03" PRIu32 "\n",
+                       prefix, seq, boot, age_ms, rh_e3 / 1000U, rh_e3 % 1000U,
+                       t_e3 < 0 ? "-" : "", WHM_ABS32(t_e3) / 1000U, WHM_ABS32(t_e3) % 1000U);
+    if (len < 0 || (unsigned)len >= size)
+    {
+        return 0;
+    }
+    return len;
+}
+
+
+void whm_line_protocol_escape(char* dst, unsigned size, const char* src)
+{
+    unsigned len = 0;
+    for (; *src; src++)
+    {
+        bool special = ',' == *src || '=' == *src || ' ' == *src;
+        unsigned need = special ? 2U : 1U;
+        /* with room left for the terminator */
+        if (len + need >= size)
+        {
+            break;
+        }
+        if (special)
+        {
+            dst[len++] = '\\';
+        }
+        dst[len++] = *src;
+    }
+    dst[len] = '\0';
+}
@@ -9,8 +9,13 @@
 #include "lwip/tcp.h"
 
 #include "htu31d.h"
+#include "sampler.h"
+#include "aggregate.h"
+#include "rules.h"
+#include "meas_log.h"
 #include "ap_station.h"
 #include "config.h"
+#include "metrics.h"
 #include "util.h"
 
 
@@ -19,6 +24,10 @@ int main(int argc, char **argv)
     stdio_init_all();
 
     whm_htu31d_init();
+    whm_sampler_init();
+    whm_aggregate_init();
+    whm_rules_init();
+    whm_meas_log_init();
 
     int gpio_toggle = 1;
     if (cyw43_arch_init())
@@ -49,14 +58,17 @@ int main(int argc, char **argv)
         while (time_us_64() - loop_time < blinking_time_us)
         {
             tight_loop_contents();
+            whm_metrics_iterate();
             whm_ap_station_iterate();
             whm_htu31d_iterate();
+            whm_sampler_iterate();
         }
         loop_time = time_us_64();
         gpio_toggle = (gpio_toggle + 1) % 2;
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, gpio_toggle);
     }
     whm_ap_station_deinit();
+    whm_sampler_deinit();
     whm_htu31d_deinit();
     return 0;
 }
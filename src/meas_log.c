@@ -0,0 +1,320 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "pico/sync.h"
+#include "hardware/flash.h"
+
+#include "meas_log.h"
+#include "flash_layout.h"
+#include "util.h"
+
+
+#define _WHM_MEAS_LOG_ERASED                    0xFFFFFFFFU
+#define _WHM_MEAS_LOG_PER_PAGE                  (FLASH_PAGE_SIZE / sizeof(_whm_meas_log_record_t))
+#define _WHM_MEAS_LOG_PER_SECTOR                (FLASH_SECTOR_SIZE / sizeof(_whm_meas_log_record_t))
+#define _WHM_MEAS_LOG_RECORDS                   (PERSIST_LOG_SIZE / sizeof(_whm_meas_log_record_t))
+
+
+/* As programmed, a record with seq s is always in slot s % records. */
+typedef struct _whm_meas_log_record
+{
+    uint32_t seq;
+    uint32_t sample_seq;
+    uint64_t time_us;
+    uint32_t rh_e3;
+    int32_t t_e3;
+    uint16_t boot;
+    /* 0xFFFF until consumed, then programmed to 0 in place, which only
+     * clears bits so needs no erase. Not covered by the CRC. */
+    uint16_t consumed;
+    uint32_t crc;
+} _whm_meas_log_record_t;
+
+
+_Static_assert(32 == sizeof(_whm_meas_log_record_t), "Log record isn't packed.");
+_Static_assert(0 == FLASH_PAGE_SIZE % sizeof(_whm_meas_log_record_t), "Log records must fill a page.");
+_Static_assert(0 == PERSIST_LOG_SIZE % FLASH_SECTOR_SIZE, "Log must be whole sectors.");
+
+
+static bool _whm_meas_log_read(uint32_t seq, _whm_meas_log_record_t* record);
+static uint32_t _whm_meas_log_slot_offset(uint32_t seq);
+static bool _whm_meas_log_page_erased(uint32_t seq);
+static void _whm_meas_log_flush(void);
+static void _whm_meas_log_mark(uint32_t first, uint32_t end);
+static uint32_t _whm_meas_log_crc32(const uint8_t* data, unsigned len);
+
+
+static struct
+{
+    uint16_t boot;
+    /* where the next page is programmed, always a page's first seq */
+    uint32_t next_seq;
+    /* nothing before this is pending */
+    uint32_t read_seq;
+    whm_sampler_reading_t buffer[_WHM_MEAS_LOG_PER_PAGE];
+    uint8_t buffered;
+    uint8_t page[FLASH_PAGE_SIZE];
+    whm_meas_log_stats_t stats;
+} _whm_meas_log_ctx;
+
+
+void whm_meas_log_init(void)
+{
+    memset(&_whm_meas_log_ctx, 0, sizeof(_whm_meas_log_ctx));
+    /* the newest record says where to carry on from */
+    bool found = false;
+    uint32_t max_seq = 0;
+    uint16_t max_boot = 0;
+    _whm_meas_log_record_t record;
+    for (uint32_t slot = 0; slot < _WHM_MEAS_LOG_RECORDS; slot++)
+    {
+        memcpy(&record, PERSIST_LOG_RAW_DATA + _whm_meas_log_slot_offset(slot), sizeof(record));
+        if (_WHM_MEAS_LOG_ERASED == record.seq)
+        {
+            continue;
+        }
+        if (!_whm_meas_log_read(record.seq, &record) || record.seq % _WHM_MEAS_LOG_RECORDS != slot)
+        {
+            _whm_meas_log_ctx.stats.corrupt++;
+            continue;
+        }
+        if (!found || record.seq > max_seq)
+        {
+            max_seq = record.seq;
+        }
+        max_boot = WHM_MAX(max_boot, record.boot);
+        found = true;
+    }
+    _whm_meas_log_ctx.boot = found ? max_boot + 1 : 0;
+    _whm_meas_log_ctx.next_seq = found ? WHM_CEIL(max_seq + 1, _WHM_MEAS_LOG_PER_PAGE) * _WHM_MEAS_LOG_PER_PAGE : 0;
+    /* a page a power loss cut short can't be programmed again, a new
+     * sector is erased first anyway */
+    while (_whm_meas_log_ctx.next_seq % _WHM_MEAS_LOG_PER_SECTOR && !_whm_meas_log_page_erased(_whm_meas_log_ctx.next_seq))
+    {
+        _whm_meas_log_ctx.next_seq += _WHM_MEAS_LOG_PER_PAGE;
+    }
+    uint32_t next_seq = _whm_meas_log_ctx.next_seq;
+    uint32_t seq = next_seq > _WHM_MEAS_LOG_RECORDS ? next_seq - _WHM_MEAS_LOG_RECORDS : 0;
+    for (; seq < next_seq; seq++)
+    {
+        if (_whm_meas_log_read(seq, &record) && 0xFFFF == record.consumed)
+        {
+            break;
+        }
+    }
+    _whm_meas_log_ctx.read_seq = seq;
+}
+
+
+uint16_t whm_meas_log_boot(void)
+{
+    return _whm_meas_log_ctx.boot;
+}
+
+
+void whm_meas_log_append(const whm_sampler_reading_t* reading)
+{
+    _whm_meas_log_ctx.buffer[_whm_meas_log_ctx.buffered++] = *reading;
+    _whm_meas_log_ctx.stats.appended++;
+    if (_WHM_MEAS_LOG_PER_PAGE == _whm_meas_log_ctx.buffered)
+    {
+        _whm_meas_log_flush();
+    }
+}
+
+
+unsigned whm_meas_log_peek(whm_meas_log_entry_t* entries, unsigned max)
+{
+    unsigned count = 0;
+    _whm_meas_log_record_t record;
+    for (uint32_t seq = _whm_meas_log_ctx.read_seq; seq < _whm_meas_log_ctx.next_seq && count < max; seq++)
+    {
+        if (!_whm_meas_log_read(seq, &record) || 0xFFFF != record.consumed)
+        {
+            if (!count)
+            {
+                /* nothing to come back for */
+                _whm_meas_log_ctx.read_seq = seq + 1;
+            }
+            continue;
+        }
+        whm_meas_log_entry_t* entry = &entries[count++];
+        entry->seq = seq;
+        entry->boot = record.boot;
+        entry->reading.seq = record.sample_seq;
+        entry->reading.time_us = record.time_us;
+        entry->reading.rh_e3 = record.rh_e3;
+        entry->reading.t_e3 = record.t_e3;
+    }
+    /* then those still waiting for a page, as they would be numbered */
+    for (uint8_t i = 0; i < _whm_meas_log_ctx.buffered && count < max; i++)
+    {
+        whm_meas_log_entry_t* entry = &entries[count++];
+        entry->seq = _whm_meas_log_ctx.next_seq + i;
+        entry->boot = _whm_meas_log_ctx.boot;
+        entry->reading = _whm_meas_log_ctx.buffer[i];
+    }
+    return count;
+}
+
+
+void whm_meas_log_consume(uint32_t seq)
+{
+    uint32_t end = WHM_MIN(seq + 1, _whm_meas_log_ctx.next_seq);
+    if (end > _whm_meas_log_ctx.read_seq)
+    {
+        _whm_meas_log_mark(_whm_meas_log_ctx.read_seq, end);
+        _whm_meas_log_ctx.read_seq = end;
+    }
+    if (seq >= _whm_meas_log_ctx.next_seq)
+    {
+        /* never reached flash, just forgotten */
+        uint8_t count = WHM_MIN(seq - _whm_meas_log_ctx.next_seq + 1, _whm_meas_log_ctx.buffered);
+        _whm_meas_log_ctx.buffered -= count;
+        memmove(_whm_meas_log_ctx.buffer, &_whm_meas_log_ctx.buffer[count],
+                _whm_meas_log_ctx.buffered * sizeof(whm_sampler_reading_t));
+    }
+}
+
+
+void whm_meas_log_get_stats(whm_meas_log_stats_t* stats)
+{
+    *stats = _whm_meas_log_ctx.stats;
+    stats->pending = _whm_meas_log_ctx.next_seq - _whm_meas_log_ctx.read_seq + _whm_meas_log_ctx.buffered;
+    stats->boot = _whm_meas_log_ctx.boot;
+}
+
+
+/* false for an erased, mismatched or corrupt slot */
+static bool _whm_meas_log_read(uint32_t seq, _whm_meas_log_record_t* record)
+{
+    memcpy(record, PERSIST_LOG_RAW_DATA + _whm_meas_log_slot_offset(seq), sizeof(_whm_meas_log_record_t));
+    if (record->seq != seq)
+    {
+        return false;
+    }
+    return record->crc == _whm_meas_log_crc32((const uint8_t*)record, offsetof(_whm_meas_log_record_t, consumed));
+}
+
+
+/* from the start of the log */
+static uint32_t _whm_meas_log_slot_offset(uint32_t seq)
+{
+    return (seq % _WHM_MEAS_LOG_RECORDS) * sizeof(_whm_meas_log_record_t);
+}
+
+
+static bool _whm_meas_log_page_erased(uint32_t seq)
+{
+    const uint8_t* page = PERSIST_LOG_RAW_DATA + _whm_meas_log_slot_offset(seq);
+    for (unsigned i = 0; i < FLASH_PAGE_SIZE; i++)
+    {
+        if (0xFF != page[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void _whm_meas_log_flush(void)
+{
+    uint32_t next_seq = _whm_meas_log_ctx.next_seq;
+    bool erase = 0 == next_seq % _WHM_MEAS_LOG_PER_SECTOR;
+    if (erase && next_seq + _WHM_MEAS_LOG_PER_SECTOR > _WHM_MEAS_LOG_RECORDS)
+    {
+        /* went round, what is left of the sector's last time goes */
+        uint32_t lost_end = next_seq + _WHM_MEAS_LOG_PER_SECTOR - _WHM_MEAS_LOG_RECORDS;
+        if (_whm_meas_log_ctx.read_seq < lost_end)
+        {
+            _whm_meas_log_ctx.stats.dropped += lost_end - _whm_meas_log_ctx.read_seq;
+            _whm_meas_log_ctx.read_seq = lost_end;
+        }
+    }
+    for (uint8_t i = 0; i < _WHM_MEAS_LOG_PER_PAGE; i++)
+    {
+        const whm_sampler_reading_t* reading = &_whm_meas_log_ctx.buffer[i];
+        _whm_meas_log_record_t record =
+        {
+            .seq = next_seq + i,
+            .sample_seq = reading->seq,
+            .time_us = reading->time_us,
+            .rh_e3 = reading->rh_e3,
+            .t_e3 = reading->t_e3,
+            .boot = _whm_meas_log_ctx.boot,
+            .consumed = 0xFFFF,
+        };
+        record.crc = _whm_meas_log_crc32((const uint8_t*)&record, offsetof(_whm_meas_log_record_t, consumed));
+        memcpy(&_whm_meas_log_ctx.page[i * sizeof(record)], &record, sizeof(record));
+    }
+    uint32_t offset = PERSIST_LOG_SECTOR + _whm_meas_log_slot_offset(next_seq);
+    critical_section_t crit_sec;
+    critical_section_init(&crit_sec);
+    critical_section_enter_blocking(&crit_sec);
+    if (erase)
+    {
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    }
+    flash_range_program(offset, _whm_meas_log_ctx.page, FLASH_PAGE_SIZE);
+    critical_section_exit(&crit_sec);
+    critical_section_deinit(&crit_sec);
+    if (erase)
+    {
+        _whm_meas_log_ctx.stats.erases++;
+    }
+    _whm_meas_log_ctx.next_seq += _WHM_MEAS_LOG_PER_PAGE;
+    _whm_meas_log_ctx.buffered = 0;
+}
+
+
+/* programs consumed to 0 for first up to end, a page at a time, the rest
+ * of the page left 0xFF so it is unchanged */
+static void _whm_meas_log_mark(uint32_t first, uint32_t end)
+{
+    _whm_meas_log_record_t record;
+    uint32_t seq = first;
+    while (seq < end)
+    {
+        uint32_t page_seq = seq - seq % _WHM_MEAS_LOG_PER_PAGE;
+        bool any = false;
+        memset(_whm_meas_log_ctx.page, 0xFF, FLASH_PAGE_SIZE);
+        for (; seq < end && seq < page_seq + _WHM_MEAS_LOG_PER_PAGE; seq++)
+        {
+            if (_whm_meas_log_read(seq, &record) && 0xFFFF == record.consumed)
+            {
+                unsigned at = (seq - page_seq) * sizeof(record) + offsetof(_whm_meas_log_record_t, consumed);
+                memset(&_whm_meas_log_ctx.page[at], 0, sizeof(record.consumed));
+                any = true;
+            }
+        }
+        if (!any)
+        {
+            continue;
+        }
+        critical_section_t crit_sec;
+        critical_section_init(&crit_sec);
+        critical_section_enter_blocking(&crit_sec);
+        flash_range_program(PERSIST_LOG_SECTOR + _whm_meas_log_slot_offset(page_seq), _whm_meas_log_ctx.page, FLASH_PAGE_SIZE);
+        critical_section_exit(&crit_sec);
+        critical_section_deinit(&crit_sec);
+    }
+}
+
+
+/* CRC-32 as in zlib, bitwise as records are short */
+static uint32_t _whm_meas_log_crc32(const uint8_t* data, unsigned len)
+{
+    uint32_t crc = 0xFFFFFFFFU;
+    for (unsigned i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320U & -(crc & 1U));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <malloc.h>
+
+#include "pico/time.h"
+#include "pico/cyw43_arch.h"
+
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#include "metrics.h"
+#include "json_writer.h"
+#include "htu31d.h"
+
+
+#define _WHM_METRICS_NUMBER_LEN                 24
+
+
+static void _whm_metrics_pool(whm_metrics_pool_t* pool, const struct stats_mem* stats);
+static void _whm_metrics_write_prometheus_pools(whm_json_writer_t* writer, const whm_metrics_snapshot_t* snapshot, unsigned field);
+static uint32_t _whm_metrics_pool_field(const whm_metrics_pool_t* pool, unsigned field);
+static void _whm_metrics_write_json_pool(whm_json_writer_t* writer, const char* name, const whm_metrics_pool_t* pool);
+static void _whm_metrics_write_seconds(whm_json_writer_t* writer, uint64_t us);
+
+
+/* from the linker script, the heap is everything between them */
+extern char __end__;
+extern char __HeapLimit;
+
+
+static const struct
+{
+    uint32_t us;
+    const char* le;
+} _whm_metrics_buckets[WHM_METRICS_BUCKETS] =
+{
+    {100, "0.0001"},
+    {500, "0.0005"},
+    {1000, "0.001"},
+    {5000, "0.005"},
+    {10000, "0.01"},
+    {50000, "0.05"},
+    {100000, "0.1"},
+    {500000, "0.5"},
+    {1000000, "1"},
+    {5000000, "5"},
+};
+
+
+/* one metric family per field of whm_metrics_pool_t */
+static const struct
+{
+    const char* name;
+    const char* type;
+} _whm_metrics_pool_fields[] =
+{
+    {"whm_lwip_pool_used", "gauge"},
+    {"whm_lwip_pool_max", "gauge"},
+    {"whm_lwip_pool_avail", "gauge"},
+    {"whm_lwip_pool_errors_total", "counter"},
+};
+
+
+static const struct
+{
+    const char* name;
+    memp_t memp;
+} _whm_metrics_pools[WHM_METRICS_POOLS] =
+{
+    {"pbuf_pool", MEMP_PBUF_POOL},
+    {"pbuf", MEMP_PBUF},
+    {"tcp_pcb", MEMP_TCP_PCB},
+    {"tcp_pcb_listen", MEMP_TCP_PCB_LISTEN},
+    {"tcp_seg", MEMP_TCP_SEG},
+    {"udp_pcb", MEMP_UDP_PCB},
+    {"sys_timeout", MEMP_SYS_TIMEOUT},
+};
+
+
+static struct
+{
+    uint64_t last_us;
+    whm_metrics_histogram_t loop;
+} _whm_metrics_ctx =
+{
+    .last_us = 0,
+};
+
+
+void whm_metrics_iterate(void)
+{
+    uint64_t now = time_us_64();
+    if (_whm_metrics_ctx.last_us)
+    {
+        whm_metrics_observe(&_whm_metrics_ctx.loop, now - _whm_metrics_ctx.last_us);
+    }
+    _whm_metrics_ctx.last_us = now;
+}
+
+
+void whm_metrics_observe(whm_metrics_histogram_t* histogram, uint32_t us)
+{
+    unsigned i = 0;
+    while (i < WHM_METRICS_BUCKETS && us > _whm_metrics_buckets[i].us)
+    {
+        i++;
+    }
+    histogram->buckets[i]++;
+    histogram->count++;
+    histogram->sum_us += us;
+    if (us > histogram->max_us)
+    {
+        histogram->max_us = us;
+    }
+}
+
+
+void whm_metrics_snapshot(whm_metrics_snapshot_t* snapshot)
+{
+    snapshot->uptime_us = time_us_64();
+    cyw43_arch_lwip_begin();
+    _whm_metrics_pool(&snapshot->mem, &lwip_stats.mem);
+    for (unsigned i = 0; i < WHM_METRICS_POOLS; i++)
+    {
+        _whm_metrics_pool(&snapshot->pools[i], lwip_stats.memp[_whm_metrics_pools[i].memp]);
+    }
+    cyw43_arch_lwip_end();
+    struct mallinfo info = mallinfo();
+    snapshot->heap_used = info.uordblks;
+    snapshot->heap_size = &__HeapLimit - &__end__;
+    snapshot->loop = _whm_metrics_ctx.loop;
+    whm_htu31d_get_stats(&snapshot->sensor);
+    whm_htu31d_get_latency(&snapshot->sensor_latency);
+    whm_uplink_get_stats(&snapshot->uplink);
+    whm_mqtt_get_stats(&snapshot->mqtt);
+    whm_telemetry_get_stats(&snapshot->telemetry);
+    whm_meas_log_get_stats(&snapshot->meas_log);
+}
+
+
+void whm_metrics_write_prometheus(whm_json_writer_t* writer, const whm_metrics_snapshot_t* snapshot)
+{
+    whm_metrics_write_prometheus_type(writer, "whm_uptime_seconds", "gauge");
+    whm_json_writer_raw(writer, "whm_uptime_seconds ");
+    _whm_metrics_write_seconds(writer, snapshot->uptime_us);
+    whm_json_writer_raw(writer, "\n");
+    whm_metrics_write_prometheus_type(writer, "whm_heap_used_bytes", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_heap_used_bytes", NULL, snapshot->heap_used);
+    whm_metrics_write_prometheus_type(writer, "whm_heap_size_bytes", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_heap_size_bytes", NULL, snapshot->heap_size);
+    for (unsigned field = 0; field < sizeof(_whm_metrics_pool_fields) / sizeof(_whm_metrics_pool_fields[0]); field++)
+    {
+        _whm_metrics_write_prometheus_pools(writer, snapshot, field);
+    }
+    whm_metrics_write_prometheus_type(writer, "whm_main_loop_seconds", "histogram");
+    whm_metrics_write_prometheus_histogram(writer, "whm_main_loop_seconds", NULL, &snapshot->loop);
+    char labels[32];
+    snprintf(labels, sizeof(labels), "profile=\"%s\"", whm_htu31d_profile_name(snapshot->sensor.profile));
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_profile", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_sensor_profile", labels, 1);
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_conversion_seconds", "gauge");
+    whm_json_writer_raw(writer, "whm_sensor_conversion_seconds ");
+    _whm_metrics_write_seconds(writer, snapshot->sensor.conversion_us);
+    whm_json_writer_raw(writer, "\n");
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_margin_seconds", "gauge");
+    whm_json_writer_raw(writer, "whm_sensor_margin_seconds ");
+    _whm_metrics_write_seconds(writer, snapshot->sensor.margin_us);
+    whm_json_writer_raw(writer, "\n");
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_not_ready_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_sensor_not_ready_total", NULL, snapshot->sensor.not_ready);
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_coalesced_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_sensor_coalesced_total", NULL, snapshot->sensor.coalesced);
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_cached_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_sensor_cached_total", NULL, snapshot->sensor.cached);
+    whm_metrics_write_prometheus_type(writer, "whm_sensor_latency_seconds", "histogram");
+    whm_metrics_write_prometheus_histogram(writer, "whm_sensor_latency_seconds", NULL, &snapshot->sensor_latency);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_posts_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_uplink_posts_total", NULL, snapshot->uplink.posts);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_sent_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_uplink_sent_total", NULL, snapshot->uplink.sent);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_failures_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_uplink_failures_total", NULL, snapshot->uplink.failures);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_connects_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_uplink_connects_total", NULL, snapshot->uplink.connects);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_logged_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_uplink_logged_total", NULL, snapshot->uplink.logged);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_queued", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_uplink_queued", NULL, snapshot->uplink.queued);
+    whm_metrics_write_prometheus_type(writer, "whm_uplink_backoff_seconds", "gauge");
+    whm_json_writer_raw(writer, "whm_uplink_backoff_seconds ");
+    _whm_metrics_write_seconds(writer, (uint64_t)snapshot->uplink.backoff_ms * 1000U);
+    whm_json_writer_raw(writer, "\n");
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_connects_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_connects_total", NULL, snapshot->mqtt.connects);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_failures_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_failures_total", NULL, snapshot->mqtt.failures);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_published_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_published_total", NULL, snapshot->mqtt.published);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_acked_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_acked_total", NULL, snapshot->mqtt.acked);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_retries_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_retries_total", NULL, snapshot->mqtt.retries);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_dropped_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_dropped_total", NULL, snapshot->mqtt.dropped);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_queued", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_queued", NULL, snapshot->mqtt.queued);
+    whm_metrics_write_prometheus_type(writer, "whm_mqtt_inflight", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_mqtt_inflight", NULL, snapshot->mqtt.inflight);
+    whm_metrics_write_prometheus_type(writer, "whm_telemetry_datagrams_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_telemetry_datagrams_total", NULL, snapshot->telemetry.datagrams);
+    whm_metrics_write_prometheus_type(writer, "whm_telemetry_lines_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_telemetry_lines_total", NULL, snapshot->telemetry.lines);
+    whm_metrics_write_prometheus_type(writer, "whm_telemetry_skipped_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_telemetry_skipped_total", NULL, snapshot->telemetry.skipped);
+    whm_metrics_write_prometheus_type(writer, "whm_telemetry_send_errors_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_telemetry_send_errors_total", NULL, snapshot->telemetry.send_errors);
+    whm_metrics_write_prometheus_type(writer, "whm_telemetry_resolve_errors_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_telemetry_resolve_errors_total", NULL, snapshot->telemetry.resolve_errors);
+    whm_metrics_write_prometheus_type(writer, "whm_meas_log_appended_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_meas_log_appended_total", NULL, snapshot->meas_log.appended);
+    whm_metrics_write_prometheus_type(writer, "whm_meas_log_dropped_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_meas_log_dropped_total", NULL, snapshot->meas_log.dropped);
+    whm_metrics_write_prometheus_type(writer, "whm_meas_log_erases_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_meas_log_erases_total", NULL, snapshot->meas_log.erases);
+    whm_metrics_write_prometheus_type(writer, "whm_meas_log_corrupt_total", "counter");
+    whm_metrics_write_prometheus_value(writer, "whm_meas_log_corrupt_total", NULL, snapshot->meas_log.corrupt);
+    whm_metrics_write_prometheus_type(writer, "whm_meas_log_pending", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_meas_log_pending", NULL, snapshot->meas_log.pending);
+    whm_metrics_write_prometheus_type(writer, "whm_meas_log_boot", "gauge");
+    whm_metrics_write_prometheus_value(writer, "whm_meas_log_boot", NULL, snapshot->meas_log.boot);
+}
+
+
+void whm_metrics_write_prometheus_type(whm_json_writer_t* writer, const char* name, const char* type)
+{
+    whm_json_writer_raw(writer, "# TYPE ");
+    whm_json_writer_raw(writer, name);
+    whm_json_writer_raw(writer, " ");
+    whm_json_writer_raw(writer, type);
+    whm_json_writer_raw(writer, "\n");
+}
+
+
+void whm_metrics_write_prometheus_value(whm_json_writer_t* writer, const char* name, const char* labels, uint64_t value)
+{
+    char number[_WHM_METRICS_NUMBER_LEN];
+    whm_json_writer_raw(writer, name);
+    if (NULL != labels)
+    {
+        whm_json_writer_raw(writer, "{");
+        whm_json_writer_raw(writer, labels);
+        whm_json_writer_raw(writer, "}");
+    }
+    snprintf(number, sizeof(number), " %" PRIu64 "\n", value);
+    whm_json_writer_raw(writer, number);
+}
+
+
+void whm_metrics_write_prometheus_histogram(whm_json_writer_t* writer, const char* name, const char* labels, const whm_metrics_histogram_t* histogram)
+{
+    char number[_WHM_METRICS_NUMBER_LEN];
+    uint32_t cumulative = 0;
+    for (unsigned i = 0; i <= WHM_METRICS_BUCKETS; i++)
+    {
+        cumulative += histogram->buckets[i];
+        whm_json_writer_raw(writer, name);
+        whm_json_writer_raw(writer, "_bucket{");
+        if (NULL != labels)
+        {
+            whm_json_writer_raw(writer, labels);
+            whm_json_writer_raw(writer, ",");
+        }
+        whm_json_writer_raw(writer, "le=\"");
+        whm_json_writer_raw(writer, i < WHM_METRICS_BUCKETS ? _whm_metrics_buckets[i].le : "+Inf");
+        snprintf(number, sizeof(number), "\"} %" PRIu32 "\n", cumulative);
+        whm_json_writer_raw(writer, number);
+    }
+    whm_json_writer_raw(writer, name);
+    whm_json_writer_raw(writer, "_sum");
+    if (NULL != labels)
+    {
+        whm_json_writer_raw(writer, "{");
+        whm_json_writer_raw(writer, labels);
+        whm_json_writer_raw(writer, "}");
+    }
+    whm_json_writer_raw(writer, " ");
+    _whm_metrics_write_seconds(writer, histogram->sum_us);
+    whm_json_writer_raw(writer, "\n");
+    char count_name[64];
+    snprintf(count_name, sizeof(count_name), "%s_count", name);
+    whm_metrics_write_prometheus_value(writer, count_name, labels, histogram->count);
+}
+
+
+void whm_metrics_write_json(whm_json_writer_t* writer, const whm_metrics_snapshot_t* snapshot)
+{
+    whm_json_writer_key(writer, "uptime_ms");
+    whm_json_writer_uint(writer, snapshot->uptime_us / 1000);
+    whm_json_writer_key(writer, "heap");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "used");
+    whm_json_writer_uint(writer, snapshot->heap_used);
+    whm_json_writer_key(writer, "size");
+    whm_json_writer_uint(writer, snapshot->heap_size);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "lwip");
+    whm_json_writer_object_begin(writer);
+    _whm_metrics_write_json_pool(writer, "mem", &snapshot->mem);
+    for (unsigned i = 0; i < WHM_METRICS_POOLS; i++)
+    {
+        _whm_metrics_write_json_pool(writer, _whm_metrics_pools[i].name, &snapshot->pools[i]);
+    }
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "main_loop");
+    whm_metrics_write_json_histogram(writer, &snapshot->loop);
+    whm_json_writer_key(writer, "sensor");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "profile");
+    whm_json_writer_string(writer, whm_htu31d_profile_name(snapshot->sensor.profile));
+    whm_json_writer_key(writer, "conversion_us");
+    whm_json_writer_uint(writer, snapshot->sensor.conversion_us);
+    whm_json_writer_key(writer, "margin_us");
+    whm_json_writer_uint(writer, snapshot->sensor.margin_us);
+    whm_json_writer_key(writer, "not_ready");
+    whm_json_writer_uint(writer, snapshot->sensor.not_ready);
+    whm_json_writer_key(writer, "coalesced");
+    whm_json_writer_uint(writer, snapshot->sensor.coalesced);
+    whm_json_writer_key(writer, "cached");
+    whm_json_writer_uint(writer, snapshot->sensor.cached);
+    whm_json_writer_key(writer, "latency");
+    whm_metrics_write_json_histogram(writer, &snapshot->sensor_latency);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "uplink");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "posts");
+    whm_json_writer_uint(writer, snapshot->uplink.posts);
+    whm_json_writer_key(writer, "sent");
+    whm_json_writer_uint(writer, snapshot->uplink.sent);
+    whm_json_writer_key(writer, "failures");
+    whm_json_writer_uint(writer, snapshot->uplink.failures);
+    whm_json_writer_key(writer, "connects");
+    whm_json_writer_uint(writer, snapshot->uplink.connects);
+    whm_json_writer_key(writer, "logged");
+    whm_json_writer_uint(writer, snapshot->uplink.logged);
+    whm_json_writer_key(writer, "queued");
+    whm_json_writer_uint(writer, snapshot->uplink.queued);
+    whm_json_writer_key(writer, "backoff_ms");
+    whm_json_writer_uint(writer, snapshot->uplink.backoff_ms);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "mqtt");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "connects");
+    whm_json_writer_uint(writer, snapshot->mqtt.connects);
+    whm_json_writer_key(writer, "failures");
+    whm_json_writer_uint(writer, snapshot->mqtt.failures);
+    whm_json_writer_key(writer, "published");
+    whm_json_writer_uint(writer, snapshot->mqtt.published);
+    whm_json_writer_key(writer, "acked");
+    whm_json_writer_uint(writer, snapshot->mqtt.acked);
+    whm_json_writer_key(writer, "retries");
+    whm_json_writer_uint(writer, snapshot->mqtt.retries);
+    whm_json_writer_key(writer, "dropped");
+    whm_json_writer_uint(writer, snapshot->mqtt.dropped);
+    whm_json_writer_key(writer, "queued");
+    whm_json_writer_uint(writer, snapshot->mqtt.queued);
+    whm_json_writer_key(writer, "inflight");
+    whm_json_writer_uint(writer, snapshot->mqtt.inflight);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "telemetry");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "datagrams");
+    whm_json_writer_uint(writer, snapshot->telemetry.datagrams);
+    whm_json_writer_key(writer, "lines");
+    whm_json_writer_uint(writer, snapshot->telemetry.lines);
+    whm_json_writer_key(writer, "skipped");
+    whm_json_writer_uint(writer, snapshot->telemetry.skipped);
+    whm_json_writer_key(writer, "send_errors");
+    whm_json_writer_uint(writer, snapshot->telemetry.send_errors);
+    whm_json_writer_key(writer, "resolve_errors");
+    whm_json_writer_uint(writer, snapshot->telemetry.resolve_errors);
+    whm_json_writer_object_end(writer);
+    whm_json_writer_key(writer, "meas_log");
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "pending");
+    whm_json_writer_uint(writer, snapshot->meas_log.pending);
+    whm_json_writer_key(writer, "appended");
+    whm_json_writer_uint(writer, snapshot->meas_log.appended);
+    whm_json_writer_key(writer, "dropped");
+    whm_json_writer_uint(writer, snapshot->meas_log.dropped);
+    whm_json_writer_key(writer, "erases");
+    whm_json_writer_uint(writer, snapshot->meas_log.erases);
+    whm_json_writer_key(writer, "corrupt");
+    whm_json_writer_uint(writer, snapshot->meas_log.corrupt);
+    whm_json_writer_key(writer, "boot");
+    whm_json_writer_uint(writer, snapshot->meas_log.boot);
+    whm_json_writer_object_end(writer);
+}
+
+
+void whm_metrics_write_json_histogram(whm_json_writer_t* writer, const whm_metrics_histogram_t* histogram)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "count");
+    whm_json_writer_uint(writer, histogram->count);
+    whm_json_writer_key(writer, "sum_ms");
+    whm_json_writer_uint(writer, histogram->sum_us / 1000);
+    whm_json_writer_key(writer, "max_us");
+    whm_json_writer_uint(writer, histogram->max_us);
+    whm_json_writer_key(writer, "le_us");
+    whm_json_writer_array_begin(writer);
+    for (unsigned i = 0; i < WHM_METRICS_BUCKETS; i++)
+    {
+        whm_json_writer_uint(writer, _whm_metrics_buckets[i].us);
+    }
+    whm_json_writer_array_end(writer);
+    /* one more than le_us, the last being everything above */
+    whm_json_writer_key(writer, "buckets");
+    whm_json_writer_array_begin(writer);
+    for (unsigned i = 0; i <= WHM_METRICS_BUCKETS; i++)
+    {
+        whm_json_writer_uint(writer, histogram->buckets[i]);
+    }
+    whm_json_writer_array_end(writer);
+    whm_json_writer_object_end(writer);
+}
+
+
+static void _whm_metrics_pool(whm_metrics_pool_t* pool, const struct stats_mem* stats)
+{
+    pool->avail = stats->avail;
+    pool->used = stats->used;
+    pool->max = stats->max;
+    pool->err = stats->err;
+}
+
+
+static void _whm_metrics_write_prometheus_pools(whm_json_writer_t* writer, const whm_metrics_snapshot_t* snapshot, unsigned field)
+{
+    /* samples of a family have to be together, after its type */
+    const char* name = _whm_metrics_pool_fields[field].name;
+    whm_metrics_write_prometheus_type(writer, name, _whm_metrics_pool_fields[field].type);
+    whm_metrics_write_prometheus_value(writer, name, "pool=\"mem\"", _whm_metrics_pool_field(&snapshot->mem, field));
+    for (unsigned i = 0; i < WHM_METRICS_POOLS; i++)
+    {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "pool=\"%s\"", _whm_metrics_pools[i].name);
+        whm_metrics_write_prometheus_value(writer, name, labels, _whm_metrics_pool_field(&snapshot->pools[i], field));
+    }
+}
+
+
+static uint32_t _whm_metrics_pool_field(const whm_metrics_pool_t* pool, unsigned field)
+{
+    switch (field)
+    {
+        case 0:
+            return pool->used;
+        case 1:
+            return pool->max;
+        case 2:
+            return pool->avail;
+        default:
+            return pool->err;
+    }
+}
+
+
+static void _whm_metrics_write_json_pool(whm_json_writer_t* writer, const char* name, const whm_metrics_pool_t* pool)
+{
+    whm_json_writer_key(writer, name);
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "used");
+    whm_json_writer_uint(writer, pool->used);
+    whm_json_writer_key(writer, "max");
+    whm_json_writer_uint(writer, pool->max);
+    whm_json_writer_key(writer, "avail");
+    whm_json_writer_uint(writer, pool->avail);
+    whm_json_writer_key(writer, "errors");
+    whm_json_writer_uint(writer, pool->err);
+    whm_json_writer_object_end(writer);
+}
+
+
+static void _whm_metrics_write_seconds(whm_json_writer_t* writer, uint64_t us)
+{
+    char number[_WHM_METRICS_NUMBER_LEN];
+    snprintf(number, sizeof(number), "%" PRIu64 ".%06" PRIu32, us / 1000000, (uint32_t)(us % 1000000));
+    whm_json_writer_raw(writer, number);
+}
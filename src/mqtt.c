@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/time.h"
+#include "pico/unique_id.h"
+#include "pico/cyw43_arch.h"
+
+#include "lwip/dns.h"
+#include "lwip/apps/mqtt.h"
+
+#include "mqtt.h"
+#include "config.h"
+#include "sampler.h"
+#include "ap_station.h"
+#include "json_writer.h"
+#include "util.h"
+
+
+#define _WHM_MQTT_KEEP_ALIVE_S                  60
+#define _WHM_MQTT_QOS                           1
+#define _WHM_MQTT_PAYLOAD_SIZE                  128
+/* "whm-" and the board id in hex */
+#define _WHM_MQTT_CLIENT_ID_LEN                 (4 + 2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES)
+/* from resolving to the broker accepting */
+#define _WHM_MQTT_TIMEOUT_US                    (10 * 1000 * 1000) /* 10 seconds */
+#define _WHM_MQTT_BACKOFF_MIN_MS                1000U
+#define _WHM_MQTT_BACKOFF_MAX_MS                (5U * 60U * 1000U) /* 5 minutes */
+#define _WHM_MQTT_STATUS_ONLINE                 "{\"online\":true,\"name\":"
+#define _WHM_MQTT_STATUS_OFFLINE                "{\"online\":false}"
+
+
+typedef enum _whm_mqtt_state
+{
+    /* not connected, or no broker */
+    _WHM_MQTT_STATE_IDLE,
+    _WHM_MQTT_STATE_RESOLVING,
+    _WHM_MQTT_STATE_CONNECTING,
+    _WHM_MQTT_STATE_CONNECTED,
+    _WHM_MQTT_STATE_BACKOFF,
+} _whm_mqtt_state_t;
+
+
+typedef enum _whm_mqtt_entry_state
+{
+    _WHM_MQTT_ENTRY_QUEUED,
+    _WHM_MQTT_ENTRY_INFLIGHT,
+    _WHM_MQTT_ENTRY_ACKED,
+} _whm_mqtt_entry_state_t;
+
+
+typedef struct _whm_mqtt_entry
+{
+    /* the head this was queued at, so a late PUBACK for one since
+     * dropped and overwritten can be told apart */
+    uint32_t pos;
+    uint8_t state;
+    whm_sampler_reading_t reading;
+} _whm_mqtt_entry_t;
+
+
+static void _whm_mqtt_queue(const whm_sampler_reading_t* reading);
+static void _whm_mqtt_resolve(void);
+static void _whm_mqtt_dns_found(const char* name, const ip_addr_t* addr, void* arg);
+static void _whm_mqtt_connect(void);
+static void _whm_mqtt_connection(mqtt_client_t* client, void* arg, mqtt_connection_status_t status);
+static void _whm_mqtt_publish_status(void);
+static void _whm_mqtt_publish_queued(void);
+static void _whm_mqtt_published(void* arg, err_t err);
+static void _whm_mqtt_requeue(void);
+static void _whm_mqtt_fail(const char* reason);
+static void _whm_mqtt_disconnect(void);
+
+
+static struct
+{
+    _whm_mqtt_state_t state;
+    mqtt_client_t* client;
+    /* the broker and topics connected with */
+    whm_config_mqtt_t conf;
+    char client_id[_WHM_MQTT_CLIENT_ID_LEN + 1];
+    ip_addr_t addr;
+    uint32_t reading_seq;
+    /* counted since init, head - tail are queued, tail only passes
+     * what the broker has acknowledged */
+    uint32_t head;
+    uint32_t tail;
+    _whm_mqtt_entry_t queue[WHM_MQTT_QUEUE_LEN];
+    uint32_t inflight;
+    uint64_t deadline_us;
+    uint64_t retry_us;
+    uint8_t attempts;
+    whm_mqtt_stats_t stats;
+} _whm_mqtt_ctx;
+
+
+void whm_mqtt_init(void)
+{
+    memset(&_whm_mqtt_ctx, 0, sizeof(_whm_mqtt_ctx));
+    _whm_mqtt_ctx.state = _WHM_MQTT_STATE_IDLE;
+    /* unique across a fleet, which the broker needs of a client id */
+    strcpy(_whm_mqtt_ctx.client_id, "whm-");
+    pico_get_unique_board_id_string(&_whm_mqtt_ctx.client_id[4], sizeof(_whm_mqtt_ctx.client_id) - 4);
+    cyw43_arch_lwip_begin();
+    _whm_mqtt_ctx.client = mqtt_client_new();
+    cyw43_arch_lwip_end();
+    if (!_whm_mqtt_ctx.client)
+    {
+        printf("Failed to allocate mqtt client\n");
+    }
+}
+
+
+void whm_mqtt_deinit(void)
+{
+    cyw43_arch_lwip_begin();
+    _whm_mqtt_disconnect();
+    if (_whm_mqtt_ctx.client)
+    {
+        mqtt_client_free(_whm_mqtt_ctx.client);
+        _whm_mqtt_ctx.client = NULL;
+    }
+    cyw43_arch_lwip_end();
+    _whm_mqtt_ctx.state = _WHM_MQTT_STATE_IDLE;
+}
+
+
+void whm_mqtt_iterate(void)
+{
+    uint64_t now = time_us_64();
+    whm_sampler_reading_t reading;
+    if (whm_sampler_get_reported(&reading) && reading.seq != _whm_mqtt_ctx.reading_seq)
+    {
+        _whm_mqtt_ctx.reading_seq = reading.seq;
+        /* without a broker there is nobody to hold them for */
+        if (_whm_mqtt_ctx.conf.host[0])
+        {
+            _whm_mqtt_queue(&reading);
+        }
+    }
+    if (!_whm_mqtt_ctx.client)
+    {
+        return;
+    }
+    cyw43_arch_lwip_begin();
+    if (0 != memcmp(&_whm_mqtt_ctx.conf, &whm_conf.mqtt, sizeof(_whm_mqtt_ctx.conf)))
+    {
+        /* changed, start again with the new one */
+        _whm_mqtt_disconnect();
+        _whm_mqtt_ctx.conf = whm_conf.mqtt;
+        _whm_mqtt_ctx.state = _WHM_MQTT_STATE_IDLE;
+        _whm_mqtt_ctx.attempts = 0;
+        if (!_whm_mqtt_ctx.conf.host[0])
+        {
+            /* nowhere left to send what was queued */
+            _whm_mqtt_ctx.tail = _whm_mqtt_ctx.head;
+        }
+    }
+    if (!whm_ap_station_get_connected() && _WHM_MQTT_STATE_IDLE != _whm_mqtt_ctx.state)
+    {
+        _whm_mqtt_disconnect();
+        _whm_mqtt_ctx.state = _WHM_MQTT_STATE_IDLE;
+    }
+    switch (_whm_mqtt_ctx.state)
+    {
+        case _WHM_MQTT_STATE_IDLE:
+            if (_whm_mqtt_ctx.conf.host[0] && whm_ap_station_get_connected())
+            {
+                _whm_mqtt_ctx.deadline_us = now + _WHM_MQTT_TIMEOUT_US;
+                _whm_mqtt_resolve();
+            }
+            break;
+        case _WHM_MQTT_STATE_RESOLVING:
+        case _WHM_MQTT_STATE_CONNECTING:
+            if (now >= _whm_mqtt_ctx.deadline_us)
+            {
+                _whm_mqtt_fail("timed out");
+            }
+            break;
+        case _WHM_MQTT_STATE_CONNECTED:
+            _whm_mqtt_publish_queued();
+            break;
+        case _WHM_MQTT_STATE_BACKOFF:
+            if (now >= _whm_mqtt_ctx.retry_us)
+            {
+                _whm_mqtt_ctx.state = _WHM_MQTT_STATE_IDLE;
+            }
+            break;
+    }
+    cyw43_arch_lwip_end();
+}
+
+
+void whm_mqtt_get_stats(whm_mqtt_stats_t* stats)
+{
+    *stats = _whm_mqtt_ctx.stats;
+    stats->queued = _whm_mqtt_ctx.head - _whm_mqtt_ctx.tail;
+    stats->inflight = _whm_mqtt_ctx.inflight;
+}
+
+
+static void _whm_mqtt_queue(const whm_sampler_reading_t* reading)
+{
+    if (WHM_MQTT_QUEUE_LEN == _whm_mqtt_ctx.head - _whm_mqtt_ctx.tail)
+    {
+        /* the oldest goes, its PUBACK is ignored if still coming */
+        _whm_mqtt_entry_t* oldest = &_whm_mqtt_ctx.queue[_whm_mqtt_ctx.tail % WHM_MQTT_QUEUE_LEN];
+        if (_WHM_MQTT_ENTRY_INFLIGHT == oldest->state)
+        {
+            _whm_mqtt_ctx.inflight--;
+        }
+        _whm_mqtt_ctx.tail++;
+        _whm_mqtt_ctx.stats.dropped++;
+    }
+    _whm_mqtt_entry_t* entry = &_whm_mqtt_ctx.queue[_whm_mqtt_ctx.head % WHM_MQTT_QUEUE_LEN];
+    entry->pos = _whm_mqtt_ctx.head;
+    entry->state = _WHM_MQTT_ENTRY_QUEUED;
+    entry->reading = *reading;
+    _whm_mqtt_ctx.head++;
+}
+
+
+static void _whm_mqtt_resolve(void)
+{
+    _whm_mqtt_ctx.state = _WHM_MQTT_STATE_RESOLVING;
+    err_t err = dns_gethostbyname(_whm_mqtt_ctx.conf.host, &_whm_mqtt_ctx.addr, _whm_mqtt_dns_found, NULL);
+    if (ERR_OK == err)
+    {
+        /* an address, or already cached */
+        _whm_mqtt_connect();
+    }
+    else if (ERR_INPROGRESS != err)
+    {
+        _whm_mqtt_fail("dns");
+    }
+}
+
+
+static void _whm_mqtt_dns_found(const char* name, const ip_addr_t* addr, void* arg)
+{
+    if (_WHM_MQTT_STATE_RESOLVING != _whm_mqtt_ctx.state)
+    {
+        /* timed out meanwhile */
+        return;
+    }
+    if (!addr)
+    {
+        _whm_mqtt_fail("dns");
+        return;
+    }
+    _whm_mqtt_ctx.addr = *addr;
+    _whm_mqtt_connect();
+}
+
+
+static void _whm_mqtt_connect(void)
+{
+    struct mqtt_connect_client_info_t info =
+    {
+        .client_id = _whm_mqtt_ctx.client_id,
+        .keep_alive = _WHM_MQTT_KEEP_ALIVE_S,
+        .will_topic = _whm_mqtt_ctx.conf.status_topic,
+        .will_msg = _WHM_MQTT_STATUS_OFFLINE,
+        .will_qos = _WHM_MQTT_QOS,
+        .will_retain = 1,
+    };
+    _whm_mqtt_ctx.state = _WHM_MQTT_STATE_CONNECTING;
+    err_t err = mqtt_client_connect(_whm_mqtt_ctx.client, &_whm_mqtt_ctx.addr, _whm_mqtt_ctx.conf.port,
+                                    _whm_mqtt_connection, NULL, &info);
+    if (ERR_OK != err)
+    {
+        _whm_mqtt_fail("connect");
+    }
+}
+
+
+/* called once accepted, and once more when that connection ends */
+static void _whm_mqtt_connection(mqtt_client_t* client, void* arg, mqtt_connection_status_t status)
+{
+    if (MQTT_CONNECT_ACCEPTED == status)
+    {
+        if (_WHM_MQTT_STATE_CONNECTING != _whm_mqtt_ctx.state)
+        {
+            return;
+        }
+        _whm_mqtt_ctx.stats.connects++;
+        _whm_mqtt_ctx.attempts = 0;
+        _whm_mqtt_ctx.state = _WHM_MQTT_STATE_CONNECTED;
+        _whm_mqtt_publish_status();
+        _whm_mqtt_publish_queued();
+        return;
+    }
+    /* lwIP drops its pending requests without calling back */
+    _whm_mqtt_requeue();
+    if (_WHM_MQTT_STATE_CONNECTING == _whm_mqtt_ctx.state || _WHM_MQTT_STATE_CONNECTED == _whm_mqtt_ctx.state)
+    {
+        char reason[24];
+        snprintf(reason, sizeof(reason), "status %u", (unsigned)status);
+        _whm_mqtt_fail(reason);
+    }
+}
+
+
+static void _whm_mqtt_publish_status(void)
+{
+    char payload[_WHM_MQTT_PAYLOAD_SIZE];
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, payload, sizeof(payload), 0);
+    whm_json_writer_raw(&writer, _WHM_MQTT_STATUS_ONLINE);
+    whm_json_writer_string(&writer, whm_conf.name);
+    whm_json_writer_raw(&writer, "}");
+    if (whm_json_writer_full(&writer))
+    {
+        return;
+    }
+    /* not queued, the next connect publishes it again anyway */
+    mqtt_publish(_whm_mqtt_ctx.client, _whm_mqtt_ctx.conf.status_topic, payload, whm_json_writer_written(&writer),
+                 _WHM_MQTT_QOS, 1, NULL, NULL);
+}
+
+
+/* oldest first, anything not yet acknowledged and not in flight */
+static void _whm_mqtt_publish_queued(void)
+{
+    uint64_t now = time_us_64();
+    for (uint32_t pos = _whm_mqtt_ctx.tail; pos != _whm_mqtt_ctx.head && _whm_mqtt_ctx.inflight < WHM_MQTT_INFLIGHT; pos++)
+    {
+        _whm_mqtt_entry_t* entry = &_whm_mqtt_ctx.queue[pos % WHM_MQTT_QUEUE_LEN];
+        if (_WHM_MQTT_ENTRY_QUEUED != entry->state)
+        {
+            continue;
+        }
+        char payload[_WHM_MQTT_PAYLOAD_SIZE];
+        whm_json_writer_t writer;
+        whm_json_writer_init(&writer, payload, sizeof(payload), 0);
+        whm_json_writer_object_begin(&writer);
+        whm_json_writer_key(&writer, "seq");
+        whm_json_writer_uint(&writer, entry->reading.seq);
+        whm_json_writer_key(&writer, "age_ms");
+        whm_json_writer_uint(&writer, (now - entry->reading.time_us) / 1000U);
+        whm_json_writer_key(&writer, "relative_humidity");
+        whm_json_writer_fixed(&writer, entry->reading.rh_e3, 3);
+        whm_json_writer_key(&writer, "temperature");
+        whm_json_writer_fixed(&writer, entry->reading.t_e3, 3);
+        whm_json_writer_object_end(&writer);
+        err_t err = mqtt_publish(_whm_mqtt_ctx.client, _whm_mqtt_ctx.conf.meas_topic, payload,
+                                 whm_json_writer_written(&writer), _WHM_MQTT_QOS, 0,
+                                 _whm_mqtt_published, (void*)(uintptr_t)pos);
+        if (ERR_OK != err)
+        {
+            /* out of request slots or output buffer, tried again next time */
+            break;
+        }
+        entry->state = _WHM_MQTT_ENTRY_INFLIGHT;
+        _whm_mqtt_ctx.inflight++;
+        _whm_mqtt_ctx.stats.published++;
+    }
+}
+
+
+static void _whm_mqtt_published(void* arg, err_t err)
+{
+    uint32_t pos = (uintptr_t)arg;
+    _whm_mqtt_entry_t* entry = &_whm_mqtt_ctx.queue[pos % WHM_MQTT_QUEUE_LEN];
+    if (entry->pos != pos || _WHM_MQTT_ENTRY_INFLIGHT != entry->state)
+    {
+        /* dropped from the queue meanwhile */
+        return;
+    }
+    _whm_mqtt_ctx.inflight--;
+    if (ERR_OK != err)
+    {
+        _whm_mqtt_ctx.stats.retries++;
+        entry->state = _WHM_MQTT_ENTRY_QUEUED;
+        return;
+    }
+    _whm_mqtt_ctx.stats.acked++;
+    entry->state = _WHM_MQTT_ENTRY_ACKED;
+    while (_whm_mqtt_ctx.tail != _whm_mqtt_ctx.head
+           && _WHM_MQTT_ENTRY_ACKED == _whm_mqtt_ctx.queue[_whm_mqtt_ctx.tail % WHM_MQTT_QUEUE_LEN].state)
+    {
+        _whm_mqtt_ctx.tail++;
+    }
+}
+
+
+/* what was in flight goes again on the next connection, QoS 1 allows
+ * the broker to see it twice */
+static void _whm_mqtt_requeue(void)
+{
+    for (uint32_t pos = _whm_mqtt_ctx.tail; pos != _whm_mqtt_ctx.head; pos++)
+    {
+        _whm_mqtt_entry_t* entry = &_whm_mqtt_ctx.queue[pos % WHM_MQTT_QUEUE_LEN];
+        if (_WHM_MQTT_ENTRY_INFLIGHT == entry->state)
+        {
+            entry->state = _WHM_MQTT_ENTRY_QUEUED;
+            _whm_mqtt_ctx.stats.retries++;
+        }
+    }
+    _whm_mqtt_ctx.inflight = 0;
+}
+
+
+/* waits 1/2 to all of min * 2^attempts before the next try */
+static void _whm_mqtt_fail(const char* reason)
+{
+    printf("mqtt failed, %s\n", reason);
+    _whm_mqtt_disconnect();
+    _whm_mqtt_ctx.stats.failures++;
+    if (_whm_mqtt_ctx.attempts < 31)
+    {
+        _whm_mqtt_ctx.attempts++;
+    }
+    uint32_t delay_ms = _WHM_MQTT_BACKOFF_MAX_MS;
+    if (_whm_mqtt_ctx.attempts <= 10)
+    {
+        delay_ms = WHM_MIN(_WHM_MQTT_BACKOFF_MIN_MS << (_whm_mqtt_ctx.attempts - 1), _WHM_MQTT_BACKOFF_MAX_MS);
+    }
+    delay_ms = delay_ms / 2U + LWIP_RAND() % (delay_ms / 2U + 1U);
+    _whm_mqtt_ctx.retry_us = time_us_64() + WHM_MS_TO_US((uint64_t)delay_ms);
+    _whm_mqtt_ctx.state = _WHM_MQTT_STATE_BACKOFF;
+}
+
+
+static void _whm_mqtt_disconnect(void)
+{
+    /* moved on first, the disconnect may call back into
+     * _whm_mqtt_connection, also aborts a connect still in progress */
+    _whm_mqtt_ctx.state = _WHM_MQTT_STATE_IDLE;
+    if (_whm_mqtt_ctx.client)
+    {
+        mqtt_disconnect(_whm_mqtt_ctx.client);
+    }
+    _whm_mqtt_requeue();
+}
@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rate_limit.h"
+
+
+static whm_rate_limit_client_t* _whm_rate_limit_client(whm_rate_limit_t* limit, uint32_t addr, uint64_t now_us);
+
+
+void whm_rate_limit_init(whm_rate_limit_t* limit, unsigned routes,
+                         const whm_rate_limit_budget_t* (* budget)(unsigned route), uint32_t* tokens)
+{
+    memset(limit, 0, sizeof(whm_rate_limit_t));
+    limit->routes = routes;
+    limit->budget = budget;
+    limit->tokens = tokens;
+}
+
+
+uint32_t whm_rate_limit_admit(whm_rate_limit_t* limit, uint32_t addr, unsigned route, uint64_t now_us)
+{
+    whm_rate_limit_client_t* client = _whm_rate_limit_client(limit, addr, now_us);
+    uint32_t* tokens = &limit->tokens[(client - limit->clients) * limit->routes];
+    uint64_t elapsed_us = now_us - client->last_us;
+    client->last_us = now_us;
+    for (unsigned i = 0; i < limit->routes; i++)
+    {
+        const whm_rate_limit_budget_t* budget = limit->budget(i);
+        uint64_t full = (uint64_t)budget->burst * WHM_RATE_LIMIT_TOKEN;
+        /* a token every interval_ms is a thousandth every interval_ms us */
+        uint64_t refilled = tokens[i] + elapsed_us / budget->interval_ms;
+        tokens[i] = refilled < full ? refilled : full;
+    }
+    if (tokens[route] < WHM_RATE_LIMIT_TOKEN)
+    {
+        uint64_t wait_us = (uint64_t)(WHM_RATE_LIMIT_TOKEN - tokens[route]) * limit->budget(route)->interval_ms;
+        return (wait_us + 999999) / 1000000;
+    }
+    tokens[route] -= WHM_RATE_LIMIT_TOKEN;
+    return 0;
+}
+
+
+/* found by address, or else a new one with full buckets in place of a
+ * free slot or the least recently seen */
+static whm_rate_limit_client_t* _whm_rate_limit_client(whm_rate_limit_t* limit, uint32_t addr, uint64_t now_us)
+{
+    whm_rate_limit_client_t* client = NULL;
+    for (unsigned i = 0; i < WHM_RATE_LIMIT_CLIENT_MAX; i++)
+    {
+        whm_rate_limit_client_t* c = &limit->clients[i];
+        if (c->used && c->addr == addr)
+        {
+            return c;
+        }
+        if (NULL == client || (client->used && (!c->used || c->last_us < client->last_us)))
+        {
+            client = c;
+        }
+    }
+    uint32_t* tokens = &limit->tokens[(client - limit->clients) * limit->routes];
+    client->used = true;
+    client->addr = addr;
+    client->last_us = now_us;
+    for (unsigned i = 0; i < limit->routes; i++)
+    {
+        tokens[i] = limit->budget(i)->burst * WHM_RATE_LIMIT_TOKEN;
+    }
+    return client;
+}
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rules.h"
+#include "config.h"
+#include "util.h"
+
+
+#define _WHM_RULES_MINUTE_US                    (60U * 1000U * 1000U)
+
+
+typedef struct _whm_rules_state
+{
+    /* the rule this state was built up under */
+    whm_config_rule_t rule;
+    bool valid;
+    /* last value the deadband fired on */
+    int32_t reported_e3;
+    bool high;
+    bool low;
+    int32_t last_e3;
+    uint64_t last_us;
+} _whm_rules_state_t;
+
+
+static bool _whm_rules_rule(uint8_t index, const whm_config_rule_t* rule, uint64_t time_us, int32_t value_e3);
+static bool _whm_rules_same(const whm_config_rule_t* a, const whm_config_rule_t* b);
+static void _whm_rules_fire(uint8_t index, const whm_config_rule_t* rule, uint8_t kind, uint64_t time_us, int32_t value_e3);
+
+
+static const char* const _whm_rules_kind_names[] =
+{
+    [WHM_RULES_KIND_DEADBAND] = "deadband",
+    [WHM_RULES_KIND_HIGH] = "high",
+    [WHM_RULES_KIND_HIGH_CLEAR] = "high_clear",
+    [WHM_RULES_KIND_LOW] = "low",
+    [WHM_RULES_KIND_LOW_CLEAR] = "low_clear",
+    [WHM_RULES_KIND_RATE] = "rate",
+};
+
+
+static struct
+{
+    _whm_rules_state_t states[WHM_CONFIG_RULES_MAX];
+    uint32_t event_last;
+    whm_rules_event_t events[WHM_RULES_EVENTS];
+} _whm_rules_ctx;
+
+
+void whm_rules_init(void)
+{
+    memset(&_whm_rules_ctx, 0, sizeof(_whm_rules_ctx));
+}
+
+
+bool whm_rules_evaluate(uint64_t time_us, uint32_t rh_e3, int32_t t_e3)
+{
+    bool fired = false;
+    uint8_t count = WHM_MIN(whm_conf.rules_count, WHM_CONFIG_RULES_MAX);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const whm_config_rule_t* rule = &whm_conf.rules[i];
+        int32_t value_e3 = WHM_CONFIG_CHANNEL_TEMPERATURE == rule->channel ? t_e3 : (int32_t)rh_e3;
+        /* every rule is run, each keeps its own state */
+        fired |= _whm_rules_rule(i, rule, time_us, value_e3);
+    }
+    return fired;
+}
+
+
+uint32_t whm_rules_event_last(void)
+{
+    return _whm_rules_ctx.event_last;
+}
+
+
+bool whm_rules_event_get(uint32_t seq, whm_rules_event_t* event)
+{
+    uint32_t last = _whm_rules_ctx.event_last;
+    if (0 == seq || seq > last || last - seq >= WHM_RULES_EVENTS)
+    {
+        return false;
+    }
+    *event = _whm_rules_ctx.events[(seq - 1) % WHM_RULES_EVENTS];
+    return true;
+}
+
+
+const char* whm_rules_kind_name(uint8_t kind)
+{
+    return kind < sizeof(_whm_rules_kind_names) / sizeof(_whm_rules_kind_names[0]) ? _whm_rules_kind_names[kind] : "unknown";
+}
+
+
+static bool _whm_rules_rule(uint8_t index, const whm_config_rule_t* rule, uint64_t time_us, int32_t value_e3)
+{
+    _whm_rules_state_t* state = &_whm_rules_ctx.states[index];
+    if (!_whm_rules_same(&state->rule, rule))
+    {
+        memset(state, 0, sizeof(_whm_rules_state_t));
+        state->rule = *rule;
+    }
+    bool fired = false;
+    if (rule->deadband_e3
+        && (!state->valid || WHM_ABS32(value_e3 - state->reported_e3) >= (uint32_t)rule->deadband_e3))
+    {
+        _whm_rules_fire(index, rule, WHM_RULES_KIND_DEADBAND, time_us, value_e3);
+        state->reported_e3 = value_e3;
+        fired = true;
+    }
+    if (rule->high_set)
+    {
+        if (!state->high && value_e3 >= rule->high_e3)
+        {
+            _whm_rules_fire(index, rule, WHM_RULES_KIND_HIGH, time_us, value_e3);
+            state->high = true;
+            fired = true;
+        }
+        else if (state->high && value_e3 <= rule->high_e3 - rule->hysteresis_e3)
+        {
+            _whm_rules_fire(index, rule, WHM_RULES_KIND_HIGH_CLEAR, time_us, value_e3);
+            state->high = false;
+            fired = true;
+        }
+    }
+    if (rule->low_set)
+    {
+        if (!state->low && value_e3 <= rule->low_e3)
+        {
+            _whm_rules_fire(index, rule, WHM_RULES_KIND_LOW, time_us, value_e3);
+            state->low = true;
+            fired = true;
+        }
+        else if (state->low && value_e3 >= rule->low_e3 + rule->hysteresis_e3)
+        {
+            _whm_rules_fire(index, rule, WHM_RULES_KIND_LOW_CLEAR, time_us, value_e3);
+            state->low = false;
+            fired = true;
+        }
+    }
+    if (rule->rate_e3 && state->valid && time_us > state->last_us)
+    {
+        /* change per minute over rate, without dividing */
+        uint64_t change = (uint64_t)WHM_ABS32(value_e3 - state->last_e3) * _WHM_RULES_MINUTE_US;
+        if (change > (uint64_t)rule->rate_e3 * (time_us - state->last_us))
+        {
+            _whm_rules_fire(index, rule, WHM_RULES_KIND_RATE, time_us, value_e3);
+            fired = true;
+        }
+    }
+    state->valid = true;
+    state->last_e3 = value_e3;
+    state->last_us = time_us;
+    return fired;
+}
+
+
+/* field by field, the padding after channel and the bools is whatever
+ * the copy left there */
+static bool _whm_rules_same(const whm_config_rule_t* a, const whm_config_rule_t* b)
+{
+    return a->channel == b->channel
+        && a->high_set == b->high_set
+        && a->low_set == b->low_set
+        && a->deadband_e3 == b->deadband_e3
+        && a->high_e3 == b->high_e3
+        && a->low_e3 == b->low_e3
+        && a->hysteresis_e3 == b->hysteresis_e3
+        && a->rate_e3 == b->rate_e3;
+}
+
+
+static void _whm_rules_fire(uint8_t index, const whm_config_rule_t* rule, uint8_t kind, uint64_t time_us, int32_t value_e3)
+{
+    whm_rules_event_t* event = &_whm_rules_ctx.events[_whm_rules_ctx.event_last % WHM_RULES_EVENTS];
+    _whm_rules_ctx.event_last++;
+    event->seq = _whm_rules_ctx.event_last;
+    event->time_us = time_us;
+    event->rule = index;
+    event->channel = rule->channel;
+    event->kind = kind;
+    event->value_e3 = value_e3;
+}
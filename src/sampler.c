@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico/time.h"
+
+#include "sampler.h"
+#include "htu31d.h"
+#include "aggregate.h"
+#include "rules.h"
+#include "filter.h"
+#include "series.h"
+#include "config.h"
+#include "util.h"
+
+
+/* where the last history get left off, so reading in order is one step
+ * each rather than decoding the block from its start */
+typedef struct _whm_sampler_cursor
+{
+    bool valid;
+    uint32_t block;
+    uint32_t next_seq;
+    whm_series_decoder_t decoder;
+    whm_series_sample_t sample;
+} _whm_sampler_cursor_t;
+
+
+static void _whm_sampler_htu31d_finish(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3);
+static void _whm_sampler_history_add(const whm_sampler_reading_t* reading, bool fired);
+static bool _whm_sampler_history_store(const whm_series_sample_t* sample);
+static uint32_t _whm_sampler_history_block_first(uint32_t block);
+
+
+static struct
+{
+    bool pending;
+    bool valid;
+    uint64_t next_sample_us;
+    uint32_t failures;
+    whm_sampler_reading_t latest;
+    whm_filter_t filters[WHM_CONFIG_CHANNELS];
+    /* latest that a rule fired on, or every one without rules */
+    bool reported_valid;
+    whm_sampler_reading_t reported;
+    uint64_t next_history_us;
+    uint32_t history_last;
+    unsigned history_pins;
+    uint32_t history_pin_seq;
+    bool history_held;
+    whm_series_sample_t history_hold;
+    /* blocks started since boot, the newest being added to */
+    uint32_t history_blocks;
+    whm_series_encoder_t history_encoder;
+    _whm_sampler_cursor_t history_cursor;
+    whm_series_block_t history[WHM_SAMPLER_HISTORY_BLOCKS];
+} _whm_sampler_ctx =
+{
+    .pending = false,
+    .valid = false,
+    .next_sample_us = 0,
+    .failures = 0,
+    .reported_valid = false,
+    .next_history_us = 0,
+    .history_last = 0,
+    .history_pins = 0,
+    .history_held = false,
+    .history_blocks = 0,
+};
+
+
+void whm_sampler_init(void)
+{
+    _whm_sampler_ctx.pending = false;
+    _whm_sampler_ctx.valid = false;
+    _whm_sampler_ctx.next_sample_us = time_us_64();
+    _whm_sampler_ctx.failures = 0;
+    _whm_sampler_ctx.next_history_us = _whm_sampler_ctx.next_sample_us;
+    for (unsigned i = 0; i < WHM_CONFIG_CHANNELS; i++)
+    {
+        whm_filter_init(&_whm_sampler_ctx.filters[i], &whm_conf.filters[i]);
+    }
+}
+
+
+void whm_sampler_deinit(void)
+{
+    _whm_sampler_ctx.pending = false;
+    _whm_sampler_ctx.valid = false;
+}
+
+
+void whm_sampler_iterate(void)
+{
+    uint64_t now = time_us_64();
+    if (_whm_sampler_ctx.pending || now < _whm_sampler_ctx.next_sample_us)
+    {
+        return;
+    }
+    _whm_sampler_ctx.next_sample_us = now + WHM_MS_TO_US(WHM_SAMPLER_INTERVAL_MS);
+    if (whm_htu31d_get(NULL, _whm_sampler_htu31d_finish))
+    {
+        _whm_sampler_ctx.pending = true;
+    }
+    else
+    {
+        /* sensor busy or not responding, try again next interval */
+        _whm_sampler_ctx.failures++;
+    }
+}
+
+
+bool whm_sampler_get(whm_sampler_reading_t* reading)
+{
+    if (!reading || !_whm_sampler_ctx.valid)
+    {
+        return false;
+    }
+    *reading = _whm_sampler_ctx.latest;
+    return true;
+}
+
+
+bool whm_sampler_get_reported(whm_sampler_reading_t* reading)
+{
+    if (!reading || !_whm_sampler_ctx.reported_valid)
+    {
+        return false;
+    }
+    *reading = _whm_sampler_ctx.reported;
+    return true;
+}
+
+
+uint32_t whm_sampler_get_age_ms(const whm_sampler_reading_t* reading)
+{
+    return (uint32_t)((time_us_64() - reading->time_us) / 1000U);
+}
+
+
+uint32_t whm_sampler_history_first(void)
+{
+    uint32_t blocks = _whm_sampler_ctx.history_blocks;
+    if (!blocks)
+    {
+        return 0;
+    }
+    uint32_t oldest = blocks > WHM_SAMPLER_HISTORY_BLOCKS ? blocks - WHM_SAMPLER_HISTORY_BLOCKS : 0;
+    return _whm_sampler_history_block_first(oldest);
+}
+
+
+uint32_t whm_sampler_history_last(void)
+{
+    return _whm_sampler_ctx.history_last;
+}
+
+
+bool whm_sampler_history_get(uint32_t seq, whm_sampler_reading_t* reading)
+{
+    if (0 == seq || seq < whm_sampler_history_first() || seq > _whm_sampler_ctx.history_last)
+    {
+        return false;
+    }
+    /* the newest block starting at or before seq */
+    uint32_t block = _whm_sampler_ctx.history_blocks - 1;
+    while (_whm_sampler_history_block_first(block) > seq)
+    {
+        block--;
+    }
+    _whm_sampler_cursor_t* cursor = &_whm_sampler_ctx.history_cursor;
+    if (!cursor->valid || cursor->block != block || seq + 1 < cursor->next_seq)
+    {
+        whm_series_decoder_init(&cursor->decoder, &_whm_sampler_ctx.history[block % WHM_SAMPLER_HISTORY_BLOCKS]);
+        cursor->valid = true;
+        cursor->block = block;
+        cursor->next_seq = _whm_sampler_history_block_first(block);
+    }
+    while (cursor->next_seq <= seq)
+    {
+        if (!whm_series_decoder_next(&cursor->decoder, &cursor->sample))
+        {
+            cursor->valid = false;
+            return false;
+        }
+        cursor->next_seq++;
+    }
+    reading->seq = seq;
+    reading->time_us = WHM_MS_TO_US(cursor->sample.time_ms);
+    reading->rh_e3 = cursor->sample.rh_e3;
+    reading->t_e3 = cursor->sample.t_e3;
+    return true;
+}
+
+
+void whm_sampler_history_pin(uint32_t seq)
+{
+    /* only the lowest is kept, it covers the others */
+    if (!_whm_sampler_ctx.history_pins || seq < _whm_sampler_ctx.history_pin_seq)
+    {
+        _whm_sampler_ctx.history_pin_seq = seq;
+    }
+    _whm_sampler_ctx.history_pins++;
+}
+
+
+void whm_sampler_history_unpin(void)
+{
+    if (!_whm_sampler_ctx.history_pins || --_whm_sampler_ctx.history_pins)
+    {
+        return;
+    }
+    if (_whm_sampler_ctx.history_held)
+    {
+        _whm_sampler_ctx.history_held = false;
+        _whm_sampler_history_store(&_whm_sampler_ctx.history_hold);
+    }
+}
+
+
+static void _whm_sampler_htu31d_finish(void* userdata, bool success, uint32_t rh_e3, int32_t t_e3)
+{
+    _whm_sampler_ctx.pending = false;
+    if (!success)
+    {
+        /* keep the last good reading, it will just age */
+        _whm_sampler_ctx.failures++;
+        return;
+    }
+    /* everything from here on sees the filtered reading */
+    int32_t rh_filtered = whm_filter_apply(&_whm_sampler_ctx.filters[WHM_CONFIG_CHANNEL_RELATIVE_HUMIDITY],
+                                           &whm_conf.filters[WHM_CONFIG_CHANNEL_RELATIVE_HUMIDITY], rh_e3);
+    rh_e3 = rh_filtered < 0 ? 0 : rh_filtered;
+    t_e3 = whm_filter_apply(&_whm_sampler_ctx.filters[WHM_CONFIG_CHANNEL_TEMPERATURE],
+                            &whm_conf.filters[WHM_CONFIG_CHANNEL_TEMPERATURE], t_e3);
+    _whm_sampler_ctx.latest.seq++;
+    _whm_sampler_ctx.latest.time_us = time_us_64();
+    _whm_sampler_ctx.latest.rh_e3 = rh_e3;
+    _whm_sampler_ctx.latest.t_e3 = t_e3;
+    _whm_sampler_ctx.valid = true;
+    whm_aggregate_add(_whm_sampler_ctx.latest.time_us, rh_e3, t_e3);
+    bool fired = whm_rules_evaluate(_whm_sampler_ctx.latest.time_us, rh_e3, t_e3);
+    if (!whm_conf.rules_count || fired || !_whm_sampler_ctx.reported_valid)
+    {
+        _whm_sampler_ctx.reported = _whm_sampler_ctx.latest;
+        _whm_sampler_ctx.reported_valid = true;
+    }
+    _whm_sampler_history_add(&_whm_sampler_ctx.latest, fired);
+}
+
+
+static void _whm_sampler_history_add(const whm_sampler_reading_t* reading, bool fired)
+{
+    /* with rules, history_ms is only the longest it goes without one */
+    if (!fired && reading->time_us < _whm_sampler_ctx.next_history_us)
+    {
+        return;
+    }
+    uint32_t history_ms = whm_conf.history_ms ? whm_conf.history_ms : WHM_SAMPLER_INTERVAL_MS;
+    _whm_sampler_ctx.next_history_us = reading->time_us + WHM_MS_TO_US((uint64_t)history_ms);
+    whm_series_sample_t sample =
+    {
+        .time_ms = reading->time_us / 1000U,
+        .rh_e3 = reading->rh_e3,
+        .t_e3 = reading->t_e3,
+    };
+    /* once one is held the rest are too, or they would be out of order */
+    if (_whm_sampler_ctx.history_held || !_whm_sampler_history_store(&sample))
+    {
+        _whm_sampler_ctx.history_hold = sample;
+        _whm_sampler_ctx.history_held = true;
+    }
+}
+
+
+/* false if a pinned record would have to go to make room */
+static bool _whm_sampler_history_store(const whm_series_sample_t* sample)
+{
+    uint32_t blocks = _whm_sampler_ctx.history_blocks;
+    if (blocks && whm_series_encoder_add(&_whm_sampler_ctx.history_encoder, sample))
+    {
+        _whm_sampler_ctx.history_last++;
+        return true;
+    }
+    if (blocks >= WHM_SAMPLER_HISTORY_BLOCKS && _whm_sampler_ctx.history_pins
+        && _whm_sampler_ctx.history_pin_seq < _whm_sampler_history_block_first(blocks - WHM_SAMPLER_HISTORY_BLOCKS + 1))
+    {
+        /* the oldest block is about to be reused */
+        return false;
+    }
+    whm_series_encoder_init(&_whm_sampler_ctx.history_encoder,
+                            &_whm_sampler_ctx.history[blocks % WHM_SAMPLER_HISTORY_BLOCKS],
+                            _whm_sampler_ctx.history_last + 1);
+    whm_series_encoder_add(&_whm_sampler_ctx.history_encoder, sample);
+    _whm_sampler_ctx.history_blocks++;
+    _whm_sampler_ctx.history_last++;
+    return true;
+}
+
+
+static uint32_t _whm_sampler_history_block_first(uint32_t block)
+{
+    return _whm_sampler_ctx.history[block % WHM_SAMPLER_HISTORY_BLOCKS].first_seq;
+}
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "series.h"
+
+
+/* three varints of a 64 bit value at worst */
+#define _WHM_SERIES_ENCODED_MAX                 30
+
+
+_Static_assert(WHM_SERIES_BLOCK_SIZE == sizeof(whm_series_block_t), "Series block isn't packed.");
+
+
+static unsigned _whm_series_put(uint8_t* buf, int64_t value);
+static bool _whm_series_get(const whm_series_block_t* block, uint16_t* pos, int64_t* value);
+
+
+void whm_series_encoder_init(whm_series_encoder_t* encoder, whm_series_block_t* block, uint32_t first_seq)
+{
+    memset(block, 0, sizeof(whm_series_block_t));
+    block->first_seq = first_seq;
+    encoder->block = block;
+    encoder->delta_ms = 0;
+}
+
+
+bool whm_series_encoder_add(whm_series_encoder_t* encoder, const whm_series_sample_t* sample)
+{
+    whm_series_block_t* block = encoder->block;
+    if (!block->count)
+    {
+        block->base_ms = sample->time_ms;
+        block->first_rh_e3 = sample->rh_e3;
+        block->first_t_e3 = sample->t_e3;
+        encoder->last = *sample;
+        encoder->delta_ms = 0;
+        block->count = 1;
+        return true;
+    }
+    int64_t delta_ms = (int64_t)(sample->time_ms - encoder->last.time_ms);
+    uint8_t buf[_WHM_SERIES_ENCODED_MAX];
+    unsigned len = _whm_series_put(buf, delta_ms - encoder->delta_ms);
+    len += _whm_series_put(&buf[len], (int64_t)sample->rh_e3 - encoder->last.rh_e3);
+    len += _whm_series_put(&buf[len], (int64_t)sample->t_e3 - encoder->last.t_e3);
+    if (len > WHM_SERIES_DATA_SIZE - block->len || UINT16_MAX == block->count)
+    {
+        return false;
+    }
+    memcpy(&block->data[block->len], buf, len);
+    block->len += len;
+    block->count++;
+    encoder->last = *sample;
+    encoder->delta_ms = delta_ms;
+    return true;
+}
+
+
+void whm_series_decoder_init(whm_series_decoder_t* decoder, const whm_series_block_t* block)
+{
+    memset(decoder, 0, sizeof(whm_series_decoder_t));
+    decoder->block = block;
+}
+
+
+bool whm_series_decoder_next(whm_series_decoder_t* decoder, whm_series_sample_t* sample)
+{
+    const whm_series_block_t* block = decoder->block;
+    if (decoder->index >= block->count)
+    {
+        return false;
+    }
+    if (!decoder->index)
+    {
+        decoder->last.time_ms = block->base_ms;
+        decoder->last.rh_e3 = block->first_rh_e3;
+        decoder->last.t_e3 = block->first_t_e3;
+    }
+    else
+    {
+        int64_t dod_ms, rh_delta, t_delta;
+        if (!_whm_series_get(block, &decoder->pos, &dod_ms)
+            || !_whm_series_get(block, &decoder->pos, &rh_delta)
+            || !_whm_series_get(block, &decoder->pos, &t_delta))
+        {
+            return false;
+        }
+        decoder->delta_ms += dod_ms;
+        decoder->last.time_ms += decoder->delta_ms;
+        decoder->last.rh_e3 += rh_delta;
+        decoder->last.t_e3 += t_delta;
+    }
+    decoder->index++;
+    *sample = decoder->last;
+    return true;
+}
+
+
+/* zig-zag so small negatives stay small, then 7 bits a byte, low first */
+static unsigned _whm_series_put(uint8_t* buf, int64_t value)
+{
+    uint64_t zz = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    unsigned len = 0;
+    while (zz >= 0x80)
+    {
+        buf[len++] = (uint8_t)(zz | 0x80);
+        zz >>= 7;
+    }
+    buf[len++] = (uint8_t)zz;
+    return len;
+}
+
+
+static bool _whm_series_get(const whm_series_block_t* block, uint16_t* pos, int64_t* value)
+{
+    uint64_t zz = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (*pos >= block->len)
+        {
+            return false;
+        }
+        uint8_t byte = block->data[(*pos)++];
+        zz |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+            return true;
+        }
+    }
+    return false;
+}
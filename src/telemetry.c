@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "pico/time.h"
+#include "pico/cyw43_arch.h"
+
+#include "lwip/dns.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "telemetry.h"
+#include "config.h"
+#include "sampler.h"
+#include "meas_log.h"
+#include "ap_station.h"
+#include "line_protocol.h"
+#include "util.h"
+
+
+/* within one ethernet frame, so a datagram is never fragmented */
+#define _WHM_TELEMETRY_DATAGRAM_MAX             1400U
+/* a part batch goes anyway once its oldest is this old */
+#define _WHM_TELEMETRY_HOLD_US                  (60 * 1000 * 1000) /* 60 seconds */
+/* the address is looked up again this often, from the cache mostly */
+#define _WHM_TELEMETRY_RESOLVE_US               (10 * 60 * 1000 * 1000ULL) /* 10 minutes */
+#define _WHM_TELEMETRY_RESOLVE_RETRY_US         (30 * 1000 * 1000) /* 30 seconds */
+
+
+static void _whm_telemetry_reset(void);
+static void _whm_telemetry_resolve(uint64_t now);
+static void _whm_telemetry_dns_found(const char* name, const ip_addr_t* addr, void* arg);
+static struct pbuf* _whm_telemetry_pbuf(void);
+static void _whm_telemetry_send(uint64_t now);
+
+
+static struct
+{
+    struct udp_pcb* udp;
+    /* allocated once and sent again and again, payload where the lines go
+     * before the headers are put in front */
+    struct pbuf* pbuf;
+    void* payload;
+    /* the host and name sent with */
+    whm_config_telemetry_t conf;
+    char name[WHM_CONFIG_NAME_LEN + 1];
+    /* the measurement and the name as a tag, which can't be empty */
+    char prefix[WHM_LINE_PROTOCOL_PREFIX_MAX(WHM_CONFIG_NAME_LEN)];
+    ip_addr_t addr;
+    bool resolved;
+    bool resolving;
+    /* bumped on every reset, so a late lookup for an old host is ignored */
+    uint32_t generation;
+    uint64_t resolve_us;
+    uint32_t reading_seq;
+    uint32_t line_seq;
+    /* readings waiting for the rest of their batch */
+    whm_sampler_reading_t held[WHM_CONFIG_TELEMETRY_BATCH_MAX];
+    uint8_t held_count;
+    uint64_t held_us;
+    whm_telemetry_stats_t stats;
+} _whm_telemetry_ctx;
+
+
+void whm_telemetry_init(void)
+{
+    memset(&_whm_telemetry_ctx, 0, sizeof(_whm_telemetry_ctx));
+    cyw43_arch_lwip_begin();
+    _whm_telemetry_ctx.udp = udp_new();
+    _whm_telemetry_ctx.pbuf = pbuf_alloc(PBUF_TRANSPORT, _WHM_TELEMETRY_DATAGRAM_MAX, PBUF_RAM);
+    cyw43_arch_lwip_end();
+    if (!_whm_telemetry_ctx.udp)
+    {
+        printf("Unable to allocate memory for telemetry udp.\n");
+    }
+    if (_whm_telemetry_ctx.pbuf)
+    {
+        _whm_telemetry_ctx.payload = _whm_telemetry_ctx.pbuf->payload;
+    }
+}
+
+
+void whm_telemetry_deinit(void)
+{
+    cyw43_arch_lwip_begin();
+    if (_whm_telemetry_ctx.udp)
+    {
+        udp_remove(_whm_telemetry_ctx.udp);
+        _whm_telemetry_ctx.udp = NULL;
+    }
+    if (_whm_telemetry_ctx.pbuf)
+    {
+        pbuf_free(_whm_telemetry_ctx.pbuf);
+        _whm_telemetry_ctx.pbuf = NULL;
+    }
+    cyw43_arch_lwip_end();
+    _whm_telemetry_reset();
+}
+
+
+void whm_telemetry_iterate(void)
+{
+    if (!_whm_telemetry_ctx.udp)
+    {
+        return;
+    }
+    uint64_t now = time_us_64();
+    if (0 != memcmp(&_whm_telemetry_ctx.conf, &whm_conf.telemetry, sizeof(_whm_telemetry_ctx.conf))
+        || 0 != strcmp(_whm_telemetry_ctx.name, whm_conf.name))
+    {
+        /* changed, what's held was meant for the old one */
+        _whm_telemetry_reset();
+        /* padding and all, for the memcmp above */
+        memcpy(&_whm_telemetry_ctx.conf, &whm_conf.telemetry, sizeof(_whm_telemetry_ctx.conf));
+        strcpy(_whm_telemetry_ctx.name, whm_conf.name);
+        whm_line_protocol_prefix(_whm_telemetry_ctx.prefix, sizeof(_whm_telemetry_ctx.prefix), _whm_telemetry_ctx.name);
+    }
+    if (!_whm_telemetry_ctx.conf.host[0])
+    {
+        return;
+    }
+    if (!whm_ap_station_get_connected())
+    {
+        if (_whm_telemetry_ctx.resolved || _whm_telemetry_ctx.resolving)
+        {
+            /* the address may differ on whatever network comes next */
+            _whm_telemetry_reset();
+        }
+    }
+    else if (!_whm_telemetry_ctx.resolving && now >= _whm_telemetry_ctx.resolve_us)
+    {
+        _whm_telemetry_resolve(now);
+    }
+    whm_sampler_reading_t reading;
+    if (whm_sampler_get_reported(&reading) && reading.seq != _whm_telemetry_ctx.reading_seq)
+    {
+        _whm_telemetry_ctx.reading_seq = reading.seq;
+        /* counted whether sent or not, the gap is what the receiver sees */
+        _whm_telemetry_ctx.line_seq++;
+        if (!_whm_telemetry_ctx.resolved)
+        {
+            _whm_telemetry_ctx.stats.skipped++;
+        }
+        else
+        {
+            if (!_whm_telemetry_ctx.held_count)
+            {
+                _whm_telemetry_ctx.held_us = now;
+            }
+            _whm_telemetry_ctx.held[_whm_telemetry_ctx.held_count++] = reading;
+        }
+    }
+    if (_whm_telemetry_ctx.held_count
+        && (_whm_telemetry_ctx.held_count >= _whm_telemetry_ctx.conf.batch
+            || now - _whm_telemetry_ctx.held_us >= _WHM_TELEMETRY_HOLD_US))
+    {
+        _whm_telemetry_send(now);
+    }
+}
+
+
+void whm_telemetry_get_stats(whm_telemetry_stats_t* stats)
+{
+    *stats = _whm_telemetry_ctx.stats;
+}
+
+
+static void _whm_telemetry_reset(void)
+{
+    _whm_telemetry_ctx.stats.skipped += _whm_telemetry_ctx.held_count;
+    _whm_telemetry_ctx.held_count = 0;
+    _whm_telemetry_ctx.resolved = false;
+    _whm_telemetry_ctx.resolving = false;
+    _whm_telemetry_ctx.resolve_us = 0;
+    _whm_telemetry_ctx.generation++;
+}
+
+
+static void _whm_telemetry_resolve(uint64_t now)
+{
+    /* the old address is kept meanwhile, a lookup failing doesn't stop
+     * sending to where it last went */
+    _whm_telemetry_ctx.resolving = true;
+    _whm_telemetry_ctx.resolve_us = now + _WHM_TELEMETRY_RESOLVE_US;
+    ip_addr_t addr;
+    cyw43_arch_lwip_begin();
+    err_t err = dns_gethostbyname(_whm_telemetry_ctx.conf.host, &addr, _whm_telemetry_dns_found,
+                                  (void*)(uintptr_t)_whm_telemetry_ctx.generation);
+    cyw43_arch_lwip_end();
+    if (ERR_OK == err)
+    {
+        /* an address, or already cached */
+        _whm_telemetry_ctx.addr = addr;
+        _whm_telemetry_ctx.resolved = true;
+        _whm_telemetry_ctx.resolving = false;
+    }
+    else if (ERR_INPROGRESS != err)
+    {
+        _whm_telemetry_dns_found(_whm_telemetry_ctx.conf.host, NULL, (void*)(uintptr_t)_whm_telemetry_ctx.generation);
+    }
+}
+
+
+static void _whm_telemetry_dns_found(const char* name, const ip_addr_t* addr, void* arg)
+{
+    if ((uintptr_t)arg != _whm_telemetry_ctx.generation || !_whm_telemetry_ctx.resolving)
+    {
+        return;
+    }
+    _whm_telemetry_ctx.resolving = false;
+    if (!addr)
+    {
+        printf("telemetry failed to resolve %s\n", name);
+        _whm_telemetry_ctx.stats.resolve_errors++;
+        if (!_whm_telemetry_ctx.resolved)
+        {
+            _whm_telemetry_ctx.resolve_us = time_us_64() + _WHM_TELEMETRY_RESOLVE_RETRY_US;
+        }
+        return;
+    }
+    _whm_telemetry_ctx.addr = *addr;
+    _whm_telemetry_ctx.resolved = true;
+}
+
+
+/* The one pbuf, its payload back where the lines go and its length the
+ * whole datagram. Sending put the headers in front, and it may still be
+ * queued for an ARP reply, in which case it is left to that and another
+ * allocated. */
+static struct pbuf* _whm_telemetry_pbuf(void)
+{
+    struct pbuf* p = _whm_telemetry_ctx.pbuf;
+    if (p && 1 != p->ref)
+    {
+        pbuf_free(p);
+        p = NULL;
+    }
+    if (!p)
+    {
+        p = pbuf_alloc(PBUF_TRANSPORT, _WHM_TELEMETRY_DATAGRAM_MAX, PBUF_RAM);
+        _whm_telemetry_ctx.pbuf = p;
+        if (!p)
+        {
+            return NULL;
+        }
+        _whm_telemetry_ctx.payload = p->payload;
+    }
+    pbuf_remove_header(p, (uint8_t*)_whm_telemetry_ctx.payload - (uint8_t*)p->payload);
+    /* a single PBUF_RAM, only trimmed by its length so the memory stays */
+    p->len = p->tot_len = _WHM_TELEMETRY_DATAGRAM_MAX;
+    return p;
+}
+
+
+/* The lines are written straight into the pbuf, which is then sent
+ * trimmed to them, so nothing is copied or allocated per datagram. */
+static void _whm_telemetry_send(uint64_t now)
+{
+    uint32_t first_seq = _whm_telemetry_ctx.line_seq - _whm_telemetry_ctx.held_count + 1U;
+    unsigned count = _whm_telemetry_ctx.held_count;
+    _whm_telemetry_ctx.held_count = 0;
+    cyw43_arch_lwip_begin();
+    struct pbuf* p = _whm_telemetry_pbuf();
+    if (!p)
+    {
+        cyw43_arch_lwip_end();
+        _whm_telemetry_ctx.stats.skipped += count;
+        return;
+    }
+    char* payload = p->payload;
+    unsigned len = 0;
+    unsigned lines = 0;
+    for (; lines < count; lines++)
+    {
+        const whm_sampler_reading_t* reading = &_whm_telemetry_ctx.held[lines];
+        unsigned line_len = whm_line_protocol_line(&payload[len], _WHM_TELEMETRY_DATAGRAM_MAX - len,
+                                                   _whm_telemetry_ctx.prefix, first_seq + lines, whm_meas_log_boot(),
+                                                   (now - reading->time_us) / 1000U, reading->rh_e3, reading->t_e3);
+        if (!line_len)
+        {
+            /* no room left, unusual as only a long name makes lines wide */
+            break;
+        }
+        len += line_len;
+    }
+    _whm_telemetry_ctx.stats.skipped += count - lines;
+    if (!len)
+    {
+        cyw43_arch_lwip_end();
+        return;
+    }
+    p->len = p->tot_len = len;
+    err_t err = udp_sendto(_whm_telemetry_ctx.udp, p, &_whm_telemetry_ctx.addr, _whm_telemetry_ctx.conf.port);
+    cyw43_arch_lwip_end();
+    if (ERR_OK != err)
+    {
+        _whm_telemetry_ctx.stats.send_errors++;
+        return;
+    }
+    _whm_telemetry_ctx.stats.datagrams++;
+    _whm_telemetry_ctx.stats.lines += lines;
+}
@@ -0,0 +1,741 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pico/time.h"
+#include "pico/cyw43_arch.h"
+
+#include "lwip/tcp.h"
+#include "lwip/dns.h"
+
+#include "uplink.h"
+#include "config.h"
+#include "sampler.h"
+#include "meas_log.h"
+#include "ap_station.h"
+#include "json_writer.h"
+#include "util.h"
+
+
+#define _WHM_UPLINK_BUFFER_SIZE                 2048
+/* the response's status line and headers, the body is only skipped */
+#define _WHM_UPLINK_HEAD_SIZE                   256
+#define _WHM_UPLINK_HOST_LEN                    63
+#define _WHM_UPLINK_PATH_LEN                    63
+#define _WHM_UPLINK_PORT                        80
+/* from connecting to the response being read */
+#define _WHM_UPLINK_TIMEOUT_US                  (10 * 1000 * 1000) /* 10 seconds */
+/* a kept-alive connection with nothing to send is closed after this */
+#define _WHM_UPLINK_IDLE_US                     (30 * 1000 * 1000) /* 30 seconds */
+#define _WHM_UPLINK_BACKOFF_MIN_MS              1000U
+#define _WHM_UPLINK_BACKOFF_MAX_MS              (5U * 60U * 1000U) /* 5 minutes */
+
+
+typedef enum _whm_uplink_state
+{
+    /* no connection, or no url */
+    _WHM_UPLINK_STATE_IDLE,
+    _WHM_UPLINK_STATE_RESOLVING,
+    _WHM_UPLINK_STATE_CONNECTING,
+    /* connected, nothing in flight */
+    _WHM_UPLINK_STATE_READY,
+    /* a batch is being written or its response read */
+    _WHM_UPLINK_STATE_SENDING,
+    _WHM_UPLINK_STATE_BACKOFF,
+} _whm_uplink_state_t;
+
+
+static bool _whm_uplink_parse_url(const char* url);
+static bool _whm_uplink_down(void);
+static void _whm_uplink_spill(uint32_t end);
+static bool _whm_uplink_due(uint64_t now);
+static void _whm_uplink_resolve(void);
+static void _whm_uplink_dns_found(const char* name, const ip_addr_t* addr, void* arg);
+static void _whm_uplink_connect(void);
+static err_t _whm_uplink_connected(void* arg, struct tcp_pcb* pcb, err_t err);
+static void _whm_uplink_send(void);
+static void _whm_uplink_write(void);
+static unsigned _whm_uplink_render(uint32_t count);
+static void _whm_uplink_render_body(whm_json_writer_t* writer, uint32_t count, uint64_t now);
+static err_t _whm_uplink_sent(void* arg, struct tcp_pcb* pcb, u16_t len);
+static err_t _whm_uplink_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err);
+static void _whm_uplink_err(void* arg, err_t err);
+static void _whm_uplink_response(const char* data, unsigned len);
+static bool _whm_uplink_parse_head(void);
+static void _whm_uplink_done(void);
+static void _whm_uplink_fail(const char* reason);
+static void _whm_uplink_close(void);
+
+
+static struct
+{
+    _whm_uplink_state_t state;
+    struct tcp_pcb* pcb;
+    /* the pcb had to be aborted, which lwIP must be told from a callback */
+    bool aborted;
+    /* the url the host, port and path were taken from */
+    char url[WHM_CONFIG_URL_LEN];
+    bool valid;
+    char host[_WHM_UPLINK_HOST_LEN + 1];
+    uint16_t port;
+    char path[_WHM_UPLINK_PATH_LEN + 1];
+    ip_addr_t addr;
+    uint32_t reading_seq;
+    /* counted since init, head - tail are queued, a batch from the queue
+     * covers tail up to batch_end */
+    uint32_t head;
+    uint32_t tail;
+    uint32_t batch_end;
+    whm_sampler_reading_t queue[WHM_UPLINK_QUEUE_LEN];
+    /* copied out as it is sent, from the flash log while that has any */
+    whm_meas_log_entry_t batch[WHM_CONFIG_UPLINK_BATCH_MAX];
+    uint32_t batch_count;
+    bool batch_logged;
+    unsigned len;
+    unsigned written;
+    char buffer[_WHM_UPLINK_BUFFER_SIZE];
+    unsigned head_len;
+    bool head_done;
+    unsigned status;
+    /* -1 while the body runs to the connection closing */
+    int32_t body_left;
+    bool keep_alive;
+    uint64_t deadline_us;
+    uint64_t idle_us;
+    uint64_t retry_us;
+    uint8_t attempts;
+    char response_head[_WHM_UPLINK_HEAD_SIZE + 1];
+    whm_uplink_stats_t stats;
+} _whm_uplink_ctx;
+
+
+void whm_uplink_init(void)
+{
+    memset(&_whm_uplink_ctx, 0, sizeof(_whm_uplink_ctx));
+    _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+}
+
+
+void whm_uplink_deinit(void)
+{
+    cyw43_arch_lwip_begin();
+    _whm_uplink_close();
+    cyw43_arch_lwip_end();
+    _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+}
+
+
+void whm_uplink_iterate(void)
+{
+    uint64_t now = time_us_64();
+    cyw43_arch_lwip_begin();
+    if (0 != strcmp(_whm_uplink_ctx.url, whm_conf.uplink.url))
+    {
+        /* changed, start again with the new one */
+        _whm_uplink_close();
+        memcpy(_whm_uplink_ctx.url, whm_conf.uplink.url, sizeof(_whm_uplink_ctx.url));
+        _whm_uplink_ctx.valid = _whm_uplink_parse_url(_whm_uplink_ctx.url);
+        _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+        _whm_uplink_ctx.attempts = 0;
+    }
+    cyw43_arch_lwip_end();
+    whm_sampler_reading_t reading;
+    if (whm_sampler_get_reported(&reading) && reading.seq != _whm_uplink_ctx.reading_seq)
+    {
+        _whm_uplink_ctx.reading_seq = reading.seq;
+        if (!_whm_uplink_ctx.valid)
+        {
+            /* nowhere to send it, nothing is kept and flash isn't worn */
+            _whm_uplink_ctx.tail = _whm_uplink_ctx.head;
+        }
+        else if (_whm_uplink_down())
+        {
+            /* straight to flash, so a power cut meanwhile loses at most the
+             * log's part page */
+            _whm_uplink_spill(_whm_uplink_ctx.head);
+            whm_meas_log_append(&reading);
+            _whm_uplink_ctx.stats.logged++;
+        }
+        else
+        {
+            if (WHM_UPLINK_QUEUE_LEN == _whm_uplink_ctx.head - _whm_uplink_ctx.tail)
+            {
+                /* the oldest moves to flash, even from a batch in flight,
+                 * which may then be sent twice */
+                _whm_uplink_spill(_whm_uplink_ctx.tail + 1U);
+            }
+            _whm_uplink_ctx.queue[_whm_uplink_ctx.head % WHM_UPLINK_QUEUE_LEN] = reading;
+            _whm_uplink_ctx.head++;
+        }
+    }
+    cyw43_arch_lwip_begin();
+    switch (_whm_uplink_ctx.state)
+    {
+        case _WHM_UPLINK_STATE_IDLE:
+            if (_whm_uplink_ctx.valid && whm_ap_station_get_connected() && _whm_uplink_due(now))
+            {
+                _whm_uplink_ctx.deadline_us = now + _WHM_UPLINK_TIMEOUT_US;
+                _whm_uplink_resolve();
+            }
+            break;
+        case _WHM_UPLINK_STATE_READY:
+            if (_whm_uplink_due(now))
+            {
+                _whm_uplink_ctx.deadline_us = now + _WHM_UPLINK_TIMEOUT_US;
+                _whm_uplink_send();
+            }
+            else if (now >= _whm_uplink_ctx.idle_us)
+            {
+                _whm_uplink_close();
+                _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+            }
+            break;
+        case _WHM_UPLINK_STATE_RESOLVING:
+        case _WHM_UPLINK_STATE_CONNECTING:
+        case _WHM_UPLINK_STATE_SENDING:
+            if (now >= _whm_uplink_ctx.deadline_us)
+            {
+                _whm_uplink_fail("timed out");
+            }
+            else if (_WHM_UPLINK_STATE_SENDING == _whm_uplink_ctx.state)
+            {
+                /* whatever didn't fit in the send buffer last time */
+                _whm_uplink_write();
+            }
+            break;
+        case _WHM_UPLINK_STATE_BACKOFF:
+            if (now >= _whm_uplink_ctx.retry_us)
+            {
+                _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+            }
+            break;
+    }
+    cyw43_arch_lwip_end();
+}
+
+
+void whm_uplink_get_stats(whm_uplink_stats_t* stats)
+{
+    *stats = _whm_uplink_ctx.stats;
+    stats->queued = _whm_uplink_ctx.head - _whm_uplink_ctx.tail;
+}
+
+
+/* only plain http://host[:port][/path], there is no TLS */
+static bool _whm_uplink_parse_url(const char* url)
+{
+    static const char scheme[] = "http://";
+    if (0 != strncmp(url, scheme, sizeof(scheme) - 1))
+    {
+        if (url[0])
+        {
+            printf("uplink url must be http://\n");
+        }
+        return false;
+    }
+    const char* host = url + sizeof(scheme) - 1;
+    size_t host_len = strcspn(host, ":/");
+    if (!host_len || host_len > _WHM_UPLINK_HOST_LEN)
+    {
+        printf("invalid uplink host\n");
+        return false;
+    }
+    memcpy(_whm_uplink_ctx.host, host, host_len);
+    _whm_uplink_ctx.host[host_len] = '\0';
+    const char* rest = host + host_len;
+    _whm_uplink_ctx.port = _WHM_UPLINK_PORT;
+    if (':' == *rest)
+    {
+        char* end = NULL;
+        unsigned long port = strtoul(rest + 1, &end, 10);
+        if (end == rest + 1 || !port || port > UINT16_MAX || ('\0' != *end && '/' != *end))
+        {
+            printf("invalid uplink port\n");
+            return false;
+        }
+        _whm_uplink_ctx.port = port;
+        rest = end;
+    }
+    if (!rest[0])
+    {
+        rest = "/";
+    }
+    if (strlen(rest) > _WHM_UPLINK_PATH_LEN)
+    {
+        printf("invalid uplink path\n");
+        return false;
+    }
+    strcpy(_whm_uplink_ctx.path, rest);
+    return true;
+}
+
+
+/* failed and waiting to try again, or off the network with nothing in
+ * flight, either way no batch is using the queue */
+static bool _whm_uplink_down(void)
+{
+    return _WHM_UPLINK_STATE_BACKOFF == _whm_uplink_ctx.state
+        || (_WHM_UPLINK_STATE_IDLE == _whm_uplink_ctx.state && !whm_ap_station_get_connected());
+}
+
+
+/* the queue up to end into the flash log, oldest first so it is sent in
+ * order */
+static void _whm_uplink_spill(uint32_t end)
+{
+    while ((int32_t)(end - _whm_uplink_ctx.tail) > 0)
+    {
+        whm_meas_log_append(&_whm_uplink_ctx.queue[_whm_uplink_ctx.tail % WHM_UPLINK_QUEUE_LEN]);
+        _whm_uplink_ctx.tail++;
+        _whm_uplink_ctx.stats.logged++;
+    }
+}
+
+
+/* a full batch, or the oldest has waited interval_s, or anything in the
+ * flash log which has waited longer still */
+static bool _whm_uplink_due(uint64_t now)
+{
+    whm_meas_log_entry_t entry;
+    if (whm_meas_log_peek(&entry, 1))
+    {
+        return true;
+    }
+    uint32_t queued = _whm_uplink_ctx.head - _whm_uplink_ctx.tail;
+    if (!queued)
+    {
+        return false;
+    }
+    if (queued >= whm_conf.uplink.batch)
+    {
+        return true;
+    }
+    const whm_sampler_reading_t* oldest = &_whm_uplink_ctx.queue[_whm_uplink_ctx.tail % WHM_UPLINK_QUEUE_LEN];
+    return now - oldest->time_us >= WHM_MS_TO_US((uint64_t)whm_conf.uplink.interval_s * 1000U);
+}
+
+
+static void _whm_uplink_resolve(void)
+{
+    _whm_uplink_ctx.state = _WHM_UPLINK_STATE_RESOLVING;
+    err_t err = dns_gethostbyname(_whm_uplink_ctx.host, &_whm_uplink_ctx.addr, _whm_uplink_dns_found, NULL);
+    if (ERR_OK == err)
+    {
+        /* an address, or already cached */
+        _whm_uplink_connect();
+    }
+    else if (ERR_INPROGRESS != err)
+    {
+        _whm_uplink_fail("dns");
+    }
+}
+
+
+static void _whm_uplink_dns_found(const char* name, const ip_addr_t* addr, void* arg)
+{
+    if (_WHM_UPLINK_STATE_RESOLVING != _whm_uplink_ctx.state)
+    {
+        /* timed out meanwhile */
+        return;
+    }
+    if (!addr)
+    {
+        _whm_uplink_fail("dns");
+        return;
+    }
+    _whm_uplink_ctx.addr = *addr;
+    _whm_uplink_connect();
+}
+
+
+static void _whm_uplink_connect(void)
+{
+    struct tcp_pcb* pcb = tcp_new_ip_type(IP_GET_TYPE(&_whm_uplink_ctx.addr));
+    if (!pcb)
+    {
+        _whm_uplink_fail("no pcb");
+        return;
+    }
+    _whm_uplink_ctx.pcb = pcb;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, _whm_uplink_recv);
+    tcp_sent(pcb, _whm_uplink_sent);
+    tcp_err(pcb, _whm_uplink_err);
+    _whm_uplink_ctx.state = _WHM_UPLINK_STATE_CONNECTING;
+    if (ERR_OK != tcp_connect(pcb, &_whm_uplink_ctx.addr, _whm_uplink_ctx.port, _whm_uplink_connected))
+    {
+        _whm_uplink_fail("connect");
+    }
+}
+
+
+static err_t _whm_uplink_connected(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    _whm_uplink_ctx.aborted = false;
+    if (ERR_OK != err)
+    {
+        _whm_uplink_fail("connect");
+    }
+    else
+    {
+        _whm_uplink_ctx.stats.connects++;
+        tcp_nagle_disable(pcb);
+        _whm_uplink_send();
+    }
+    return _whm_uplink_ctx.aborted ? ERR_ABRT : ERR_OK;
+}
+
+
+/* renders the batch whole, it is kept until the response so a retry
+ * resends the same readings */
+static void _whm_uplink_send(void)
+{
+    uint32_t count = WHM_MIN(whm_conf.uplink.batch, WHM_CONFIG_UPLINK_BATCH_MAX);
+    /* the flash log first, it only holds what is older than the queue */
+    uint32_t logged = whm_meas_log_peek(_whm_uplink_ctx.batch, count);
+    _whm_uplink_ctx.batch_logged = 0 != logged;
+    if (logged)
+    {
+        count = logged;
+    }
+    else
+    {
+        count = WHM_MIN(_whm_uplink_ctx.head - _whm_uplink_ctx.tail, count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            whm_meas_log_entry_t* entry = &_whm_uplink_ctx.batch[i];
+            entry->seq = 0;
+            entry->boot = whm_meas_log_boot();
+            entry->reading = _whm_uplink_ctx.queue[(_whm_uplink_ctx.tail + i) % WHM_UPLINK_QUEUE_LEN];
+        }
+    }
+    unsigned len = 0;
+    while (count && !(len = _whm_uplink_render(count)))
+    {
+        /* a long name leaves less room */
+        count--;
+    }
+    if (!count)
+    {
+        _whm_uplink_fail("render");
+        return;
+    }
+    _whm_uplink_ctx.batch_count = count;
+    _whm_uplink_ctx.batch_end = _whm_uplink_ctx.tail + count;
+    _whm_uplink_ctx.len = len;
+    _whm_uplink_ctx.written = 0;
+    _whm_uplink_ctx.head_len = 0;
+    _whm_uplink_ctx.head_done = false;
+    _whm_uplink_ctx.status = 0;
+    _whm_uplink_ctx.body_left = -1;
+    _whm_uplink_ctx.keep_alive = true;
+    _whm_uplink_ctx.state = _WHM_UPLINK_STATE_SENDING;
+    _whm_uplink_write();
+}
+
+
+static void _whm_uplink_write(void)
+{
+    struct tcp_pcb* pcb = _whm_uplink_ctx.pcb;
+    unsigned left = _whm_uplink_ctx.len - _whm_uplink_ctx.written;
+    unsigned len = WHM_MIN(left, tcp_sndbuf(pcb));
+    if (!len)
+    {
+        return;
+    }
+    if (ERR_OK != tcp_write(pcb, &_whm_uplink_ctx.buffer[_whm_uplink_ctx.written], len, TCP_WRITE_FLAG_COPY))
+    {
+        /* out of segments, tried again from sent or iterate */
+        return;
+    }
+    _whm_uplink_ctx.written += len;
+    tcp_output(pcb);
+}
+
+
+/* request line, headers and body into the buffer, 0 if they don't fit */
+static unsigned _whm_uplink_render(uint32_t count)
+{
+    uint64_t now = time_us_64();
+    /* the body's length first, which the headers need */
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, NULL, 0, 0);
+    _whm_uplink_render_body(&writer, count, now);
+    unsigned body_len = whm_json_writer_len(&writer);
+    int head_len = snprintf(_whm_uplink_ctx.buffer, _WHM_UPLINK_BUFFER_SIZE,
+        "POST %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %u\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+        _whm_uplink_ctx.path, _whm_uplink_ctx.host, body_len);
+    if (head_len < 0 || (unsigned)head_len + body_len > _WHM_UPLINK_BUFFER_SIZE)
+    {
+        return 0;
+    }
+    whm_json_writer_init(&writer, &_whm_uplink_ctx.buffer[head_len], body_len, 0);
+    _whm_uplink_render_body(&writer, count, now);
+    return head_len + body_len;
+}
+
+
+static void _whm_uplink_render_body(whm_json_writer_t* writer, uint32_t count, uint64_t now)
+{
+    whm_meas_log_stats_t log_stats;
+    whm_meas_log_get_stats(&log_stats);
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "name");
+    whm_json_writer_string(writer, whm_conf.name);
+    whm_json_writer_key(writer, "dropped");
+    whm_json_writer_uint(writer, log_stats.dropped);
+    whm_json_writer_key(writer, "samples");
+    whm_json_writer_array_begin(writer);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const whm_meas_log_entry_t* entry = &_whm_uplink_ctx.batch[i];
+        const whm_sampler_reading_t* record = &entry->reading;
+        whm_json_writer_object_begin(writer);
+        whm_json_writer_key(writer, "seq");
+        whm_json_writer_uint(writer, record->seq);
+        whm_json_writer_key(writer, "boot");
+        whm_json_writer_uint(writer, entry->boot);
+        /* no clock on the device, the collector dates it on arrival, which
+         * it can't for one from before a reboot */
+        if (entry->boot == whm_meas_log_boot())
+        {
+            whm_json_writer_key(writer, "age_ms");
+            whm_json_writer_uint(writer, (now - record->time_us) / 1000U);
+        }
+        whm_json_writer_key(writer, "relative_humidity");
+        whm_json_writer_fixed(writer, record->rh_e3, 3);
+        whm_json_writer_key(writer, "temperature");
+        whm_json_writer_fixed(writer, record->t_e3, 3);
+        whm_json_writer_object_end(writer);
+    }
+    whm_json_writer_array_end(writer);
+    whm_json_writer_object_end(writer);
+}
+
+
+static err_t _whm_uplink_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    if (_WHM_UPLINK_STATE_SENDING == _whm_uplink_ctx.state && _whm_uplink_ctx.written < _whm_uplink_ctx.len)
+    {
+        _whm_uplink_write();
+    }
+    return ERR_OK;
+}
+
+
+static err_t _whm_uplink_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    _whm_uplink_ctx.aborted = false;
+    if (!p)
+    {
+        /* closed by the collector */
+        if (_WHM_UPLINK_STATE_SENDING == _whm_uplink_ctx.state)
+        {
+            if (_whm_uplink_ctx.head_done && _whm_uplink_ctx.body_left < 0)
+            {
+                /* the body ran to the close */
+                _whm_uplink_ctx.keep_alive = false;
+                _whm_uplink_done();
+            }
+            else
+            {
+                _whm_uplink_fail("closed");
+            }
+        }
+        else
+        {
+            _whm_uplink_close();
+            _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+        }
+        return _whm_uplink_ctx.aborted ? ERR_ABRT : ERR_OK;
+    }
+    tcp_recved(pcb, p->tot_len);
+    if (_WHM_UPLINK_STATE_SENDING == _whm_uplink_ctx.state)
+    {
+        for (struct pbuf* q = p; q && _WHM_UPLINK_STATE_SENDING == _whm_uplink_ctx.state; q = q->next)
+        {
+            _whm_uplink_response(q->payload, q->len);
+        }
+    }
+    pbuf_free(p);
+    return _whm_uplink_ctx.aborted ? ERR_ABRT : ERR_OK;
+}
+
+
+static void _whm_uplink_err(void* arg, err_t err)
+{
+    /* the pcb is already freed */
+    _whm_uplink_ctx.pcb = NULL;
+    if (_WHM_UPLINK_STATE_READY == _whm_uplink_ctx.state)
+    {
+        _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+        return;
+    }
+    if (_WHM_UPLINK_STATE_CONNECTING == _whm_uplink_ctx.state || _WHM_UPLINK_STATE_SENDING == _whm_uplink_ctx.state)
+    {
+        _whm_uplink_fail("connection lost");
+    }
+}
+
+
+static void _whm_uplink_response(const char* data, unsigned len)
+{
+    while (len && !_whm_uplink_ctx.head_done)
+    {
+        if (_whm_uplink_ctx.head_len >= _WHM_UPLINK_HEAD_SIZE)
+        {
+            _whm_uplink_fail("response head too long");
+            return;
+        }
+        char c = *data++;
+        len--;
+        _whm_uplink_ctx.response_head[_whm_uplink_ctx.head_len++] = c;
+        _whm_uplink_ctx.response_head[_whm_uplink_ctx.head_len] = '\0';
+        if (_whm_uplink_ctx.head_len >= 4
+            && 0 == memcmp(&_whm_uplink_ctx.response_head[_whm_uplink_ctx.head_len - 4], "\r\n\r\n", 4))
+        {
+            _whm_uplink_ctx.head_done = true;
+            if (!_whm_uplink_parse_head())
+            {
+                _whm_uplink_fail("bad response");
+                return;
+            }
+        }
+    }
+    if (!_whm_uplink_ctx.head_done || _whm_uplink_ctx.body_left < 0)
+    {
+        return;
+    }
+    /* the body is skipped */
+    unsigned skip = WHM_MIN(len, (unsigned)_whm_uplink_ctx.body_left);
+    _whm_uplink_ctx.body_left -= skip;
+    if (!_whm_uplink_ctx.body_left)
+    {
+        _whm_uplink_done();
+    }
+}
+
+
+static bool _whm_uplink_parse_head(void)
+{
+    char* head = _whm_uplink_ctx.response_head;
+    if (0 != strncmp(head, "HTTP/1.", 7) || strlen(head) < 12)
+    {
+        return false;
+    }
+    _whm_uplink_ctx.status = strtoul(&head[9], NULL, 10);
+    if (0 == strncmp(head, "HTTP/1.0", 8))
+    {
+        _whm_uplink_ctx.keep_alive = false;
+    }
+    for (char* line = strstr(head, "\r\n"); line && line[2]; line = strstr(line + 2, "\r\n"))
+    {
+        char* field = line + 2;
+        if (0 == strncasecmp(field, "Content-Length:", 15))
+        {
+            _whm_uplink_ctx.body_left = strtol(&field[15], NULL, 10);
+        }
+        else if (0 == strncasecmp(field, "Connection:", 11))
+        {
+            char* value = &field[11];
+            value += strspn(value, " \t");
+            if (0 == strncasecmp(value, "close", 5))
+            {
+                _whm_uplink_ctx.keep_alive = false;
+            }
+        }
+    }
+    if (_whm_uplink_ctx.body_left < 0)
+    {
+        /* runs to the close, can't be reused */
+        _whm_uplink_ctx.keep_alive = false;
+    }
+    return true;
+}
+
+
+static void _whm_uplink_done(void)
+{
+    if (_whm_uplink_ctx.status < 200 || _whm_uplink_ctx.status > 299)
+    {
+        char reason[16];
+        snprintf(reason, sizeof(reason), "status %u", _whm_uplink_ctx.status);
+        _whm_uplink_fail(reason);
+        return;
+    }
+    _whm_uplink_ctx.stats.posts++;
+    _whm_uplink_ctx.stats.sent += _whm_uplink_ctx.batch_count;
+    if (_whm_uplink_ctx.batch_logged)
+    {
+        whm_meas_log_consume(_whm_uplink_ctx.batch[_whm_uplink_ctx.batch_count - 1].seq);
+    }
+    else if ((int32_t)(_whm_uplink_ctx.batch_end - _whm_uplink_ctx.tail) > 0)
+    {
+        /* some of the batch may have moved to the log meanwhile */
+        _whm_uplink_ctx.tail = _whm_uplink_ctx.batch_end;
+    }
+    _whm_uplink_ctx.attempts = 0;
+    _whm_uplink_ctx.stats.backoff_ms = 0;
+    if (_whm_uplink_ctx.keep_alive && _whm_uplink_ctx.pcb)
+    {
+        _whm_uplink_ctx.state = _WHM_UPLINK_STATE_READY;
+        _whm_uplink_ctx.idle_us = time_us_64() + _WHM_UPLINK_IDLE_US;
+    }
+    else
+    {
+        _whm_uplink_close();
+        _whm_uplink_ctx.state = _WHM_UPLINK_STATE_IDLE;
+    }
+}
+
+
+/* waits 1/2 to all of min * 2^attempts before the next try */
+static void _whm_uplink_fail(const char* reason)
+{
+    printf("uplink failed, %s\n", reason);
+    _whm_uplink_close();
+    _whm_uplink_ctx.stats.failures++;
+    if (_whm_uplink_ctx.attempts < 31)
+    {
+        _whm_uplink_ctx.attempts++;
+    }
+    uint32_t delay_ms = _WHM_UPLINK_BACKOFF_MAX_MS;
+    if (_whm_uplink_ctx.attempts <= 10)
+    {
+        delay_ms = WHM_MIN(_WHM_UPLINK_BACKOFF_MIN_MS << (_whm_uplink_ctx.attempts - 1), _WHM_UPLINK_BACKOFF_MAX_MS);
+    }
+    /* spread out so a fleet that lost the collector together doesn't
+     * come back together */
+    delay_ms = delay_ms / 2U + LWIP_RAND() % (delay_ms / 2U + 1U);
+    _whm_uplink_ctx.stats.backoff_ms = delay_ms;
+    _whm_uplink_ctx.retry_us = time_us_64() + WHM_MS_TO_US((uint64_t)delay_ms);
+    _whm_uplink_ctx.state = _WHM_UPLINK_STATE_BACKOFF;
+}
+
+
+static void _whm_uplink_close(void)
+{
+    struct tcp_pcb* pcb = _whm_uplink_ctx.pcb;
+    if (!pcb)
+    {
+        return;
+    }
+    _whm_uplink_ctx.pcb = NULL;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    if (ERR_OK != tcp_close(pcb))
+    {
+        tcp_abort(pcb);
+        _whm_uplink_ctx.aborted = true;
+    }
+}
@@ -0,0 +1,763 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pico/cyw43_arch.h"
+#include "pico/stdlib.h"
+
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+
+#include "ws_server.h"
+#include "http_server.h"
+#include "ap_station.h"
+#include "sampler.h"
+#include "config.h"
+#include "util.h"
+
+
+#define _WHM_WS_SERVER_PATH                         "/ws"
+#define _WHM_WS_SERVER_GUID                         "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define _WHM_WS_SERVER_KEY_LEN                      24 /* base64 of 16 bytes */
+#define _WHM_WS_SERVER_SHA1_LEN                     20
+#define _WHM_WS_SERVER_ACCEPT_LEN                   28 /* base64 of the SHA-1 */
+#define _WHM_WS_SERVER_MASK_LEN                     4
+#define _WHM_WS_SERVER_VERSION                      "13"
+/* a quiet client is pinged, and dropped if it doesn't answer in time,
+ * as is one that never finishes its handshake */
+#define _WHM_WS_SERVER_PING_US                      (30 * 1000 * 1000)
+#define _WHM_WS_SERVER_PONG_US                      (10 * 1000 * 1000)
+#define _WHM_WS_SERVER_ROL32(_x, _n)                (((_x) << (_n)) | ((_x) >> (32 - (_n))))
+
+
+typedef enum _whm_ws_server_opcode
+{
+    _WHM_WS_SERVER_OPCODE_CONTINUATION  = 0x0,
+    _WHM_WS_SERVER_OPCODE_TEXT          = 0x1,
+    _WHM_WS_SERVER_OPCODE_BINARY        = 0x2,
+    _WHM_WS_SERVER_OPCODE_CLOSE         = 0x8,
+    _WHM_WS_SERVER_OPCODE_PING          = 0x9,
+    _WHM_WS_SERVER_OPCODE_PONG          = 0xA,
+} _whm_ws_server_opcode_t;
+
+
+typedef enum _whm_ws_server_topic
+{
+    _WHM_WS_SERVER_TOPIC_MEAS           = (1 << 0),
+    _WHM_WS_SERVER_TOPIC_STATUS         = (1 << 1),
+} _whm_ws_server_topic_t;
+
+
+/* Messages are text frames of "<command> [<argument>]", the device
+ * replies and publishes as "<topic> <json>":
+ *
+ *   sub meas|status     -> meas [...] / status {...} as they change
+ *   unsub meas|status
+ *   scan                -> scan {...} once the scan has finished, an
+ *                          error if another's scan is running
+ *   config {...}        -> config {"status":...} once it is saved
+ *
+ * anything else gets "error {...}". Round trips can be timed with
+ * ping frames, they are answered straight from the receive callback. */
+typedef struct _whm_ws_server_cmd
+{
+    const char* name;
+    void (* handler)(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len);
+} _whm_ws_server_cmd_t;
+
+
+static err_t _whm_ws_server_accept(void* arg, struct tcp_pcb* pcb, err_t err);
+static err_t _whm_ws_server_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err);
+static void _whm_ws_server_err(void* arg, err_t err);
+static err_t _whm_ws_server_close(whm_ws_server_client_t* client);
+static int _whm_ws_server_handshake(whm_ws_server_client_t* client);
+static int _whm_ws_server_frame_process(whm_ws_server_client_t* client);
+static void _whm_ws_server_message_process(whm_ws_server_client_t* client, char* msg, unsigned len);
+static bool _whm_ws_server_send(whm_ws_server_client_t* client, uint8_t opcode, const void* payload, unsigned len);
+static bool _whm_ws_server_send_topic(whm_ws_server_client_t* client, const char* topic, const char* body, unsigned body_len);
+static void _whm_ws_server_cmd_sub(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len);
+static void _whm_ws_server_cmd_unsub(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len);
+static void _whm_ws_server_cmd_scan(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len);
+static void _whm_ws_server_cmd_config(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len);
+static uint8_t _whm_ws_server_topic_find(const char* name, unsigned len);
+static const char* _whm_ws_server_header_find(const char* request, const char* name);
+static bool _whm_ws_server_header_is(const char* request, const char* name, const char* value);
+static int _whm_ws_server_refuse(whm_ws_server_client_t* client, const char* response, unsigned len);
+static void _whm_ws_server_sha1(const uint8_t* data, unsigned len, uint8_t digest[_WHM_WS_SERVER_SHA1_LEN]);
+static void _whm_ws_server_sha1_block(uint32_t h[5], const uint8_t block[64]);
+static unsigned _whm_ws_server_base64(char* out, const uint8_t* data, unsigned len);
+
+
+static const _whm_ws_server_cmd_t _whm_ws_server_cmds[] =
+{
+    {"sub", _whm_ws_server_cmd_sub},
+    {"unsub", _whm_ws_server_cmd_unsub},
+    {"scan", _whm_ws_server_cmd_scan},
+    {"config", _whm_ws_server_cmd_config},
+};
+
+
+int whm_ws_server_init(whm_ws_server_t* server)
+{
+    memset(server->clients, 0, sizeof(server->clients));
+    for (unsigned i = 0; i < WHM_WS_SERVER_CLIENT_MAX; i++)
+    {
+        server->clients[i].server = server;
+    }
+    cyw43_arch_lwip_begin();
+    struct tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (!pcb)
+    {
+        cyw43_arch_lwip_end();
+        printf("Failed to create websocket pcb\n");
+        return -1;
+    }
+    if (ERR_OK != tcp_bind(pcb, IP_ANY_TYPE, WHM_WS_SERVER_PORT))
+    {
+        tcp_close(pcb);
+        cyw43_arch_lwip_end();
+        printf("Failed to bind websocket port\n");
+        return -1;
+    }
+    server->pcb = tcp_listen_with_backlog(pcb, 1);
+    if (!server->pcb)
+    {
+        tcp_close(pcb);
+        cyw43_arch_lwip_end();
+        printf("Failed to listen on websocket port\n");
+        return -1;
+    }
+    tcp_arg(server->pcb, server);
+    tcp_accept(server->pcb, _whm_ws_server_accept);
+    cyw43_arch_lwip_end();
+    return 0;
+}
+
+
+void whm_ws_server_deinit(whm_ws_server_t* server)
+{
+    cyw43_arch_lwip_begin();
+    for (unsigned i = 0; i < WHM_WS_SERVER_CLIENT_MAX; i++)
+    {
+        if (server->clients[i].pcb)
+        {
+            _whm_ws_server_close(&server->clients[i]);
+        }
+    }
+    if (server->pcb)
+    {
+        tcp_arg(server->pcb, NULL);
+        tcp_close(server->pcb);
+        server->pcb = NULL;
+    }
+    cyw43_arch_lwip_end();
+}
+
+
+void whm_ws_server_iterate(whm_ws_server_t* server)
+{
+    uint64_t now = time_us_64();
+    whm_sampler_reading_t reading;
+    bool have_reading = whm_sampler_get_reported(&reading);
+    const char* state = whm_ap_station_get_state();
+    bool scanning = whm_ap_station_scanning();
+    /* the server's own scan, every waiting client gets the same, and
+     * dropped if they have all gone */
+    whm_ap_station_scan_result_t* scan = scanning ? NULL : whm_ap_station_take_scan_for(server);
+    cyw43_arch_lwip_begin();
+    for (unsigned i = 0; i < WHM_WS_SERVER_CLIENT_MAX; i++)
+    {
+        whm_ws_server_client_t* client = &server->clients[i];
+        if (!client->pcb)
+        {
+            continue;
+        }
+        if ((!client->upgraded || client->ping_sent) && client->last_us + _WHM_WS_SERVER_PONG_US <= now)
+        {
+            /* no handshake, or no answer to the ping, in time */
+            _whm_ws_server_close(client);
+            continue;
+        }
+        if (!client->upgraded)
+        {
+            continue;
+        }
+        if (!client->ping_sent && client->last_us + _WHM_WS_SERVER_PING_US <= now
+            && _whm_ws_server_send(client, _WHM_WS_SERVER_OPCODE_PING, NULL, 0))
+        {
+            client->ping_sent = true;
+            client->last_us = now;
+        }
+        if ((client->topics & _WHM_WS_SERVER_TOPIC_STATUS) && state != client->state)
+        {
+            int len = whm_http_server_gen_status(server->send_buffer, WHM_WS_SERVER_SEND_BUFFER_SIZE);
+            if (_whm_ws_server_send_topic(client, "status", server->send_buffer, len))
+            {
+                client->state = state;
+            }
+        }
+        if ((client->topics & _WHM_WS_SERVER_TOPIC_MEAS) && have_reading && reading.seq != client->meas_seq)
+        {
+            int len = whm_http_server_gen_meas(server->send_buffer, WHM_WS_SERVER_SEND_BUFFER_SIZE, &reading);
+            if (_whm_ws_server_send_topic(client, "meas", server->send_buffer, len))
+            {
+                client->meas_seq = reading.seq;
+            }
+        }
+        if (client->scan_pending && !scanning)
+        {
+            unsigned len = 0;
+            whm_http_server_gen_wifi_scan(server->send_buffer, WHM_WS_SERVER_SEND_BUFFER_SIZE, scan, &len);
+            _whm_ws_server_send_topic(client, "scan", server->send_buffer, len);
+            client->scan_pending = false;
+        }
+        if (client->config_pending)
+        {
+            /* flash commit is done from the loop, not the receive callback */
+            const char* body = (0 == whm_config_save())
+                ? "{\"status\":\"ok\"}"
+                : "{\"status\":\"error\",\"error\":\"config invalid\"}";
+            _whm_ws_server_send_topic(client, "config", body, strlen(body));
+            client->config_pending = false;
+        }
+    }
+    cyw43_arch_lwip_end();
+    whm_ap_station_scan_free(scan);
+}
+
+
+static err_t _whm_ws_server_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    whm_ws_server_t* server = arg;
+    if (ERR_OK != err || !pcb)
+    {
+        return ERR_VAL;
+    }
+    whm_ws_server_client_t* client = NULL;
+    for (unsigned i = 0; i < WHM_WS_SERVER_CLIENT_MAX; i++)
+    {
+        if (!server->clients[i].pcb)
+        {
+            client = &server->clients[i];
+            break;
+        }
+    }
+    if (!client)
+    {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    client->pcb = pcb;
+    client->upgraded = false;
+    client->topics = 0;
+    client->meas_seq = 0;
+    client->state = NULL;
+    client->last_us = time_us_64();
+    client->ping_sent = false;
+    client->scan_pending = false;
+    client->config_pending = false;
+    client->recv_len = 0;
+    tcp_arg(pcb, client);
+    tcp_recv(pcb, _whm_ws_server_recv);
+    tcp_err(pcb, _whm_ws_server_err);
+    /* messages are small and latency matters more than packing */
+    tcp_nagle_disable(pcb);
+    return ERR_OK;
+}
+
+
+static err_t _whm_ws_server_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    whm_ws_server_client_t* client = arg;
+    if (!p)
+    {
+        return _whm_ws_server_close(client);
+    }
+    /* one spare byte so the handshake can be terminated */
+    unsigned remaining = WHM_WS_SERVER_RECV_BUFFER_SIZE - 1 - client->recv_len;
+    if (p->tot_len > remaining)
+    {
+        pbuf_free(p);
+        return _whm_ws_server_close(client);
+    }
+    pbuf_copy_partial(p, &client->recv_buffer[client->recv_len], p->tot_len, 0);
+    client->recv_len += p->tot_len;
+    if (client->upgraded)
+    {
+        /* anything, not only a pong, shows the client is still there,
+         * the handshake's time runs from the accept */
+        client->last_us = time_us_64();
+        client->ping_sent = false;
+    }
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    int used = 0;
+    do
+    {
+        used = client->upgraded
+            ? _whm_ws_server_frame_process(client)
+            : _whm_ws_server_handshake(client);
+        if (used < 0)
+        {
+            return _whm_ws_server_close(client);
+        }
+        client->recv_len -= used;
+        memmove(client->recv_buffer, &client->recv_buffer[used], client->recv_len);
+    } while (used > 0 && client->recv_len);
+    return ERR_OK;
+}
+
+
+static void _whm_ws_server_err(void* arg, err_t err)
+{
+    whm_ws_server_client_t* client = arg;
+    if (client)
+    {
+        /* pcb already freed by lwIP */
+        client->pcb = NULL;
+    }
+}
+
+
+/* ERR_ABRT if the pcb had to be aborted, lwIP must be told from a callback */
+static err_t _whm_ws_server_close(whm_ws_server_client_t* client)
+{
+    struct tcp_pcb* pcb = client->pcb;
+    client->pcb = NULL;
+    if (!pcb)
+    {
+        return ERR_OK;
+    }
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+    if (ERR_OK != tcp_close(pcb))
+    {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+
+/* returns the bytes used, 0 until the whole request is in, or -1 to drop
+ * the connection */
+static int _whm_ws_server_handshake(whm_ws_server_client_t* client)
+{
+    char* request = (char*)client->recv_buffer;
+    request[client->recv_len] = '\0';
+    char* end = strstr(request, "\r\n\r\n");
+    if (!end)
+    {
+        return 0;
+    }
+    const char* key = _whm_ws_server_header_find(request, "Sec-WebSocket-Key");
+    bool path_ok = 0 == strncmp(request, "GET " _WHM_WS_SERVER_PATH, strlen("GET " _WHM_WS_SERVER_PATH))
+        && (' ' == request[strlen("GET " _WHM_WS_SERVER_PATH)] || '?' == request[strlen("GET " _WHM_WS_SERVER_PATH)]);
+    if (!path_ok || !key || strcspn(key, "\r\n") != _WHM_WS_SERVER_KEY_LEN
+        || !_whm_ws_server_header_is(request, "Upgrade", "websocket"))
+    {
+        static const char bad_request[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        return _whm_ws_server_refuse(client, bad_request, sizeof(bad_request) - 1);
+    }
+    if (!_whm_ws_server_header_is(request, "Sec-WebSocket-Version", _WHM_WS_SERVER_VERSION))
+    {
+        /* the one version spoken, for the client to retry with */
+        static const char upgrade_required[] =
+            "HTTP/1.1 426 Upgrade Required\r\n"
+            "Sec-WebSocket-Version: " _WHM_WS_SERVER_VERSION "\r\n"
+            "Connection: close\r\n"
+            "\r\n";
+        return _whm_ws_server_refuse(client, upgrade_required, sizeof(upgrade_required) - 1);
+    }
+    uint8_t key_guid[_WHM_WS_SERVER_KEY_LEN + sizeof(_WHM_WS_SERVER_GUID) - 1];
+    memcpy(key_guid, key, _WHM_WS_SERVER_KEY_LEN);
+    memcpy(&key_guid[_WHM_WS_SERVER_KEY_LEN], _WHM_WS_SERVER_GUID, sizeof(_WHM_WS_SERVER_GUID) - 1);
+    uint8_t digest[_WHM_WS_SERVER_SHA1_LEN];
+    _whm_ws_server_sha1(key_guid, sizeof(key_guid), digest);
+    char accept[_WHM_WS_SERVER_ACCEPT_LEN + 1];
+    _whm_ws_server_base64(accept, digest, sizeof(digest));
+
+    char response[160];
+    int len = snprintf(
+        response,
+        sizeof(response),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n"
+        "\r\n",
+        accept
+    );
+    if (ERR_OK != tcp_write(client->pcb, response, len, TCP_WRITE_FLAG_COPY))
+    {
+        return -1;
+    }
+    tcp_output(client->pcb);
+    client->upgraded = true;
+    return end + 4 - request;
+}
+
+
+/* returns the bytes used, 0 until the whole frame is in, or -1 to drop
+ * the connection */
+static int _whm_ws_server_frame_process(whm_ws_server_client_t* client)
+{
+    uint8_t* frame = client->recv_buffer;
+    unsigned avail = client->recv_len;
+    if (avail < 2)
+    {
+        return 0;
+    }
+    bool fin = frame[0] & 0x80;
+    uint8_t opcode = frame[0] & 0x0F;
+    bool masked = frame[1] & 0x80;
+    unsigned len = frame[1] & 0x7F;
+    unsigned header_len = 2;
+    if (126 == len)
+    {
+        if (avail < 4)
+        {
+            return 0;
+        }
+        len = (frame[2] << 8) | frame[3];
+        header_len = 4;
+    }
+    else if (127 == len)
+    {
+        /* never fits the buffer */
+        return -1;
+    }
+    /* clients must mask, messages are too small to need fragmenting */
+    if (!masked || !fin || header_len + _WHM_WS_SERVER_MASK_LEN + len >= WHM_WS_SERVER_RECV_BUFFER_SIZE)
+    {
+        return -1;
+    }
+    if (avail < header_len + _WHM_WS_SERVER_MASK_LEN + len)
+    {
+        return 0;
+    }
+    const uint8_t* mask = &frame[header_len];
+    uint8_t* payload = &frame[header_len + _WHM_WS_SERVER_MASK_LEN];
+    for (unsigned i = 0; i < len; i++)
+    {
+        payload[i] ^= mask[i % _WHM_WS_SERVER_MASK_LEN];
+    }
+    switch (opcode)
+    {
+        case _WHM_WS_SERVER_OPCODE_TEXT:
+            _whm_ws_server_message_process(client, (char*)payload, len);
+            break;
+        case _WHM_WS_SERVER_OPCODE_PING:
+            _whm_ws_server_send(client, _WHM_WS_SERVER_OPCODE_PONG, payload, len);
+            break;
+        case _WHM_WS_SERVER_OPCODE_PONG:
+            break;
+        case _WHM_WS_SERVER_OPCODE_CLOSE:
+            /* echo the status code back before closing */
+            _whm_ws_server_send(client, _WHM_WS_SERVER_OPCODE_CLOSE, payload, WHM_MIN(len, 2U));
+            return -1;
+        default:
+            return -1;
+    }
+    return header_len + _WHM_WS_SERVER_MASK_LEN + len;
+}
+
+
+static void _whm_ws_server_message_process(whm_ws_server_client_t* client, char* msg, unsigned len)
+{
+    unsigned name_len = 0;
+    while (name_len < len && ' ' != msg[name_len])
+    {
+        name_len++;
+    }
+    char* arg = &msg[WHM_MIN(name_len + 1, len)];
+    unsigned arg_len = len - (arg - msg);
+    for (unsigned i = 0; i < LWIP_ARRAYSIZE(_whm_ws_server_cmds); i++)
+    {
+        const _whm_ws_server_cmd_t* cmd = &_whm_ws_server_cmds[i];
+        if (strlen(cmd->name) == name_len && 0 == strncmp(cmd->name, msg, name_len))
+        {
+            cmd->handler(client->server, client, arg, arg_len);
+            return;
+        }
+    }
+    static const char unknown[] = "{\"status\":\"error\",\"error\":\"unknown command\"}";
+    _whm_ws_server_send_topic(client, "error", unknown, sizeof(unknown) - 1);
+}
+
+
+/* a client too slow to take the message just misses it, the next
+ * publish carries the latest state anyway */
+static bool _whm_ws_server_send(whm_ws_server_client_t* client, uint8_t opcode, const void* payload, unsigned len)
+{
+    uint8_t header[4];
+    unsigned header_len = 2;
+    header[0] = 0x80 | opcode;
+    if (len < 126)
+    {
+        header[1] = len;
+    }
+    else
+    {
+        header[1] = 126;
+        header[2] = (len >> 8) & 0xFF;
+        header[3] = len & 0xFF;
+        header_len = 4;
+    }
+    if (!client->pcb || tcp_sndbuf(client->pcb) < header_len + len)
+    {
+        return false;
+    }
+    if (ERR_OK != tcp_write(client->pcb, header, header_len, TCP_WRITE_FLAG_COPY | (len ? TCP_WRITE_FLAG_MORE : 0))
+        || (len && ERR_OK != tcp_write(client->pcb, payload, len, TCP_WRITE_FLAG_COPY)))
+    {
+        return false;
+    }
+    tcp_output(client->pcb);
+    return true;
+}
+
+
+static bool _whm_ws_server_send_topic(whm_ws_server_client_t* client, const char* topic, const char* body, unsigned body_len)
+{
+    char msg[WHM_WS_SERVER_SEND_BUFFER_SIZE + 16];
+    int len = snprintf(msg, sizeof(msg), "%s %.*s", topic, body_len, body);
+    return _whm_ws_server_send(client, _WHM_WS_SERVER_OPCODE_TEXT, msg, WHM_MIN(len, (int)sizeof(msg) - 1));
+}
+
+
+static void _whm_ws_server_cmd_sub(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len)
+{
+    uint8_t topic = _whm_ws_server_topic_find(arg, arg_len);
+    if (!topic)
+    {
+        static const char unknown[] = "{\"status\":\"error\",\"error\":\"unknown topic\"}";
+        _whm_ws_server_send_topic(client, "error", unknown, sizeof(unknown) - 1);
+        return;
+    }
+    client->topics |= topic;
+    /* publish the current value on the next iterate */
+    if (topic & _WHM_WS_SERVER_TOPIC_MEAS)
+    {
+        client->meas_seq = 0;
+    }
+    if (topic & _WHM_WS_SERVER_TOPIC_STATUS)
+    {
+        client->state = NULL;
+    }
+}
+
+
+static void _whm_ws_server_cmd_unsub(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len)
+{
+    client->topics &= ~_whm_ws_server_topic_find(arg, arg_len);
+}
+
+
+static void _whm_ws_server_cmd_scan(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len)
+{
+    /* the results are the server's, so a GET of /api/wifi-scan-get can't
+     * take them, and joined by its other clients */
+    if (whm_ap_station_start_scan_for(server))
+    {
+        client->scan_pending = true;
+    }
+    else if (whm_ap_station_scanning())
+    {
+        static const char busy[] = "{\"status\":\"error\",\"error\":\"scan busy\"}";
+        _whm_ws_server_send_topic(client, "scan", busy, sizeof(busy) - 1);
+    }
+    else
+    {
+        static const char failed[] = "{\"status\":\"error\"}";
+        _whm_ws_server_send_topic(client, "scan", failed, sizeof(failed) - 1);
+    }
+}
+
+
+static void _whm_ws_server_cmd_config(whm_ws_server_t* server, whm_ws_server_client_t* client, char* arg, unsigned arg_len)
+{
+    if (0 == whm_config_set_string(arg, arg_len))
+    {
+        client->config_pending = true;
+    }
+    else
+    {
+        static const char invalid[] = "{\"status\":\"error\",\"error\":\"config invalid\"}";
+        _whm_ws_server_send_topic(client, "config", invalid, sizeof(invalid) - 1);
+    }
+}
+
+
+static uint8_t _whm_ws_server_topic_find(const char* name, unsigned len)
+{
+    if (4 == len && 0 == strncmp(name, "meas", len))
+    {
+        return _WHM_WS_SERVER_TOPIC_MEAS;
+    }
+    if (6 == len && 0 == strncmp(name, "status", len))
+    {
+        return _WHM_WS_SERVER_TOPIC_STATUS;
+    }
+    return 0;
+}
+
+
+static const char* _whm_ws_server_header_find(const char* request, const char* name)
+{
+    unsigned name_len = strlen(name);
+    const char* line = strstr(request, "\r\n");
+    while (line && 0 != strncmp(line, "\r\n\r\n", 4))
+    {
+        line += 2;
+        if (0 == strncasecmp(line, name, name_len) && ':' == line[name_len])
+        {
+            const char* value = &line[name_len + 1];
+            while (' ' == *value)
+            {
+                value++;
+            }
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+
+/* the whole value, ignoring case */
+static bool _whm_ws_server_header_is(const char* request, const char* name, const char* value)
+{
+    const char* found = _whm_ws_server_header_find(request, name);
+    unsigned len = strlen(value);
+    return found && strcspn(found, "\r\n") == len && 0 == strncasecmp(found, value, len);
+}
+
+
+/* the response goes out before the connection is dropped */
+static int _whm_ws_server_refuse(whm_ws_server_client_t* client, const char* response, unsigned len)
+{
+    tcp_write(client->pcb, response, len, 0);
+    tcp_output(client->pcb);
+    return -1;
+}
+
+
+static void _whm_ws_server_sha1(const uint8_t* data, unsigned len, uint8_t digest[_WHM_WS_SERVER_SHA1_LEN])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint64_t bits = (uint64_t)len * 8;
+    /* message, 0x80, zero padding then the 64 bit length */
+    unsigned total = ((len + 8) / 64 + 1) * 64;
+    uint8_t block[64];
+    for (unsigned offset = 0; offset < total; offset += 64)
+    {
+        for (unsigned i = 0; i < 64; i++)
+        {
+            unsigned pos = offset + i;
+            if (pos < len)
+            {
+                block[i] = data[pos];
+            }
+            else if (pos == len)
+            {
+                block[i] = 0x80;
+            }
+            else if (pos >= total - 8)
+            {
+                block[i] = (bits >> (8 * (total - 1 - pos))) & 0xFF;
+            }
+            else
+            {
+                block[i] = 0;
+            }
+        }
+        _whm_ws_server_sha1_block(h, block);
+    }
+    for (unsigned i = 0; i < 5; i++)
+    {
+        digest[i * 4 + 0] = (h[i] >> 24) & 0xFF;
+        digest[i * 4 + 1] = (h[i] >> 16) & 0xFF;
+        digest[i * 4 + 2] = (h[i] >> 8) & 0xFF;
+        digest[i * 4 + 3] = h[i] & 0xFF;
+    }
+}
+
+
+static void _whm_ws_server_sha1_block(uint32_t h[5], const uint8_t block[64])
+{
+    uint32_t w[80];
+    for (unsigned i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16)
+             | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (unsigned i = 16; i < 80; i++)
+    {
+        w[i] = _WHM_WS_SERVER_ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (unsigned i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = _WHM_WS_SERVER_ROL32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = _WHM_WS_SERVER_ROL32(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+
+static unsigned _whm_ws_server_base64(char* out, const uint8_t* data, unsigned len)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char* p = out;
+    for (unsigned i = 0; i < len; i += 3)
+    {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len)
+        {
+            v |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < len)
+        {
+            v |= data[i + 2];
+        }
+        *p++ = table[(v >> 18) & 0x3F];
+        *p++ = table[(v >> 12) & 0x3F];
+        *p++ = (i + 1 < len) ? table[(v >> 6) & 0x3F] : '=';
+        *p++ = (i + 2 < len) ? table[v & 0x3F] : '=';
+    }
+    *p = '\0';
+    return p - out;
+}
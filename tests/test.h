@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static unsigned whm_test_failures;
+
+
+/* carries on after a failure, so one run shows them all */
+#define WHM_TEST_CHECK(_cond)                                                       \
+    do                                                                              \
+    {                                                                               \
+        if (!(_cond))                                                               \
+        {                                                                           \
+            printf("%s:%d: failed %s\n", __FILE__, __LINE__, #_cond);               \
+            whm_test_failures++;                                                    \
+        }                                                                           \
+    } while (0)
+
+#define WHM_TEST_RESULT()                   (whm_test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
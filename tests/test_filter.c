@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "filter.h"
+#include "test.h"
+
+
+#define LEN(_a)                             (sizeof(_a) / sizeof((_a)[0]))
+
+
+/* Reference outputs from an independent model of the arithmetic, rounded
+ * half away from zero, the step responses agreeing with floating point. */
+static const int32_t rh_in[] = {45123, 45130, 45990, 45127, 45140, 45120, 45135, 45131};
+/* below zero and crossing it, where truncating division would differ */
+static const int32_t t_in[] = {-1500, -1502, -1499, -1650, -1501, -1, -2, 0};
+
+
+static void run(const whm_config_filter_t* config, const int32_t* in, const int32_t* expected, unsigned len, unsigned line)
+{
+    whm_filter_t filter;
+    whm_filter_init(&filter, config);
+    for (unsigned i = 0; i < len; i++)
+    {
+        int32_t out = whm_filter_apply(&filter, config, in[i]);
+        if (out != expected[i])
+        {
+            printf("%s:%u: reading %u gave %d, expected %d\n", __FILE__, line, i, (int)out, (int)expected[i]);
+            whm_test_failures++;
+        }
+    }
+}
+
+
+#define RUN(_config, _in, _expected)                                                \
+    do                                                                              \
+    {                                                                               \
+        _Static_assert(LEN(_in) == LEN(_expected), "Vectors differ in length.");   \
+        run(&(_config), _in, _expected, LEN(_in), __LINE__);                        \
+    } while (0)
+
+
+static void test_none(void)
+{
+    whm_config_filter_t config = {.type = WHM_CONFIG_FILTER_NONE, .length = 4, .shift = 2};
+    RUN(config, t_in, t_in);
+}
+
+
+static void test_mean(void)
+{
+    whm_config_filter_t config = {.type = WHM_CONFIG_FILTER_MEAN, .length = 4};
+    static const int32_t rh_out[] = {45123, 45127, 45414, 45343, 45347, 45344, 45131, 45132};
+    RUN(config, rh_in, rh_out);
+    static const int32_t t_out[] = {-1500, -1501, -1500, -1538, -1538, -1163, -789, -376};
+    RUN(config, t_in, t_out);
+    /* halves go away from zero either side of it */
+    config.length = 2;
+    static const int32_t half_in[] = {-1, -2, 1, 2};
+    static const int32_t half_out[] = {-1, -2, -1, 2};
+    RUN(config, half_in, half_out);
+}
+
+
+static void test_median(void)
+{
+    whm_config_filter_t config = {.type = WHM_CONFIG_FILTER_MEDIAN, .length = 3};
+    /* the spike at 45990 never gets through */
+    static const int32_t rh_out[] = {45123, 45127, 45130, 45130, 45140, 45127, 45135, 45131};
+    RUN(config, rh_in, rh_out);
+    /* even, halfway between the middle two */
+    config.length = 4;
+    static const int32_t t_out[] = {-1500, -1501, -1500, -1501, -1502, -1500, -752, -2};
+    RUN(config, t_in, t_out);
+}
+
+
+static void test_iir(void)
+{
+    whm_config_filter_t config = {.type = WHM_CONFIG_FILTER_IIR, .shift = 2};
+    static const int32_t t_out[] = {-1500, -1501, -1500, -1538, -1528, -1147, -860, -645};
+    RUN(config, t_in, t_out);
+    /* a step of one e3 still comes through, on the third reading after */
+    static const int32_t step_in[] = {0, 1, 1, 1, 1, 1, 1, 1};
+    static const int32_t step_out[] = {0, 0, 0, 1, 1, 1, 1, 1};
+    RUN(config, step_in, step_out);
+    /* -125, -234.375, -330.1, -413.8 in floating point */
+    config.shift = 3;
+    static const int32_t neg_in[] = {0, -1000, -1000, -1000, -1000};
+    static const int32_t neg_out[] = {0, -125, -234, -330, -414};
+    RUN(config, neg_in, neg_out);
+}
+
+
+static void test_config_change(void)
+{
+    whm_config_filter_t mean = {.type = WHM_CONFIG_FILTER_MEAN, .length = 4};
+    whm_config_filter_t longer = {.type = WHM_CONFIG_FILTER_MEAN, .length = 8};
+    whm_filter_t filter;
+    whm_filter_init(&filter, &mean);
+    whm_filter_apply(&filter, &mean, 1000);
+    WHM_TEST_CHECK(1500 == whm_filter_apply(&filter, &mean, 2000));
+    /* starts again, the old window forgotten */
+    WHM_TEST_CHECK(3000 == whm_filter_apply(&filter, &longer, 3000));
+    /* a length out of range is kept inside the window */
+    whm_config_filter_t bad = {.type = WHM_CONFIG_FILTER_MEDIAN, .length = 0};
+    whm_filter_init(&filter, &bad);
+    WHM_TEST_CHECK(WHM_CONFIG_FILTER_LENGTH_MAX == filter.length);
+}
+
+
+int main(void)
+{
+    test_none();
+    test_mean();
+    test_median();
+    test_iir();
+    test_config_change();
+    return WHM_TEST_RESULT();
+}
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "http_request.h"
+#include "test.h"
+
+
+#define ETAG                                "\"abc1234-gz\""
+
+
+/* each segment in turn, as the receive callback sees them */
+static whm_http_request_index_t index_of(whm_http_request_t* request, const char* const* segments)
+{
+    whm_http_request_init(request);
+    for (; NULL != *segments; segments++)
+    {
+        whm_http_request_feed(request, *segments, strlen(*segments), ETAG);
+    }
+    return whm_http_request_index(request);
+}
+
+
+static void test_index(void)
+{
+    whm_http_request_t request;
+    const char* plain[] = {"GET / HTTP/1.1\r\nHost: whm\r\n\r\n", NULL};
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_PLAIN == index_of(&request, plain));
+    const char* gzip[] = {"GET / HTTP/1.1\r\nHost: whm\r\naccept-encoding: deflate, GZIP;q=1.0\r\n\r\n", NULL};
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_GZIP == index_of(&request, gzip));
+    const char* deflate[] = {"GET / HTTP/1.1\r\nAccept-Encoding: deflate, br\r\n\r\n", NULL};
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_PLAIN == index_of(&request, deflate));
+    const char* matched[] =
+    {
+        "GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\nIf-None-Match: \"old\", " ETAG "\r\n\r\n",
+        NULL,
+    };
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_NOT_MODIFIED == index_of(&request, matched));
+    const char* stale[] = {"GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\nIf-None-Match: \"old-gz\"\r\n\r\n", NULL};
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_GZIP == index_of(&request, stale));
+    /* a 304 only to a client that could have had the gzipped copy */
+    const char* no_gzip[] = {"GET / HTTP/1.1\r\nIf-None-Match: " ETAG "\r\n\r\n", NULL};
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_PLAIN == index_of(&request, no_gzip));
+}
+
+
+static void test_segments(void)
+{
+    whm_http_request_t request;
+    /* headers over two segments, split between lines */
+    const char* split[] =
+    {
+        "GET / HTTP/1.1\r\nHost: whm\r\nAccept-Encoding: gzip\r\n",
+        "If-None-Match: " ETAG "\r\n\r\n",
+        NULL,
+    };
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_NOT_MODIFIED == index_of(&request, split));
+    /* a POST's body is never taken for headers */
+    const char* body[] =
+    {
+        "POST /api/config HTTP/1.1\r\nContent-Length: 40\r\n\r\n",
+        "Accept-Encoding: gzip\r\n",
+        NULL,
+    };
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_PLAIN == index_of(&request, body));
+    const char* same[] = {"POST /api/config HTTP/1.1\r\n\r\nAccept-Encoding: gzip\r\n", NULL};
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_PLAIN == index_of(&request, same));
+    /* the next request on a kept alive connection starts again */
+    const char* next[] =
+    {
+        "GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: whm\r\n\r\n",
+        NULL,
+    };
+    WHM_TEST_CHECK(WHM_HTTP_REQUEST_INDEX_PLAIN == index_of(&request, next));
+    WHM_TEST_CHECK(whm_http_request_feed(&request, "POST / HTTP/1.1\r\n", 17, ETAG));
+    WHM_TEST_CHECK(!whm_http_request_feed(&request, "Host: whm\r\n", 11, ETAG));
+}
+
+
+static void test_cbor(void)
+{
+    whm_http_request_t request;
+    const char* cbor[] = {"GET /api/meas HTTP/1.1\r\nAccept: application/json, Application/CBOR\r\n\r\n", NULL};
+    index_of(&request, cbor);
+    WHM_TEST_CHECK(request.accepts_cbor && !request.accepts_gzip);
+    const char* json[] = {"GET /api/meas HTTP/1.1\r\nAccept: application/json\r\nAccept-Encoding: gzip\r\n\r\n", NULL};
+    index_of(&request, json);
+    WHM_TEST_CHECK(!request.accepts_cbor && request.accepts_gzip);
+    /* not carried over to the next request */
+    const char* next[] =
+    {
+        "GET /api/meas HTTP/1.1\r\nAccept: application/cbor\r\n\r\n",
+        "GET /api/meas HTTP/1.1\r\n\r\n",
+        NULL,
+    };
+    index_of(&request, next);
+    WHM_TEST_CHECK(!request.accepts_cbor);
+}
+
+
+static void test_header_find(void)
+{
+    static const char headers[] = "GET / HTTP/1.1\r\nAccept:  application/cbor\r\nAccept-Language: en\r\n\r\n";
+    unsigned len = 0;
+    const char* value = whm_http_request_header_find(headers, sizeof(headers) - 1, "accept", &len);
+    WHM_TEST_CHECK(NULL != value && 16 == len && 0 == strncmp(value, "application/cbor", len));
+    WHM_TEST_CHECK(whm_http_request_header_contains(value, len, "APPLICATION/CBOR"));
+    WHM_TEST_CHECK(NULL == whm_http_request_header_find(headers, sizeof(headers) - 1, "Accept-Encoding", &len));
+}
+
+
+int main(void)
+{
+    test_index();
+    test_segments();
+    test_cbor();
+    test_header_find();
+    return WHM_TEST_RESULT();
+}
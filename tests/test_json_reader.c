@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "json_reader.h"
+#include "test.h"
+
+
+/* the token of the value of {"k":<value>}, fed a byte at a time as it
+ * would arrive, the value left in reader */
+static whm_json_reader_token_t read_value(whm_json_reader_t* reader, const char* value)
+{
+    char doc[256];
+    snprintf(doc, sizeof(doc), "{\"k\":%s}", value);
+    whm_json_reader_init(reader);
+    whm_json_reader_token_t token = WHM_JSON_READER_TOKEN_NONE;
+    for (unsigned i = 0; doc[i]; i++)
+    {
+        whm_json_reader_next(reader, &doc[i], 1, &token);
+        if (WHM_JSON_READER_TOKEN_ERROR == token
+            || WHM_JSON_READER_TOKEN_STRING == token
+            || WHM_JSON_READER_TOKEN_NUMBER == token)
+        {
+            return token;
+        }
+    }
+    return token;
+}
+
+
+static void test_escapes(void)
+{
+    whm_json_reader_t reader;
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_STRING == read_value(&reader, "\"a\\\"b\\\\c\\n\""));
+    WHM_TEST_CHECK(0 == strcmp(reader.value, "a\"b\\c\n"));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_STRING == read_value(&reader, "\"\\u00e9\\u20ac\""));
+    WHM_TEST_CHECK(0 == strcmp(reader.value, "\xc3\xa9\xe2\x82\xac"));
+    /* U+1F600 as a surrogate pair */
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_STRING == read_value(&reader, "\"x\\ud83d\\ude00y\""));
+    WHM_TEST_CHECK(0 == strcmp(reader.value, "x\xf0\x9f\x98\x80y"));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\q\""));
+}
+
+
+static void test_rejected(void)
+{
+    whm_json_reader_t reader;
+    /* would end the value early as a C string */
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"a\\u0000b\""));
+    /* a high surrogate alone, at the end, before a character or another escape */
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\ud83d\""));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\ud83dx\""));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\ud83d\\n\""));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\ud83d\\u0041\""));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\ud83d\\ud83d\""));
+    /* and a low one alone */
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"\\ude00\""));
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_ERROR == read_value(&reader, "\"a\x01\""));
+}
+
+
+static void test_numbers(void)
+{
+    whm_json_reader_t reader;
+    WHM_TEST_CHECK(WHM_JSON_READER_TOKEN_NUMBER == read_value(&reader, "-12.5e3"));
+    WHM_TEST_CHECK(0 == strcmp(reader.value, "-12.5e3"));
+}
+
+
+int main(void)
+{
+    test_escapes();
+    test_rejected();
+    test_numbers();
+    return WHM_TEST_RESULT();
+}
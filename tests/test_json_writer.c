@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "json_writer.h"
+#include "test.h"
+
+
+#define LEN(_a)                             (sizeof(_a) / sizeof((_a)[0]))
+#define WINDOW                              7U
+
+
+/* every integer head length either side of its boundary */
+static const uint32_t uints[] = {0, 23, 24, 255, 256, 65535, 65536, UINT32_MAX};
+
+/* the same calls, an already encoded value copied as it is */
+static const char expected_json[] =
+    "{\"a\":[0,23,24,255,256,65535,65536,4294967295],\"t\":-1.500,\"q\":0.25,"
+    "\"i\":[-1,-500,42],\"b\":[true,false,null],\"v\":{\"x\": [1, 2.5]}}";
+static const uint8_t expected_cbor[] =
+{
+    0xBF,
+    0x61, 'a', 0x9F,
+    0x00, 0x17, 0x18, 0x18, 0x18, 0xFF, 0x19, 0x01, 0x00, 0x19, 0xFF, 0xFF,
+    0x1A, 0x00, 0x01, 0x00, 0x00, 0x1A, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,
+    /* fixed point values with decimals are doubles */
+    0x61, 't', 0xFB, 0xBF, 0xF8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x61, 'q', 0xFB, 0x3F, 0xD0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* without, integers */
+    0x61, 'i', 0x9F, 0x20, 0x39, 0x01, 0xF3, 0x18, 0x2A, 0xFF,
+    0x61, 'b', 0x9F, 0xF5, 0xF4, 0xF6, 0xFF,
+    /* already encoded JSON re-encoded */
+    0x61, 'v', 0xBF, 0x61, 'x', 0x9F, 0x01, 0xFB, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF,
+    0xFF,
+};
+
+
+static void generate(whm_json_writer_t* writer)
+{
+    whm_json_writer_object_begin(writer);
+    whm_json_writer_key(writer, "a");
+    whm_json_writer_array_begin(writer);
+    for (unsigned i = 0; i < LEN(uints); i++)
+    {
+        whm_json_writer_uint(writer, uints[i]);
+    }
+    whm_json_writer_array_end(writer);
+    whm_json_writer_key(writer, "t");
+    whm_json_writer_fixed(writer, -1500, 3);
+    whm_json_writer_key(writer, "q");
+    whm_json_writer_fixed(writer, 25, 2);
+    whm_json_writer_key(writer, "i");
+    whm_json_writer_array_begin(writer);
+    whm_json_writer_int(writer, -1);
+    whm_json_writer_int(writer, -500);
+    whm_json_writer_fixed(writer, 42, 0);
+    whm_json_writer_array_end(writer);
+    whm_json_writer_key(writer, "b");
+    whm_json_writer_array_begin(writer);
+    whm_json_writer_bool(writer, true);
+    whm_json_writer_bool(writer, false);
+    whm_json_writer_null(writer);
+    whm_json_writer_array_end(writer);
+    whm_json_writer_key(writer, "v");
+    whm_json_writer_value(writer, "{\"x\": [1, 2.5]}");
+    whm_json_writer_object_end(writer);
+}
+
+
+static void test_json(void)
+{
+    char buf[256];
+    whm_json_writer_t writer;
+    whm_json_writer_init(&writer, buf, sizeof(buf), 0);
+    generate(&writer);
+    WHM_TEST_CHECK(sizeof(expected_json) - 1 == whm_json_writer_len(&writer));
+    WHM_TEST_CHECK(0 == memcmp(buf, expected_json, sizeof(expected_json) - 1));
+}
+
+
+static void test_cbor(void)
+{
+    char buf[256];
+    whm_json_writer_t writer;
+    whm_json_writer_init_cbor(&writer, buf, sizeof(buf), 0);
+    generate(&writer);
+    WHM_TEST_CHECK(sizeof(expected_cbor) == whm_json_writer_len(&writer));
+    WHM_TEST_CHECK(sizeof(expected_cbor) == whm_json_writer_written(&writer));
+    WHM_TEST_CHECK(!whm_json_writer_full(&writer));
+    WHM_TEST_CHECK(0 == memcmp(buf, expected_cbor, sizeof(expected_cbor)));
+}
+
+
+/* sent in pieces, rendered again for each one, the length first */
+static void test_window(void)
+{
+    whm_json_writer_t writer;
+    whm_json_writer_init_cbor(&writer, NULL, 0, 0);
+    generate(&writer);
+    unsigned len = whm_json_writer_len(&writer);
+    WHM_TEST_CHECK(sizeof(expected_cbor) == len);
+    WHM_TEST_CHECK(0 == whm_json_writer_written(&writer));
+    char out[sizeof(expected_cbor)];
+    for (unsigned offset = 0; offset < len; offset += WINDOW)
+    {
+        char buf[WINDOW];
+        memset(buf, 0xAA, sizeof(buf));
+        whm_json_writer_init_cbor(&writer, buf, sizeof(buf), offset);
+        generate(&writer);
+        unsigned written = whm_json_writer_written(&writer);
+        WHM_TEST_CHECK(written == (len - offset < WINDOW ? len - offset : WINDOW));
+        WHM_TEST_CHECK(whm_json_writer_full(&writer) == (offset + WINDOW <= len));
+        memcpy(&out[offset], buf, written);
+    }
+    WHM_TEST_CHECK(0 == memcmp(out, expected_cbor, sizeof(expected_cbor)));
+    /* a window starting inside a multi-byte head */
+    char buf[3];
+    whm_json_writer_init_cbor(&writer, buf, sizeof(buf), 17);
+    generate(&writer);
+    WHM_TEST_CHECK(0 == memcmp(buf, &expected_cbor[17], sizeof(buf)));
+}
+
+
+int main(void)
+{
+    test_json();
+    test_cbor();
+    test_window();
+    return WHM_TEST_RESULT();
+}
@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "line_protocol.h"
+#include "test.h"
+
+
+static void test_escape(void)
+{
+    char buf[64];
+    whm_line_protocol_escape(buf, sizeof(buf), "plain");
+    WHM_TEST_CHECK(0 == strcmp(buf, "plain"));
+    whm_line_protocol_escape(buf, sizeof(buf), "living room,a=b");
+    WHM_TEST_CHECK(0 == strcmp(buf, "living\\ room\\,a\\=b"));
+    /* stops short rather than leave a backslash without its character */
+    whm_line_protocol_escape(buf, 4, "ab,c");
+    WHM_TEST_CHECK(0 == strcmp(buf, "ab"));
+    whm_line_protocol_escape(buf, 5, "ab,c");
+    WHM_TEST_CHECK(0 == strcmp(buf, "ab\\,"));
+    /* a name that fits exactly, and one a character too long */
+    whm_line_protocol_escape(buf, 6, "abcde");
+    WHM_TEST_CHECK(0 == strcmp(buf, "abcde"));
+    whm_line_protocol_escape(buf, 6, "abcdef");
+    WHM_TEST_CHECK(0 == strcmp(buf, "abcde"));
+    /* an escaped character in the last slot, and one past it */
+    whm_line_protocol_escape(buf, 6, "abc=");
+    WHM_TEST_CHECK(0 == strcmp(buf, "abc\\="));
+    whm_line_protocol_escape(buf, 6, "abcd=");
+    WHM_TEST_CHECK(0 == strcmp(buf, "abcd"));
+    whm_line_protocol_escape(buf, 1, "a");
+    WHM_TEST_CHECK(0 == strcmp(buf, ""));
+}
+
+
+static void test_prefix(void)
+{
+    char buf[WHM_LINE_PROTOCOL_PREFIX_MAX(8)];
+    whm_line_protocol_prefix(buf, sizeof(buf), "");
+    WHM_TEST_CHECK(0 == strcmp(buf, "whm"));
+    whm_line_protocol_prefix(buf, sizeof(buf), "a b");
+    WHM_TEST_CHECK(0 == strcmp(buf, "whm,name=a\\ b"));
+    /* every character escaped still fits */
+    whm_line_protocol_prefix(buf, sizeof(buf), ",,,,,,,,");
+    WHM_TEST_CHECK(0 == strcmp(buf, "whm,name=\\,\\,\\,\\,\\,\\,\\,\\,"));
+}
+
+
+static void test_line(void)
+{
+    char buf[256];
+    static const char expected[] =
+        "whm,name=a\\ b seq=42i,boot=3i,age_ms=1500i,relative_humidity=45.123,temperature=21.050\n";
+    unsigned len = whm_line_protocol_line(buf, sizeof(buf), "whm,name=a\\ b", 42, 3, 1500, 45123, 21050);
+    WHM_TEST_CHECK(sizeof(expected) - 1 == len);
+    WHM_TEST_CHECK(0 == strcmp(buf, expected));
+    /* below zero, and above it by less than a degree */
+    len = whm_line_protocol_line(buf, sizeof(buf), "whm", 1, 0, 0, 0, -1500);
+    WHM_TEST_CHECK(0 == strcmp(buf, "whm seq=1i,boot=0i,age_ms=0i,relative_humidity=0.000,temperature=-1.500\n"));
+    len = whm_line_protocol_line(buf, sizeof(buf), "whm", 1, 0, 0, 100000, -5);
+    WHM_TEST_CHECK(0 == strcmp(buf, "whm seq=1i,boot=0i,age_ms=0i,relative_humidity=100.000,temperature=-0.005\n"));
+    len = whm_line_protocol_line(buf, sizeof(buf), "whm", UINT32_MAX, 65535, UINT64_MAX, 7, 5);
+    WHM_TEST_CHECK(0 == strcmp(buf, "whm seq=4294967295i,boot=65535i,age_ms=18446744073709551615i,"
+                                    "relative_humidity=0.007,temperature=0.005\n"));
+    /* 0 if the newline doesn't fit, a part line is never sent */
+    len = whm_line_protocol_line(buf, sizeof(expected) - 1, "whm,name=a\\ b", 42, 3, 1500, 45123, 21050);
+    WHM_TEST_CHECK(0 == len);
+    len = whm_line_protocol_line(buf, sizeof(expected), "whm,name=a\\ b", 42, 3, 1500, 45123, 21050);
+    WHM_TEST_CHECK(sizeof(expected) - 1 == len);
+}
+
+
+int main(void)
+{
+    test_escape();
+    test_prefix();
+    test_line();
+    return WHM_TEST_RESULT();
+}
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rate_limit.h"
+#include "test.h"
+
+
+/* budgets of GET /api/meas, GET /api/wifi-scan-start and POST /api/config */
+#define MEAS                                0U
+#define SCAN                                1U
+#define CONFIG                              2U
+#define ROUTES                              3U
+#define MS                                  1000ULL
+
+
+static const whm_rate_limit_budget_t budgets[ROUTES] = {{10, 200}, {2, 10000}, {3, 5000}};
+static uint32_t tokens[WHM_RATE_LIMIT_CLIENT_MAX * ROUTES];
+
+
+static const whm_rate_limit_budget_t* budget(unsigned route)
+{
+    return &budgets[route];
+}
+
+
+static void test_burst(void)
+{
+    whm_rate_limit_t limit;
+    whm_rate_limit_init(&limit, ROUTES, budget, tokens);
+    uint64_t now = 1000 * MS;
+    for (unsigned i = 0; i < 10; i++)
+    {
+        WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now));
+    }
+    /* the burst used up, the 11th GET gets a 429 with the wait rounded up */
+    WHM_TEST_CHECK(1 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now));
+    WHM_TEST_CHECK(1 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now + 100 * MS));
+    /* a token every 200 ms */
+    WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now + 200 * MS));
+    WHM_TEST_CHECK(1 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now + 200 * MS));
+    /* the other routes and clients have their own buckets */
+    WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, CONFIG, now + 200 * MS));
+    WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000002, MEAS, now + 200 * MS));
+    /* refilled no further than the burst */
+    now += 3600 * 1000 * MS;
+    for (unsigned i = 0; i < 10; i++)
+    {
+        WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now));
+    }
+    WHM_TEST_CHECK(1 == whm_rate_limit_admit(&limit, 0x0a000001, MEAS, now));
+}
+
+
+static void test_slow_route(void)
+{
+    whm_rate_limit_t limit;
+    whm_rate_limit_init(&limit, ROUTES, budget, tokens);
+    uint64_t now = 5 * MS;
+    WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now));
+    WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now));
+    WHM_TEST_CHECK(10 == whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now));
+    WHM_TEST_CHECK(3 == whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now + 7000 * MS));
+}
+
+
+static void test_eviction(void)
+{
+    whm_rate_limit_t limit;
+    whm_rate_limit_init(&limit, ROUTES, budget, tokens);
+    uint64_t now = 0;
+    for (unsigned i = 0; i < 2; i++)
+    {
+        whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now);
+    }
+    WHM_TEST_CHECK(0 != whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now));
+    /* as many others as there is room for push out the least recent */
+    for (uint32_t addr = 0x0a000002; addr < 0x0a000002 + WHM_RATE_LIMIT_CLIENT_MAX; addr++)
+    {
+        now += MS;
+        WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, addr, MEAS, now));
+    }
+    WHM_TEST_CHECK(0 == whm_rate_limit_admit(&limit, 0x0a000001, SCAN, now));
+}
+
+
+int main(void)
+{
+    test_burst();
+    test_slow_route();
+    test_eviction();
+    return WHM_TEST_RESULT();
+}
@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "series.h"
+#include "test.h"
+
+
+#define LEN(_a)                             (sizeof(_a) / sizeof((_a)[0]))
+/* two weeks of a reading a minute */
+#define SERIES_LEN                          (14U * 24U * 60U)
+#define SERIES_BLOCKS                       512U
+#define ENCODE_RUNS                         20U
+
+
+static whm_series_sample_t series[SERIES_LEN];
+static whm_series_block_t blocks[SERIES_BLOCKS];
+
+
+/* past 2^32 ms of uptime, where a 32 bit time would have wrapped */
+static const whm_series_sample_t vector_in[] =
+{
+    {5000000000ULL, 45123, -1500},
+    {5000060000ULL, 45130, -1502},
+    {5000120000ULL, 45127, -1499},
+    {5000180001ULL, 45127, -1499},
+};
+/* the time delta of 60000, then unchanged but for a millisecond late */
+static const uint8_t vector_data[] = {0xC0, 0xA9, 0x07, 0x0E, 0x03, 0x00, 0x05, 0x06, 0x02, 0x00, 0x00};
+
+
+static uint32_t lcg_state = 1;
+
+
+static uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1664525U + 1013904223U;
+    return lcg_state >> 8;
+}
+
+
+static bool same(const whm_series_sample_t* a, const whm_series_sample_t* b)
+{
+    return a->time_ms == b->time_ms && a->rh_e3 == b->rh_e3 && a->t_e3 == b->t_e3;
+}
+
+
+/* into as many blocks as it takes, their count */
+static unsigned encode(const whm_series_sample_t* in, unsigned len)
+{
+    whm_series_encoder_t encoder;
+    unsigned count = 0;
+    for (unsigned i = 0; i < len; i++)
+    {
+        if (!count || !whm_series_encoder_add(&encoder, &in[i]))
+        {
+            if (count >= SERIES_BLOCKS)
+            {
+                return 0;
+            }
+            whm_series_encoder_init(&encoder, &blocks[count++], i);
+            whm_series_encoder_add(&encoder, &in[i]);
+        }
+    }
+    return count;
+}
+
+
+static bool round_trip(const whm_series_sample_t* in, unsigned len)
+{
+    unsigned count = encode(in, len);
+    unsigned i = 0;
+    for (unsigned b = 0; b < count; b++)
+    {
+        if (blocks[b].first_seq != i)
+        {
+            return false;
+        }
+        whm_series_decoder_t decoder;
+        whm_series_decoder_init(&decoder, &blocks[b]);
+        whm_series_sample_t sample;
+        while (whm_series_decoder_next(&decoder, &sample))
+        {
+            if (i >= len || !same(&sample, &in[i]))
+            {
+                return false;
+            }
+            i++;
+        }
+    }
+    return i == len;
+}
+
+
+/* drifting and noisy, the interval jittering a little */
+static void make_series(uint64_t start_ms)
+{
+    uint64_t time_ms = start_ms;
+    int32_t rh_e3 = 45000;
+    int32_t t_e3 = -1500;
+    for (unsigned i = 0; i < SERIES_LEN; i++)
+    {
+        time_ms += 60000U + lcg() % 5U;
+        rh_e3 += (int32_t)(lcg() % 41U) - 20;
+        t_e3 += (int32_t)(lcg() % 21U) - 10;
+        series[i].time_ms = time_ms;
+        series[i].rh_e3 = rh_e3 < 0 ? 0 : rh_e3;
+        series[i].t_e3 = t_e3;
+    }
+}
+
+
+static void test_vector(void)
+{
+    whm_series_block_t block;
+    whm_series_encoder_t encoder;
+    whm_series_encoder_init(&encoder, &block, 7);
+    for (unsigned i = 0; i < LEN(vector_in); i++)
+    {
+        WHM_TEST_CHECK(whm_series_encoder_add(&encoder, &vector_in[i]));
+    }
+    WHM_TEST_CHECK(7 == block.first_seq);
+    WHM_TEST_CHECK(LEN(vector_in) == block.count);
+    WHM_TEST_CHECK(5000000000ULL == block.base_ms);
+    WHM_TEST_CHECK(45123 == block.first_rh_e3);
+    WHM_TEST_CHECK(-1500 == block.first_t_e3);
+    WHM_TEST_CHECK(sizeof(vector_data) == block.len);
+    WHM_TEST_CHECK(0 == memcmp(block.data, vector_data, sizeof(vector_data)));
+    WHM_TEST_CHECK(round_trip(vector_in, LEN(vector_in)));
+}
+
+
+static void test_extremes(void)
+{
+    static const whm_series_sample_t in[] =
+    {
+        {UINT32_MAX - 1U, 0, INT32_MIN},
+        {UINT32_MAX + 1ULL, UINT32_MAX, INT32_MAX},
+        {UINT64_MAX / 2U, 0, INT32_MIN},
+        {UINT64_MAX / 2U, 1, 0},
+        {UINT64_MAX / 2U + 1U, 1, 0},
+    };
+    WHM_TEST_CHECK(round_trip(in, LEN(in)));
+}
+
+
+static void test_full(void)
+{
+    whm_series_block_t block;
+    whm_series_encoder_t encoder;
+    whm_series_encoder_init(&encoder, &block, 1);
+    /* every value swinging the whole range takes the most bytes */
+    whm_series_sample_t sample = {0, 0, 0};
+    unsigned added = 0;
+    while (whm_series_encoder_add(&encoder, &sample))
+    {
+        added++;
+        sample.time_ms += added & 1U ? UINT32_MAX : 1U;
+        sample.rh_e3 = added & 1U ? UINT32_MAX : 0;
+        sample.t_e3 = added & 1U ? INT32_MAX : INT32_MIN;
+    }
+    WHM_TEST_CHECK(added == block.count);
+    whm_series_block_t before = block;
+    WHM_TEST_CHECK(!whm_series_encoder_add(&encoder, &sample));
+    WHM_TEST_CHECK(0 == memcmp(&before, &block, sizeof(block)));
+    /* followed while still being added to */
+    whm_series_encoder_init(&encoder, &block, 1);
+    whm_series_decoder_t decoder;
+    whm_series_decoder_init(&decoder, &block);
+    WHM_TEST_CHECK(!whm_series_decoder_next(&decoder, &sample));
+    whm_series_encoder_add(&encoder, &vector_in[0]);
+    WHM_TEST_CHECK(whm_series_decoder_next(&decoder, &sample) && same(&sample, &vector_in[0]));
+    WHM_TEST_CHECK(!whm_series_decoder_next(&decoder, &sample));
+    whm_series_encoder_add(&encoder, &vector_in[1]);
+    WHM_TEST_CHECK(whm_series_decoder_next(&decoder, &sample) && same(&sample, &vector_in[1]));
+}
+
+
+/* the figures are printed for comparing changes to the codec, only a
+ * gross regression fails */
+static void test_ratio(void)
+{
+    make_series(UINT32_MAX - 30U * 60000U);
+    WHM_TEST_CHECK(round_trip(series, SERIES_LEN));
+    unsigned count = 0;
+    clock_t start = clock();
+    for (unsigned run = 0; run < ENCODE_RUNS; run++)
+    {
+        count = encode(series, SERIES_LEN);
+    }
+    double ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / ((double)ENCODE_RUNS * SERIES_LEN);
+    unsigned bytes = count * WHM_SERIES_BLOCK_SIZE;
+    double ratio = (double)SERIES_LEN * sizeof(whm_series_sample_t) / bytes;
+    printf("%u samples in %u blocks, %.2f bytes a sample, %.1f times smaller, %.1f ns a sample to encode\n",
+           SERIES_LEN, count, (double)bytes / SERIES_LEN, ratio, ns);
+    WHM_TEST_CHECK(ratio >= 3.0);
+}
+
+
+int main(void)
+{
+    test_vector();
+    test_extremes();
+    test_full();
+    test_ratio();
+    return WHM_TEST_RESULT();
+}
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Stand-in for the collector the uplink posts batches to, standard library only.
+
+    $ tools/fake_collector.py --port 8000
+    $ tools/fake_collector.py --port 8000 --fail-rate 0.3 --delay 2
+
+Point the device's uplink url at it, e.g. http://192.168.4.2:8000/ingest.
+"""
+import argparse
+import json
+import random
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class Collector(BaseHTTPRequestHandler):
+    # keep-alive, as the device reuses its connection
+    protocol_version = "HTTP/1.1"
+    fail_rate = 0.0
+    delay = 0.0
+    last_seq = {}
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        if self.delay:
+            time.sleep(self.delay)
+        if random.random() < self.fail_rate:
+            self.reply(503, b"unavailable\n")
+            print(f"{self.client_address[0]}: failed on purpose")
+            return
+        try:
+            batch = json.loads(body)
+            samples = batch["samples"]
+        except (ValueError, KeyError, TypeError):
+            self.reply(400, b"bad batch\n")
+            return
+        name = batch.get("name", "?")
+        now = time.time()
+        for sample in samples:
+            seq = sample["seq"]
+            # the device numbers its readings afresh each boot
+            key = (name, sample.get("boot"))
+            last = self.last_seq.get(key)
+            if last is not None and seq > last + 1:
+                print(f"{name}: gap of {seq - last - 1} before seq {seq}")
+            self.last_seq[key] = max(seq, last or 0)
+            if "age_ms" in sample:
+                stamp = time.strftime("%H:%M:%S", time.localtime(now - sample["age_ms"] / 1000))
+            else:
+                # from the flash log, taken before the device last rebooted
+                stamp = f"boot {sample.get('boot')}"
+            print(f"{name}: seq {seq} at {stamp} "
+                  f"{sample['relative_humidity']} %RH {sample['temperature']} C")
+        print(f"{name}: batch of {len(samples)}, {batch.get('dropped', 0)} dropped so far")
+        self.reply(204, b"")
+
+    def reply(self, code: int, body: bytes):
+        self.send_response(code)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--fail-rate", type=float, default=0.0, help="fraction of posts answered 503")
+    parser.add_argument("--delay", type=float, default=0.0, help="seconds to wait before answering")
+    args = parser.parse_args()
+    Collector.fail_rate = args.fail_rate
+    Collector.delay = args.delay
+    server = ThreadingHTTPServer(("", args.port), Collector)
+    print(f"collecting on port {args.port}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
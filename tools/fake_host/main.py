@@ -1,6 +1,9 @@
+import asyncio
 import time
 from typing import Annotated, List
+import json
 from fastapi import FastAPI, Request, Response, status
+from fastapi.responses import StreamingResponse
 from fastapi.staticfiles import StaticFiles
 from pydantic import BaseModel
 from contextlib import asynccontextmanager
@@ -19,6 +22,16 @@ class Status(BaseModel):
 class Config(BaseModel):
     name: str
     blinking_ms: int
+    history_ms: int = 60000
+    sensor_profile: str = "fast"
+    filters: dict = {
+        "relative_humidity": {"type": "none", "length": 4, "shift": 2},
+        "temperature": {"type": "none", "length": 4, "shift": 2},
+    }
+    rules: list[dict] = []
+    uplink: dict = {"url": "", "batch": 8, "interval_s": 30}
+    mqtt: dict = {"host": "", "port": 1883, "meas_topic": "whm/meas", "status_topic": "whm/status"}
+    telemetry: dict = {"host": "", "port": 8089, "batch": 1}
     station_ssid: str | None
     station_password: str | None
 
@@ -27,6 +40,7 @@ class Measurements(BaseModel):
     name: str
     value: str
     unit: str
+    age_ms: int
 
 
 class WifiScanStart(BaseModel):
@@ -93,14 +107,104 @@ async def get_meas() -> List[Measurements]:
             "name": "relative_humidity",
             "value": "48.29",
             "unit": "%",
+            "age_ms": 120,
         },
         {
             "name": "temperature",
             "value": "18.78",
             "unit": "C",
+            "age_ms": 120,
         },
     ]
 
+@app.get("/api/meas/history")
+async def get_meas_history(since: int = 0, limit: int = 512):
+    # a sample a minute for the last hour, numbered like the device's
+    last = 60
+    first = max(since + 1, 1)
+    count = max(0, min(last - first + 1, limit))
+    return {
+        "last": last,
+        "more": first + count <= last,
+        "samples": [
+            {
+                "seq": seq,
+                "age_ms": (last - seq) * 60000,
+                "relative_humidity": 48.29,
+                "temperature": 18.78,
+            }
+            for seq in range(first, first + count)
+        ],
+    }
+
+@app.get("/api/meas/aggregates")
+async def get_meas_aggregates():
+    uptime_s = time.monotonic()
+    return [
+        {
+            "window_s": window_s,
+            "count": int(min(uptime_s, window_s)),
+            "relative_humidity": {"min": 47.91, "max": 48.62, "mean": 48.29},
+            "temperature": {"min": 18.52, "max": 18.97, "mean": 18.78},
+        }
+        for window_s in (60, 15 * 60, 60 * 60, 24 * 60 * 60)
+    ]
+
+@app.get("/api/dashboard")
+async def get_dashboard(request: Request):
+    # like the device, sections are bare query parameters, none means all
+    sections = [s for s in ("config", "status", "meas") if s in request.query_params]
+    if not sections:
+        sections = ["config", "status", "meas"]
+    dashboard = {}
+    if "config" in sections:
+        dashboard["config"] = request.state.var["static_config"]
+    if "status" in sections:
+        dashboard["status"] = request.state.var["status"]
+    if "meas" in sections:
+        dashboard["meas"] = await get_meas()
+    return dashboard
+
+@app.get("/api/http-stats")
+async def get_http_stats():
+    return {"requests": 0, "reused": 0, "reclaimed": 0, "idle": 0, "rejected": 0}
+
+@app.get("/api/metrics")
+async def get_metrics(format: str = ""):
+    uptime_ms = int(time.monotonic() * 1000)
+    if format == "json":
+        return {
+            "routes": [],
+            "http": {"requests": 0, "reused": 0, "reclaimed": 0, "idle": 0, "rejected": 0},
+            "uptime_ms": uptime_ms,
+            "heap": {"used": 0, "size": 0},
+            "lwip": {},
+            "sensor": {"profile": "fast", "conversion_us": 2600, "margin_us": 1000, "not_ready": 0, "coalesced": 0, "cached": 0},
+        }
+    return Response(
+        f"# TYPE whm_uptime_seconds gauge\nwhm_uptime_seconds {uptime_ms / 1000:.6f}\n",
+        media_type="text/plain; version=0.0.4",
+    )
+
+@app.get("/api/stream")
+async def get_stream(request: Request):
+    async def events():
+        yield "retry: 2000\n\n"
+        last_status = None
+        while not await request.is_disconnected():
+            current = request.state.var["status"].model_dump_json()
+            if current != last_status:
+                yield f"event: status\ndata: {current}\n\n"
+                last_status = current
+            meas = json.dumps(await get_meas(), ensure_ascii=False)
+            yield f"event: meas\ndata: {meas}\n\n"
+            await asyncio.sleep(1.)
+    return StreamingResponse(
+        events(),
+        media_type="text/event-stream",
+        headers={"Cache-Control": "no-cache"},
+    )
+
 @app.get("/api/wifi-scan-start")
 async def get_wifi_scan_start(
     request: Request,
@@ -129,12 +233,10 @@ async def get_wifi_scan_get(
             "status": "fail",
             "scan": "not started",
         }
-    if time.monotonic() < WIFI_SCAN_TIME + request.state.var["wifi-scan"]["started"]:
-        response.status_code = status.HTTP_425_TOO_EARLY
-        return {
-            "status": "fail",
-            "scan": "not ready",
-        }
+    remaining = WIFI_SCAN_TIME + request.state.var["wifi-scan"]["started"] - time.monotonic()
+    if remaining > 0:
+        # like the device, hold the response until the scan is done
+        await asyncio.sleep(remaining)
     request.state.var["wifi-scan"]["started"] = None
     return {
         "status": "ok",
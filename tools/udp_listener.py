@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Receives the device's UDP telemetry, standard library only.
+
+    $ tools/udp_listener.py --port 8089
+
+Prints each line of InfluxDB line protocol as it comes and, from the seq
+field, any readings lost on the way.
+"""
+import argparse
+import re
+import socket
+
+# the tag value ends at the first unescaped space
+LINE = re.compile(r"^(?P<series>(?:[^ \\]|\\.)*) (?P<fields>\S+)")
+
+
+def parse_fields(fields: str) -> dict:
+    values = {}
+    for field in fields.split(","):
+        key, _, value = field.partition("=")
+        values[key] = int(value[:-1]) if value.endswith("i") else float(value)
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8089)
+    args = parser.parse_args()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", args.port))
+    print(f"listening on udp port {args.port}")
+    last_seq = {}
+    received = {}
+    lost = {}
+    try:
+        while True:
+            data, addr = sock.recvfrom(2048)
+            for line in data.decode(errors="replace").splitlines():
+                print(f"{addr[0]}: {line}")
+                match = LINE.match(line)
+                if not match:
+                    print(f"{addr[0]}: not line protocol")
+                    continue
+                try:
+                    fields = parse_fields(match["fields"])
+                    seq = fields["seq"]
+                except (ValueError, KeyError):
+                    print(f"{addr[0]}: no seq")
+                    continue
+                # the device counts afresh each boot
+                key = (match["series"], fields.get("boot"))
+                last = last_seq.get(key)
+                if last is not None and seq > last + 1:
+                    lost[key] = lost.get(key, 0) + seq - last - 1
+                    print(f"{key[0]}: gap of {seq - last - 1} before seq {seq}")
+                last_seq[key] = max(seq, last or 0)
+                received[key] = received.get(key, 0) + 1
+    except KeyboardInterrupt:
+        pass
+    for key, count in received.items():
+        print(f"{key[0]} boot {key[1]}: {count} received, {lost.get(key, 0)} lost")
+
+
+if __name__ == "__main__":
+    main()
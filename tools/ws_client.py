@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Test client for the device's websocket endpoint, standard library only.
+
+    $ tools/ws_client.py 192.168.4.1 --sub meas status
+    $ tools/ws_client.py 192.168.4.1 --ping 100
+    $ tools/ws_client.py 192.168.4.1 --scan
+    $ tools/ws_client.py 192.168.4.1 --config config.json
+"""
+import argparse
+import base64
+import hashlib
+import os
+import socket
+import statistics
+import struct
+import sys
+import time
+
+
+GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OPCODE_TEXT = 0x1
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+
+
+class WebSocket:
+    def __init__(self, host: str, port: int, path: str, timeout: float):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b""
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(
+            f"GET {path} HTTP/1.1\r\n"
+            f"Host: {host}:{port}\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            f"Sec-WebSocket-Key: {key}\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "\r\n".encode()
+        )
+        while b"\r\n\r\n" not in self.buf:
+            self._fill()
+        head, self.buf = self.buf.split(b"\r\n\r\n", 1)
+        lines = head.decode().split("\r\n")
+        if " 101 " not in lines[0]:
+            raise ConnectionError(f"upgrade refused: {lines[0]}")
+        headers = {k.strip().lower(): v.strip() for k, v in (l.split(":", 1) for l in lines[1:])}
+        expected = base64.b64encode(hashlib.sha1((key + GUID).encode()).digest()).decode()
+        if headers.get("sec-websocket-accept") != expected:
+            raise ConnectionError("bad Sec-WebSocket-Accept")
+
+    def _fill(self):
+        data = self.sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed")
+        self.buf += data
+
+    def _take(self, n: int) -> bytes:
+        while len(self.buf) < n:
+            self._fill()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def send(self, opcode: int, payload: bytes = b""):
+        # client frames must be masked
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack("!H", len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def send_text(self, text: str):
+        self.send(OPCODE_TEXT, text.encode())
+
+    def recv(self) -> tuple[int, bytes]:
+        b0, b1 = self._take(2)
+        length = b1 & 0x7F
+        if length == 126:
+            length, = struct.unpack("!H", self._take(2))
+        elif length == 127:
+            length, = struct.unpack("!Q", self._take(8))
+        return b0 & 0x0F, self._take(length)
+
+    def recv_text(self) -> str:
+        while True:
+            opcode, payload = self.recv()
+            if opcode == OPCODE_TEXT:
+                return payload.decode()
+            if opcode == OPCODE_PING:
+                # the device drops a client that doesn't answer
+                self.send(OPCODE_PONG, payload)
+            if opcode == OPCODE_CLOSE:
+                raise ConnectionError("closed by device")
+
+    def close(self):
+        try:
+            self.send(OPCODE_CLOSE, struct.pack("!H", 1000))
+        finally:
+            self.sock.close()
+
+
+def ping(ws: WebSocket, count: int):
+    rtts = []
+    for i in range(count):
+        payload = struct.pack("!I", i)
+        start = time.perf_counter()
+        ws.send(OPCODE_PING, payload)
+        while True:
+            opcode, data = ws.recv()
+            if opcode == OPCODE_PONG and data == payload:
+                break
+        rtts.append((time.perf_counter() - start) * 1000.)
+    print(f"{count} pings: min {min(rtts):.1f} ms, "
+          f"median {statistics.median(rtts):.1f} ms, max {max(rtts):.1f} ms")
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--path", default="/ws")
+    parser.add_argument("--timeout", type=float, default=10.)
+    parser.add_argument("--sub", nargs="+", choices=["meas", "status"], default=[])
+    parser.add_argument("--ping", type=int, metavar="COUNT", help="time COUNT ping round trips")
+    parser.add_argument("--scan", action="store_true", help="scan for wifi and print the result")
+    parser.add_argument("--config", type=argparse.FileType("r"), help="apply a JSON config file")
+    args = parser.parse_args()
+
+    ws = WebSocket(args.host, args.port, args.path, args.timeout)
+    try:
+        if args.ping:
+            ping(ws, args.ping)
+        if args.scan:
+            ws.send_text("scan")
+            print(ws.recv_text())
+        if args.config:
+            ws.send_text("config " + args.config.read().strip())
+            print(ws.recv_text())
+        if args.sub:
+            ws.sock.settimeout(None)
+            for topic in args.sub:
+                ws.send_text(f"sub {topic}")
+            while True:
+                print(ws.recv_text(), flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        ws.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -26,6 +26,9 @@ const unitNames = {
 
 
 let lastStations = []
+let stream = null
+// fields not edited here, only sent back as they were
+let keptConfig = {}
 
 
 function setStatus(msg) {
@@ -39,39 +42,66 @@ blinkingNumber.addEventListener('input', () => {
     blinkingSlider.value = blinkingNumber.value
 })
 
-async function loadConfig() {
+function applyConfig(data) {
+    nameInput.value = data?.name?.trim() || 'Web-Host-MCU'
+    keptConfig = {
+        history_ms: Number.isFinite(data?.history_ms) ? data.history_ms : undefined,
+        sensor_profile: typeof data?.sensor_profile === 'string' ? data.sensor_profile : undefined,
+        filters: data?.filters && typeof data.filters === 'object' ? data.filters : undefined,
+        rules: Array.isArray(data?.rules) ? data.rules : undefined,
+        uplink: data?.uplink && typeof data.uplink === 'object' ? data.uplink : undefined,
+        mqtt: data?.mqtt && typeof data.mqtt === 'object' ? data.mqtt : undefined,
+        telemetry: data?.telemetry && typeof data.telemetry === 'object' ? data.telemetry : undefined
+    }
+    const blinking = Number.isFinite(data?.blinking_ms) ? data.blinking_ms : 250
+    blinkingSlider.value = blinking
+    blinkingNumber.value = blinking
+
+    ssidInput.value = data?.wifi_ssid?.trim() || ''
+    passwordInput.value = data?.wifi_pass?.trim() || ''
+}
+
+function applyDefaultConfig() {
+    nameInput.value = 'Web-Host-MCU'
+    blinkingSlider.value = 250
+    blinkingNumber.value = 250
+    ssidInput.value = ''
+    passwordInput.value = ''
+}
+
+// config, status and measurements come back in one response, the
+// sections wanted are picked with bare query parameters
+async function loadDashboard(sections = []) {
     setStatus('Loading configuration...')
     saveBtn.disabled = true
     try {
-        const response = await fetch('/api/config')
+        const query = sections.length ? '?' + sections.join('&') : ''
+        const response = await fetch(`/api/dashboard${query}`)
         if (!response.ok) throw new Error(`HTTP error: ${response.status}`)
         const data = await response.json()
 
-        nameInput.value = data?.name?.trim() || 'Web-Host-MCU'
-        const blinking = Number.isFinite(data?.blinking_ms) ? data.blinking_ms : 250
-        blinkingSlider.value = blinking
-        blinkingNumber.value = blinking
-
-        ssidInput.value = data?.wifi_ssid?.trim() || ''
-        passwordInput.value = data?.wifi_pass?.trim() || ''
+        if ('status' in data) renderStatus(data.status)
+        if (data.meas) renderMeasurements(data.meas)
+        applyConfig(data.config)
 
         saveBtn.disabled = false
         setStatus('Configuration loaded.')
     } catch (err) {
-        nameInput.value = 'Web-Host-MCU'
-        blinkingSlider.value = 250
-        blinkingNumber.value = 250
-        ssidInput.value = ''
-        passwordInput.value = ''
+        applyDefaultConfig()
         saveBtn.disabled = false
         setStatus('Failed to load configuration, using defaults.')
     }
 }
 
+function loadConfig() {
+    return loadDashboard(['config'])
+}
+
 async function saveConfig() {
     const config = {
         name: nameInput.value.trim() || 'Web-Host-MCU',
         blinking_ms: parseInt(blinkingSlider.value, 10) || 250,
+        ...keptConfig,
         ap: {
             ssid: 'Web-Host MCU',
             password: 'host52%files'
@@ -100,28 +130,24 @@ async function saveConfig() {
     }
 }
 
-async function loadStatus() {
-    try {
-        const res = await fetch('/api/status')
-        if (!res.ok) throw new Error(`HTTP error: ${res.status}`)
-        const data = await res.json()
-
-        if (data?.network?.connected) {
-            connectionStatus.style.backgroundColor = 'green'
-            connectionStatus.title = 'Wi-Fi connected'
-            setStatus('Network connected.')
-        } else {
-            connectionStatus.style.backgroundColor = 'orange'
-            connectionStatus.title = 'Wi-Fi disconnected'
-            //setStatus('Network not connected. Configure Wi-Fi.')
-        }
-    } catch (err) {
-        connectionStatus.style.backgroundColor = 'red'
-        connectionStatus.title = 'Device disconnected'
-        setStatus('Failed to fetch network status.')
+function renderStatus(data) {
+    if (data?.network?.connected) {
+        connectionStatus.style.backgroundColor = 'green'
+        connectionStatus.title = 'Wi-Fi connected'
+        setStatus('Network connected.')
+    } else {
+        connectionStatus.style.backgroundColor = 'orange'
+        connectionStatus.title = 'Wi-Fi disconnected'
+        //setStatus('Network not connected. Configure Wi-Fi.')
     }
 }
 
+function renderDeviceDisconnected() {
+    connectionStatus.style.backgroundColor = 'red'
+    connectionStatus.title = 'Device disconnected'
+}
+
+
 function renderMeasurements(list) {
     if (!Array.isArray(list) || list.length === 0) {
         measurementsContainer.textContent = 'No measurements available.'
@@ -162,14 +188,24 @@ function renderMeasurements(list) {
 }
 
 
-async function fetchMeasurements() {
-    try {
-        const res = await fetch('/api/meas')
-        if (!res.ok) throw new Error(`HTTP error: ${res.status}`)
-        const data = await res.json()
-        renderMeasurements(data)
-    } catch (err) {
-        measurementsContainer.textContent = 'Failed to load measurements.'
+// one long lived connection, the device pushes measurements and
+// network state as they change
+function openStream() {
+    stream = new EventSource('/api/stream')
+    stream.addEventListener('meas', (e) => {
+        renderMeasurements(JSON.parse(e.data))
+    })
+    stream.addEventListener('status', (e) => {
+        renderStatus(JSON.parse(e.data))
+    })
+    stream.onerror = () => {
+        renderDeviceDisconnected()
+        if (stream.readyState === EventSource.CLOSED) {
+            // refused rather than dropped, e.g. too many streams open,
+            // the browser won't retry this itself
+            measurementsContainer.textContent = 'Failed to load measurements.'
+            setTimeout(openStream, 5000)
+        }
     }
 }
 
@@ -270,9 +306,8 @@ scanWifiBtn.addEventListener('click', async () => {
         const startData = await startRes.json()
         if (startData.status !== 'ok') throw new Error('Scan start failed')
 
-        setStatus('Scanning... Please wait 3 seconds...')
-        await new Promise(r => setTimeout(r, 3000))
-
+        // the device holds this response until the scan has finished
+        setStatus('Scanning...')
         const getRes = await fetch('/api/wifi-scan-get')
         if (!getRes.ok) {
             if (getRes.status === 409) setStatus('Scan not started.')
@@ -312,10 +347,6 @@ ssidInput.addEventListener('input', () => {
     passwordInput.classList.remove('disabled-input')
 })
 
-loadStatus().then(() => {
-    loadConfig()
+loadDashboard().then(() => {
+    openStream()
 })
-
-fetchMeasurements()
-setInterval(fetchMeasurements, 1000)
-setInterval(loadStatus, 1200)